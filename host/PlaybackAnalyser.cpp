@@ -0,0 +1,183 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PlaybackAnalyser.h"
+#include "TestSignal.h"
+#include <algorithm>
+#include <cmath>
+
+static const char FromAnalyser[] = "analyser";
+
+CPlaybackAnalyser::CPlaybackAnalyser(float fFrequency, unsigned nFrameRate, u8 nChannels) :
+        k_nChannels{nChannels},
+        k_nFrameRate{nFrameRate},
+        k_fCoeff{static_cast<float>(2 * cos(2 * M_PI * fFrequency / nFrameRate))},
+        // Let the envelope halve in half a second.
+        k_fDecay{static_cast<float>(pow(.5, 2. / nFrameRate))},
+        k_nSettle{nFrameRate / 10},
+        k_nQuiet{nFrameRate / 50},
+        k_nHoldOff{4},
+        k_nClickHoldOff{nFrameRate / 100}
+{
+    pthread_mutex_init(&m_Mutex, nullptr);
+}
+
+CPlaybackAnalyser::~CPlaybackAnalyser(void)
+{
+    pthread_mutex_destroy(&m_Mutex);
+}
+
+void CPlaybackAnalyser::OnChunk(const u32 *pBuffer, unsigned nWords, int nRangeMin, int nRangeMax,
+                                u64 nPlayTime, double fFramePeriod)
+{
+    const float centre{(static_cast<float>(nRangeMin) + static_cast<float>(nRangeMax)) / 2.f};
+    const float scale{2.f / (static_cast<float>(nRangeMax) - static_cast<float>(nRangeMin))};
+    const bool isSigned{nRangeMin < 0};
+
+    auto normalise = [=](u32 word) {
+        float value{isSigned ? static_cast<float>(static_cast<s32>(word)) : static_cast<float>(word)};
+        return (value - centre) * scale;
+    };
+
+    pthread_mutex_lock(&m_Mutex);
+
+    for (unsigned n{0}; n < nWords / k_nChannels; ++n) {
+        const u32 *pFrame{pBuffer + n * k_nChannels};
+        u64 nTime{nPlayTime + static_cast<u64>(n * fFramePeriod)};
+
+        if (k_nChannels > 1) {
+            AnalyseTone(normalise(pFrame[0]), nTime);
+            AnalyseClick(normalise(pFrame[1]), nTime);
+        } else {
+            AnalyseClick(normalise(pFrame[0]), nTime);
+        }
+
+        ++m_nFrame;
+    }
+
+    pthread_mutex_unlock(&m_Mutex);
+}
+
+void CPlaybackAnalyser::AnalyseTone(float x, u64 nTime)
+{
+    float level{fabsf(x)};
+    m_fLevel = level > m_fLevel ? level : m_fLevel * k_fDecay;
+
+    if (level < k_fSilence) {
+        if (++m_nQuietFrames >= k_nQuiet && m_bArmed) {
+            // The stream stopped; anything just before that was the stopping.
+            m_bArmed = false;
+            ConfirmGlitches(true);
+        }
+    } else {
+        if (m_nQuietFrames >= k_nQuiet || m_nFrame == m_nQuietFrames) {
+            m_Onsets.push_back(nTime);
+        }
+        m_nQuietFrames = 0;
+    }
+
+    if (!m_bArmed) {
+        m_nLoudFrames = m_fLevel > k_fMinLevel && m_nQuietFrames < k_nQuiet ? m_nLoudFrames + 1 : 0;
+        if (m_nLoudFrames >= k_nSettle) {
+            m_bArmed = true;
+            m_nLoudFrames = 0;
+        }
+    } else {
+        ++m_nArmedFrames;
+
+        float error{x - k_fCoeff * m_fX1 + m_fX2};
+        if (fabsf(error) > k_fGlitch * m_fLevel && m_nFrame - m_nLastGlitch > k_nHoldOff) {
+            if (m_nPending == k_nMaxPending) {
+                ++m_nGlitches;
+                --m_nPending;
+                std::copy(m_Pending + 1, m_Pending + k_nMaxPending, m_Pending);
+            }
+            m_Pending[m_nPending++] = m_nFrame;
+            m_nLastGlitch = m_nFrame;
+        }
+
+        ConfirmGlitches(false);
+    }
+
+    m_fX2 = m_fX1;
+    m_fX1 = x;
+}
+
+void CPlaybackAnalyser::AnalyseClick(float x, u64 nTime)
+{
+    if (fabsf(x) < k_fClick || (m_nLastClick != 0 && m_nFrame - m_nLastClick < k_nClickHoldOff)) {
+        return;
+    }
+    m_nLastClick = m_nFrame;
+
+    // The click went out as the hub's clock passed a multiple of the period.
+    m_Latencies.push_back(static_cast<float>(nTime % TEST_CLICK_PERIOD_NS) * 1e-6f);
+}
+
+void CPlaybackAnalyser::ConfirmGlitches(bool bDiscard)
+{
+    if (bDiscard) {
+        m_nPending = 0;
+        return;
+    }
+
+    unsigned n{0};
+    while (n < m_nPending && m_Pending[n] + 2 * k_nQuiet < m_nFrame) {
+        ++n;
+    }
+    if (n > 0) {
+        m_nGlitches += n;
+        m_nPending -= n;
+        std::copy(m_Pending + n, m_Pending + n + m_nPending, m_Pending);
+    }
+}
+
+void CPlaybackAnalyser::Report(CLogger *pLogger)
+{
+    pthread_mutex_lock(&m_Mutex);
+    std::vector<float> latencies{m_Latencies};
+    u64 nArmedFrames{m_nArmedFrames};
+    // Count the ones still awaiting confirmation, unless the output is
+    // already falling silent.
+    unsigned nGlitches{m_nGlitches + (m_nQuietFrames == 0 ? m_nPending : 0)};
+    std::vector<u64> onsets{m_Onsets};
+    pthread_mutex_unlock(&m_Mutex);
+
+    if (k_nChannels > 1) {
+        float fSeconds{static_cast<float>(nArmedFrames) / k_nFrameRate};
+        pLogger->Write(FromAnalyser, LogNotice, "tone: %.1f s analysed, %u glitches (%.2f per minute)",
+                       fSeconds, nGlitches, fSeconds > 0.f ? nGlitches * 60.f / fSeconds : 0.f);
+        for (u64 nOnset : onsets) {
+            pLogger->Write(FromAnalyser, LogNotice, "tone: started at %.3f ms", nOnset * 1e-6);
+        }
+    }
+
+    if (latencies.empty()) {
+        pLogger->Write(FromAnalyser, LogNotice, "clicks: none heard; no latency measurement");
+        return;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](float p) {
+        return latencies[static_cast<size_t>(p * static_cast<float>(latencies.size() - 1) + .5f)];
+    };
+    pLogger->Write(FromAnalyser, LogNotice, "clicks: %u heard; end-to-end latency %.2f/%.2f/%.2f/%.2f/%.2f ms "
+                                            "(min/p50/p95/p99/max)",
+                   static_cast<unsigned>(latencies.size()), latencies.front(), percentile(.5f),
+                   percentile(.95f), percentile(.99f), latencies.back());
+}
@@ -0,0 +1,108 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_PLAYBACKANALYSER_H
+#define JACKTRIP_HOST_PLAYBACKANALYSER_H
+
+#include <circle/sound/soundbasedevice.h>
+#include <circle/logger.h>
+#include <pthread.h>
+#include <vector>
+
+/**
+ * Watches the simulated sound device's output for the stand-in hub's test
+ * signal (see TestSignal.h), counting glitches in the tone and timing the
+ * clicks.
+ *
+ * A glitch is a sample that the tone's own recurrence, x[n] = 2 cos(w) x[n-1]
+ * - x[n-2], fails to predict: a dropped, repeated or stale frame, or a jump.
+ * Repeats and drops right at the tone's peaks are too small to see, and
+ * barely audible. Analysis starts once the tone has played for a moment, and
+ * stops when the output falls silent, e.g. on disconnection; glitches in the
+ * run-up to silence are put down to the stream stopping.
+ *
+ * It also notes when the tone starts, or starts again after silence, e.g.
+ * when the client reconnects.
+ */
+class CPlaybackAnalyser : public CSoundMonitor
+{
+public:
+    /**
+     * @param fFrequency Of the tone, in Hz.
+     * @param nFrameRate The sound device's nominal rate.
+     * @param nChannels Frames are sample-interleaved. Tone on the first
+     * channel and clicks on the second; clicks only in mono.
+     */
+    CPlaybackAnalyser(float fFrequency, unsigned nFrameRate, u8 nChannels);
+
+    ~CPlaybackAnalyser(void) override;
+
+    void OnChunk(const u32 *pBuffer, unsigned nWords, int nRangeMin, int nRangeMax,
+                 u64 nPlayTime, double fFramePeriod) override;
+
+    /**
+     * Log the results so far.
+     * @param pLogger
+     */
+    void Report(CLogger *pLogger);
+
+private:
+    void AnalyseTone(float x, u64 nTime);
+
+    void AnalyseClick(float x, u64 nTime);
+
+    void ConfirmGlitches(bool bDiscard);
+
+    // Envelope and thresholds, relative to full scale or to the envelope.
+    static constexpr float k_fMinLevel{.01f};
+    static constexpr float k_fSilence{.001f};
+    static constexpr float k_fGlitch{.02f};
+    static constexpr float k_fClick{.1f};
+    static constexpr unsigned k_nMaxPending{64};
+
+    const u8 k_nChannels;
+    const unsigned k_nFrameRate;
+    const float k_fCoeff;
+    const float k_fDecay;
+    // In frames.
+    const unsigned k_nSettle, k_nQuiet, k_nHoldOff, k_nClickHoldOff;
+
+    pthread_mutex_t m_Mutex;
+
+    u64 m_nFrame{0};
+    float m_fX1{0.f}, m_fX2{0.f};
+    float m_fLevel{0.f};
+    bool m_bArmed{false};
+    unsigned m_nLoudFrames{0};
+    unsigned m_nQuietFrames{0};
+    u64 m_nLastGlitch{0};
+    u64 m_nArmedFrames{0};
+
+    // Glitches are confirmed once the output has carried on past them.
+    u64 m_Pending[k_nMaxPending];
+    unsigned m_nPending{0};
+    unsigned m_nGlitches{0};
+
+    u64 m_nLastClick{0};
+    std::vector<float> m_Latencies;
+
+    // When the tone started, in nanoseconds on the monotonic clock.
+    std::vector<u64> m_Onsets;
+};
+
+#endif //JACKTRIP_HOST_PLAYBACKANALYSER_H
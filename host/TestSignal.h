@@ -0,0 +1,125 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_TESTSIGNAL_H
+#define JACKTRIP_HOST_TESTSIGNAL_H
+
+#include <circle/types.h>
+#include <cmath>
+#include <string.h>
+
+// Period of the clicks, in nanoseconds. Latency is measured modulo this, so it
+// must be comfortably longer than any latency worth measuring.
+#define TEST_CLICK_PERIOD_NS 100000000ull
+// Peak level of the test signals, full scale being 1.
+#define TEST_LEVEL           .5f
+
+/**
+ * The stand-in hub's test signals (see hub.cpp), shared with the analysis of
+ * the client's output (see CPlaybackAnalyser).
+ *
+ * The tone, on the first channel, is for spotting glitches. The clicks, on the
+ * second, are for measuring latency: a single-frame impulse marks the frame
+ * captured as the sender's CLOCK_MONOTONIC passes a multiple of
+ * TEST_CLICK_PERIOD_NS. Hub and client run on the same machine, so the time at
+ * which the client plays the click, modulo the period, is the end-to-end
+ * latency.
+ */
+class CTestSignal
+{
+public:
+    enum TType
+    {
+        Silence,
+        Tone,
+        Clicks,
+        // Tone on the first channel, clicks on the second (or clicks alone,
+        // in mono).
+        ToneAndClicks
+    };
+
+    /**
+     * @param type
+     * @param fFrequency Of the tone, in Hz.
+     * @param nSampleRate
+     * @param nChannels
+     */
+    CTestSignal(TType type, float fFrequency, unsigned nSampleRate, u8 nChannels) :
+            k_Type{type},
+            k_fStep{static_cast<double>(2 * M_PI * fFrequency / nSampleRate)},
+            k_nChannels{nChannels}
+    {
+    }
+
+    /**
+     * Generate the next frame.
+     * @param pFrame nChannels samples in [-1, 1).
+     * @param nCaptureTime When the frame was "captured", in nanoseconds on
+     * CLOCK_MONOTONIC.
+     */
+    void Generate(float *pFrame, u64 nCaptureTime)
+    {
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            pFrame[ch] = 0.f;
+        }
+
+        bool tone{k_Type == Tone || (k_Type == ToneAndClicks && k_nChannels > 1)};
+        if (tone) {
+            pFrame[0] = TEST_LEVEL * static_cast<float>(sin(m_fPhase));
+            m_fPhase += k_fStep;
+            if (m_fPhase > M_PI) {
+                m_fPhase -= 2 * M_PI;
+            }
+        }
+
+        u64 nPeriod{nCaptureTime / TEST_CLICK_PERIOD_NS};
+        if ((k_Type == Clicks || k_Type == ToneAndClicks) && nPeriod != m_nLastPeriod && m_nLastPeriod != 0) {
+            pFrame[tone ? 1 : 0] = TEST_LEVEL;
+        }
+        m_nLastPeriod = nPeriod;
+    }
+
+    TType GetType() const { return k_Type; }
+
+    /**
+     * @param pName "silence", "tone", "clicks" or "test".
+     * @param pType Set if the name is recognised.
+     * @return Whether it was.
+     */
+    static bool Parse(const char *pName, TType *pType)
+    {
+        static const char *const names[]{"silence", "tone", "clicks", "test"};
+        for (unsigned i{0}; i < sizeof names / sizeof names[0]; ++i) {
+            if (strcmp(pName, names[i]) == 0) {
+                *pType = static_cast<TType>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const TType k_Type;
+    const double k_fStep;
+    const u8 k_nChannels;
+
+    double m_fPhase{0.};
+    u64 m_nLastPeriod{0};
+};
+
+#endif //JACKTRIP_HOST_TESTSIGNAL_H
@@ -0,0 +1,702 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Microbenchmarks of the client's signal processing, for the costs that the
+// load tests can't isolate. Each is timed on CLOCK_MONOTONIC over many runs
+// and reported against the block period it has to fit in.
+
+#include <circle/types.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "BlockRing.h"
+#include "fifo.h"
+#include "LossConcealer.h"
+#include "Mixer.h"
+#include "PacketHeader.h"
+#include "Resampler.h"
+#include "StreamFormat.h"
+
+static const double k_fBlockPeriodNs{1e9 * AUDIO_BLOCK_FRAMES / SAMPLE_RATE};
+static const unsigned k_nPacketSize{PACKET_HEADER_SIZE + WRITE_CHANNELS * CHANNEL_QUEUE_SIZE};
+
+/**
+ * Accumulates timings of one thing.
+ */
+class CTiming
+{
+public:
+    /**
+     * @param pName
+     * @param fBlockPeriodNs To report against, if not the configured one's.
+     */
+    explicit CTiming(const char *pName, double fBlockPeriodNs = k_fBlockPeriodNs) :
+            m_pName{pName},
+            k_fPeriodNs{fBlockPeriodNs}
+    {
+    }
+
+    void Start() { m_nStart = Now(); }
+
+    void Stop()
+    {
+        u64 nElapsed{Now() - m_nStart};
+        m_nSum += nElapsed;
+        m_nMax = nElapsed > m_nMax ? nElapsed : m_nMax;
+        ++m_nCount;
+    }
+
+    double GetMean() const { return m_nCount > 0 ? static_cast<double>(m_nSum) / m_nCount : 0.; }
+
+    void Report() const
+    {
+        double fMean{GetMean()};
+        printf("%-36s %8u runs, mean %9.0f ns (%5.2f%% of a block), max %9llu ns\n",
+               m_pName, m_nCount, fMean, 100. * fMean / k_fPeriodNs, (unsigned long long) m_nMax);
+    }
+
+private:
+    static u64 Now()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<u64>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+    }
+
+    const char *m_pName;
+    const double k_fPeriodNs;
+    u64 m_nStart{0};
+    u64 m_nSum{0}, m_nMax{0};
+    unsigned m_nCount{0};
+};
+
+/**
+ * A block of something voice-like: a 150 Hz buzz with a few harmonics, and a
+ * little noise.
+ */
+template<typename T = TYPE>
+static void MakeBlock(T *const *ppBlock, unsigned &nFrame, u8 nChannels = WRITE_CHANNELS)
+{
+    const float fScale{.25f / TSampleTraits<T>::k_fScale};
+    for (u16 n{0}; n < AUDIO_BLOCK_FRAMES; ++n, ++nFrame) {
+        float phase{2.f * static_cast<float>(M_PI) * 150.f * nFrame / SAMPLE_RATE};
+        float x{0.f};
+        for (int h{1}; h <= 5; ++h) {
+            x += sinf(h * phase) / h;
+        }
+        x = .5f * x + .05f * (static_cast<float>(rand()) / RAND_MAX - .5f);
+        for (u8 ch{0}; ch < nChannels; ++ch) {
+            ppBlock[ch][n] = TSampleTraits<T>::FromCentred(static_cast<int>(x * fScale));
+        }
+    }
+}
+
+template<typename T>
+static const char *s_pTypeName;
+template<>
+const char *s_pTypeName<u8>{"u8"};
+template<>
+const char *s_pTypeName<s16>{"s16"};
+template<>
+const char *s_pTypeName<s32>{"s24"};
+template<>
+const char *s_pTypeName<u32>{"u32"};
+
+/**
+ * Loss concealment: a loss of nBurst blocks every so often. The first block
+ * concealed includes the pitch search; recovery is the crossfade back.
+ */
+static void BenchConcealment(unsigned nRuns, unsigned nBurst)
+{
+    CLossConcealer concealer{WRITE_CHANNELS, AUDIO_BLOCK_FRAMES, SAMPLE_RATE};
+    CTiming first{"conceal: first block"}, further{"conceal: further blocks"};
+    CTiming receive{"conceal: block received"}, recover{"conceal: block received, recovering"};
+
+    TYPE block[WRITE_CHANNELS][AUDIO_BLOCK_FRAMES];
+    TYPE *channels[WRITE_CHANNELS];
+    for (int ch{0}; ch < WRITE_CHANNELS; ++ch) {
+        channels[ch] = block[ch];
+    }
+
+    unsigned nFrame{0};
+    for (unsigned run{0}; run < nRuns; ++run) {
+        // Enough to fill the history.
+        for (int n{0}; n < 50; ++n) {
+            MakeBlock(channels, nFrame);
+            receive.Start();
+            concealer.Receive(channels);
+            receive.Stop();
+        }
+
+        for (unsigned n{0}; n < nBurst; ++n) {
+            CTiming &timing{n == 0 ? first : further};
+            timing.Start();
+            concealer.Conceal(channels);
+            timing.Stop();
+            nFrame += AUDIO_BLOCK_FRAMES;
+        }
+
+        MakeBlock(channels, nFrame);
+        recover.Start();
+        concealer.Receive(channels);
+        recover.Stop();
+    }
+
+    first.Report();
+    further.Report();
+    receive.Report();
+    recover.Report();
+}
+
+/**
+ * Receiving a packet into the fifo, with the socket's copy out of its
+ * buffer stood in for by a memcpy: into a buffer and from there into the
+ * fifo, as before, or straight into the fifo's next slot. The sound device
+ * callback's read is left out of the timings.
+ */
+static void BenchReceive(unsigned nRuns)
+{
+    CFIFO<TYPE, WRITE_CHANNELS, FIFO_LENGTH_FRAMES> fifo{AUDIO_BLOCK_FRAMES, true, PACKET_HEADER_SIZE,
+                                                         MAX_REDUNDANCY};
+    fifo.SetTargetDepth(FIFO_LENGTH_FRAMES / 4);
+    CTiming copy{"receive: via a buffer"}, inPlace{"receive: into the fifo's slot"},
+            decode{"receive: decoding 24-bit"};
+
+    // A stream in another format than the fifo's.
+    CStreamDecoder<TYPE> decoder{WRITE_CHANNELS, AUDIO_BLOCK_FRAMES, SAMPLE_RATE};
+    decoder.Negotiate({AUDIO_BLOCK_FRAMES, SAMPLE_RATE, BIT24, WRITE_CHANNELS});
+    static u8 wire[PACKET_HEADER_SIZE + WRITE_CHANNELS * AUDIO_BLOCK_FRAMES * BIT24];
+    static TYPE decoded[WRITE_CHANNELS][AUDIO_BLOCK_FRAMES];
+    TYPE *decodedChannels[WRITE_CHANNELS];
+    for (int ch{0}; ch < WRITE_CHANNELS; ++ch) {
+        decodedChannels[ch] = decoded[ch];
+    }
+
+    static u8 datagram[k_nPacketSize], buffer[k_nPacketSize * MAX_REDUNDANCY];
+    static float output[AUDIO_BLOCK_FRAMES * WRITE_CHANNELS];
+    TYPE *channels[WRITE_CHANNELS];
+    for (int ch{0}; ch < WRITE_CHANNELS; ++ch) {
+        channels[ch] = reinterpret_cast<TYPE *>(datagram + PACKET_HEADER_SIZE + CHANNEL_QUEUE_SIZE * ch);
+    }
+    unsigned nFrame{0};
+    MakeBlock(channels, nFrame);
+
+    for (int ch{0}; ch < WRITE_CHANNELS; ++ch) {
+        channels[ch] = reinterpret_cast<TYPE *>(buffer + PACKET_HEADER_SIZE + CHANNEL_QUEUE_SIZE * ch);
+    }
+
+    for (unsigned run{0}; run < nRuns; ++run) {
+        copy.Start();
+        memcpy(buffer, datagram, sizeof datagram);
+        fifo.Write(channels, AUDIO_BLOCK_FRAMES);
+        copy.Stop();
+        fifo.Read(output, AUDIO_BLOCK_FRAMES);
+
+        inPlace.Start();
+        memcpy(fifo.GetWriteSlot(), datagram, sizeof datagram);
+        fifo.CommitSlot();
+        inPlace.Stop();
+        fifo.Read(output, AUDIO_BLOCK_FRAMES);
+
+        decode.Start();
+        decoder.Decode(wire + PACKET_HEADER_SIZE, 0, decodedChannels);
+        fifo.Write(decodedChannels, AUDIO_BLOCK_FRAMES);
+        decode.Stop();
+        fifo.Read(output, AUDIO_BLOCK_FRAMES);
+    }
+
+    copy.Report();
+    printf("%-36s %8u bytes copied per packet\n", "", static_cast<unsigned>(2 * k_nPacketSize - PACKET_HEADER_SIZE));
+    inPlace.Report();
+    printf("%-36s %8u bytes copied per packet\n", "", static_cast<unsigned>(k_nPacketSize));
+    decode.Report();
+}
+
+/**
+ * The fifo on its own: a block written, then read for the sound device in
+ * DMA chunks, and again as floats, for the resampler.
+ */
+template<u8 nChannels>
+static void BenchFIFO(unsigned nRuns)
+{
+    CFIFO<TYPE, nChannels, FIFO_LENGTH_FRAMES> fifo{AUDIO_BLOCK_FRAMES, true, PACKET_HEADER_SIZE};
+    fifo.SetTargetDepth(FIFO_LENGTH_FRAMES / 4);
+    char name[2][40];
+    snprintf(name[0], sizeof name[0], "fifo: %u channels, read for device", nChannels);
+    snprintf(name[1], sizeof name[1], "fifo: %u channels, read as floats", nChannels);
+    CTiming device{name[0]}, floats{name[1]};
+
+    std::vector<TYPE> samples(nChannels * AUDIO_BLOCK_FRAMES);
+    TYPE *channels[nChannels];
+    for (u8 ch{0}; ch < nChannels; ++ch) {
+        channels[ch] = samples.data() + ch * AUDIO_BLOCK_FRAMES;
+    }
+    unsigned nFrame{0};
+    MakeBlock(channels, nFrame, nChannels);
+
+    static u32 chunk[DMA_CHUNK_FRAMES * nChannels];
+    static float floatChunk[DMA_CHUNK_FRAMES * nChannels];
+
+    for (unsigned run{0}; run < nRuns; ++run) {
+        fifo.Write(channels, AUDIO_BLOCK_FRAMES);
+        device.Start();
+        for (unsigned n{0}; n < AUDIO_BLOCK_FRAMES; n += DMA_CHUNK_FRAMES) {
+            fifo.template Read<OutputSigned>(chunk, DMA_CHUNK_FRAMES, AUDIO_VOLUME * ((1 << 23) - 1), 0.f);
+        }
+        device.Stop();
+
+        fifo.Write(channels, AUDIO_BLOCK_FRAMES);
+        floats.Start();
+        for (unsigned n{0}; n < AUDIO_BLOCK_FRAMES; n += DMA_CHUNK_FRAMES) {
+            fifo.Read(floatChunk, DMA_CHUNK_FRAMES);
+        }
+        floats.Stop();
+    }
+
+    device.Report();
+    floats.Report();
+}
+
+/**
+ * The resampler: a block of output at a ratio, reading its input from a
+ * buffer, as it does from the fifo, so that only the interpolation is timed.
+ * Clock recovery keeps it within a few hundred ppm of 1; converting 48 kHz
+ * for a 44.1 kHz device takes about 9% more input.
+ */
+template<u8 nChannels>
+static void BenchResampler(unsigned nRuns, float fRatio)
+{
+    CResampler resampler{nChannels, AUDIO_BLOCK_FRAMES, 2.f};
+    resampler.SetRatio(fRatio);
+    char name[40];
+    snprintf(name, sizeof name, "resampler: %u channels, ratio %.4f", nChannels, fRatio);
+    CTiming timing{name};
+
+    static float input[2 * AUDIO_BLOCK_FRAMES * nChannels];
+    for (unsigned n{0}; n < 2 * AUDIO_BLOCK_FRAMES * nChannels; ++n) {
+        input[n] = .5f * sinf(.01f * n);
+    }
+    static float output[AUDIO_BLOCK_FRAMES * nChannels];
+
+    for (unsigned run{0}; run < nRuns; ++run) {
+        timing.Start();
+        resampler.Process(output, AUDIO_BLOCK_FRAMES, [](float *pBuffer, u16 nFrames) {
+            memcpy(pBuffer, input, nFrames * nChannels * sizeof(float));
+        });
+        timing.Stop();
+    }
+
+    timing.Report();
+    printf("%-36s %8.2f ns an output sample\n", "", timing.GetMean() / (AUDIO_BLOCK_FRAMES * nChannels));
+}
+
+/**
+ * A spinlock, as the fifo took before it was lock-free: Circle's CSpinLock
+ * on a multicore Pi, which the host's stands in for with a no-op. Waiting,
+ * it yields now and then, so as not to spin out the time slice of a holder
+ * that was preempted.
+ */
+class CBenchSpinLock
+{
+public:
+    void Acquire()
+    {
+        for (unsigned n{1}; m_Flag.test_and_set(std::memory_order_acquire); ++n) {
+            if (n % 64 == 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void Release() { m_Flag.clear(std::memory_order_release); }
+
+private:
+    std::atomic_flag m_Flag = ATOMIC_FLAG_INIT;
+};
+
+/**
+ * The fifo lock-free, as it is, against the same fifo with both sides taking
+ * a spinlock around each call, as before: on one thread, a block written and
+ * read back in device chunks, which is the lock's own cost; and across two,
+ * a producer and a consumer passing nBlocks blocks as fast as they can, each
+ * waiting only for room or for frames.
+ */
+template<bool Locked>
+static void BenchSPSC(unsigned nRuns, unsigned nBlocks)
+{
+    typedef CFIFO<TYPE, WRITE_CHANNELS, FIFO_LENGTH_FRAMES> TFIFO;
+    TFIFO fifo{AUDIO_BLOCK_FRAMES, true, PACKET_HEADER_SIZE};
+    fifo.SetTargetDepth(FIFO_LENGTH_FRAMES / 4);
+    CBenchSpinLock lock;
+    const char *pVariant{Locked ? "spinlock" : "lock-free"};
+
+    TYPE samples[WRITE_CHANNELS][AUDIO_BLOCK_FRAMES];
+    TYPE *channels[WRITE_CHANNELS];
+    for (u8 ch{0}; ch < WRITE_CHANNELS; ++ch) {
+        channels[ch] = samples[ch];
+    }
+    unsigned nFrame{0};
+    MakeBlock(channels, nFrame);
+
+    auto write{[&]() {
+        if (Locked) {
+            lock.Acquire();
+        }
+        fifo.Write(channels, AUDIO_BLOCK_FRAMES);
+        if (Locked) {
+            lock.Release();
+        }
+    }};
+    static float chunk[DMA_CHUNK_FRAMES * WRITE_CHANNELS];
+    auto read{[&]() {
+        if (Locked) {
+            lock.Acquire();
+        }
+        fifo.Read(chunk, DMA_CHUNK_FRAMES);
+        if (Locked) {
+            lock.Release();
+        }
+    }};
+
+    char name[40];
+    snprintf(name, sizeof name, "fifo: %s, one thread", pVariant);
+    CTiming single{name};
+    for (unsigned run{0}; run < nRuns; ++run) {
+        single.Start();
+        write();
+        for (unsigned n{0}; n < AUDIO_BLOCK_FRAMES; n += DMA_CHUNK_FRAMES) {
+            read();
+        }
+        single.Stop();
+    }
+    single.Report();
+
+    // Passing blocks between threads: the producer waits for room, the
+    // consumer for a chunk's worth.
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // The fifo may slip a few frames to hold its depth, so the consumer
+    // stops once the producer has finished and less than a chunk remains.
+    std::atomic<bool> bWritten{false};
+    std::thread producer{[&]() {
+        for (unsigned n{0}; n < nBlocks; ++n) {
+            while (fifo.GetFillLevel() + AUDIO_BLOCK_FRAMES >= FIFO_LENGTH_FRAMES / 2) {
+                std::this_thread::yield();
+            }
+            write();
+        }
+        bWritten = true;
+    }};
+    for (;;) {
+        bool bDone{bWritten};
+        if (fifo.GetFillLevel() >= DMA_CHUNK_FRAMES) {
+            read();
+        } else if (bDone) {
+            break;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double fNs{1e9 * (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)};
+    printf("%-36s %8u blocks, %9.0f ns a block, %.1f M frames/s\n", Locked ? "fifo: spinlock, two threads"
+                                                                          : "fifo: lock-free, two threads",
+           nBlocks, fNs / nBlocks, 1e3 * nBlocks * AUDIO_BLOCK_FRAMES / fNs);
+}
+
+/**
+ * Scaling a sample format for the sound device, via float and in fixed
+ * point, for I2S or for PWM at 48 or 192 kHz (its range is a sample period of
+ * a 125 MHz clock): how far apart the two are over every sample value (or a
+ * spread of them, for formats wider than 16 bits), and what a block of stereo
+ * costs, and a sample.
+ */
+template<typename T, TOutputStyle Style>
+static void BenchOutput(unsigned nRuns, const char *pDevice, float fAmp, float fOffset, s32 nMin, s32 nMax)
+{
+    const TFixedGain gain{CConvert::MakeFixedGain<T>(fAmp, fOffset, nMin, nMax)};
+
+    const u64 nValues{1ull << TSampleTraits<T>::k_nBits};
+    const u64 nStep{nValues > (1u << 16) ? nValues >> 16 : 1};
+    unsigned nSame{0}, nCount{0};
+    int nMaxDiff{0};
+    for (u64 v{0}; v < nValues; v += nStep, ++nCount) {
+        T x{TSampleTraits<T>::FromCentred(static_cast<int>(v - nValues / 2))};
+        int diff{static_cast<int>(CConvert::SampleToDeviceFixed<Style>(x, gain))
+                 - static_cast<int>(CConvert::SampleToDevice<Style>(x, fAmp, fOffset))};
+        diff = diff < 0 ? -diff : diff;
+        nMaxDiff = diff > nMaxDiff ? diff : nMaxDiff;
+        nSame += diff == 0;
+    }
+
+    char pName[16];
+    snprintf(pName, sizeof pName, "%s %s", s_pTypeName<T>, pDevice);
+    char name[4][48];
+    snprintf(name[0], sizeof name[0], "output: %s, float", pName);
+    snprintf(name[1], sizeof name[1], "output: %s, Q%u", pName, gain.bQ15 ? 15u : 31u);
+    snprintf(name[2], sizeof name[2], "output: %s, Q%u, dithered", pName, gain.bQ15 ? 15u : 31u);
+    snprintf(name[3], sizeof name[3], "output: %s, float, dithered", pName);
+    printf("%-36s %8u values, at most %d step%s apart, %.1f%% the same\n", name[1], nCount, nMaxDiff,
+           nMaxDiff == 1 ? "" : "s", 100. * nSame / nCount);
+
+    T samples[2][AUDIO_BLOCK_FRAMES];
+    T *channels[2]{samples[0], samples[1]};
+    unsigned nFrame{0};
+    MakeBlock(channels, nFrame, 2);
+    static float floats[2 * AUDIO_BLOCK_FRAMES];
+    CConvert::ToFloat<2>(floats, channels, AUDIO_BLOCK_FRAMES);
+    static u32 chunk[2 * AUDIO_BLOCK_FRAMES];
+    TDither dither;
+
+    CTiming viaFloat{name[0]}, fixed{name[1]}, fixedDithered{name[2]}, floatDithered{name[3]};
+    for (unsigned run{0}; run < nRuns; ++run) {
+        viaFloat.Start();
+        CConvert::ToDevice<Style, 2>(chunk, channels, AUDIO_BLOCK_FRAMES, fAmp, fOffset);
+        viaFloat.Stop();
+
+        fixed.Start();
+        CConvert::ToDeviceFixed<Style, 2>(chunk, channels, AUDIO_BLOCK_FRAMES, gain);
+        fixed.Stop();
+
+        if (Style == OutputOffsetBinary) {
+            fixedDithered.Start();
+            CConvert::ToDeviceFixed<Style, 2>(chunk, channels, AUDIO_BLOCK_FRAMES, gain, &dither);
+            fixedDithered.Stop();
+
+            // As after the resampler.
+            floatDithered.Start();
+            CConvert::FloatToDevice<Style>(chunk, floats, 2 * AUDIO_BLOCK_FRAMES, fAmp, fOffset, &dither);
+            floatDithered.Stop();
+        }
+    }
+
+    viaFloat.Report();
+    fixed.Report();
+    if (Style == OutputOffsetBinary) {
+        fixedDithered.Report();
+        floatDithered.Report();
+    }
+    constexpr double fSamples{2 * AUDIO_BLOCK_FRAMES};
+    if (Style == OutputOffsetBinary) {
+        printf("%-36s %8.2f ns a sample via float, %.2f in Q%u; dithered %.2f and %.2f\n", "", viaFloat.GetMean() / fSamples,
+               fixed.GetMean() / fSamples, gain.bQ15 ? 15u : 31u, floatDithered.GetMean() / fSamples,
+               fixedDithered.GetMean() / fSamples);
+    } else {
+        printf("%-36s %8.2f ns a sample via float, %.2f in Q%u\n", "", viaFloat.GetMean() / fSamples,
+               fixed.GetMean() / fSamples, gain.bQ15 ? 15u : 31u);
+    }
+}
+
+/**
+ * A sample format to I2S and to PWM at 48 kHz.
+ */
+template<typename T>
+static void BenchOutputs(unsigned nRuns, float fI2SMax, float fPWMMax)
+{
+    BenchOutput<T, OutputSigned>(nRuns, "I2S", AUDIO_VOLUME * fI2SMax, 0.f, -fI2SMax, fI2SMax);
+    BenchOutput<T, OutputOffsetBinary>(nRuns, "PWM 48k", AUDIO_VOLUME * fPWMMax / 2, fPWMMax / 2, 0, fPWMMax);
+}
+
+/**
+ * The mixer, from a stream of nChannels down to stereo, per block: read from
+ * the fifo and mixed at steady gains, the same while ramping to new ones,
+ * and the monitor mix of a captured chunk added.
+ */
+template<u8 nChannels>
+static void BenchMixer(unsigned nRuns)
+{
+    CFIFO<TYPE, nChannels, FIFO_LENGTH_FRAMES> fifo{AUDIO_BLOCK_FRAMES, true, PACKET_HEADER_SIZE};
+    fifo.SetTargetDepth(FIFO_LENGTH_FRAMES / 4);
+    CMixer mixer{nChannels, 2, AUDIO_BLOCK_FRAMES, AUDIO_BLOCK_FRAMES, MIXER_RAMP_MS * SAMPLE_RATE / 1000,
+                 AUDIO_VOLUME};
+    char name[3][40];
+    snprintf(name[0], sizeof name[0], "mixer: %u to 2 channels", nChannels);
+    snprintf(name[1], sizeof name[1], "mixer: %u to 2 channels, ramping", nChannels);
+    snprintf(name[2], sizeof name[2], "mixer: monitor");
+    CTiming steady{name[0]}, ramping{name[1]}, monitor{name[2]};
+
+    std::vector<TYPE> samples(nChannels * AUDIO_BLOCK_FRAMES);
+    TYPE *channels[nChannels];
+    for (u8 ch{0}; ch < nChannels; ++ch) {
+        channels[ch] = samples.data() + ch * AUDIO_BLOCK_FRAMES;
+    }
+    unsigned nFrame{0};
+    MakeBlock(channels, nFrame, nChannels);
+
+    static u32 captured[2 * AUDIO_BLOCK_FRAMES];
+    for (unsigned n{0}; n < 2 * AUDIO_BLOCK_FRAMES; ++n) {
+        captured[n] = static_cast<u32>(static_cast<s32>(n * 997) % (1 << 23));
+    }
+    mixer.Capture(captured);
+    mixer.SetMonitor(.5f);
+
+    static float output[2 * AUDIO_BLOCK_FRAMES];
+    auto read{[&fifo](float *const *ppChannels, u16 nFrames) { fifo.Read(ppChannels, nFrames); }};
+
+    for (unsigned run{0}; run < nRuns; ++run) {
+        fifo.Write(channels, AUDIO_BLOCK_FRAMES);
+        steady.Start();
+        mixer.Mix(output, AUDIO_BLOCK_FRAMES, read);
+        steady.Stop();
+
+        monitor.Start();
+        mixer.AddMonitor(output);
+        monitor.Stop();
+
+        // Every block starts a new ramp, which is longer than a block.
+        mixer.SetGain(0, run & 1 ? 1.f : .5f);
+        fifo.Write(channels, AUDIO_BLOCK_FRAMES);
+        ramping.Start();
+        mixer.Mix(output, AUDIO_BLOCK_FRAMES, read);
+        ramping.Stop();
+        mixer.AddMonitor(output);
+
+        // And back to steady for the next.
+        mixer.SetGain(0, run & 1 ? 1.f : .5f);
+        for (unsigned n{0}; n < MIXER_RAMP_MS * SAMPLE_RATE / 1000; n += AUDIO_BLOCK_FRAMES) {
+            fifo.Write(channels, AUDIO_BLOCK_FRAMES);
+            mixer.Mix(output, AUDIO_BLOCK_FRAMES, read);
+            mixer.AddMonitor(output);
+        }
+    }
+
+    steady.Report();
+    ramping.Report();
+    monitor.Report();
+}
+
+/**
+ * A block's way through the client, whatever the build's rate and channel
+ * count: received into the fifo's slot, seen by the loss concealer, read out
+ * for the sound device as a chunk of the same length, and, in full duplex, a
+ * chunk captured into the uplink ring. Reported against the block period at
+ * the given rate, which is what the headroom depends on.
+ */
+template<u8 nChannels>
+static void BenchPath(unsigned nRuns, unsigned nSampleRate)
+{
+    const double fBlockPeriodNs{1e9 * AUDIO_BLOCK_FRAMES / nSampleRate};
+    printf("path: %u Hz, %u channels; a block is %.0f ns\n", nSampleRate, nChannels, fBlockPeriodNs);
+
+    CFIFO<TYPE, nChannels, FIFO_LENGTH_FRAMES, DEVICE_CHANNELS> fifo{AUDIO_BLOCK_FRAMES, true, PACKET_HEADER_SIZE};
+    fifo.SetTargetDepth(FIFO_LENGTH_FRAMES / 4);
+    CLossConcealer concealer{nChannels, AUDIO_BLOCK_FRAMES, nSampleRate};
+    CBlockRing<TYPE> ring{nChannels, AUDIO_BLOCK_FRAMES, 2, PACKET_HEADER_SIZE, DEVICE_CHANNELS};
+    ring.Start();
+    CTiming receive{"path: receive", fBlockPeriodNs}, conceal{"path: concealer", fBlockPeriodNs};
+    CTiming render{"path: render", fBlockPeriodNs}, capture{"path: capture", fBlockPeriodNs};
+
+    const unsigned nPacketSize{static_cast<unsigned>(PACKET_HEADER_SIZE + nChannels * CHANNEL_QUEUE_SIZE)};
+    std::vector<u8> datagram(nPacketSize);
+    TYPE *channels[8];
+    for (u8 ch{0}; ch < nChannels; ++ch) {
+        channels[ch] = reinterpret_cast<TYPE *>(datagram.data() + PACKET_HEADER_SIZE + CHANNEL_QUEUE_SIZE * ch);
+    }
+    unsigned nFrame{0};
+    MakeBlock(channels, nFrame, nChannels);
+
+    static u32 chunk[AUDIO_BLOCK_FRAMES * DEVICE_CHANNELS];
+
+    for (unsigned run{0}; run < nRuns; ++run) {
+        receive.Start();
+        memcpy(fifo.GetWriteSlot(), datagram.data(), nPacketSize);
+        fifo.CommitSlot();
+        receive.Stop();
+
+        conceal.Start();
+        concealer.Receive(channels);
+        conceal.Stop();
+
+        render.Start();
+        fifo.template Read<OutputSigned>(chunk, AUDIO_BLOCK_FRAMES, AUDIO_VOLUME * ((1 << 23) - 1), 0.f);
+        render.Stop();
+
+        capture.Start();
+        ring.Write(chunk, AUDIO_BLOCK_FRAMES);
+        ring.Pop();
+        capture.Stop();
+    }
+
+    receive.Report();
+    conceal.Report();
+    render.Report();
+    capture.Report();
+    double fTotal{receive.GetMean() + conceal.GetMean() + render.GetMean() + capture.GetMean()};
+    printf("%-36s %8s       %9.0f ns (%5.2f%% of a block)\n", "path: total", "", fTotal,
+           100. * fTotal / fBlockPeriodNs);
+}
+
+static void Usage(const char *pProgram)
+{
+    fprintf(stderr, "Usage: %s [-n runs]\n"
+                    "  -n  Runs of each benchmark (default 1000)\n", pProgram);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned nRuns{1000};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                nRuns = static_cast<unsigned>(atoi(optarg));
+                break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    printf("jtbench: %u Hz, %u frames, %u channels, %u-byte samples; a block is %.0f ns\n",
+           SAMPLE_RATE, AUDIO_BLOCK_FRAMES, WRITE_CHANNELS, (unsigned) TYPE_SIZE, k_fBlockPeriodNs);
+
+    BenchConcealment(nRuns, 4);
+    BenchReceive(nRuns * 100);
+    BenchFIFO<1>(nRuns * 100);
+    BenchFIFO<2>(nRuns * 100);
+    BenchFIFO<8>(nRuns * 100);
+    BenchResampler<2>(nRuns * 100, 1.0005f);
+    BenchResampler<2>(nRuns * 100, 48000.f / 44100.f);
+    BenchResampler<8>(nRuns * 100, 1.0005f);
+    BenchSPSC<false>(nRuns * 100, nRuns * 100);
+    BenchSPSC<true>(nRuns * 100, nRuns * 100);
+    const float fI2SMax{(1 << 23) - 2}, fPWMMax48{125000000 / 48000 - 2}, fPWMMax192{125000000 / 192000 - 2};
+    BenchOutputs<u8>(nRuns * 100, fI2SMax, fPWMMax48);
+    BenchOutputs<s16>(nRuns * 100, fI2SMax, fPWMMax48);
+    BenchOutputs<s32>(nRuns * 100, fI2SMax, fPWMMax48);
+    BenchOutputs<u32>(nRuns * 100, fI2SMax, fPWMMax48);
+    BenchOutput<TYPE, OutputOffsetBinary>(nRuns * 100, "PWM 192k", AUDIO_VOLUME * fPWMMax192 / 2, fPWMMax192 / 2, 0,
+                                          fPWMMax192);
+    BenchMixer<2>(nRuns * 10);
+    BenchMixer<8>(nRuns * 10);
+    BenchPath<2>(nRuns * 10, 48000);
+    BenchPath<8>(nRuns * 10, 96000);
+    BenchPath<8>(nRuns * 10, 192000);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,649 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// A stand-in for a JackTrip hub server, for load tests of the client over
+// loopback (or a LAN). It speaks the part of the protocol the client uses:
+// the TCP port exchange, a stream of audio packets, and the exit packet. On
+// the way out it can lose, reorder, delay and mis-clock packets, and what it
+// sends is a test signal the client's host build can analyse (see
+// TestSignal.h). It can send in any of JackTrip's formats, as a server set
+// up differently from the client would; what it gets back is in the
+// client's. It can echo the client's packet timestamps back, for the client
+// to measure the round trip with.
+
+#include <circle/types.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "config.h"
+#include "convert.h"
+#include "PacketHeader.h"
+#include "StreamFormat.h"
+#include "TestSignal.h"
+
+// JackTrip's default UDP port for the first client of a hub.
+#define HUB_UDP_PORT   61002
+
+// The client's packets.
+static const unsigned k_nPacketSize{PACKET_HEADER_SIZE + WRITE_CHANNELS * CHANNEL_QUEUE_SIZE};
+
+struct THubOptions
+{
+    float fLoss{0.f};
+    float fBurst{1.f};
+    float fReorder{0.f};
+    float fJitterMs{0.f};
+    float fSkewPPM{0.f};
+    CTestSignal::TType Signal{CTestSignal::ToneAndClicks};
+    float fFrequency{997.f};
+    unsigned nSeconds{10};
+    unsigned nSessions{1};
+    u32 nSeed{1};
+    unsigned nRedundancy{1};
+    // The format to send in.
+    unsigned nFrames{AUDIO_BLOCK_FRAMES};
+    unsigned nBits{JACKTRIP_BIT_RES * 8};
+    unsigned nChannels{WRITE_CHANNELS};
+    bool bEcho{false};
+};
+
+// A datagram: a packet, followed, with redundancy, by those before it.
+struct TPacket
+{
+    u64 nSendTime;
+    std::vector<u8> Data;
+};
+
+struct TSessionStats
+{
+    unsigned nGenerated{0};
+    unsigned nSent{0};
+    unsigned nLost{0};
+    unsigned nReordered{0};
+    unsigned nReceived{0};
+    unsigned nMalformed{0};
+    unsigned nRecovered{0};
+    u64 nMaxDelay{0};
+
+    // What came back: peak level, and the clicks, if the client loops its
+    // output back to its input.
+    float fUplinkPeak{0.f};
+    bool bUplinkStarted{false};
+    u16 nUplinkSeqNumber{0};
+    u64 nUplinkFrames{0};
+    u64 nLastClick{0};
+    std::vector<float> RoundTrips;
+
+    // The newest timestamp from the client, and when it came, to echo.
+    u64 nEchoTimeStamp{0};
+    u64 nEchoArrival{0};
+    unsigned nEchoed{0};
+};
+
+static u64 GetNanoseconds(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<u64>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
+static void SleepUntil(u64 nTime)
+{
+    timespec ts{static_cast<time_t>(nTime / 1000000000u), static_cast<long>(nTime % 1000000000u)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+/**
+ * xorshift32: cheap, and the same sequence for the same seed everywhere, so
+ * that impairments are repeatable.
+ */
+class CRandom
+{
+public:
+    explicit CRandom(u32 nSeed) : m_nState{nSeed ? nSeed : 1} {}
+
+    /**
+     * @return Uniform in [0, 1).
+     */
+    float Next()
+    {
+        m_nState ^= m_nState << 13;
+        m_nState ^= m_nState >> 17;
+        m_nState ^= m_nState << 5;
+        return static_cast<float>(m_nState >> 8) / (1 << 24);
+    }
+
+private:
+    u32 m_nState;
+};
+
+/**
+ * Store a sample in [-1, 1) in a wire format, as JackTrip's
+ * AudioInterface::fromSampleToBitConversion() does: rounded and clipped to
+ * 127 or 32767 steps at 8 and 16 bits, rounded down to 2^23 at 24, and as
+ * it is at 32.
+ * @param pDest
+ * @param nBytes One of TAudioBitResolution.
+ * @param fSample
+ */
+static void PutSample(u8 *pDest, unsigned nBytes, float fSample)
+{
+    switch (nBytes) {
+        case BIT8:
+            TWireSample<BIT8>::Put(pDest, static_cast<int>(std::clamp(round(fSample * 127.), -127., 127.)));
+            break;
+        case BIT16:
+            TWireSample<BIT16>::Put(pDest, static_cast<int>(std::clamp(round(fSample * 32767.), -32767., 32767.)));
+            break;
+        case BIT24:
+            // The 16-bit sample rounded down, and the remainder's byte
+            // rounded down: together, the 24-bit sample rounded down.
+            TWireSample<BIT24>::Put(pDest, static_cast<int>(floor(fSample * 8388608.)));
+            break;
+        default:
+            memcpy(pDest, &fSample, sizeof fSample);
+            break;
+    }
+}
+
+/**
+ * @return A sample in the client's format, in [-1, 1).
+ */
+static float GetSample(const u8 *pSource)
+{
+    TYPE sample{};
+    memcpy(&sample, pSource, TYPE_SIZE);
+    return static_cast<float>(TSampleTraits<TYPE>::Centre(sample)) * TSampleTraits<TYPE>::k_fScale;
+}
+
+class CHub
+{
+public:
+    explicit CHub(const THubOptions &options) :
+            k_Options(options),
+            k_nWirePacketSize{static_cast<unsigned>(PACKET_HEADER_SIZE)
+                              + options.nChannels * options.nFrames * options.nBits / 8},
+            m_Random{options.nSeed}
+    {
+    }
+
+    bool Listen()
+    {
+        m_nListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        m_nUdpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_nListenSocket < 0 || m_nUdpSocket < 0) {
+            perror("socket");
+            return false;
+        }
+
+        int on{1};
+        setsockopt(m_nListenSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+        setsockopt(m_nUdpSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(JACKTRIP_TCP_PORT);
+        if (bind(m_nListenSocket, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0
+            || listen(m_nListenSocket, 1) < 0) {
+            perror("TCP port");
+            return false;
+        }
+
+        addr.sin_port = htons(HUB_UDP_PORT);
+        if (bind(m_nUdpSocket, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0) {
+            perror("UDP port");
+            return false;
+        }
+
+        printf("jthub: listening on TCP port %u; %u Hz, %u frames, %u channels, %u-bit samples, "
+               "redundancy %u\n",
+               JACKTRIP_TCP_PORT, SAMPLE_RATE, k_Options.nFrames, k_Options.nChannels, k_Options.nBits,
+               k_Options.nRedundancy);
+        // For timing the client's reconnection against.
+        printf("jthub: up at %.3f ms\n", GetNanoseconds() * 1e-6);
+        fflush(stdout);
+        return true;
+    }
+
+    /**
+     * Wait for a client and exchange port numbers with it.
+     */
+    bool Accept()
+    {
+        sockaddr_in peer{};
+        socklen_t len{sizeof peer};
+        int nSocket{accept(m_nListenSocket, reinterpret_cast<sockaddr *>(&peer), &len)};
+        if (nSocket < 0) {
+            perror("accept");
+            return false;
+        }
+
+        // Port numbers go over the wire as 32-bit integers.
+        u32 nPort;
+        bool ok{recv(nSocket, &nPort, sizeof nPort, MSG_WAITALL) == sizeof nPort};
+        u32 nHubPort{HUB_UDP_PORT};
+        ok = ok && send(nSocket, &nHubPort, sizeof nHubPort, 0) == sizeof nHubPort;
+        close(nSocket);
+
+        if (!ok || nPort == 0 || nPort > 0xFFFF) {
+            fprintf(stderr, "jthub: port exchange failed\n");
+            return false;
+        }
+
+        m_Client = peer;
+        m_Client.sin_port = htons(static_cast<u16>(nPort));
+        printf("jthub: client %s, UDP port %u\n", inet_ntoa(peer.sin_addr), nPort);
+        return true;
+    }
+
+    /**
+     * Stream to the client for the configured time, then send it the exit
+     * packet.
+     */
+    void Serve()
+    {
+        TSessionStats stats;
+        CTestSignal signal{k_Options.Signal, k_Options.fFrequency, SAMPLE_RATE,
+                           static_cast<u8>(k_Options.nChannels)};
+
+        // Positive skew: the hub's clock runs fast, so it sends more often.
+        const double fFramePeriod{1e9 / SAMPLE_RATE / (1. + k_Options.fSkewPPM * 1e-6)};
+        const u64 nStart{GetNanoseconds()};
+        const u64 nEnd{k_Options.nSeconds ? nStart + k_Options.nSeconds * 1000000000ull : ~0ull};
+
+        std::deque<TPacket> queue;
+        TPacket held;
+        bool isHeld{false};
+        bool isLosing{false};
+        u64 nLastSendTime{0};
+        u16 nSeqNumber{0};
+        u64 nFrames{0};
+        const unsigned nDatagramSize{k_nWirePacketSize * k_Options.nRedundancy};
+        // The packets that go in the next datagram, newest first; zeroed to
+        // start with, as JackTrip's are.
+        std::vector<u8> history(nDatagramSize);
+
+        while (true) {
+            u64 nNextCapture{nStart + static_cast<u64>((nFrames + k_Options.nFrames) * fFramePeriod)};
+            u64 nNow{GetNanoseconds()};
+
+            if (nNextCapture <= nNow) {
+                if (nNextCapture >= nEnd) {
+                    break;
+                }
+
+                memmove(history.data() + k_nWirePacketSize, history.data(), nDatagramSize - k_nWirePacketSize);
+                Fill(history.data(), &signal, nSeqNumber++, nStart, nFrames, fFramePeriod);
+                nFrames += k_Options.nFrames;
+
+                TPacket packet{0, history};
+                ++stats.nGenerated;
+                if (k_Options.bEcho && stats.nEchoArrival != 0) {
+                    Echo(packet.Data.data(), &stats);
+                }
+
+                // Gilbert-style loss: once losing, keep losing for a burst of
+                // fBurst packets on average.
+                isLosing = isLosing ? m_Random.Next() < 1.f - 1.f / k_Options.fBurst
+                                    : m_Random.Next() < k_Options.fLoss;
+                if (isLosing) {
+                    ++stats.nLost;
+                } else {
+                    // Delay, but keep the order: a late packet holds up the
+                    // ones behind it, as in a queue.
+                    u64 nDelay{static_cast<u64>(m_Random.Next() * k_Options.fJitterMs * 1e6f)};
+                    packet.nSendTime = nNextCapture + nDelay;
+                    if (packet.nSendTime < nLastSendTime) {
+                        packet.nSendTime = nLastSendTime;
+                    }
+                    nLastSendTime = packet.nSendTime;
+                    if (packet.nSendTime - nNextCapture > stats.nMaxDelay) {
+                        stats.nMaxDelay = packet.nSendTime - nNextCapture;
+                    }
+
+                    if (isHeld) {
+                        // Send the held packet after this one.
+                        queue.push_back(packet);
+                        held.nSendTime = packet.nSendTime;
+                        queue.push_back(held);
+                        isHeld = false;
+                        ++stats.nReordered;
+                    } else if (m_Random.Next() < k_Options.fReorder) {
+                        held = packet;
+                        isHeld = true;
+                    } else {
+                        queue.push_back(packet);
+                    }
+                }
+            }
+
+            while (!queue.empty() && queue.front().nSendTime <= nNow) {
+                if (sendto(m_nUdpSocket, queue.front().Data.data(), nDatagramSize, 0,
+                           reinterpret_cast<sockaddr *>(&m_Client), sizeof m_Client) == nDatagramSize) {
+                    ++stats.nSent;
+                }
+                queue.pop_front();
+            }
+
+            Drain(&stats);
+
+            u64 nWake{nNextCapture};
+            if (!queue.empty() && queue.front().nSendTime < nWake) {
+                nWake = queue.front().nSendTime;
+            }
+            if (k_Options.bEcho) {
+                // Wake for the client's packets too, so that they're
+                // stamped as they arrive.
+                WaitUntil(nWake);
+            } else {
+                SleepUntil(nWake);
+            }
+        }
+
+        const u8 exitPacket[EXIT_PACKET_SIZE]{
+#define X8 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+                X8, X8, X8, X8, X8, X8, X8, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+#undef X8
+        };
+        sendto(m_nUdpSocket, exitPacket, sizeof exitPacket, 0,
+               reinterpret_cast<sockaddr *>(&m_Client), sizeof m_Client);
+
+        // Pick up what the client sent in the meantime.
+        SleepUntil(GetNanoseconds() + 50000000);
+        Drain(&stats);
+
+        printf("jthub: %.1f s; packets generated %u, sent %u, lost %u, reordered %u; max delay %.2f ms; "
+               "received %u from the client (%u malformed, %u packets recovered), peak %.1f dBFS\n",
+               (GetNanoseconds() - nStart) * 1e-9, stats.nGenerated, stats.nSent, stats.nLost,
+               stats.nReordered, stats.nMaxDelay * 1e-6, stats.nReceived, stats.nMalformed, stats.nRecovered,
+               stats.fUplinkPeak > 0.f ? 20.f * log10f(stats.fUplinkPeak) : -INFINITY);
+        if (k_Options.bEcho) {
+            printf("jthub: %u timestamps echoed\n", stats.nEchoed);
+        }
+        if (!stats.RoundTrips.empty()) {
+            std::vector<float> &trips{stats.RoundTrips};
+            std::sort(trips.begin(), trips.end());
+            printf("jthub: %u clicks came back; round trip %.2f/%.2f/%.2f ms (min/p50/max)\n",
+                   static_cast<unsigned>(trips.size()), trips.front(), trips[trips.size() / 2], trips.back());
+        }
+        fflush(stdout);
+    }
+
+private:
+    /**
+     * Build a packet, in the format to send in.
+     * @param pPacket
+     * @param pSignal
+     * @param nSeqNumber
+     * @param nStart When the stream started.
+     * @param nFrame Index of the packet's first frame in the stream.
+     * @param fFramePeriod In nanoseconds.
+     */
+    void Fill(u8 *pPacket, CTestSignal *pSignal, u16 nSeqNumber, u64 nStart, u64 nFrame,
+              double fFramePeriod) const
+    {
+        const unsigned nBytes{k_Options.nBits / 8};
+        TJackTripPacketHeader header{
+                // JackTrip stamps packets in microseconds.
+                (nStart + static_cast<u64>((nFrame + k_Options.nFrames) * fFramePeriod)) / 1000,
+                nSeqNumber,
+                static_cast<u16>(k_Options.nFrames),
+                JACKTRIP_SAMPLE_RATE,
+                static_cast<u8>(k_Options.nBits),
+                static_cast<u8>(k_Options.nChannels),
+                static_cast<u8>(k_Options.nChannels)
+        };
+        memcpy(pPacket, &header, PACKET_HEADER_SIZE);
+
+        // Channel-planar, as JackTrip sends it.
+        for (unsigned n{0}; n < k_Options.nFrames; ++n) {
+            float frame[255];
+            pSignal->Generate(frame, nStart + static_cast<u64>((nFrame + n + 1) * fFramePeriod));
+            for (unsigned ch{0}; ch < k_Options.nChannels; ++ch) {
+                PutSample(pPacket + PACKET_HEADER_SIZE + (ch * k_Options.nFrames + n) * nBytes, nBytes, frame[ch]);
+            }
+        }
+    }
+
+    /**
+     * Put the client's newest timestamp in the newest packet of a datagram,
+     * with the time it was held here added, so that the client sees only the
+     * time spent getting here and back. The impairments come after, as they
+     * would on the network.
+     */
+    static void Echo(u8 *pPacket, TSessionStats *pStats)
+    {
+        u64 nHeld{(GetNanoseconds() - pStats->nEchoArrival) / 1000};
+        u64 nTimeStamp{(pStats->nEchoTimeStamp + nHeld) | TIMESTAMP_ECHO};
+        memcpy(pPacket + offsetof(TJackTripPacketHeader, nTimeStamp), &nTimeStamp, sizeof nTimeStamp);
+        ++pStats->nEchoed;
+    }
+
+    /**
+     * Wait until a time, or until something comes from the client.
+     */
+    void WaitUntil(u64 nTime) const
+    {
+        u64 nNow{GetNanoseconds()};
+        if (nTime <= nNow) {
+            return;
+        }
+        pollfd fd{m_nUdpSocket, POLLIN, 0};
+        timespec ts{static_cast<time_t>((nTime - nNow) / 1000000000u),
+                    static_cast<long>((nTime - nNow) % 1000000000u)};
+        ppoll(&fd, 1, &ts, nullptr);
+    }
+
+    void Drain(TSessionStats *pStats)
+    {
+        u8 buffer[k_nPacketSize * MAX_REDUNDANCY];
+        ssize_t nBytes;
+        while ((nBytes = recv(m_nUdpSocket, buffer, sizeof buffer, MSG_DONTWAIT)) >= 0) {
+            ++pStats->nReceived;
+            if (nBytes == 0 || nBytes % k_nPacketSize != 0) {
+                ++pStats->nMalformed;
+                continue;
+            }
+
+            // Oldest first, and only those not seen yet, as the client does.
+            u64 nArrival{GetNanoseconds()};
+            for (int n{static_cast<int>(nBytes / k_nPacketSize) - 1}; n >= 0; --n) {
+                const u8 *pPacket{buffer + n * k_nPacketSize};
+                TJackTripPacketHeader header;
+                memcpy(&header, pPacket, PACKET_HEADER_SIZE);
+                if (header.nBufferSize == 0
+                    || (pStats->bUplinkStarted && static_cast<s16>(header.nSeqNumber - pStats->nUplinkSeqNumber) <= 0)) {
+                    continue;
+                }
+                pStats->bUplinkStarted = true;
+                pStats->nUplinkSeqNumber = header.nSeqNumber;
+                if (n > 0) {
+                    ++pStats->nRecovered;
+                }
+                // The client's own stamps never have the echo flag set.
+                pStats->nEchoTimeStamp = header.nTimeStamp & ~TIMESTAMP_ECHO;
+                pStats->nEchoArrival = nArrival;
+                Analyse(pPacket, nArrival, pStats);
+            }
+        }
+    }
+
+    /**
+     * Look for the test signal's clicks in a packet from the client. A click
+     * is timed as if the hub played the packet as it arrived.
+     */
+    static void Analyse(const u8 *pPacket, u64 nArrival, TSessionStats *pStats)
+    {
+        const double fFramePeriod{1e9 / SAMPLE_RATE};
+        const unsigned clickChannel{WRITE_CHANNELS > 1 ? 1 : 0};
+
+        for (unsigned n{0}; n < AUDIO_BLOCK_FRAMES; ++n, ++pStats->nUplinkFrames) {
+            for (unsigned ch{0}; ch < WRITE_CHANNELS; ++ch) {
+                float x{fabsf(GetSample(pPacket + PACKET_HEADER_SIZE + ch * CHANNEL_QUEUE_SIZE + n * TYPE_SIZE))};
+                if (x > pStats->fUplinkPeak) {
+                    pStats->fUplinkPeak = x;
+                }
+
+                if (ch == clickChannel && x > .1f
+                    && (pStats->nLastClick == 0 || pStats->nUplinkFrames - pStats->nLastClick > SAMPLE_RATE / 100)) {
+                    pStats->nLastClick = pStats->nUplinkFrames;
+                    u64 nTime{nArrival + static_cast<u64>(n * fFramePeriod)};
+                    pStats->RoundTrips.push_back(static_cast<float>(nTime % TEST_CLICK_PERIOD_NS) * 1e-6f);
+                }
+            }
+        }
+    }
+
+    const THubOptions k_Options;
+    const unsigned k_nWirePacketSize;
+    CRandom m_Random;
+
+    int m_nListenSocket{-1};
+    int m_nUdpSocket{-1};
+    sockaddr_in m_Client{};
+};
+
+static void Usage(const char *pProgram)
+{
+    fprintf(stderr, "Usage: %s [-l loss] [-b burst] [-r reorder] [-j ms] [-k ppm] [-s signal] [-f Hz]\n"
+                    "       %*s [-R redundancy] [-F frames] [-B bits] [-C channels] [-t seconds]\n"
+                    "       %*s [-n sessions] [-S seed] [-e]\n"
+                    "  -l  Chance, 0 to 1, that a packet is lost (default 0)\n"
+                    "  -b  Mean length of a run of losses, once one starts (default 1)\n"
+                    "  -r  Fraction of packets to send after the one that follows (default 0)\n"
+                    "  -j  Delay each packet by up to this long, keeping their order (default 0)\n"
+                    "  -k  Run the hub's clock fast (+) or slow (-) by this much (default 0)\n"
+                    "  -s  silence, tone, clicks or test: tone and clicks (default test)\n"
+                    "  -f  Frequency of the tone (default 997)\n"
+                    "  -R  Packets per datagram, as JackTrip's --redundancy (default 1)\n"
+                    "  -F  Frames per packet (default the client's, %u)\n"
+                    "  -B  Bits per sample: 8, 16, 24 or 32 (default the client's, %u)\n"
+                    "  -C  Channels to send (default the client's, %u)\n"
+                    "  -t  Length of each session; 0 for no limit (default 10)\n"
+                    "  -n  Sessions to serve, one after the other (default 1)\n"
+                    "  -S  Random seed (default 1)\n"
+                    "  -e  Echo the client's timestamps, for it to measure latency by\n",
+            pProgram, static_cast<int>(strlen(pProgram)), "", static_cast<int>(strlen(pProgram)), "",
+            AUDIO_BLOCK_FRAMES, JACKTRIP_BIT_RES * 8, WRITE_CHANNELS);
+}
+
+int main(int argc, char **argv)
+{
+    THubOptions options;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:b:r:j:k:s:f:R:F:B:C:t:n:S:eh")) != -1) {
+        switch (opt) {
+            case 'l':
+                options.fLoss = static_cast<float>(atof(optarg));
+                break;
+            case 'b':
+                options.fBurst = static_cast<float>(atof(optarg));
+                break;
+            case 'r':
+                options.fReorder = static_cast<float>(atof(optarg));
+                break;
+            case 'j':
+                options.fJitterMs = static_cast<float>(atof(optarg));
+                break;
+            case 'k':
+                options.fSkewPPM = static_cast<float>(atof(optarg));
+                break;
+            case 's':
+                if (!CTestSignal::Parse(optarg, &options.Signal)) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'f':
+                options.fFrequency = static_cast<float>(atof(optarg));
+                break;
+            case 'R':
+                options.nRedundancy = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 'F':
+                options.nFrames = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 'B':
+                options.nBits = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 'C':
+                options.nChannels = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 't':
+                options.nSeconds = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 'n':
+                options.nSessions = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 'S':
+                options.nSeed = static_cast<u32>(strtoul(optarg, nullptr, 0));
+                break;
+            case 'e':
+                options.bEcho = true;
+                break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (options.fBurst < 1.f) {
+        options.fBurst = 1.f;
+    }
+    if (options.nRedundancy < 1 || options.nRedundancy > MAX_REDUNDANCY) {
+        fprintf(stderr, "jthub: redundancy must be 1 to %u\n", MAX_REDUNDANCY);
+        return 1;
+    }
+    if (options.nBits % 8 != 0 || options.nBits < 8 || options.nBits > 32 || options.nChannels < 1
+        || options.nChannels > 255 || options.nFrames < 1 || options.nFrames > 0xFFFF
+        || (PACKET_HEADER_SIZE + options.nChannels * options.nFrames * options.nBits / 8) * options.nRedundancy
+           > 65507) {
+        fprintf(stderr, "jthub: can't send %u-bit samples, %u channels, %u frames per packet\n",
+                options.nBits, options.nChannels, options.nFrames);
+        return 1;
+    }
+
+    CHub hub{options};
+    if (!hub.Listen()) {
+        return 1;
+    }
+
+    for (unsigned n{0}; options.nSessions == 0 || n < options.nSessions;) {
+        if (hub.Accept()) {
+            hub.Serve();
+            ++n;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_GPIOCLOCK_H
+#define JACKTRIP_HOST_GPIOCLOCK_H
+
+#include <circle/types.h>
+
+enum TGPIOClock
+{
+    GPIOClock0 = 0,
+    GPIOClock1 = 1,
+    GPIOClock2 = 2,
+    GPIOClockPCM = 5,
+    GPIOClockPWM = 6
+};
+
+enum TGPIOClockSource
+{
+    GPIOClockSourceOscillator = 1,
+    GPIOClockSourcePLLC = 5,
+    GPIOClockSourcePLLD = 6,
+    GPIOClockSourceHDMI = 7,
+    GPIOClockSourceUnknown = 16
+};
+
+/**
+ * On the host, starting the PCM clock retunes the simulated I2S device (see
+ * CSoundBaseDevice), so that clock recovery can be exercised.
+ */
+class CGPIOClock
+{
+public:
+    CGPIOClock(TGPIOClock Clock, TGPIOClockSource Source = GPIOClockSourceOscillator);
+
+    void Start(unsigned nDivI, unsigned nDivF = 0, unsigned nMASH = 1);
+
+    void Stop(void);
+
+private:
+    TGPIOClock m_Clock;
+    TGPIOClockSource m_Source;
+};
+
+#endif //JACKTRIP_HOST_GPIOCLOCK_H
@@ -0,0 +1,58 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_LOGGER_H
+#define JACKTRIP_HOST_LOGGER_H
+
+#include <circle/device.h>
+#include <circle/string.h>
+#include <circle/timer.h>
+#include <stdarg.h>
+
+enum TLogSeverity
+{
+    LogPanic,
+    LogError,
+    LogWarning,
+    LogNotice,
+    LogDebug
+};
+
+/**
+ * Writes to stderr. Safe to call from any thread.
+ */
+class CLogger
+{
+public:
+    CLogger(unsigned nLogLevel, CTimer *pTimer = nullptr);
+
+    boolean Initialize(CDevice *pTarget);
+
+    static CLogger *Get(void);
+
+    void Write(const char *pSource, TLogSeverity Severity, const char *pMessage, ...);
+
+    void WriteV(const char *pSource, TLogSeverity Severity, const char *pMessage, va_list Args);
+
+private:
+    unsigned m_nLogLevel;
+
+    static CLogger *s_pThis;
+};
+
+#endif //JACKTRIP_HOST_LOGGER_H
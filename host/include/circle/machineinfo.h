@@ -0,0 +1,35 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_MACHINEINFO_H
+#define JACKTRIP_HOST_MACHINEINFO_H
+
+#include <circle/types.h>
+
+class CMachineInfo
+{
+public:
+    static CMachineInfo *Get(void);
+
+    /**
+     * @return Rate of a GPIO clock source, in Hz, as on a Pi 3.
+     */
+    unsigned GetGPIOClockSourceRate(unsigned nSourceId);
+};
+
+#endif //JACKTRIP_HOST_MACHINEINFO_H
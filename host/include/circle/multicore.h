@@ -0,0 +1,51 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_MULTICORE_H
+#define JACKTRIP_HOST_MULTICORE_H
+
+#include <circle/memory.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+/**
+ * Runs Run() for each secondary core on a thread of its own, the main
+ * program's being core 0. As on the Pi, a core halts once Run() returns, and
+ * can't be stopped otherwise; nor can the class be initialized twice.
+ */
+class CMultiCoreSupport
+{
+public:
+    CMultiCoreSupport(CMemorySystem *pMemorySystem);
+
+    virtual ~CMultiCoreSupport(void);
+
+    /**
+     * Start the secondary cores.
+     */
+    boolean Initialize(void);
+
+    virtual void Run(unsigned nCore) = 0;
+
+    static unsigned ThisCore(void);
+
+private:
+    static void *CoreEntry(void *pParam);
+};
+
+#endif //JACKTRIP_HOST_MULTICORE_H
@@ -0,0 +1,51 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_IPADDRESS_H
+#define JACKTRIP_HOST_IPADDRESS_H
+
+#include <circle/types.h>
+#include <circle/string.h>
+
+#define IP_ADDRESS_SIZE 4
+
+class CIPAddress
+{
+public:
+    CIPAddress(void);
+
+    CIPAddress(u32 nAddress);
+
+    CIPAddress(const u8 *pAddress);
+
+    boolean operator==(const CIPAddress &rAddress2) const;
+
+    operator u32(void) const { return m_nAddress; }
+
+    void Set(const u8 *pAddress);
+
+    void CopyTo(u8 *pBuffer) const;
+
+    void Format(CString *pString) const;
+
+private:
+    // Network byte order.
+    u32 m_nAddress;
+};
+
+#endif //JACKTRIP_HOST_IPADDRESS_H
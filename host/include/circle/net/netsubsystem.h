@@ -0,0 +1,53 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_NETSUBSYSTEM_H
+#define JACKTRIP_HOST_NETSUBSYSTEM_H
+
+#include <circle/types.h>
+#include <circle/net/ipaddress.h>
+
+class CNetConfig
+{
+public:
+    const CIPAddress *GetIPAddress(void) const { return &m_IPAddress; }
+
+private:
+    friend class CNetSubSystem;
+
+    CIPAddress m_IPAddress;
+};
+
+/**
+ * The host's own network stack does the work.
+ */
+class CNetSubSystem
+{
+public:
+    CNetSubSystem(const u8 *pIPAddress = nullptr, const u8 *pNetMask = nullptr,
+                  const u8 *pDefaultGateway = nullptr, const u8 *pDNSServer = nullptr);
+
+    boolean Initialize(boolean bWaitForActivate = TRUE);
+
+    CNetConfig *GetConfig(void) { return &m_Config; }
+
+private:
+    CNetConfig m_Config;
+};
+
+#endif //JACKTRIP_HOST_NETSUBSYSTEM_H
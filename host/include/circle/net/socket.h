@@ -0,0 +1,65 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_SOCKET_H
+#define JACKTRIP_HOST_SOCKET_H
+
+#include <circle/types.h>
+#include <circle/net/in.h>
+#include <circle/net/ipaddress.h>
+#include <circle/net/netsubsystem.h>
+
+/**
+ * A BSD socket. As under Circle, a blocking call lets other tasks run, and
+ * Receive() with MSG_DONTWAIT returns 0 if nothing is available; and it can
+ * be neither copied nor moved, only deleted to close it.
+ */
+class CSocket
+{
+public:
+    CSocket(CNetSubSystem *pNetSubSystem, int nProtocol);
+
+    CSocket(const CSocket &) = delete;
+
+    CSocket &operator=(const CSocket &) = delete;
+
+    ~CSocket(void);
+
+    int Bind(u16 nOwnPort);
+
+    int Connect(CIPAddress &rForeignIP, u16 nForeignPort);
+
+    int Send(const void *pBuffer, unsigned nLength, int nFlags);
+
+    int Receive(void *pBuffer, unsigned nLength, int nFlags);
+
+    /**
+     * @param nMicroSeconds How long a blocking Receive() may wait before
+     * returning 0; 0 to wait indefinitely.
+     * @return 0, or < 0 on error.
+     */
+    int SetOptionReceiveTimeout(unsigned nMicroSeconds);
+
+private:
+    void Close(void);
+
+    int m_nProtocol;
+    int m_hSocket;
+};
+
+#endif //JACKTRIP_HOST_SOCKET_H
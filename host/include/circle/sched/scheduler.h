@@ -0,0 +1,89 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_SCHEDULER_H
+#define JACKTRIP_HOST_SCHEDULER_H
+
+#include <circle/types.h>
+#include <circle/spinlock.h>
+#include <circle/sched/task.h>
+#include <circle/sched/synchronizationevent.h>
+
+/**
+ * Emulates Circle's cooperative scheduler with threads that take turns: a
+ * thread must hold the scheduler's turn to run task code, and gives it up in
+ * Yield(), the sleeps, and blocking waits. Turns are handed out in order, so
+ * a task that yields lets every other ready task run first.
+ *
+ * The thread that constructs the scheduler (the main program) holds the first
+ * turn. Threads that aren't tasks, e.g. the simulated sound device's, stand in
+ * for interrupt handlers and run whenever they like.
+ */
+class CScheduler
+{
+public:
+    CScheduler(void);
+
+    static CScheduler *Get(void);
+
+    void Yield(void);
+
+    void Sleep(unsigned nSeconds);
+
+    void MsSleep(unsigned nMilliSeconds);
+
+    void usSleep(unsigned nMicroSeconds);
+
+    /**
+     * Give up the turn while blocking in the operating system, e.g. in a
+     * socket call, and take a new one afterwards. No-ops for threads that
+     * aren't tasks.
+     */
+    static void BeginBlocking(void);
+
+    static void EndBlocking(void);
+
+    /**
+     * Wait, without the turn, until pCondition(pParam) is true. The condition
+     * is evaluated under the scheduler's internal lock; whatever it reads must
+     * be changed with Notify().
+     * @param pCondition
+     * @param pParam
+     * @param nMicroSeconds Timeout; 0 to wait indefinitely.
+     * @return Whether the condition became true.
+     */
+    static boolean WaitUntil(bool (*pCondition)(void *), void *pParam, unsigned nMicroSeconds = 0);
+
+    /**
+     * Apply a change under the internal lock and wake any waiters.
+     */
+    static void Notify(void (*pChange)(void *), void *pParam);
+
+private:
+    friend class CTask;
+
+    static void TakeTurn(void);
+
+    static void GiveUpTurn(void);
+
+    static void ReapZombies(void);
+
+    static CScheduler *s_pThis;
+};
+
+#endif //JACKTRIP_HOST_SCHEDULER_H
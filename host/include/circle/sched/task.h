@@ -0,0 +1,61 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_TASK_H
+#define JACKTRIP_HOST_TASK_H
+
+#include <circle/types.h>
+
+#define TASK_STACK_SIZE 0x8000
+
+/**
+ * Each task runs on a thread of its own, but only one task -- including the
+ * main program -- runs at a time: a task keeps running until it yields,
+ * sleeps or waits, as it would under Circle's cooperative scheduler.
+ */
+class CTask
+{
+public:
+    CTask(unsigned nStackSize = TASK_STACK_SIZE, boolean bCreateSuspended = FALSE);
+
+    virtual ~CTask(void);
+
+    virtual void Run(void);
+
+    void Start(void);
+
+    boolean IsSuspended(void) const { return m_bSuspended; }
+
+    void SetName(const char *pName);
+
+    const char *GetName(void) const;
+
+    void WaitForTermination(void);
+
+private:
+    friend class CScheduler;
+
+    static void *ThreadEntry(void *pParam);
+
+    char m_Name[32];
+    boolean m_bSuspended;
+    boolean m_bTerminated{false};
+    unsigned m_nWaiters{0};
+};
+
+#endif //JACKTRIP_HOST_TASK_H
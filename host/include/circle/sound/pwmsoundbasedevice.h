@@ -0,0 +1,30 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_PWMSOUNDBASEDEVICE_H
+#define JACKTRIP_HOST_PWMSOUNDBASEDEVICE_H
+
+#include <circle/sound/soundbasedevice.h>
+
+class CPWMSoundBaseDevice : public CSoundBaseDevice
+{
+public:
+    CPWMSoundBaseDevice(CInterruptSystem *pInterrupt, unsigned nSampleRate = 44100, unsigned nChunkSize = 2048);
+};
+
+#endif //JACKTRIP_HOST_PWMSOUNDBASEDEVICE_H
@@ -0,0 +1,150 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_SOUNDBASEDEVICE_H
+#define JACKTRIP_HOST_SOUNDBASEDEVICE_H
+
+#include <circle/types.h>
+#include <circle/interrupt.h>
+#include <stdio.h>
+
+/**
+ * Host only: sees every chunk the simulated sound device plays, e.g. to
+ * analyse the output.
+ */
+class CSoundMonitor
+{
+public:
+    virtual ~CSoundMonitor(void) = default;
+
+    /**
+     * Called on the device's thread, after each GetChunk().
+     * @param pBuffer The chunk, as the device would play it.
+     * @param nWords
+     * @param nRangeMin The device's range.
+     * @param nRangeMax
+     * @param nPlayTime When the chunk's first frame will be heard, in
+     * nanoseconds on CLOCK_MONOTONIC.
+     * @param fFramePeriod The device's current frame period, in nanoseconds.
+     */
+    virtual void OnChunk(const u32 *pBuffer, unsigned nWords, int nRangeMin, int nRangeMax,
+                         u64 nPlayTime, double fFramePeriod) = 0;
+};
+
+/**
+ * A simulated sound device: once started, a thread of its own calls
+ * GetChunk() once per chunk period, paced by CLOCK_MONOTONIC, like the DMA
+ * completion interrupt would. The chunks go nowhere, or to a file. A device
+ * that captures is looped back, as if its output were patched into its
+ * input: PutChunk() gets each chunk once it has played.
+ *
+ * The device's clock can be made to run fast or slow (SetClockSkew()), and an
+ * I2S device follows the PCM clock (see CGPIOClock), so that drift and clock
+ * recovery can be exercised.
+ */
+class CSoundBaseDevice
+{
+public:
+    enum TDeviceMode
+    {
+        DeviceModeTXOnly,
+        DeviceModeRXOnly,
+        DeviceModeTXRX
+    };
+
+    /**
+     * @param nSampleRate
+     * @param nChunkSize In words; two channels per frame.
+     * @param nRangeMin
+     * @param nRangeMax
+     * @param bFollowPCMClock Whether the PCM clock sets the rate.
+     * @param DeviceMode
+     */
+    CSoundBaseDevice(unsigned nSampleRate, unsigned nChunkSize, int nRangeMin, int nRangeMax,
+                     boolean bFollowPCMClock, TDeviceMode DeviceMode = DeviceModeTXOnly);
+
+    virtual ~CSoundBaseDevice(void);
+
+    int GetRangeMin(void) const { return m_nRangeMin; }
+
+    int GetRangeMax(void) const { return m_nRangeMax; }
+
+    boolean Start(void);
+
+    void Cancel(void);
+
+    boolean IsActive(void) const;
+
+    /**
+     * @return Chunks delivered so far.
+     */
+    u64 GetChunkCount(void) const;
+
+    /**
+     * Host only: run every device's clock fast (positive) or slow.
+     * @param fPPM
+     */
+    static void SetClockSkew(float fPPM);
+
+    /**
+     * Host only: append every chunk, as raw 32-bit words, to a file.
+     * @param pFile nullptr to stop.
+     */
+    static void SetOutputFile(FILE *pFile);
+
+    /**
+     * Host only: show every chunk to a monitor.
+     * @param pMonitor nullptr to stop.
+     */
+    static void SetMonitor(CSoundMonitor *pMonitor);
+
+    /**
+     * Host only: the PCM clock has been set to a rate, in Hz, of frames.
+     * @param fFrameRate
+     */
+    static void SetPCMFrameRate(float fFrameRate);
+
+protected:
+    virtual unsigned GetChunk(u32 *pBuffer, unsigned nChunkSize) = 0;
+
+    virtual void PutChunk(const u32 *pBuffer, unsigned nChunkSize);
+
+private:
+    static void *ThreadEntry(void *pParam);
+
+    void Run(void);
+
+    /**
+     * @return Current chunk period, in nanoseconds.
+     */
+    double GetPeriod(void) const;
+
+    const unsigned m_nSampleRate;
+    const unsigned m_nChunkSize;
+    const int m_nRangeMin, m_nRangeMax;
+    const boolean m_bFollowPCMClock;
+    const TDeviceMode m_DeviceMode;
+
+    // Two, as for DMA: one playing while the other is filled.
+    u32 *m_pBuffer[2];
+    unsigned m_nBuffer{0};
+    volatile boolean m_bActive{false};
+    u64 m_nChunkCount{0};
+};
+
+#endif //JACKTRIP_HOST_SOUNDBASEDEVICE_H
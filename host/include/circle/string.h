@@ -0,0 +1,54 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_STRING_H
+#define JACKTRIP_HOST_STRING_H
+
+#include <circle/types.h>
+#include <stdarg.h>
+
+class CString
+{
+public:
+    CString(void);
+
+    CString(const char *pString);
+
+    CString(const CString &rString);
+
+    ~CString(void);
+
+    operator const char *(void) const;
+
+    const char *operator=(const char *pString);
+
+    const CString &operator=(const CString &rString);
+
+    size_t GetLength(void) const;
+
+    void Append(const char *pString);
+
+    void Format(const char *pFormat, ...);
+
+    void FormatV(const char *pFormat, va_list Args);
+
+private:
+    char *m_pBuffer;
+};
+
+#endif //JACKTRIP_HOST_STRING_H
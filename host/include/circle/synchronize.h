@@ -0,0 +1,43 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_SYNCHRONIZE_H
+#define JACKTRIP_HOST_SYNCHRONIZE_H
+
+/**
+ * Mask core 0's interrupts, i.e. keep the sound device's callbacks out, until
+ * LeaveCritical(). Calls nest.
+ */
+void EnterCritical(void);
+
+void LeaveCritical(void);
+
+inline void DataSyncBarrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * As the Arm instructions: each core has an event register, which
+ * SendEvent() sets on every core, and WaitForEvent() waits for and clears.
+ */
+void WaitForEvent(void);
+
+void SendEvent(void);
+
+#endif //JACKTRIP_HOST_SYNCHRONIZE_H
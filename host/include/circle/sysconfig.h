@@ -0,0 +1,28 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_SYSCONFIG_H
+#define JACKTRIP_HOST_SYSCONFIG_H
+
+// The host build can run a secondary core's work, for AUDIO_CORE, on a thread
+// of its own; see multicore.h.
+#define ARM_ALLOW_MULTI_CORE
+
+#define CORES	4
+
+#endif //JACKTRIP_HOST_SYSCONFIG_H
@@ -0,0 +1,54 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_HOST_TIMER_H
+#define JACKTRIP_HOST_TIMER_H
+
+#include <circle/types.h>
+
+#define HZ 100
+
+/**
+ * Time since the process started, from CLOCK_MONOTONIC.
+ */
+class CTimer
+{
+public:
+    CTimer(void);
+
+    static CTimer *Get(void);
+
+    /**
+     * @return Microseconds; wraps, like the Pi's system timer.
+     */
+    static unsigned GetClockTicks(void);
+
+    /**
+     * @return Seconds.
+     */
+    unsigned GetUptime(void) const;
+
+    void MsDelay(unsigned nMilliSeconds);
+
+    void usDelay(unsigned nMicroSeconds);
+
+private:
+    static CTimer *s_pThis;
+};
+
+#endif //JACKTRIP_HOST_TIMER_H
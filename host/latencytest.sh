@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Measures end-to-end latency, hub capture to client output, for combinations
+# of sound device chunk (DMA_CHUNK_FRAMES, built in) and network block (the
+# hub's frames per packet, negotiated), and tabulates it with the underruns
+# it cost. Builds a client per chunk size. Usage:
+#
+#   ./latencytest.sh [seconds per combination]
+#
+# CHUNKS and BLOCKS override the sizes tried; blocks must be multiples of
+# AUDIO_BLOCK_FRAMES.
+#
+
+SECONDS_EACH=${1:-10}
+CHUNKS=${CHUNKS:-16 32 64 128}
+BLOCKS=${BLOCKS:-32 64 128}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+for CHUNK in $CHUNKS; do
+    make -s BUILD="build/chunk$CHUNK" DMA_CHUNK_FRAMES="$CHUNK" jtclient || exit 1
+    mv jtclient "$DIR/jtclient-$CHUNK"
+done
+# Put back the usual client.
+make -s jtclient || exit 1
+
+printf '%6s %6s %9s %9s %9s %22s\n' chunk block underruns overruns glitches "latency p50/p99/max ms"
+
+for CHUNK in $CHUNKS; do
+    for BLOCK in $BLOCKS; do
+        ./jthub -t "$SECONDS_EACH" -F "$BLOCK" > /dev/null &
+        HUB_PID=$!
+        sleep .2
+        "$DIR/jtclient-$CHUNK" -a 997 -t $((SECONDS_EACH + 1)) > "$DIR/log" 2>&1
+        wait $HUB_PID
+
+        sed -n -e 's/.*host: fifo: underruns \([0-9]*\), overruns \([0-9]*\),.*/\1 \2/p' \
+               -e 's/.*tone: .* \([0-9]*\) glitches (.*/\1/p' \
+               -e 's|.*latency [0-9.]*/\([0-9.]*\)/[0-9.]*/\([0-9.]*\)/\([0-9.]*\) ms.*|\1/\2/\3|p' "$DIR/log" |
+            tr '\n' ' ' |
+            { read -r UNDER OVER GLITCHES LATENCY
+              printf '%6s %6s %9s %9s %9s %22s\n' "$CHUNK" "$BLOCK" "$UNDER" "$OVER" "$GLITCHES" "${LATENCY:--}"; }
+    done
+done
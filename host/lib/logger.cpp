@@ -0,0 +1,73 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <circle/logger.h>
+#include <pthread.h>
+#include <stdio.h>
+
+CLogger *CLogger::s_pThis{nullptr};
+
+static pthread_mutex_t s_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+CLogger::CLogger(unsigned nLogLevel, CTimer *pTimer) :
+        m_nLogLevel(nLogLevel)
+{
+    (void) pTimer;
+    if (!s_pThis) {
+        s_pThis = this;
+    }
+}
+
+boolean CLogger::Initialize(CDevice *pTarget)
+{
+    (void) pTarget;
+    return TRUE;
+}
+
+CLogger *CLogger::Get(void)
+{
+    static CLogger logger{LogNotice};
+    return s_pThis ? s_pThis : &logger;
+}
+
+void CLogger::Write(const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+    va_list args;
+    va_start(args, pMessage);
+    WriteV(pSource, Severity, pMessage, args);
+    va_end(args);
+}
+
+void CLogger::WriteV(const char *pSource, TLogSeverity Severity, const char *pMessage, va_list Args)
+{
+    if (static_cast<unsigned>(Severity) > m_nLogLevel) {
+        return;
+    }
+
+    static const char severities[]{"PEWND"};
+    unsigned ticks{CTimer::GetClockTicks()};
+
+    CString message;
+    message.FormatV(pMessage, Args);
+
+    pthread_mutex_lock(&s_Mutex);
+    fprintf(stderr, "%02u:%02u:%02u.%03u %c %s: %s\n",
+            ticks / 3600000000u, ticks / 60000000u % 60, ticks / 1000000u % 60, ticks / 1000u % 1000,
+            severities[Severity], pSource, (const char *) message);
+    pthread_mutex_unlock(&s_Mutex);
+}
@@ -0,0 +1,101 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <circle/multicore.h>
+#include <circle/synchronize.h>
+#include <assert.h>
+#include <pthread.h>
+
+// Masks core 0's interrupts; see EnterCritical().
+static pthread_mutex_t s_InterruptMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+// Protects the event registers; s_EventCond signals any being set.
+static pthread_mutex_t s_EventMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_EventCond = PTHREAD_COND_INITIALIZER;
+static bool s_bEvent[CORES];
+
+static thread_local unsigned t_nCore{0};
+
+static CMultiCoreSupport *s_pThis{nullptr};
+
+CMultiCoreSupport::CMultiCoreSupport(CMemorySystem *pMemorySystem)
+{
+    (void) pMemorySystem;
+}
+
+CMultiCoreSupport::~CMultiCoreSupport(void)
+{
+}
+
+boolean CMultiCoreSupport::Initialize(void)
+{
+    assert(!s_pThis);
+    s_pThis = this;
+
+    for (uintptr nCore = 1; nCore < CORES; ++nCore) {
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, CoreEntry, reinterpret_cast<void *>(nCore)) != 0) {
+            return FALSE;
+        }
+        pthread_detach(thread);
+    }
+
+    return TRUE;
+}
+
+unsigned CMultiCoreSupport::ThisCore(void)
+{
+    return t_nCore;
+}
+
+void *CMultiCoreSupport::CoreEntry(void *pParam)
+{
+    t_nCore = static_cast<unsigned>(reinterpret_cast<uintptr>(pParam));
+    s_pThis->Run(t_nCore);
+    return nullptr;
+}
+
+void EnterCritical(void)
+{
+    pthread_mutex_lock(&s_InterruptMutex);
+}
+
+void LeaveCritical(void)
+{
+    pthread_mutex_unlock(&s_InterruptMutex);
+}
+
+void WaitForEvent(void)
+{
+    pthread_mutex_lock(&s_EventMutex);
+    while (!s_bEvent[t_nCore]) {
+        pthread_cond_wait(&s_EventCond, &s_EventMutex);
+    }
+    s_bEvent[t_nCore] = false;
+    pthread_mutex_unlock(&s_EventMutex);
+}
+
+void SendEvent(void)
+{
+    pthread_mutex_lock(&s_EventMutex);
+    for (bool &bEvent: s_bEvent) {
+        bEvent = true;
+    }
+    pthread_cond_broadcast(&s_EventCond);
+    pthread_mutex_unlock(&s_EventMutex);
+}
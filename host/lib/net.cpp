@@ -0,0 +1,168 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <circle/net/socket.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/sched/scheduler.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+//// IP ADDRESS ///////////////////////////////////////////////////////////////
+
+CIPAddress::CIPAddress(void) :
+        m_nAddress(0)
+{
+}
+
+CIPAddress::CIPAddress(u32 nAddress) :
+        m_nAddress(nAddress)
+{
+}
+
+CIPAddress::CIPAddress(const u8 *pAddress)
+{
+    Set(pAddress);
+}
+
+boolean CIPAddress::operator==(const CIPAddress &rAddress2) const
+{
+    return m_nAddress == rAddress2.m_nAddress;
+}
+
+void CIPAddress::Set(const u8 *pAddress)
+{
+    memcpy(&m_nAddress, pAddress, IP_ADDRESS_SIZE);
+}
+
+void CIPAddress::CopyTo(u8 *pBuffer) const
+{
+    memcpy(pBuffer, &m_nAddress, IP_ADDRESS_SIZE);
+}
+
+void CIPAddress::Format(CString *pString) const
+{
+    u8 address[IP_ADDRESS_SIZE];
+    CopyTo(address);
+    pString->Format("%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
+}
+
+//// NET SUBSYSTEM ////////////////////////////////////////////////////////////
+
+CNetSubSystem::CNetSubSystem(const u8 *pIPAddress, const u8 *pNetMask, const u8 *pDefaultGateway,
+                             const u8 *pDNSServer)
+{
+    (void) pNetMask;
+    (void) pDefaultGateway;
+    (void) pDNSServer;
+
+    static const u8 loopback[]{127, 0, 0, 1};
+    m_Config.m_IPAddress.Set(pIPAddress ? pIPAddress : loopback);
+}
+
+boolean CNetSubSystem::Initialize(boolean bWaitForActivate)
+{
+    (void) bWaitForActivate;
+    return TRUE;
+}
+
+//// SOCKET ///////////////////////////////////////////////////////////////////
+
+CSocket::CSocket(CNetSubSystem *pNetSubSystem, int nProtocol) :
+        m_nProtocol(nProtocol)
+{
+    (void) pNetSubSystem;
+    m_hSocket = socket(AF_INET, nProtocol == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM, nProtocol);
+
+    int nReuse{1};
+    setsockopt(m_hSocket, SOL_SOCKET, SO_REUSEADDR, &nReuse, sizeof nReuse);
+}
+
+CSocket::~CSocket(void)
+{
+    Close();
+}
+
+void CSocket::Close(void)
+{
+    if (m_hSocket >= 0) {
+        close(m_hSocket);
+        m_hSocket = -1;
+    }
+}
+
+int CSocket::Bind(u16 nOwnPort)
+{
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(nOwnPort);
+
+    return bind(m_hSocket, reinterpret_cast<sockaddr *>(&address), sizeof address) < 0 ? -1 : 0;
+}
+
+int CSocket::Connect(CIPAddress &rForeignIP, u16 nForeignPort)
+{
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = rForeignIP;
+    address.sin_port = htons(nForeignPort);
+
+    CScheduler::BeginBlocking();
+    int nResult{connect(m_hSocket, reinterpret_cast<sockaddr *>(&address), sizeof address)};
+    CScheduler::EndBlocking();
+
+    return nResult < 0 ? -1 : 0;
+}
+
+int CSocket::Send(const void *pBuffer, unsigned nLength, int nFlags)
+{
+    int nResult{static_cast<int>(send(m_hSocket, pBuffer, nLength, nFlags | MSG_NOSIGNAL))};
+    if (nResult < 0 && (errno == EAGAIN || errno == ECONNREFUSED)) {
+        // Circle drops datagrams quietly if the peer isn't listening yet.
+        return m_nProtocol == IPPROTO_UDP ? static_cast<int>(nLength) : 0;
+    }
+    return nResult;
+}
+
+int CSocket::Receive(void *pBuffer, unsigned nLength, int nFlags)
+{
+    int nResult;
+    if (nFlags & MSG_DONTWAIT) {
+        nResult = static_cast<int>(recv(m_hSocket, pBuffer, nLength, nFlags));
+    } else {
+        CScheduler::BeginBlocking();
+        nResult = static_cast<int>(recv(m_hSocket, pBuffer, nLength, nFlags));
+        CScheduler::EndBlocking();
+    }
+
+    if (nResult < 0 && (errno == EAGAIN || errno == ECONNREFUSED)) {
+        return 0;
+    }
+    return nResult;
+}
+
+int CSocket::SetOptionReceiveTimeout(unsigned nMicroSeconds)
+{
+    timeval timeout{};
+    timeout.tv_sec = nMicroSeconds / 1000000;
+    timeout.tv_usec = nMicroSeconds % 1000000;
+
+    return setsockopt(m_hSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) < 0 ? -1 : 0;
+}
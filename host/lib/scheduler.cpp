@@ -0,0 +1,310 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <circle/sched/scheduler.h>
+#include <circle/sched/synchronizationevent.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+// Protects the turn counters, event states and task states; s_Cond signals
+// any change to them.
+static pthread_mutex_t s_Mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_Cond = PTHREAD_COND_INITIALIZER;
+static unsigned long s_nNextTurn{0};
+static unsigned long s_nServing{0};
+
+// Set for the main program and task threads, which run in turns.
+static thread_local bool t_bIsTask{false};
+
+// Terminated tasks, deleted once nobody waits for them any more.
+static const unsigned k_nMaxZombies{64};
+static CTask *s_Zombies[k_nMaxZombies];
+static unsigned s_nZombies{0};
+
+CScheduler *CScheduler::s_pThis{nullptr};
+
+void CScheduler::ReapZombies(void)
+{
+    unsigned nKept{0};
+    for (unsigned i = 0; i < s_nZombies; ++i) {
+        if (s_Zombies[i]->m_nWaiters == 0) {
+            delete s_Zombies[i];
+        } else {
+            s_Zombies[nKept++] = s_Zombies[i];
+        }
+    }
+    s_nZombies = nKept;
+}
+
+// With s_Mutex held.
+static void WaitForTurn(void)
+{
+    unsigned long nTurn{s_nNextTurn++};
+    while (s_nServing != nTurn) {
+        pthread_cond_wait(&s_Cond, &s_Mutex);
+    }
+}
+
+// With s_Mutex held.
+static void EndTurn(void)
+{
+    ++s_nServing;
+    pthread_cond_broadcast(&s_Cond);
+}
+
+static void SleepFor(u64 nNanoSeconds)
+{
+    timespec ts{static_cast<time_t>(nNanoSeconds / 1000000000u), static_cast<long>(nNanoSeconds % 1000000000u)};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+CScheduler::CScheduler(void)
+{
+    assert(!s_pThis);
+    s_pThis = this;
+
+    t_bIsTask = true;
+    TakeTurn();
+}
+
+CScheduler *CScheduler::Get(void)
+{
+    assert(s_pThis);
+    return s_pThis;
+}
+
+void CScheduler::TakeTurn(void)
+{
+    pthread_mutex_lock(&s_Mutex);
+    WaitForTurn();
+    pthread_mutex_unlock(&s_Mutex);
+}
+
+void CScheduler::GiveUpTurn(void)
+{
+    pthread_mutex_lock(&s_Mutex);
+    EndTurn();
+    ReapZombies();
+    pthread_mutex_unlock(&s_Mutex);
+}
+
+void CScheduler::Yield(void)
+{
+    if (t_bIsTask) {
+        GiveUpTurn();
+        TakeTurn();
+    } else {
+        sched_yield();
+    }
+}
+
+void CScheduler::Sleep(unsigned nSeconds)
+{
+    usSleep(nSeconds * 1000000);
+}
+
+void CScheduler::MsSleep(unsigned nMilliSeconds)
+{
+    usSleep(nMilliSeconds * 1000);
+}
+
+void CScheduler::usSleep(unsigned nMicroSeconds)
+{
+    BeginBlocking();
+    SleepFor(static_cast<u64>(nMicroSeconds) * 1000);
+    EndBlocking();
+}
+
+void CScheduler::BeginBlocking(void)
+{
+    if (t_bIsTask) {
+        GiveUpTurn();
+    }
+}
+
+void CScheduler::EndBlocking(void)
+{
+    if (t_bIsTask) {
+        TakeTurn();
+    }
+}
+
+boolean CScheduler::WaitUntil(bool (*pCondition)(void *), void *pParam, unsigned nMicroSeconds)
+{
+    timespec deadline;
+    if (nMicroSeconds > 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        u64 nNanoSeconds{deadline.tv_nsec + static_cast<u64>(nMicroSeconds) * 1000};
+        deadline.tv_sec += nNanoSeconds / 1000000000u;
+        deadline.tv_nsec = nNanoSeconds % 1000000000u;
+    }
+
+    pthread_mutex_lock(&s_Mutex);
+    if (t_bIsTask) {
+        EndTurn();
+    }
+
+    bool bResult;
+    while (!(bResult = pCondition(pParam))) {
+        if (nMicroSeconds == 0) {
+            pthread_cond_wait(&s_Cond, &s_Mutex);
+        } else if (pthread_cond_timedwait(&s_Cond, &s_Mutex, &deadline) == ETIMEDOUT) {
+            bResult = pCondition(pParam);
+            break;
+        }
+    }
+
+    if (t_bIsTask) {
+        WaitForTurn();
+    }
+    pthread_mutex_unlock(&s_Mutex);
+
+    return bResult;
+}
+
+void CScheduler::Notify(void (*pChange)(void *), void *pParam)
+{
+    pthread_mutex_lock(&s_Mutex);
+    pChange(pParam);
+    pthread_cond_broadcast(&s_Cond);
+    pthread_mutex_unlock(&s_Mutex);
+}
+
+//// TASK /////////////////////////////////////////////////////////////////////
+
+CTask::CTask(unsigned nStackSize, boolean bCreateSuspended) :
+        m_Name{"task"},
+        m_bSuspended(bCreateSuspended)
+{
+    (void) nStackSize;
+    if (!m_bSuspended) {
+        m_bSuspended = TRUE;
+        Start();
+    }
+}
+
+CTask::~CTask(void)
+{
+}
+
+void CTask::Run(void)
+{
+}
+
+void CTask::Start(void)
+{
+    if (!m_bSuspended) {
+        return;
+    }
+    m_bSuspended = FALSE;
+
+    // The new thread waits for its turn, which can't come before the creator
+    // (holding the current turn) has finished constructing the task.
+    pthread_t thread;
+    int nResult{pthread_create(&thread, nullptr, ThreadEntry, this)};
+    assert(nResult == 0);
+    (void) nResult;
+    pthread_detach(thread);
+}
+
+void CTask::SetName(const char *pName)
+{
+    strncpy(m_Name, pName, sizeof m_Name - 1);
+    m_Name[sizeof m_Name - 1] = '\0';
+}
+
+const char *CTask::GetName(void) const
+{
+    return m_Name;
+}
+
+void CTask::WaitForTermination(void)
+{
+    pthread_mutex_lock(&s_Mutex);
+    ++m_nWaiters;
+    if (t_bIsTask) {
+        EndTurn();
+    }
+    while (!m_bTerminated) {
+        pthread_cond_wait(&s_Cond, &s_Mutex);
+    }
+    --m_nWaiters;
+    if (t_bIsTask) {
+        WaitForTurn();
+    }
+    pthread_mutex_unlock(&s_Mutex);
+}
+
+void *CTask::ThreadEntry(void *pParam)
+{
+    auto *pThis = static_cast<CTask *>(pParam);
+
+    t_bIsTask = true;
+    CScheduler::TakeTurn();
+
+    pThis->Run();
+
+    pthread_mutex_lock(&s_Mutex);
+    pThis->m_bTerminated = TRUE;
+    assert(s_nZombies < k_nMaxZombies);
+    s_Zombies[s_nZombies++] = pThis;
+    EndTurn();
+    pthread_mutex_unlock(&s_Mutex);
+
+    return nullptr;
+}
+
+//// SYNCHRONIZATION EVENT ////////////////////////////////////////////////////
+
+CSynchronizationEvent::CSynchronizationEvent(boolean bState) :
+        m_bState(bState)
+{
+}
+
+boolean CSynchronizationEvent::GetState(void)
+{
+    return m_bState;
+}
+
+void CSynchronizationEvent::Clear(void)
+{
+    CScheduler::Notify([](void *pParam) { static_cast<CSynchronizationEvent *>(pParam)->m_bState = FALSE; }, this);
+}
+
+void CSynchronizationEvent::Set(void)
+{
+    CScheduler::Notify([](void *pParam) { static_cast<CSynchronizationEvent *>(pParam)->m_bState = TRUE; }, this);
+}
+
+void CSynchronizationEvent::Wait(void)
+{
+    CScheduler::WaitUntil([](void *pParam) -> bool { return static_cast<CSynchronizationEvent *>(pParam)->m_bState; },
+                          this);
+}
+
+boolean CSynchronizationEvent::WaitWithTimeout(unsigned nMicroSeconds)
+{
+    return !CScheduler::WaitUntil(
+            [](void *pParam) -> bool { return static_cast<CSynchronizationEvent *>(pParam)->m_bState; },
+            this, nMicroSeconds > 0 ? nMicroSeconds : 1);
+}
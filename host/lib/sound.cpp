@@ -0,0 +1,262 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <circle/sound/pwmsoundbasedevice.h>
+#include <circle/sound/i2ssoundbasedevice.h>
+#include <circle/gpioclock.h>
+#include <circle/machineinfo.h>
+#include <circle/synchronize.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+// Written by the main program or a task, read by the device threads.
+static volatile float s_fSkewPPM{0.f};
+static volatile float s_fPCMFrameRate{0.f};
+static FILE *volatile s_pOutputFile{nullptr};
+static CSoundMonitor *volatile s_pMonitor{nullptr};
+
+static u64 GetNanoseconds(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<u64>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
+CSoundBaseDevice::CSoundBaseDevice(unsigned nSampleRate, unsigned nChunkSize, int nRangeMin, int nRangeMax,
+                                   boolean bFollowPCMClock, TDeviceMode DeviceMode) :
+        m_nSampleRate(nSampleRate),
+        m_nChunkSize(nChunkSize),
+        m_nRangeMin(nRangeMin),
+        m_nRangeMax(nRangeMax),
+        m_bFollowPCMClock(bFollowPCMClock),
+        m_DeviceMode(DeviceMode),
+        m_pBuffer{new u32[nChunkSize](), new u32[nChunkSize]()}
+{
+}
+
+CSoundBaseDevice::~CSoundBaseDevice(void)
+{
+    Cancel();
+    delete[] m_pBuffer[0];
+    delete[] m_pBuffer[1];
+}
+
+boolean CSoundBaseDevice::Start(void)
+{
+    if (m_bActive) {
+        return TRUE;
+    }
+    m_bActive = TRUE;
+
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, ThreadEntry, this) != 0) {
+        m_bActive = FALSE;
+        return FALSE;
+    }
+    pthread_detach(thread);
+
+    return TRUE;
+}
+
+void CSoundBaseDevice::Cancel(void)
+{
+    m_bActive = FALSE;
+}
+
+boolean CSoundBaseDevice::IsActive(void) const
+{
+    return m_bActive;
+}
+
+u64 CSoundBaseDevice::GetChunkCount(void) const
+{
+    return __atomic_load_n(&m_nChunkCount, __ATOMIC_RELAXED);
+}
+
+void CSoundBaseDevice::SetClockSkew(float fPPM)
+{
+    s_fSkewPPM = fPPM;
+}
+
+void CSoundBaseDevice::SetOutputFile(FILE *pFile)
+{
+    s_pOutputFile = pFile;
+}
+
+void CSoundBaseDevice::SetMonitor(CSoundMonitor *pMonitor)
+{
+    s_pMonitor = pMonitor;
+}
+
+void CSoundBaseDevice::SetPCMFrameRate(float fFrameRate)
+{
+    s_fPCMFrameRate = fFrameRate;
+}
+
+void *CSoundBaseDevice::ThreadEntry(void *pParam)
+{
+    static_cast<CSoundBaseDevice *>(pParam)->Run();
+    return nullptr;
+}
+
+void CSoundBaseDevice::Run(void)
+{
+    double fDeadline{static_cast<double>(GetNanoseconds())};
+
+    while (m_bActive) {
+        double fPeriod{GetPeriod()};
+        fDeadline += fPeriod;
+
+        u64 nDeadline{static_cast<u64>(fDeadline)};
+        timespec ts{static_cast<time_t>(nDeadline / 1000000000u), static_cast<long>(nDeadline % 1000000000u)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        }
+
+        // Like a DMA underrun: if we were held up for a long time, e.g. in a
+        // debugger, carry on from now rather than trying to catch up.
+        u64 nNow{GetNanoseconds()};
+        if (nNow > nDeadline + 10 * fPeriod) {
+            fDeadline = static_cast<double>(nNow);
+        }
+
+        // The buffer about to be refilled has just played out; that's what
+        // the input has just heard.
+        u32 *pBuffer{m_pBuffer[m_nBuffer]};
+        m_nBuffer ^= 1;
+
+        // As in the interrupt handler, which EnterCritical() holds off.
+        EnterCritical();
+        if (m_DeviceMode != DeviceModeTXOnly) {
+            PutChunk(pBuffer, m_nChunkSize);
+        }
+
+        unsigned nWords{m_nChunkSize};
+        if (m_DeviceMode != DeviceModeRXOnly) {
+            nWords = GetChunk(pBuffer, m_nChunkSize);
+            assert(nWords <= m_nChunkSize);
+        }
+        LeaveCritical();
+
+        FILE *pFile{s_pOutputFile};
+        if (pFile) {
+            fwrite(pBuffer, sizeof(u32), nWords, pFile);
+        }
+
+        // With two DMA buffers, as in Circle, the chunk asked for now plays
+        // once the one before it has played out.
+        CSoundMonitor *pMonitor{s_pMonitor};
+        if (pMonitor) {
+            pMonitor->OnChunk(pBuffer, nWords, m_nRangeMin, m_nRangeMax,
+                              static_cast<u64>(fDeadline + fPeriod), fPeriod / (m_nChunkSize / 2));
+        }
+
+        __atomic_fetch_add(&m_nChunkCount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void CSoundBaseDevice::PutChunk(const u32 *pBuffer, unsigned nChunkSize)
+{
+    (void) pBuffer;
+    (void) nChunkSize;
+}
+
+double CSoundBaseDevice::GetPeriod(void) const
+{
+    double fRate{static_cast<double>(m_nSampleRate)};
+    if (m_bFollowPCMClock && s_fPCMFrameRate > 0.f) {
+        fRate = s_fPCMFrameRate;
+    }
+    fRate *= 1. + s_fSkewPPM * 1e-6;
+
+    // Two channels per frame.
+    return m_nChunkSize / 2 * 1e9 / fRate;
+}
+
+//// PWM //////////////////////////////////////////////////////////////////////
+
+// The PWM clock runs at 125 MHz on a Pi 3; its range is one sample period.
+static const unsigned k_nPWMClockRate{125000000};
+
+CPWMSoundBaseDevice::CPWMSoundBaseDevice(CInterruptSystem *pInterrupt, unsigned nSampleRate, unsigned nChunkSize) :
+        CSoundBaseDevice(nSampleRate, nChunkSize, 0,
+                         static_cast<int>((k_nPWMClockRate + nSampleRate / 2) / nSampleRate) - 1, FALSE)
+{
+    (void) pInterrupt;
+}
+
+//// I2S //////////////////////////////////////////////////////////////////////
+
+CI2SSoundBaseDevice::CI2SSoundBaseDevice(CInterruptSystem *pInterrupt, unsigned nSampleRate, unsigned nChunkSize,
+                                         boolean bSlave, CI2CMaster *pI2CMaster, u8 ucI2CAddress,
+                                         TDeviceMode DeviceMode) :
+        CSoundBaseDevice(nSampleRate, nChunkSize, -(1 << 23) + 1, (1 << 23) - 1, TRUE, DeviceMode)
+{
+    (void) pInterrupt;
+    (void) bSlave;
+    (void) pI2CMaster;
+    (void) ucI2CAddress;
+}
+
+//// GPIO CLOCK ///////////////////////////////////////////////////////////////
+
+CGPIOClock::CGPIOClock(TGPIOClock Clock, TGPIOClockSource Source) :
+        m_Clock(Clock),
+        m_Source(Source)
+{
+}
+
+void CGPIOClock::Start(unsigned nDivI, unsigned nDivF, unsigned nMASH)
+{
+    (void) nMASH;
+    if (m_Clock != GPIOClockPCM || nDivI == 0) {
+        return;
+    }
+
+    // 32-bit samples, two channels per frame.
+    double fDivider{nDivI + nDivF / 4096.};
+    CSoundBaseDevice::SetPCMFrameRate(static_cast<float>(
+            CMachineInfo::Get()->GetGPIOClockSourceRate(m_Source) / fDivider / 64));
+}
+
+void CGPIOClock::Stop(void)
+{
+}
+
+//// MACHINE INFO /////////////////////////////////////////////////////////////
+
+CMachineInfo *CMachineInfo::Get(void)
+{
+    static CMachineInfo info;
+    return &info;
+}
+
+unsigned CMachineInfo::GetGPIOClockSourceRate(unsigned nSourceId)
+{
+    switch (nSourceId) {
+        case GPIOClockSourceOscillator:
+            return 19200000;
+        case GPIOClockSourcePLLC:
+            return 1000000000;
+        case GPIOClockSourcePLLD:
+            return 500000000;
+        default:
+            return 0;
+    }
+}
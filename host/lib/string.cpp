@@ -0,0 +1,94 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <circle/string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+CString::CString(void) :
+        m_pBuffer(strdup(""))
+{
+}
+
+CString::CString(const char *pString) :
+        m_pBuffer(strdup(pString))
+{
+}
+
+CString::CString(const CString &rString) :
+        m_pBuffer(strdup(rString.m_pBuffer))
+{
+}
+
+CString::~CString(void)
+{
+    free(m_pBuffer);
+}
+
+CString::operator const char *(void) const
+{
+    return m_pBuffer;
+}
+
+const char *CString::operator=(const char *pString)
+{
+    char *pBuffer{strdup(pString)};
+    free(m_pBuffer);
+    m_pBuffer = pBuffer;
+    return m_pBuffer;
+}
+
+const CString &CString::operator=(const CString &rString)
+{
+    if (this != &rString) {
+        *this = rString.m_pBuffer;
+    }
+    return *this;
+}
+
+size_t CString::GetLength(void) const
+{
+    return strlen(m_pBuffer);
+}
+
+void CString::Append(const char *pString)
+{
+    size_t nLength{strlen(m_pBuffer)};
+    size_t nAppend{strlen(pString)};
+    m_pBuffer = static_cast<char *>(realloc(m_pBuffer, nLength + nAppend + 1));
+    memcpy(m_pBuffer + nLength, pString, nAppend + 1);
+}
+
+void CString::Format(const char *pFormat, ...)
+{
+    va_list args;
+    va_start(args, pFormat);
+    FormatV(pFormat, args);
+    va_end(args);
+}
+
+void CString::FormatV(const char *pFormat, va_list Args)
+{
+    char *pBuffer;
+    if (vasprintf(&pBuffer, pFormat, Args) < 0) {
+        pBuffer = strdup("");
+    }
+    free(m_pBuffer);
+    m_pBuffer = pBuffer;
+}
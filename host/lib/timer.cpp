@@ -0,0 +1,72 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <circle/timer.h>
+#include <circle/bcmrandom.h>
+#include <stdlib.h>
+#include <time.h>
+
+CTimer *CTimer::s_pThis{nullptr};
+
+static u64 GetNanoseconds(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<u64>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
+static const u64 s_nStart{GetNanoseconds()};
+
+CTimer::CTimer(void)
+{
+    if (!s_pThis) {
+        s_pThis = this;
+    }
+}
+
+CTimer *CTimer::Get(void)
+{
+    static CTimer timer;
+    return s_pThis ? s_pThis : &timer;
+}
+
+unsigned CTimer::GetClockTicks(void)
+{
+    return static_cast<unsigned>((GetNanoseconds() - s_nStart) / 1000);
+}
+
+unsigned CTimer::GetUptime(void) const
+{
+    return static_cast<unsigned>((GetNanoseconds() - s_nStart) / 1000000000u);
+}
+
+void CTimer::MsDelay(unsigned nMilliSeconds)
+{
+    usDelay(nMilliSeconds * 1000);
+}
+
+void CTimer::usDelay(unsigned nMicroSeconds)
+{
+    timespec ts{static_cast<time_t>(nMicroSeconds / 1000000), static_cast<long>(nMicroSeconds % 1000000) * 1000};
+    nanosleep(&ts, nullptr);
+}
+
+u32 CBcmRandomNumberGenerator::GetNumber(void)
+{
+    return static_cast<u32>(random());
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Runs the client against the stand-in hub under a series of impairments and
+# tabulates what the client heard. Build first (make). Usage:
+#
+#   ./loadtest.sh [seconds per scenario]
+#
+
+SECONDS_EACH=${1:-20}
+LOG=$(mktemp)
+trap 'rm -f "$LOG"' EXIT
+
+# name, hub options, client options
+SCENARIOS="
+clean||
+loss-1%|-l .01|
+loss-5%|-l .05|
+loss-10%|-l .1|
+loss-1%-redundancy-2|-l .01 -R 2|
+loss-5%-redundancy-2|-l .05 -R 2|
+loss-10%-redundancy-2|-l .1 -R 2|
+burst-loss|-l .01 -b 4|
+burst-loss-redundancy-3|-l .01 -b 4 -R 3|
+reorder-1%|-r .01|
+jitter-2ms|-j 2|
+jitter-5ms|-j 5|
+hub-fast-200ppm|-k 200|
+device-fast-200ppm||-k 200
+pwm-hub-fast-100ppm|-k 100|-d pwm
+"
+
+printf '%-24s %9s %9s %7s %9s %12s %22s\n' scenario underruns overruns lost glitches glitches/min \
+    "latency p50/p99/max ms"
+
+echo "$SCENARIOS" | while IFS='|' read -r NAME HUB CLIENT; do
+    [ -n "$NAME" ] || continue
+
+    # shellcheck disable=SC2086
+    ./jthub -t "$SECONDS_EACH" $HUB > /dev/null &
+    HUB_PID=$!
+    sleep .2
+    # shellcheck disable=SC2086
+    ./jtclient -a 997 -t $((SECONDS_EACH + 1)) $CLIENT > "$LOG" 2>&1
+    wait $HUB_PID
+
+    sed -n -e 's/.*host: fifo: underruns \([0-9]*\), overruns \([0-9]*\),.*/\1 \2/p' \
+           -e 's/.*host: packets: lost \([0-9]*\),.*/\1/p' \
+           -e 's/.*tone: .* \([0-9]*\) glitches (\([0-9.]*\) per minute).*/\1 \2/p' \
+           -e 's|.*latency [0-9.]*/\([0-9.]*\)/[0-9.]*/\([0-9.]*\)/\([0-9.]*\) ms.*|\1/\2/\3|p' "$LOG" |
+        tr '\n' ' ' |
+        { read -r UNDER OVER LOST GLITCHES RATE LATENCY
+          printf '%-24s %9s %9s %7s %9s %12s %22s\n' "$NAME" "$UNDER" "$OVER" "$LOST" "$GLITCHES" "$RATE" \
+              "${LATENCY:--}"; }
+done
@@ -0,0 +1,182 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs the client as a Linux process, against a JackTrip hub server on
+// SERVER_IP (see Makefile), with a simulated sound device.
+
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/sched/scheduler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "JackTripClient.h"
+#include "PlaybackAnalyser.h"
+
+static const char FromHost[] = "host";
+
+static void Usage(const char *pProgram)
+{
+    fprintf(stderr, "Usage: %s [-d i2s|pwm] [-k ppm] [-o file] [-a Hz] [-t seconds] [-l level] [-g gain]\n"
+                    "          [-m gain]\n"
+                    "  -d  Sound device to simulate (default i2s)\n"
+                    "  -k  Run the sound device's clock fast (+) or slow (-) by this much\n"
+                    "  -o  Write the sound device's output to a file, as raw 32-bit words\n"
+                    "  -a  Analyse the output for jthub's test signal, with a tone of this\n"
+                    "      frequency (jthub -f; default 997), and report glitches and latency\n"
+                    "  -t  Exit after this many seconds (default: run until killed)\n"
+                    "  -l  Log level, 0 (panic) to 4 (debug) (default 3)\n"
+                    "  -g  Set the mixer's master gain to this, once started (MIXER)\n"
+                    "  -m  Mix this much of the captured input into the output (MIXER)\n", pProgram);
+}
+
+int main(int argc, char **argv)
+{
+    const char *pSoundDevice{"i2s"};
+    const char *pOutputFile{nullptr};
+    unsigned nSeconds{0};
+    unsigned nLogLevel{LogNotice};
+    float fAnalyseFrequency{0.f};
+    float fMaster{-1.f}, fMonitor{0.f};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:k:o:a:t:l:g:m:h")) != -1) {
+        switch (opt) {
+            case 'd':
+                pSoundDevice = optarg;
+                break;
+            case 'k':
+                CSoundBaseDevice::SetClockSkew(static_cast<float>(atof(optarg)));
+                break;
+            case 'o':
+                pOutputFile = optarg;
+                break;
+            case 'a':
+                fAnalyseFrequency = static_cast<float>(atof(optarg));
+                break;
+            case 't':
+                nSeconds = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 'l':
+                nLogLevel = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 'g':
+                fMaster = static_cast<float>(atof(optarg));
+                break;
+            case 'm':
+                fMonitor = static_cast<float>(atof(optarg));
+                break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    FILE *pFile{nullptr};
+    if (pOutputFile) {
+        pFile = fopen(pOutputFile, "wb");
+        if (!pFile) {
+            perror(pOutputFile);
+            return 1;
+        }
+        CSoundBaseDevice::SetOutputFile(pFile);
+    }
+
+    CPlaybackAnalyser *pAnalyser{nullptr};
+    if (fAnalyseFrequency > 0.f) {
+        pAnalyser = new CPlaybackAnalyser(fAnalyseFrequency, DEVICE_SAMPLE_RATE, DEVICE_CHANNELS);
+        CSoundBaseDevice::SetMonitor(pAnalyser);
+    }
+
+    CTimer timer;
+    CLogger logger(nLogLevel, &timer);
+    CScheduler scheduler;
+    CNetSubSystem net;
+
+    new CLogFlushTask(&logger);
+
+    if (PROFILING) {
+        CProfiler::EnableCounter();
+    }
+
+    CJackTripClient *pJTC;
+    if (strcmp(pSoundDevice, "pwm") == 0) {
+        pJTC = new JackTripClientPWM(&logger, &net, nullptr, nullptr);
+    } else {
+        pSoundDevice = "i2s";
+        pJTC = new JackTripClientI2S(&logger, &net, nullptr, nullptr, nullptr);
+    }
+
+    logger.Write(FromHost, LogNotice, "Instantiated %s sound device", pSoundDevice);
+
+    if (!pJTC->Initialize() || !pJTC->Start()) {
+        logger.Write(FromHost, LogPanic, "Failed to start JackTrip client.");
+        return 1;
+    }
+
+    logger.Write(FromHost, LogNotice, "Started JackTrip client. Sample rate %u, block size %u, DMA chunk %u, "
+                                      "num channels %u.",
+                 SAMPLE_RATE, AUDIO_BLOCK_FRAMES, DMA_CHUNK_FRAMES, WRITE_CHANNELS);
+    logger.Write(FromHost, LogNotice, "Audio arena: %u of %u bytes used.", CAudioArena::GetUsed(), AUDIO_ARENA_BYTES);
+
+    // From this, the main task, as a control surface would.
+    if (!MIXER && (fMaster >= 0.f || fMonitor > 0.f)) {
+        logger.Write(FromHost, LogWarning, "Built without the MIXER; ignoring -g and -m.");
+    } else if (fMaster >= 0.f) {
+        pJTC->GetMixer().SetMaster(fMaster);
+    }
+    if (fMonitor > 0.f) {
+        pJTC->GetMixer().SetMonitor(fMonitor);
+    }
+
+    while (pJTC->IsActive()) {
+        pJTC->Run();
+
+        if (nSeconds > 0 && timer.GetUptime() >= nSeconds) {
+            break;
+        }
+    }
+
+    const CJackTripClient::TFIFO &fifo{pJTC->GetFIFO()};
+    logger.Write(FromHost, LogNotice, "fifo: underruns %u, overruns %u, slip %d frames",
+                 fifo.GetUnderruns(), fifo.GetOverruns(), fifo.GetSlip());
+    const CSequenceTracker &sequence{pJTC->GetSequenceTracker()};
+    logger.Write(FromHost, LogNotice, "packets: lost %u, late %u, duplicate %u, reordered %u; "
+                                      "%u recovered from redundancy, %u blocks concealed",
+                 sequence.GetLost(), sequence.GetLate(), sequence.GetDuplicates(), sequence.GetReordered(),
+                 pJTC->GetRecovered(), pJTC->GetLossConcealer().GetConcealed());
+    pJTC->GetLatencyMonitor().Dump(&logger);
+    if (pAnalyser) {
+        pAnalyser->Report(&logger);
+    }
+
+    // Give the flush task a moment to write out what's left.
+    scheduler.MsSleep(2 * LOG_FLUSH_MS);
+
+    if (pFile) {
+        CSoundBaseDevice::SetOutputFile(nullptr);
+        fclose(pFile);
+    }
+
+    // The tasks and the sound device's thread never finish; leave without
+    // running destructors under their feet.
+    fflush(stderr);
+    _exit(0);
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Measures how soon the client plays again after the hub restarts: the time
+# from the new hub coming up to the client's output carrying its tone. The
+# hub is killed rather than let send the exit packet, as in a crash, so the
+# client first has to notice that the stream has stopped. Build first (make).
+# Usage:
+#
+#   ./restarttest.sh [restarts] [seconds down]
+#
+
+RESTARTS=${1:-5}
+DOWN=${2:-1}
+UP=3
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+./jthub -t 0 > "$DIR/hub0" &
+HUB_PID=$!
+sleep .2
+./jtclient -a 997 -t $((RESTARTS * (UP + DOWN) + UP)) > "$DIR/client" 2>&1 &
+CLIENT_PID=$!
+
+N=1
+while [ $N -le "$RESTARTS" ]; do
+    sleep $UP
+    kill -9 $HUB_PID
+    wait $HUB_PID 2> /dev/null
+    sleep "$DOWN"
+    ./jthub -t 0 > "$DIR/hub$N" &
+    HUB_PID=$!
+    N=$((N + 1))
+done
+
+wait $CLIENT_PID
+kill $HUB_PID
+wait $HUB_PID 2> /dev/null
+
+# For each hub, the first time the tone started after it came up.
+sed -n 's/.*analyser: tone: started at \([0-9.]*\) ms.*/\1/p' "$DIR/client" > "$DIR/onsets"
+printf '%8s %22s\n' hub "ms to first audio"
+N=0
+while [ $N -le "$RESTARTS" ]; do
+    sed -n 's/^jthub: up at \([0-9.]*\) ms.*/\1/p' "$DIR/hub$N" |
+        awk -v n=$N -v onsets="$DIR/onsets" '
+            { up = $1 }
+            END {
+                while ((getline t < onsets) > 0) {
+                    if (t + 0 > up + 0) { printf "%8s %22.1f\n", n == 0 ? "first" : "restart" n, t - up; exit }
+                }
+                printf "%8s %22s\n", n == 0 ? "first" : "restart" n, "-"
+            }'
+    N=$((N + 1))
+done
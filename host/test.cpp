@@ -0,0 +1,1843 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks of the client's building blocks that need no network or sound
+// device, e.g. the sequence tracker's bookkeeping. Each prints what it
+// measured; any check that fails is reported, and fails the run. Build
+// first (make), then: make check, or ./jttest [name...].
+
+#include <circle/types.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include "config.h"
+#include "AudioArena.h"
+#include "AudioCore.h"
+#include "BlockRing.h"
+#include "convert.h"
+#include "fifo.h"
+#include "JitterTuner.h"
+#include "LatencyMonitor.h"
+#include "LogRing.h"
+#include "LossConcealer.h"
+#include "Mixer.h"
+#include "RateController.h"
+#include "Resampler.h"
+#include "SequenceTracker.h"
+#include "StreamFormat.h"
+
+static unsigned s_nChecks{0}, s_nFailures{0};
+
+static void Check(bool bPassed, const char *pWhat, const char *pFile, int nLine)
+{
+    ++s_nChecks;
+    if (!bPassed) {
+        ++s_nFailures;
+        printf("  FAILED: %s (%s:%d)\n", pWhat, pFile, nLine);
+    }
+}
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+/**
+ * xorshift32, for repeatable test data.
+ */
+static u32 Random(u32 *pState)
+{
+    *pState ^= *pState << 13;
+    *pState ^= *pState >> 17;
+    *pState ^= *pState << 5;
+    return *pState;
+}
+
+//// Sequence tracker /////////////////////////////////////////////////////////
+
+static CSequenceTracker::TArrival Track(CSequenceTracker *pTracker, u16 nSeqNumber)
+{
+    unsigned nDistance;
+    return pTracker->Track(nSeqNumber, nDistance);
+}
+
+/**
+ * Gaps, late packets filling them, duplicates, and wrapping.
+ */
+static void TestSequence()
+{
+    CSequenceTracker tracker{8};
+    unsigned nDistance;
+
+    CHECK(tracker.Track(65534, nDistance) == CSequenceTracker::InOrder);
+    CHECK(Track(&tracker, 65535) == CSequenceTracker::InOrder);
+    CHECK(tracker.Track(2, nDistance) == CSequenceTracker::AfterGap && nDistance == 2);
+    CHECK(tracker.GetLost() == 2);
+    CHECK(tracker.IsNew(0) && tracker.IsNew(1) && !tracker.IsNew(65535));
+    CHECK(tracker.Track(0, nDistance) == CSequenceTracker::OutOfOrder && nDistance == 2);
+    CHECK(tracker.GetLost() == 1);
+    CHECK(Track(&tracker, 0) == CSequenceTracker::Duplicate);
+    CHECK(Track(&tracker, 2) == CSequenceTracker::Duplicate);
+    CHECK(Track(&tracker, 65534) == CSequenceTracker::Duplicate);
+    CHECK(tracker.GetDuplicates() == 3);
+
+    // Out of the window.
+    for (u16 n{3}; n < 12; ++n) {
+        CHECK(Track(&tracker, n) == CSequenceTracker::InOrder);
+    }
+    CHECK(Track(&tracker, 1) == CSequenceTracker::TooLate);
+    CHECK(tracker.GetLost() == 1 && tracker.GetLate() == 1);
+}
+
+/**
+ * After Reset(), nothing older than the first packet has a place: a packet
+ * from the old stream is late, not a loss recovered, and isn't counted off
+ * the losses.
+ */
+static void TestSequenceReset()
+{
+    CSequenceTracker tracker{8};
+    unsigned nDistance;
+
+    for (u16 n{100}; n < 110; ++n) {
+        Track(&tracker, n);
+    }
+    tracker.Reset();
+
+    CHECK(Track(&tracker, 500) == CSequenceTracker::InOrder);
+    CHECK(!tracker.IsNew(499));
+    CHECK(tracker.Track(499, nDistance) == CSequenceTracker::TooLate);
+    CHECK(Track(&tracker, 495) == CSequenceTracker::TooLate);
+    CHECK(tracker.GetLost() == 0 && tracker.GetLate() == 2 && tracker.GetReordered() == 0);
+    CHECK(Track(&tracker, 501) == CSequenceTracker::InOrder);
+}
+
+/**
+ * A jump further than the window is a restarted stream: the same as a reset,
+ * but a gap after it is held, and a reordered packet goes into it.
+ */
+static void TestSequenceJump()
+{
+    CSequenceTracker tracker{8};
+    unsigned nDistance;
+
+    for (u16 n{0}; n < 10; ++n) {
+        Track(&tracker, n);
+    }
+    CHECK(Track(&tracker, 1000) == CSequenceTracker::InOrder);
+    CHECK(Track(&tracker, 999) == CSequenceTracker::TooLate);
+
+    // 1001 and 1002 swap places.
+    CHECK(tracker.Track(1002, nDistance) == CSequenceTracker::AfterGap && nDistance == 1);
+    CHECK(tracker.GetLost() == 1);
+    CHECK(tracker.IsNew(1001));
+    CHECK(tracker.Track(1001, nDistance) == CSequenceTracker::OutOfOrder && nDistance == 1);
+    tracker.OnOutOfOrder(true);
+    CHECK(tracker.GetLost() == 0 && tracker.GetReordered() == 1);
+    CHECK(Track(&tracker, 1001) == CSequenceTracker::Duplicate);
+    CHECK(Track(&tracker, 998) == CSequenceTracker::TooLate);
+    CHECK(tracker.GetLost() == 0 && tracker.GetLate() == 2);
+}
+
+//// Fifo /////////////////////////////////////////////////////////////////////
+
+/**
+ * Sleep for up to a block period or so, now and then, so that the two sides
+ * take turns to get ahead, and the fifo both over- and underruns.
+ */
+static void Stall(u32 *pState)
+{
+    u32 r{Random(pState)};
+    if (r % 8 == 0) {
+        timespec ts{0, static_cast<long>(r % 1000000)};
+        nanosleep(&ts, nullptr);
+    } else if (r % 4 == 0) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * The producer and the consumer on threads of their own, as the receive task
+ * and the sound interrupt are. Every frame carries its number, and its
+ * negation on the second channel, so that the consumer can tell a frame
+ * torn between two writes, or one read again from a lap before, or before
+ * it was written. Adaptive mode, as the client runs it, only ever moves
+ * forward: the frames the consumer finds skipped or repeated have to add up
+ * to the fifo's own count of them, its slip.
+ */
+static void TestFIFOStress()
+{
+    constexpr u16 nBlockFrames{32};
+    constexpr u32 nBlocks{100000};
+    // Frame numbers stay well within 24 bits, so as floats they're exact.
+    static_assert(nBlocks * nBlockFrames < (1 << 23), "too many frames");
+
+    static CFIFO<s32, 2, 1024> fifo{nBlockFrames, true};
+    fifo.SetTargetDepth(4 * nBlockFrames);
+
+    std::atomic<u32> nWritten{0};
+    auto produce{[&]() {
+        u32 nState{1};
+        s32 block[2][nBlockFrames];
+        const s32 *channels[2]{block[0], block[1]};
+        for (u32 n{0}; n < nBlocks; ++n) {
+            for (u16 i{0}; i < nBlockFrames; ++i) {
+                block[0][i] = static_cast<s32>(n * nBlockFrames + i + 1);
+                block[1][i] = -block[0][i];
+            }
+            fifo.Write(channels, nBlockFrames);
+            nWritten.store((n + 1) * nBlockFrames, std::memory_order_release);
+            Stall(&nState);
+        }
+    }};
+
+    // The first block, and the silence the fifo was cleared to ahead of it,
+    // in place before the consumer starts.
+    std::thread producer{produce};
+    while (nWritten.load(std::memory_order_acquire) == 0) {
+        std::this_thread::yield();
+    }
+
+    u32 nState{2};
+    u32 nLast{0}, nTorn{0}, nBackwards{0}, nUnwritten{0}, nReads{0};
+    s64 nSkipped{0}, nRepeated{0};
+    bool bStarted{false};
+    const u32 nEnd{nBlocks * nBlockFrames};
+    float buffer[2 * nBlockFrames];
+    // Until the producer is done, and the consumer has read all there is;
+    // the last block may have been dropped.
+    bool bDone{false};
+    while (!bDone) {
+        bDone = nWritten.load(std::memory_order_acquire) == nEnd && fifo.GetFillLevel() == 0;
+        fifo.Read(buffer, nBlockFrames);
+        const u32 nAvailable{nWritten.load(std::memory_order_acquire)};
+        ++nReads;
+
+        for (u16 i{0}; i < nBlockFrames; ++i) {
+            const s32 x{static_cast<s32>(buffer[2 * i] * (1 << 23))};
+            const s32 y{static_cast<s32>(buffer[2 * i + 1] * (1 << 23))};
+            if (x != -y) {
+                ++nTorn;
+                continue;
+            }
+            if (x == 0 && !bStarted) {
+                // The silence ahead of the first block.
+                continue;
+            }
+            bStarted = true;
+
+            const u32 nFrame{static_cast<u32>(x)};
+            if (nFrame > nAvailable) {
+                ++nUnwritten;
+            }
+            if (nFrame < nLast) {
+                ++nBackwards;
+            } else if (nFrame == nLast) {
+                ++nRepeated;
+            } else if (nLast != 0) {
+                nSkipped += nFrame - nLast - 1;
+            }
+            nLast = nFrame;
+        }
+
+        Stall(&nState);
+    }
+    producer.join();
+    // Blocks dropped at the very end are skipped with no frame after them.
+    nSkipped += nEnd - nLast;
+
+    printf("  %u blocks, %u reads: %u underruns, %u overruns; %lld frames skipped, %lld repeated, slip %d\n",
+           nBlocks, nReads, fifo.GetUnderruns(), fifo.GetOverruns(), static_cast<long long>(nSkipped),
+           static_cast<long long>(nRepeated), fifo.GetSlip());
+    CHECK(nTorn == 0);
+    CHECK(nBackwards == 0);
+    CHECK(nUnwritten == 0);
+    CHECK(nSkipped - nRepeated == fifo.GetSlip());
+    // Otherwise the test didn't test much.
+    CHECK(fifo.GetUnderruns() > 0 && fifo.GetOverruns() > 0);
+}
+
+/**
+ * A sample for each channel of each frame the producer writes; zero, the
+ * silence the fifo was cleared to, before the first.
+ */
+static s16 FIFOSample(s32 nFrame, u8 nChannel)
+{
+    return nFrame < 0 ? 0 : static_cast<s16>((nFrame % 4000 + 1) * 8 + nChannel);
+}
+
+/**
+ * Run a fifo of a given shape a few laps around its ring, a block in and a
+ * block out at a time, reading it in turn for the sound device, as
+ * interleaved floats, and one buffer per channel.
+ * @return Frames that weren't what the producer wrote, as mapped onto the
+ * output channels: a mono fifo's channel on them all, another's on its own
+ * and silence on the rest, channels beyond them dropped; and, read per
+ * channel, every channel as it is.
+ */
+template<u8 Channels, u32 Length, u8 OutputChannels>
+static unsigned CountFIFOShapeErrors()
+{
+    constexpr u16 nBlockFrames{32};
+    CFIFO<s16, Channels, Length, OutputChannels> fifo{nBlockFrames};
+
+    // A fixed fifo starts reading half its length behind the first block.
+    s32 nNextRead{nBlockFrames - static_cast<s32>(Length / 2)};
+    auto expected{[&](u16 i, u8 ch) -> s16 {
+        if (ch >= Channels && Channels > 1) {
+            return 0;
+        }
+        return FIFOSample(nNextRead + i, ch < Channels ? ch : 0);
+    }};
+    unsigned nErrors{0};
+    for (u32 nBlock{0}; nBlock < 4 * Length / nBlockFrames; ++nBlock) {
+        s16 block[Channels][nBlockFrames];
+        const s16 *channels[Channels];
+        for (u8 ch{0}; ch < Channels; ++ch) {
+            for (u16 i{0}; i < nBlockFrames; ++i) {
+                block[ch][i] = FIFOSample(static_cast<s32>(nBlock * nBlockFrames + i), ch);
+            }
+            channels[ch] = block[ch];
+        }
+        fifo.Write(channels, nBlockFrames);
+
+        u32 device[nBlockFrames * OutputChannels];
+        float interleaved[nBlockFrames * OutputChannels], planar[Channels][nBlockFrames];
+        float *planes[Channels];
+        switch (nBlock % 3) {
+            case 0:
+                fifo.template Read<OutputSigned>(device, nBlockFrames, 32768.f, 0.f);
+                for (u16 i{0}; i < nBlockFrames; ++i) {
+                    for (u8 ch{0}; ch < OutputChannels; ++ch) {
+                        nErrors += static_cast<s32>(device[i * OutputChannels + ch]) != expected(i, ch);
+                    }
+                }
+                break;
+            case 1:
+                fifo.Read(interleaved, nBlockFrames);
+                for (u16 i{0}; i < nBlockFrames; ++i) {
+                    for (u8 ch{0}; ch < OutputChannels; ++ch) {
+                        nErrors += interleaved[i * OutputChannels + ch] * 32768.f != expected(i, ch);
+                    }
+                }
+                break;
+            default:
+                for (u8 ch{0}; ch < Channels; ++ch) {
+                    planes[ch] = planar[ch];
+                }
+                fifo.Read(planes, nBlockFrames);
+                for (u8 ch{0}; ch < Channels; ++ch) {
+                    for (u16 i{0}; i < nBlockFrames; ++i) {
+                        nErrors += planar[ch][i] * 32768.f != FIFOSample(nNextRead + i, ch);
+                    }
+                }
+                break;
+        }
+        nNextRead += nBlockFrames;
+    }
+
+    // In step all along, it never under- or overran.
+    nErrors += fifo.GetUnderruns() + fifo.GetOverruns();
+    nErrors += fifo.GetFillLevel() != Length / 2 - nBlockFrames;
+    return nErrors;
+}
+
+/**
+ * Fifos of other shapes than the client's usual: fewer or more channels
+ * than the sound device's, and other lengths.
+ */
+static void TestFIFOShapes()
+{
+    CHECK((CountFIFOShapeErrors<1, 256, 2>() == 0));
+    CHECK((CountFIFOShapeErrors<2, 512, 2>() == 0));
+    CHECK((CountFIFOShapeErrors<3, 1024, 2>() == 0));
+    CHECK((CountFIFOShapeErrors<2, 128, 8>() == 0));
+    CHECK((CountFIFOShapeErrors<2, 512, 4>() == 0));
+    CHECK((CountFIFOShapeErrors<8, 2048, 2>() == 0));
+    CHECK((CountFIFOShapeErrors<1, 4096, 1>() == 0));
+    printf("  mono to stereo, stereo, three channels to stereo, stereo to eight and to four, eight to stereo, "
+           "mono; 128 to 4096 frames\n");
+}
+
+/**
+ * Read a block of a stream of u8 samples, and count the frames that aren't
+ * those of block nBlock, or silence if it's negative.
+ */
+template<typename FIFO>
+static unsigned CountRestartErrors(FIFO *pFIFO, int nBlock, u16 nBlockFrames)
+{
+    float output[2 * 32];
+    pFIFO->Read(output, nBlockFrames);
+    const float fExpected{nBlock < 0 ? 0.f : static_cast<float>(nBlock % 100 + 1) / 128.f};
+    unsigned nErrors{0};
+    for (u16 n{0}; n < 2 * nBlockFrames; ++n) {
+        nErrors += output[n] != fExpected;
+    }
+    return nErrors;
+}
+
+/**
+ * A stream starting, stopping and, after a Clear(), starting again, as when
+ * the client reconnects: nothing but silence before the first block, and no
+ * underruns counted while waiting for it; then a target depth's worth of
+ * silence, and the stream, in step with the reads. The third time, the first
+ * blocks are written before the next read, while the read index is still the
+ * old stream's: they must neither overrun nor be lost. Offset-binary samples,
+ * so that zeros for silence would show.
+ */
+static void TestFIFORestart()
+{
+    constexpr u16 nBlockFrames{32};
+    constexpr u32 nTargetDepth{3 * nBlockFrames};
+    CFIFO<u8, 2, 512> fifo{nBlockFrames, true};
+    fifo.SetTargetDepth(nTargetDepth);
+
+    u8 block[2][nBlockFrames];
+    const u8 *channels[2]{block[0], block[1]};
+    unsigned nErrors{0};
+    int nBlock{0};
+    auto write{[&]() {
+        memset(block, 128 + nBlock % 100 + 1, sizeof block);
+        fifo.Write(channels, nBlockFrames);
+    }};
+    for (int nRun{0}; nRun < 3; ++nRun) {
+        const int nFirst{nBlock};
+        if (nRun < 2) {
+            // Waiting for the stream.
+            for (int n{0}; n < 4; ++n) {
+                nErrors += CountRestartErrors(&fifo, -1, nBlockFrames);
+            }
+        } else {
+            // The stream is back before the consumer notices it went.
+            for (; nBlock < nFirst + static_cast<int>(nTargetDepth / nBlockFrames) - 1; ++nBlock) {
+                write();
+            }
+        }
+
+        // Each block is read a target depth, less the block, after it was
+        // written. A lap of the fifo and a bit, so that the read index is
+        // left just ahead of where the next stream starts writing; the last
+        // stream stops short, so that depth steering's first window doesn't
+        // close.
+        const int nBlocks{nRun < 2 ? 19 : 16};
+        for (int n{0}; n < nBlocks; ++n, ++nBlock) {
+            write();
+            const int nPlaying{nBlock - static_cast<int>(nTargetDepth / nBlockFrames) + 1};
+            nErrors += CountRestartErrors(&fifo, nPlaying < nFirst ? -1 : nPlaying, nBlockFrames);
+        }
+        CHECK(fifo.GetFillLevel() == nTargetDepth - nBlockFrames);
+
+        // The stream stops, and the client reconnects.
+        fifo.Clear();
+    }
+
+    CHECK(nErrors == 0);
+    CHECK(fifo.GetUnderruns() == 0 && fifo.GetOverruns() == 0);
+    printf("  three starts, two after %u frames of silence, one straight after the Clear()\n",
+           nTargetDepth - nBlockFrames);
+}
+
+//// Capture ring /////////////////////////////////////////////////////////////
+
+/**
+ * A 24-bit sample, as the I2S device captures it, for each channel of each
+ * frame.
+ */
+static u32 CapturedSample(unsigned nFrame, u8 nChannel)
+{
+    return static_cast<u32>(static_cast<s32>((nFrame * 7919u + nChannel * 104729u) % (1u << 24)) - (1 << 23));
+}
+
+/**
+ * Capture frames of nDeviceChannels into a ring of blocks of nChannels, in
+ * chunks that straddle blocks, and count the samples sent that aren't the
+ * device's, narrowed or widened to T: the device's channels on the first
+ * stream channels, and silence on any others.
+ */
+template<typename T>
+static unsigned CountCaptureErrors(u8 nChannels, u8 nDeviceChannels)
+{
+    constexpr u16 nBlockFrames{32}, nChunkFrames{24};
+    constexpr unsigned nBlocks{4}, nHeaderSize{16};
+    constexpr unsigned nBits{TSampleTraits<T>::k_nBits};
+    CBlockRing<T> ring{nChannels, nBlockFrames, nBlocks + 1, nHeaderSize, nDeviceChannels};
+
+    u32 chunk[nChunkFrames * 8];
+    unsigned nErrors{0};
+    // Nothing is kept until the sender starts the ring.
+    nErrors += ring.Write(chunk, nChunkFrames) != 0 || ring.Front() != nullptr;
+    ring.Start();
+
+    // The last chunk leaves the block after them part-filled, unpublished.
+    unsigned nPublished{0};
+    for (unsigned nFrame{0}; nFrame < nBlocks * nBlockFrames; nFrame += nChunkFrames) {
+        for (u16 n{0}; n < nChunkFrames; ++n) {
+            for (u8 ch{0}; ch < nDeviceChannels; ++ch) {
+                chunk[n * nDeviceChannels + ch] = CapturedSample(nFrame + n, ch);
+            }
+        }
+        nPublished += ring.Write(chunk, nChunkFrames);
+    }
+    nErrors += nPublished != nBlocks;
+    nErrors += ring.GetDatagramSize() != nHeaderSize + nChannels * nBlockFrames * sizeof(T);
+
+    for (unsigned nBlock{0}; nBlock < nBlocks; ++nBlock) {
+        const u8 *pDatagram{ring.Front()};
+        if (!pDatagram) {
+            return nErrors + 1;
+        }
+        const T *pPayload{reinterpret_cast<const T *>(pDatagram + nHeaderSize)};
+        for (u8 ch{0}; ch < nChannels; ++ch) {
+            for (u16 n{0}; n < nBlockFrames; ++n) {
+                int nExpected{0};
+                if (ch < nDeviceChannels) {
+                    const int x{static_cast<s32>(CapturedSample(nBlock * nBlockFrames + n, ch))};
+                    nExpected = nBits < 24 ? x >> (24 - nBits) : x * (1 << (nBits - 24));
+                }
+                nErrors += TSampleTraits<T>::Centre(pPayload[ch * nBlockFrames + n]) != nExpected;
+            }
+        }
+        ring.Pop();
+    }
+    nErrors += ring.Front() != nullptr || ring.GetOverruns() != 0;
+
+    return nErrors;
+}
+
+/**
+ * The capture ring with as many channels as the device, more and fewer, in
+ * each sample format.
+ */
+static void TestCaptureRing()
+{
+    const u8 shapes[][2]{{2, 2}, {8, 2}, {1, 2}, {3, 8}};
+    for (const auto &shape: shapes) {
+        CHECK(CountCaptureErrors<u8>(shape[0], shape[1]) == 0);
+        CHECK(CountCaptureErrors<s16>(shape[0], shape[1]) == 0);
+        CHECK(CountCaptureErrors<s32>(shape[0], shape[1]) == 0);
+        CHECK(CountCaptureErrors<u32>(shape[0], shape[1]) == 0);
+    }
+
+    // Full, with the sender stalled: further blocks are dropped.
+    CBlockRing<s16> ring{2, 32, 3, 0};
+    u32 chunk[2 * 32]{};
+    ring.Start();
+    unsigned nPublished{0};
+    for (int n{0}; n < 4; ++n) {
+        nPublished += ring.Write(chunk, 32);
+    }
+    CHECK(nPublished == 2 && ring.GetOverruns() == 2);
+    printf("  stereo, eight, mono and three channels from stereo and eight-channel devices, "
+           "into u8, s16, s24 and u32\n");
+}
+
+//// Jitter tuner /////////////////////////////////////////////////////////////
+
+/**
+ * How a jitter tuner fared over a replayed trace: its target depth at the end
+ * of each second, and the underruns it let through.
+ */
+struct TJitterRun
+{
+    static constexpr unsigned k_nMaxSeconds{600};
+
+    unsigned nSeconds;
+    u32 Target[k_nMaxSeconds];
+    u32 Underruns[k_nMaxSeconds];
+
+    /**
+     * @param nFrom
+     * @param nTo
+     * @return Underruns in seconds [nFrom, nTo).
+     */
+    u32 UnderrunsIn(unsigned nFrom, unsigned nTo) const
+    {
+        u32 nCount{0};
+        for (unsigned n{nFrom}; n < nTo; ++n) {
+            nCount += Underruns[n];
+        }
+        return nCount;
+    }
+
+    /**
+     * @param nFrom
+     * @param nTo
+     * @return The largest target in seconds [nFrom, nTo).
+     */
+    u32 PeakIn(unsigned nFrom, unsigned nTo) const
+    {
+        u32 nPeak{0};
+        for (unsigned n{nFrom}; n < nTo; ++n) {
+            nPeak = Target[n] > nPeak ? Target[n] : nPeak;
+        }
+        return nPeak;
+    }
+
+    /**
+     * @param nFrom
+     * @param nTo
+     * @return Seconds in [nFrom, nTo) with an underrun in them.
+     */
+    unsigned SecondsDryIn(unsigned nFrom, unsigned nTo) const
+    {
+        unsigned nCount{0};
+        for (unsigned n{nFrom}; n < nTo; ++n) {
+            nCount += Underruns[n] > 0;
+        }
+        return nCount;
+    }
+
+    /**
+     * @param nLow
+     * @param nHigh
+     * @return The second from which on the target stays within [nLow, nHigh].
+     */
+    unsigned SettledAt(u32 nLow, u32 nHigh) const
+    {
+        unsigned n{nSeconds};
+        while (n > 0 && Target[n - 1] >= nLow && Target[n - 1] <= nHigh) {
+            --n;
+        }
+        return n;
+    }
+};
+
+/**
+ * Replay a trace of packet delays into a jitter tuner set up as the client
+ * sets up its own, standing in for the fifo with a model of it: the fifo
+ * holds the target depth in spare frames for a packet on time, so one
+ * delayed by more than that has the sound device run dry. A run of such
+ * packets is one underrun, as the fifo plays on from where the late ones
+ * land.
+ * @param delay Called as delay(n): packet n's delay past its nominal
+ * arrival, in microseconds.
+ * @param pRun Filled in, for nSeconds seconds.
+ */
+template<typename Delay>
+static void ReplayJitter(Delay delay, unsigned nSeconds, TJitterRun *pRun)
+{
+    CJitterTuner tuner{AUDIO_BLOCK_FRAMES, SAMPLE_RATE, JITTER_MIN_DEPTH, JITTER_MAX_DEPTH,
+                       JITTER_UNDERRUNS_PER_MIN};
+    tuner.SetPacketFrames(AUDIO_BLOCK_FRAMES, DMA_CHUNK_FRAMES);
+
+    pRun->nSeconds = nSeconds < TJitterRun::k_nMaxSeconds ? nSeconds : TJitterRun::k_nMaxSeconds;
+    const u64 nPacketsPerSecond{SAMPLE_RATE / AUDIO_BLOCK_FRAMES};
+    u32 nUnderruns{0};
+    bool bDry{false};
+    for (unsigned nSecond{0}; nSecond < pRun->nSeconds; ++nSecond) {
+        const u32 nUnderrunsBefore{nUnderruns};
+        for (u64 n{nSecond * nPacketsPerSecond}; n < (nSecond + 1) * nPacketsPerSecond; ++n) {
+            const unsigned nDelay{delay(n)};
+            const bool bLate{static_cast<u64>(nDelay) * SAMPLE_RATE > tuner.GetTargetDepth() * 1000000ull};
+            if (bLate && !bDry) {
+                ++nUnderruns;
+            }
+            bDry = bLate;
+
+            const u64 nNominal{n * AUDIO_BLOCK_FRAMES * 1000000 / SAMPLE_RATE};
+            tuner.OnPacket(static_cast<unsigned>(nNominal + nDelay), nUnderruns);
+        }
+        pRun->Target[nSecond] = tuner.GetTargetDepth();
+        pRun->Underruns[nSecond] = nUnderruns - nUnderrunsBefore;
+    }
+}
+
+/**
+ * @param nMicroseconds
+ * @return Frames in a span of time, rounded up, as the tuner counts them.
+ */
+static u32 ToFrames(unsigned nMicroseconds)
+{
+    return static_cast<u32>((static_cast<u64>(nMicroseconds) * SAMPLE_RATE + 999999) / 1000000);
+}
+
+/**
+ * A steady trace: every packet delayed by anything up to a fixed amount,
+ * evenly. The target should settle around the spread within a window or
+ * two, and stay there. Once a minute has gone by without underruns, the
+ * tuner trims its margin until one comes, and backs off; that may cost a
+ * second with underruns about once a minute, but no more.
+ */
+static void TestJitterSteady()
+{
+    constexpr unsigned nSpread{1500}, nSeconds{300};
+    u32 nState{3};
+    TJitterRun run;
+    ReplayJitter([&](u64) { return Random(&nState) % (nSpread + 1); }, nSeconds, &run);
+
+    const u32 nSpreadFrames{ToFrames(nSpread)};
+    const u32 nLow{nSpreadFrames - AUDIO_BLOCK_FRAMES / 8}, nHigh{nSpreadFrames + AUDIO_BLOCK_FRAMES / 4};
+    const unsigned nSettled{run.SettledAt(nLow, nHigh)};
+    const unsigned nDry{run.SecondsDryIn(nSettled, nSeconds)};
+    printf("  spread %u frames: target %u to %u frames from %u s on; %u underruns, in %u s of %u\n",
+           nSpreadFrames, nLow, nHigh, nSettled, run.UnderrunsIn(nSettled, nSeconds), nDry, nSeconds - nSettled);
+    CHECK(nSettled <= 2);
+    CHECK(nDry <= (nSeconds - nSettled) / 60 + 1);
+}
+
+/**
+ * A bursty trace, as over Wi-Fi: a few tens of microseconds of jitter, but
+ * now and then the link stalls for a moment and then delivers what it held
+ * all at once. The first burst gets through the shallow fifo with
+ * underruns. The target should then rise to cover it, so that those that
+ * follow go through with underruns at most about once a minute, as the
+ * target sinks back between bursts. It should stay within the fifo, and
+ * come back down once the bursts stop: the peak decays by a frame a
+ * second, so that takes a while.
+ */
+static void TestJitterBursty()
+{
+    constexpr unsigned nQuiet{100}, nSeconds{400};
+    // Bursts of half a second every 10 s, for the first two minutes; in a
+    // burst, packets come in clumps of six, all as the last one is due.
+    constexpr unsigned nBurstEvery{10}, nBurstsUntil{120}, nClump{6};
+    const u64 nPacketsPerSecond{SAMPLE_RATE / AUDIO_BLOCK_FRAMES};
+    const unsigned nPeriod{static_cast<unsigned>(AUDIO_BLOCK_FRAMES * 1000000ull / SAMPLE_RATE)};
+    u32 nState{5};
+    TJitterRun run;
+    ReplayJitter(
+            [&](u64 n) {
+                const u64 nSecond{n / nPacketsPerSecond};
+                const bool bBurst{nSecond < nBurstsUntil && nSecond % nBurstEvery == nBurstEvery / 2
+                                  && n % nPacketsPerSecond < nPacketsPerSecond / 2};
+                const unsigned nJitter{Random(&nState) % (nQuiet + 1)};
+                return bBurst ? static_cast<unsigned>(nClump - 1 - n % nClump) * nPeriod + nJitter : nJitter;
+            },
+            nSeconds, &run);
+
+    const u32 nBurstFrames{ToFrames((nClump - 1) * nPeriod)};
+    const u32 nQuietFrames{ToFrames(nQuiet)};
+    const unsigned nFirstDry{run.SecondsDryIn(0, nBurstEvery)};
+    const unsigned nLaterDry{run.SecondsDryIn(nBurstEvery, nBurstsUntil)};
+    const unsigned nSettled{run.SettledAt(0, nQuietFrames + AUDIO_BLOCK_FRAMES / 4)};
+    printf("  bursts of %u frames: %u underruns in the first; in %u s of the %u s after; "
+           "target %u frames at most, back to %u from %u s on\n",
+           nBurstFrames, run.UnderrunsIn(0, nBurstEvery), nLaterDry, nBurstsUntil - nBurstEvery,
+           run.PeakIn(0, nSeconds), run.Target[nSeconds - 1], nSettled);
+    CHECK(nFirstDry > 0);
+    CHECK(run.PeakIn(nBurstEvery, nBurstsUntil) >= nBurstFrames);
+    CHECK(nLaterDry <= (nBurstsUntil - nBurstEvery) / 60 + 1);
+    CHECK(run.PeakIn(0, nSeconds) <= JITTER_MAX_DEPTH);
+    CHECK(nSettled < nBurstsUntil + 2 * JITTER_MAX_DEPTH);
+}
+
+//// Clock recovery ///////////////////////////////////////////////////////////
+
+/**
+ * How clock recovery fared against a simulated server clock.
+ */
+struct TClockRun
+{
+    // From when on the fill level, averaged over ten control periods to take
+    // out the noise of its measurement, stays within a frame of the
+    // reference, in seconds; or the length of the run if it never settles.
+    unsigned nSettled;
+    // Furthest the fill level strayed from the reference, in frames: the
+    // latency the fifo takes on (or gives up) while the loop catches up.
+    float fPeakError;
+    // Furthest the correction overshot the offset, in ppm.
+    float fOvershoot;
+    // Mean fill level error and correction over the last minute, and the
+    // correction's standard deviation: the wander the measurement noise
+    // leaves in the output rate.
+    float fError, fPPM, fPPMDeviation;
+};
+
+/**
+ * Run the clock task's control loop, as the client sets it up, against a
+ * server whose clock is off by some ppm. The server sends a block at a time;
+ * the sound device takes a chunk at a time at its nominal rate, corrected.
+ * There's no fifo steering in the model: the fill level it measures is what
+ * the client measures as fill level plus slip. The clock task wakes a little
+ * late, now and then, so as not to sample the packets' sawtooth in step.
+ * @param fKp
+ * @param fKi
+ * @param fOffsetPPM Server's clock rate, ppm off the nominal.
+ * @param bPCMClock Whether the correction goes through the PCM clock's
+ * divider, with its 12 fractional bits, as on I2S, rather than to the
+ * resampler, which takes it as is.
+ * @param nSeconds
+ * @param pRun
+ */
+static void SimulateClock(float fKp, float fKi, float fOffsetPPM, bool bPCMClock, unsigned nSeconds,
+                          TClockRun *pRun)
+{
+    // PLLD on the Pi 3 and earlier.
+    constexpr double fClockFreq{500e6};
+    constexpr double fSampleRate{SAMPLE_RATE};
+    constexpr unsigned nSamplesPerPeriod{CLOCK_RECOVERY_PERIOD_MS / CLOCK_RECOVERY_SAMPLE_MS};
+    CRateController controller{fKp, fKi, CLOCK_RECOVERY_MAX_PPM, CLOCK_RECOVERY_PERIOD_MS / 1000.f};
+
+    double fTime{0}, fReadFrames{0}, fRate{fSampleRate};
+    double fWriteRate{fSampleRate * (1 + fOffsetPPM * 1e-6)};
+    u32 nState{7};
+    unsigned nSamples{0}, nPeriods{0};
+    float Errors[10]{};
+    float fRecentError{0};
+    double fSumError{0}, fSumPPM{0}, fSumPPM2{0};
+    unsigned nTail{0};
+    *pRun = {nSeconds, 0.f, 0.f, 0.f, 0.f, 0.f};
+
+    while (fTime < nSeconds) {
+        // Up to 2 ms late, as the scheduler lets it.
+        const double fSleep{CLOCK_RECOVERY_SAMPLE_MS * 1e-3 + (Random(&nState) % 2000) * 1e-6};
+        fReadFrames += fRate * fSleep;
+        fTime += fSleep;
+
+        const auto nWritten{static_cast<s64>(fWriteRate * fTime) / AUDIO_BLOCK_FRAMES * AUDIO_BLOCK_FRAMES};
+        const auto nRead{static_cast<s64>(fReadFrames) / DMA_CHUNK_FRAMES * DMA_CHUNK_FRAMES};
+        controller.AddMeasurement(static_cast<int>(nWritten - nRead));
+        if (++nSamples < nSamplesPerPeriod) {
+            continue;
+        }
+        nSamples = 0;
+
+        if (!controller.Update()) {
+            continue;
+        }
+        const float fPPM{controller.GetPPM()}, fError{controller.GetError()};
+        if (bPCMClock) {
+            // As CClockTask::SetSampleRate() rounds it.
+            const double fTarget{fSampleRate * (1 + fPPM * 1e-6)};
+            const auto nDivider{static_cast<unsigned>(fClockFreq * 4096 / (32 * 2) / fTarget + .5)};
+            fRate = fClockFreq * 4096 / (32 * 2) / nDivider;
+        } else {
+            fRate = fSampleRate * (1 + fPPM * 1e-6);
+        }
+
+        if (fabsf(fError) > fabsf(pRun->fPeakError)) {
+            pRun->fPeakError = fError;
+        }
+        const float fOver{fOffsetPPM >= 0 ? fPPM - fOffsetPPM : fOffsetPPM - fPPM};
+        if (fOver > pRun->fOvershoot) {
+            pRun->fOvershoot = fOver;
+        }
+        fRecentError += (fError - Errors[nPeriods % 10]) / 10;
+        Errors[nPeriods++ % 10] = fError;
+        if (nPeriods < 10 || fabsf(fRecentError) > 1.f) {
+            pRun->nSettled = nSeconds;
+        } else if (pRun->nSettled == nSeconds) {
+            pRun->nSettled = static_cast<unsigned>(fTime);
+        }
+        if (fTime >= nSeconds - 60) {
+            fSumError += fError;
+            fSumPPM += fPPM;
+            fSumPPM2 += static_cast<double>(fPPM) * fPPM;
+            ++nTail;
+        }
+    }
+
+    if (nTail > 0) {
+        pRun->fError = static_cast<float>(fSumError / nTail);
+        pRun->fPPM = static_cast<float>(fSumPPM / nTail);
+        pRun->fPPMDeviation = static_cast<float>(sqrt(fSumPPM2 / nTail - fSumPPM / nTail * fSumPPM / nTail));
+    }
+}
+
+/**
+ * The clock recovery loop against server clocks up to a few hundred ppm
+ * off, either way, through the resampler and the PCM clock. It should
+ * settle within two minutes, without much overshoot, and hold the fill
+ * level to within a frame of where it started. Also tabulates other gains
+ * around the chosen ones, against 200 ppm: a lower Kp lets the fill level
+ * stray further, and settles slower; a higher one passes more of the fill
+ * level's measurement noise on to the output rate, as wander; a higher Ki
+ * settles sooner, but overshoots more.
+ */
+static void TestClockRecovery()
+{
+    constexpr unsigned nSeconds{300};
+    const float fMsPerFrame{1000.f / SAMPLE_RATE};
+    static const float Offsets[]{-400.f, -200.f, -50.f, 50.f, 200.f, 400.f};
+    static const float Kp[]{1.f, 2.f, CLOCK_RECOVERY_KP, 10.f, 20.f};
+    static const float Ki[]{.1f, CLOCK_RECOVERY_KI, 1.f, 3.f};
+
+    for (int nPCMClock{0}; nPCMClock < 2; ++nPCMClock) {
+        const bool bPCMClock{nPCMClock == 1};
+        for (float fOffset: Offsets) {
+            TClockRun run;
+            SimulateClock(CLOCK_RECOVERY_KP, CLOCK_RECOVERY_KI, fOffset, bPCMClock, nSeconds, &run);
+            printf("  %s, %+4.0f ppm: settled after %3u s; fill level off by %6.1f frames (%5.2f ms) at most, "
+                   "%5.2f at the end; %+7.2f ppm, wandering %4.1f (%4.1f over)\n",
+                   bPCMClock ? "PCM clock" : "resampler", fOffset, run.nSettled, run.fPeakError,
+                   run.fPeakError * fMsPerFrame, run.fError, run.fPPM, run.fPPMDeviation, run.fOvershoot);
+            CHECK(run.nSettled <= 120);
+            CHECK(fabsf(run.fError) <= 1.f);
+            CHECK(fabsf(run.fPPM - fOffset) <= 2.f);
+            CHECK(run.fOvershoot <= .25f * fabsf(fOffset) + 20.f);
+        }
+    }
+
+    printf("  gains against +200 ppm, via the resampler:\n");
+    for (float fKp: Kp) {
+        for (float fKi: Ki) {
+            TClockRun run;
+            SimulateClock(fKp, fKi, 200.f, false, nSeconds, &run);
+            printf("    Kp %4.1f, Ki %3.1f: settled after %3u s; off by %6.1f frames at most; %5.1f ppm over, "
+                   "wandering %4.1f%s\n",
+                   fKp, fKi, run.nSettled, run.fPeakError, run.fOvershoot, run.fPPMDeviation,
+                   fKp == CLOCK_RECOVERY_KP && fKi == CLOCK_RECOVERY_KI ? "  <- config.h" : "");
+        }
+    }
+}
+
+//// Resampler ////////////////////////////////////////////////////////////////
+
+/**
+ * A stereo sine, the second channel a quarter turn ahead of the first, fed
+ * through a resampler a block at a time, and what came out compared with the
+ * sine itself, sampled where the resampler should have sampled it.
+ */
+class CResamplerProbe
+{
+public:
+    /**
+     * @param fFrequency Of the sine, in cycles per input frame.
+     */
+    explicit CResamplerProbe(double fFrequency) :
+            k_fOmega{2 * M_PI * fFrequency},
+            m_Resampler{2, k_nBlockFrames, k_fMaxRatio}
+    {
+    }
+
+    /**
+     * @param fRatio Input frames per output frame, for the next block.
+     */
+    void SetRatio(float fRatio)
+    {
+        m_Resampler.SetRatio(fRatio);
+        // As the resampler steps its phase.
+        m_nStep = static_cast<u64>(static_cast<double>(fRatio) * 4294967296. + .5);
+    }
+
+    /**
+     * Resample a block, and add it up.
+     * @param bMeasure Whether to count this block's output, or just get it
+     * past the resampler's history.
+     */
+    void Process(bool bMeasure)
+    {
+        float output[2 * k_nBlockFrames];
+        m_Resampler.Process(output, k_nBlockFrames, [this](float *pBuffer, u16 nFrames) {
+            for (u16 n{0}; n < nFrames; ++n, ++m_nRead) {
+                *pBuffer++ = .5f * static_cast<float>(sin(k_fOmega * static_cast<double>(m_nRead)));
+                *pBuffer++ = .5f * static_cast<float>(cos(k_fOmega * static_cast<double>(m_nRead)));
+            }
+        });
+
+        for (u16 n{0}; n < k_nBlockFrames; ++n, m_nPhase += m_nStep) {
+            // Where the output frame should be, on the input's time line:
+            // the history puts it four frames behind the phase.
+            const double fPosition{static_cast<double>(m_nPhase) / 4294967296. - 4};
+            const double x{.5 * sin(k_fOmega * fPosition)}, y{.5 * cos(k_fOmega * fPosition)};
+            if (bMeasure) {
+                m_fSignal += x * x + y * y;
+                m_fError += (output[2 * n] - x) * (output[2 * n] - x) + (output[2 * n + 1] - y) * (output[2 * n + 1] - y);
+            }
+        }
+    }
+
+    /**
+     * @return The error against the sine, relative to the sine, in dB: THD+N.
+     */
+    double GetTHDN() const { return 10 * log10(m_fError / m_fSignal); }
+
+    /**
+     * @return Whether the input read so far is exactly what the phase
+     * stepped over: no frame lost or read twice.
+     */
+    bool IsExact() const { return m_nRead == (m_nPhase >> 32); }
+
+    static constexpr u16 k_nBlockFrames{AUDIO_BLOCK_FRAMES};
+    static constexpr float k_fMaxRatio{2.f};
+
+private:
+    const double k_fOmega;
+    CResampler m_Resampler;
+    u64 m_nStep{0};
+    u64 m_nPhase{0};
+    u64 m_nRead{0};
+    double m_fSignal{0}, m_fError{0};
+};
+
+/**
+ * THD+N of sines through the resampler, at the ratios the client may run
+ * it at: playing 48 kHz on 44.1 and vice versa, clock recovery's few
+ * hundred ppm either side of 1, and a ratio of 3:2. Six-point Lagrange
+ * interpolation is very clean low down, but falls off steeply towards the
+ * top of the band: -140 dB at 1 kHz, but only about -70 dB at 5 kHz and
+ * -37 dB at 10 kHz.
+ */
+static void TestResamplerTHDN()
+{
+    static const float Ratios[]{48000.f / 44100.f, 44100.f / 48000.f, 1.0005f, .9995f, 1.5f};
+    // Cycles per input frame, and how clean each must come out, in dB.
+    static const struct
+    {
+        double fFrequency;
+        double fLimit;
+    } Sines[]{{1000. / 48000, -120}, {5000. / 48000, -65}, {10000. / 48000, -35}};
+
+    for (const auto &sine: Sines) {
+        for (float fRatio: Ratios) {
+            CResamplerProbe probe{sine.fFrequency};
+            probe.SetRatio(fRatio);
+            for (unsigned n{0}; n < 4000; ++n) {
+                probe.Process(n >= 2);
+            }
+            printf("  %5.0f Hz at 48 kHz, ratio %.6f: THD+N %6.1f dB\n", sine.fFrequency * 48000, fRatio,
+                   probe.GetTHDN());
+            CHECK(probe.GetTHDN() < sine.fLimit);
+            CHECK(probe.IsExact());
+        }
+    }
+}
+
+/**
+ * The ratio changing as the stream goes on, as clock recovery changes it:
+ * ramped a little every block, and stepped. The output should follow the
+ * sine sampled at the moving phase as cleanly as at a fixed ratio, with no
+ * click where the ratio changes, and not a frame of input lost or read
+ * twice.
+ */
+static void TestResamplerTracking()
+{
+    CResamplerProbe probe{1000. / 48000};
+    probe.SetRatio(1.f);
+    probe.Process(false);
+    probe.Process(false);
+    for (unsigned n{0}; n < 3000; ++n) {
+        // Up to 500 ppm fast and back, in steps of a third of a ppm.
+        const unsigned nStep{n < 1500 ? n : 3000 - n};
+        probe.SetRatio(1.f + nStep / 3e6f);
+        probe.Process(true);
+    }
+    const double fRamp{probe.GetTHDN()};
+    const bool bRampExact{probe.IsExact()};
+
+    CResamplerProbe stepped{1000. / 48000};
+    stepped.SetRatio(1.f);
+    stepped.Process(false);
+    stepped.Process(false);
+    for (unsigned n{0}; n < 3000; ++n) {
+        stepped.SetRatio(n % 1000 < 500 ? 1.f : n % 2000 < 1000 ? 1.0005f : .9995f);
+        stepped.Process(true);
+    }
+
+    printf("  1 kHz at 48 kHz: ramped to +500 ppm and back, THD+N %.1f dB; stepped by 500 ppm, %.1f dB\n", fRamp,
+           stepped.GetTHDN());
+    CHECK(fRamp < -120);
+    CHECK(bRampExact);
+    CHECK(stepped.GetTHDN() < -120);
+    CHECK(stepped.IsExact());
+}
+
+//// Log ring /////////////////////////////////////////////////////////////////
+
+/**
+ * Producers on threads of their own, as the sound interrupt, the audio core
+ * and the receive task are, against the flush task, with the ring often
+ * full. Every entry written must be either flushed or counted as dropped,
+ * and the consumer must get past the positions whose entries were dropped
+ * rather than wait on them.
+ */
+static void TestLogRing()
+{
+    constexpr unsigned nProducers{3}, nWrites{100000};
+    CLogRing *pRing{CLogRing::Get()};
+    pRing->Flush(nullptr, LOG_RING_ENTRIES);
+    const u32 nDroppedBefore{pRing->GetDropped()};
+
+    std::atomic<unsigned> nRunning{nProducers};
+    std::thread producers[nProducers];
+    for (unsigned i{0}; i < nProducers; ++i) {
+        producers[i] = std::thread{[&, i]() {
+            u32 nState{11 + i};
+            for (unsigned n{0}; n < nWrites; ++n) {
+                pRing->Write("test", LogDebug, "producer %u: %u", i, n);
+                if (n % 64 == 0) {
+                    Stall(&nState);
+                }
+            }
+            --nRunning;
+        }};
+    }
+
+    u32 nState{17};
+    unsigned nFlushed{0};
+    while (nRunning > 0) {
+        nFlushed += pRing->Flush(nullptr, 16);
+        Stall(&nState);
+    }
+    for (std::thread &producer: producers) {
+        producer.join();
+    }
+    nFlushed += pRing->Flush(nullptr, LOG_RING_ENTRIES);
+    const u32 nDropped{pRing->GetDropped() - nDroppedBefore};
+
+    printf("  %u entries written by %u threads: %u flushed, %u dropped\n", nProducers * nWrites, nProducers,
+           nFlushed, nDropped);
+    CHECK(nFlushed + nDropped == nProducers * nWrites);
+    CHECK(nDropped > 0);
+    CHECK(pRing->Flush(nullptr, LOG_RING_ENTRIES) == 0);
+    // Still takes entries after all that.
+    pRing->Write("test", LogDebug, "one more");
+    CHECK(pRing->Flush(nullptr, LOG_RING_ENTRIES) == 1);
+
+    // Each argument formatted as the type its conversion says, e.g. a u64,
+    // which a long would truncate on a 32-bit Pi; and those after it in
+    // step. The logger writes to stderr, so catch it there.
+    char line[256]{};
+    FILE *pCaught{tmpfile()};
+    fflush(stderr);
+    const int nStderr{dup(2)};
+    dup2(fileno(pCaught), 2);
+    pRing->Write("test", LogNotice, "%llu %llx %lld %lu %d", 0x123456789abcdef0ull, 0x123456789abcdef0ull,
+                 -5000000000ll, 4000000000ul, -7);
+    pRing->Flush(CLogger::Get(), LOG_RING_ENTRIES);
+    fflush(stderr);
+    dup2(nStderr, 2);
+    close(nStderr);
+    rewind(pCaught);
+    CHECK(fgets(line, sizeof line, pCaught) != nullptr);
+    fclose(pCaught);
+    CHECK(strstr(line, "test: 1311768467463790320 123456789abcdef0 -5000000000 4000000000 -7\n") != nullptr);
+}
+
+//// Audio core ///////////////////////////////////////////////////////////////
+
+struct TRenderState
+{
+    u32 nChunks;
+    u32 nStallState;
+};
+
+/**
+ * Stamp each word of a chunk with the chunk's number, stalling now and then.
+ */
+static void RenderNumbered(u32 *pBuffer, unsigned nChunkSize, void *pParam)
+{
+    auto *pState{static_cast<TRenderState *>(pParam)};
+    Stall(&pState->nStallState);
+    for (unsigned i{0}; i < nChunkSize; ++i) {
+        pBuffer[i] = pState->nChunks;
+    }
+    ++pState->nChunks;
+}
+
+/**
+ * The audio core renders on a thread of its own, as core 1 would, and this
+ * one fetches as the sound interrupt would, each stalling now and then. Every
+ * chunk fetched must be whole, and either the next in order or silence, for
+ * which the statistics count a starved fetch.
+ */
+static void TestAudioCore()
+{
+    constexpr unsigned nChunkSize{64}, nFetches{20000};
+    constexpr u32 nSilence{0xffffffff};
+
+    // Secondary cores can't be stopped: core 1 waits for a fetch that never
+    // comes, once done, so it and its state stay.
+    static TRenderState state{0, 5};
+    auto *pCore{new CAudioCore(CMemorySystem::Get(), RenderNumbered, &state, nChunkSize, nSilence)};
+    CHECK(pCore->Initialize());
+
+    u32 nState{7}, nNext{0};
+    unsigned nShort{0}, nTorn{0}, nOutOfOrder{0}, nSilent{0};
+    for (unsigned n{0}; n < nFetches; ++n) {
+        u32 chunk[nChunkSize];
+        nShort += pCore->Fetch(chunk, nChunkSize) != nChunkSize;
+        for (unsigned i{1}; i < nChunkSize; ++i) {
+            nTorn += chunk[i] != chunk[0];
+        }
+        if (chunk[0] == nSilence) {
+            ++nSilent;
+        } else {
+            nOutOfOrder += chunk[0] != nNext;
+            nNext = chunk[0] + 1;
+        }
+        Stall(&nState);
+    }
+
+    THandoffStats stats;
+    pCore->GetStats(&stats);
+    printf("  %u chunks fetched, %u of them silence; handoff latency %u-%u us, %u on average\n", nFetches, nSilent,
+           stats.nMinLatency, stats.nMaxLatency, stats.nMeanLatency);
+    CHECK(nShort == 0);
+    CHECK(nTorn == 0);
+    CHECK(nOutOfOrder == 0);
+    CHECK(stats.nBlocks == nFetches - nSilent && stats.nStarved == nSilent);
+    CHECK(nNext == nFetches - nSilent);
+}
+
+//// Audio arena //////////////////////////////////////////////////////////////
+
+/**
+ * Buffers from the arena start on cache lines of their own and take up whole
+ * lines; and the resampler and the loss concealer take theirs from it, not
+ * from the heap.
+ */
+static void TestAudioArena()
+{
+    constexpr unsigned nLine{CAudioArena::k_nCacheLine};
+    const unsigned nUsed{CAudioArena::GetUsed()};
+    auto *pA{CAudioArena::Allocate<u8>(1)};
+    auto *pB{CAudioArena::Allocate<float>(17)};
+    auto *pC{CAudioArena::Allocate<u8>(nLine)};
+    CHECK(reinterpret_cast<uintptr_t>(pA) % nLine == 0);
+    CHECK(reinterpret_cast<uintptr_t>(pB) % nLine == 0);
+    CHECK(reinterpret_cast<uintptr_t>(pC) % nLine == 0);
+    CHECK(reinterpret_cast<u8 *>(pB) - pA == nLine);
+    CHECK(pC - reinterpret_cast<u8 *>(pB) == 2 * nLine);
+    CHECK(CAudioArena::GetUsed() - nUsed == 4 * nLine);
+
+    // Six frames of history, one for the phase, and 33 at a ratio of 1.0005
+    // for 32 frames out: 40 stereo frames, 320 bytes, five lines.
+    const unsigned nBeforeResampler{CAudioArena::GetUsed()};
+    CResampler resampler{2, 32, 1.0005f};
+    CHECK(CAudioArena::GetUsed() - nBeforeResampler == 5 * nLine);
+
+    // At 48 kHz, per channel: the history, twice (800 + 480 frames); a pitch
+    // period (800); a block (32); and the channels' pointers, and the mono
+    // mix, once.
+    const unsigned nBeforeConcealer{CAudioArena::GetUsed()};
+    CLossConcealer concealer{2, 32, 48000};
+    const unsigned nExpected{3 * nLine + 2 * (2560 * 4 + 800 * 4 + 32 * 4) + 1280 * 4};
+    printf("  from the arena: %u bytes for a stereo resampler, %u for a stereo loss concealer at 48 kHz\n",
+           nBeforeConcealer - nBeforeResampler, CAudioArena::GetUsed() - nBeforeConcealer);
+    CHECK(CAudioArena::GetUsed() - nBeforeConcealer == nExpected);
+}
+
+//// Fixed-point output ///////////////////////////////////////////////////////
+
+struct TFixedRun
+{
+    // From the exact value, in steps; and from the float path.
+    double fMaxError;
+    int nMaxFromFloat;
+    // Of the block kernel's output from the scalar reference's.
+    unsigned nMismatches;
+    // With dither, on a constant sample: mean and largest error, and how
+    // many levels it spread over.
+    double fDitherMean, fDitherMax;
+    unsigned nDitherLevels;
+    bool bInRange;
+};
+
+/**
+ * Scale a sample format for a device in fixed point, as the client does with
+ * FIXED_POINT_OUTPUT, and compare it with the exact scale, and the float
+ * path, over every sample value (or a spread of them, if wider than 16 bits).
+ */
+template<typename T, TOutputStyle Style>
+static TFixedRun RunFixed(float fAmp, float fOffset, s32 nMin, s32 nMax)
+{
+    const TFixedGain gain{CConvert::MakeFixedGain<T>(fAmp, fOffset, nMin, nMax)};
+    const double fOutputOffset{Style == OutputOffsetBinary ? fOffset : 0.};
+    TFixedRun run{};
+    run.bInRange = true;
+
+    // Blocks of 37 frames, so that the vector paths leave a remainder.
+    constexpr unsigned nFrames{37};
+    const u64 nValues{1ull << TSampleTraits<T>::k_nBits};
+    const u64 nStep{nValues > (1u << 16) ? nValues >> 16 : 1};
+    T samples[2][nFrames];
+    const T *channels[2]{samples[0], samples[1]};
+    u32 output[2 * nFrames];
+    unsigned nFrame{0};
+    for (u64 v{0}; v < nValues; v += nStep) {
+        const int nCentred{static_cast<int>(v - nValues / 2)};
+        const T x{TSampleTraits<T>::FromCentred(nCentred)};
+        const s32 y{static_cast<s32>(CConvert::SampleToDeviceFixed<Style>(x, gain))};
+        const double fExact{nCentred * static_cast<double>(TSampleTraits<T>::k_fScale) * fAmp + fOutputOffset};
+        run.fMaxError = fmax(run.fMaxError, fabs(y - fExact));
+        const int nFromFloat{abs(y - static_cast<s32>(CConvert::SampleToDevice<Style>(x, fAmp, fOffset)))};
+        run.nMaxFromFloat = nFromFloat > run.nMaxFromFloat ? nFromFloat : run.nMaxFromFloat;
+        run.bInRange = run.bInRange && y >= nMin && y <= nMax;
+
+        // Left and right reversed, so that channels are told apart.
+        samples[0][nFrame] = x;
+        samples[1][nFrames - 1 - nFrame] = x;
+        if (++nFrame == nFrames || v + nStep >= nValues) {
+            CConvert::ToDeviceFixed<Style, 2>(output, channels, nFrame, gain);
+            for (unsigned n{0}; n < nFrame; ++n) {
+                for (u8 ch{0}; ch < 2; ++ch) {
+                    run.nMismatches += output[2 * n + ch] != CConvert::SampleToDeviceFixed<Style>(channels[ch][n], gain);
+                }
+            }
+            CConvert::ToDeviceFixed<Style, 1>(output, channels, nFrame, gain);
+            for (unsigned n{0}; n < nFrame; ++n) {
+                run.nMismatches += output[n] != CConvert::SampleToDeviceFixed<Style>(channels[0][n], gain);
+            }
+            nFrame = 0;
+        }
+    }
+
+    // A third of full scale, dithered, through the block kernel.
+    const int nCentred{static_cast<int>(nValues / 6)};
+    const double fExact{nCentred * static_cast<double>(TSampleTraits<T>::k_fScale) * fAmp + fOutputOffset};
+    for (unsigned n{0}; n < nFrames; ++n) {
+        samples[0][n] = samples[1][n] = TSampleTraits<T>::FromCentred(nCentred);
+    }
+    TDither dither;
+    s32 nLow{nMax}, nHigh{nMin};
+    double fSum{0.};
+    constexpr unsigned nBlocks{1000};
+    for (unsigned nBlock{0}; nBlock < nBlocks; ++nBlock) {
+        CConvert::ToDeviceFixed<Style, 2>(output, channels, nFrames, gain, &dither);
+        for (u32 nOutput: output) {
+            const s32 y{static_cast<s32>(nOutput)};
+            fSum += y - fExact;
+            run.fDitherMax = fmax(run.fDitherMax, fabs(y - fExact));
+            nLow = y < nLow ? y : nLow;
+            nHigh = y > nHigh ? y : nHigh;
+        }
+    }
+    run.fDitherMean = fSum / (nBlocks * 2 * nFrames);
+    run.nDitherLevels = static_cast<unsigned>(nHigh - nLow + 1);
+
+    return run;
+}
+
+template<typename T, TOutputStyle Style>
+static void CheckFixed(const char *pName, float fAmp, float fOffset, s32 nMin, s32 nMax)
+{
+    const TFixedRun run{RunFixed<T, Style>(fAmp, fOffset, nMin, nMax)};
+    printf("  %-10s within %.3f steps of exact, %d of float; dithered, %+.3f on average, within %.2f, over %u levels\n",
+           pName, run.fMaxError, run.nMaxFromFloat, run.fDitherMean, run.fDitherMax, run.nDitherLevels);
+    // Rounded to nearest, with the gain's rounding on top: half its last
+    // bit, of a gain of at least a quarter, is 2^-14 of the scale in Q15,
+    // and next to none in Q31.
+    CHECK(run.fMaxError < .5 + fAmp / 16384. + 1e-6);
+    CHECK(run.nMaxFromFloat <= 1);
+    CHECK(run.nMismatches == 0);
+    CHECK(run.bInRange);
+    // TPDF dither of a step either side: unbiased, and three levels at most.
+    CHECK(fabs(run.fDitherMean) < .05);
+    CHECK(run.fDitherMax < 1.5 + fAmp / 16384.);
+    CHECK(run.nDitherLevels >= 2 && run.nDitherLevels <= 3);
+}
+
+/**
+ * Every sample format in fixed point, for I2S, and PWM at 48 and 192 kHz, as
+ * the client scales them: rounded to within half a step, and so within one
+ * of the float path; the block kernels the same as the scalar reference; and
+ * dither that spreads a level without shifting it. And at full volume, with
+ * the extremes a step or two from the ends of the device's range.
+ */
+static void TestFixedOutput()
+{
+    constexpr float fI2S{(1 << 23) - 2}, fPWM48{125000000 / 48000 - 1}, fPWM192{125000000 / 192000 - 1};
+    CheckFixed<u8, OutputSigned>("u8 I2S", AUDIO_VOLUME * fI2S, 0.f, -fI2S, fI2S);
+    CheckFixed<s16, OutputSigned>("s16 I2S", AUDIO_VOLUME * fI2S, 0.f, -fI2S, fI2S);
+    CheckFixed<s32, OutputSigned>("s24 I2S", AUDIO_VOLUME * fI2S, 0.f, -fI2S, fI2S);
+    CheckFixed<u32, OutputSigned>("u32 I2S", AUDIO_VOLUME * fI2S, 0.f, -fI2S, fI2S);
+    CheckFixed<u8, OutputOffsetBinary>("u8 PWM", AUDIO_VOLUME * fPWM48 / 2, fPWM48 / 2, 0, fPWM48);
+    CheckFixed<s16, OutputOffsetBinary>("s16 PWM", AUDIO_VOLUME * fPWM48 / 2, fPWM48 / 2, 0, fPWM48);
+    CheckFixed<s32, OutputOffsetBinary>("s24 PWM", AUDIO_VOLUME * fPWM48 / 2, fPWM48 / 2, 0, fPWM48);
+    CheckFixed<u32, OutputOffsetBinary>("u32 PWM", AUDIO_VOLUME * fPWM48 / 2, fPWM48 / 2, 0, fPWM48);
+    CheckFixed<s16, OutputOffsetBinary>("s16 PWM192", AUDIO_VOLUME * fPWM192 / 2, fPWM192 / 2, 0, fPWM192);
+    CheckFixed<s16, OutputOffsetBinary>("s16 PWM 1.0", fPWM48 / 2, fPWM48 / 2, 0, fPWM48);
+}
+
+//// Mixer ////////////////////////////////////////////////////////////////////
+
+/**
+ * Mix a block of a stream whose channels each hold a constant level.
+ */
+static void MixLevels(CMixer *pMixer, const float *pLevels, u8 nStreamChannels, u16 nFrames, float *pOutput)
+{
+    pMixer->Mix(pOutput, nFrames, [&](float *const *ppChannels, u16 nCount) {
+        for (u8 ch{0}; ch < nStreamChannels; ++ch) {
+            for (u16 n{0}; n < nCount; ++n) {
+                ppChannels[ch][n] = pLevels[ch];
+            }
+        }
+    });
+}
+
+/**
+ * Mix blocks of a stereo stream to a stereo device, and measure how far the
+ * output strays from a linear ramp from one pair of levels to another.
+ * @param fFrom Left and right before the change.
+ * @param fTo Left and right after it.
+ * @param nFrames Frames to check, from the block after the change on.
+ * @param pMaxStep Set to the largest step from one frame to the next.
+ * @return The largest error.
+ */
+static float MeasureRamp(CMixer *pMixer, const float *pLevels, const float (&fFrom)[2], const float (&fTo)[2],
+                         unsigned nRampFrames, unsigned nFrames, float *pMaxStep)
+{
+    // Blocks of 30 frames, so that ramps end mid-block and the vectorised
+    // mixing leaves a remainder.
+    constexpr u16 nBlockFrames{30};
+    float output[2 * nBlockFrames];
+    float fError{0.f}, fLast[2]{fFrom[0], fFrom[1]};
+    *pMaxStep = 0.f;
+    for (unsigned nFrame{0}; nFrame < nFrames; nFrame += nBlockFrames) {
+        MixLevels(pMixer, pLevels, 2, nBlockFrames, output);
+        for (u16 n{0}; n < nBlockFrames; ++n) {
+            const unsigned k{nFrame + n + 1};
+            for (u8 ch{0}; ch < 2; ++ch) {
+                const float fExpected{k >= nRampFrames ? fTo[ch]
+                                                       : fFrom[ch] + (fTo[ch] - fFrom[ch]) * k / nRampFrames};
+                fError = fmaxf(fError, fabsf(output[2 * n + ch] - fExpected));
+                *pMaxStep = fmaxf(*pMaxStep, fabsf(output[2 * n + ch] - fLast[ch]));
+                fLast[ch] = output[2 * n + ch];
+            }
+        }
+    }
+    return fError;
+}
+
+/**
+ * The mixer's defaults play as without it; and gain, master, pan, mute and
+ * the monitor mix each ramp linearly to their new levels, from wherever a
+ * ramp they cut short got to, without steps.
+ */
+static void TestMixer()
+{
+    constexpr u16 nRampFrames{64};
+    constexpr float fTolerance{1e-5f};
+    const float levels[2]{.5f, -.25f};
+    float fStep;
+
+    CMixer stereo{2, 2, 32, 32, nRampFrames, 1.f};
+    CHECK(MeasureRamp(&stereo, levels, {.5f, -.25f}, {.5f, -.25f}, nRampFrames, 60, &fStep) == 0.f);
+
+    // Left to half-right: left at half, and all of it on the right.
+    stereo.SetPan(0, .5f);
+    float fError{MeasureRamp(&stereo, levels, {.5f, -.25f}, {.25f, .25f}, nRampFrames, 90, &fStep)};
+    CHECK(fError < fTolerance);
+    CHECK(fStep < .5f / nRampFrames + fTolerance);
+
+    stereo.SetGain(0, 2.f);
+    stereo.SetMaster(.5f);
+    fError = fmaxf(fError, MeasureRamp(&stereo, levels, {.25f, .25f}, {.25f, .375f}, nRampFrames, 90, &fStep));
+    CHECK(fError < fTolerance);
+
+    // Muted for one block and back: from 30 frames into the ramp down, back
+    // up, with no step bigger than the first ramp's.
+    stereo.SetMute(0, true);
+    float fHalfway[2]{.25f - .25f * 30 / nRampFrames, .375f - .5f * 30 / nRampFrames};
+    fError = fmaxf(fError, MeasureRamp(&stereo, levels, {.25f, .375f}, {0.f, -.125f}, nRampFrames, 30, &fStep));
+    stereo.SetMute(0, false);
+    float fMaxStep{fStep};
+    fError = fmaxf(fError, MeasureRamp(&stereo, levels, fHalfway, {.25f, .375f}, nRampFrames, 90, &fStep));
+    fMaxStep = fmaxf(fMaxStep, fStep);
+    CHECK(fError < fTolerance);
+    CHECK(fMaxStep < .5f / nRampFrames + fTolerance);
+    printf("  ramps within %.1e of linear, steps of at most %.4f over %u frames\n", static_cast<double>(fError),
+           static_cast<double>(fMaxStep), nRampFrames);
+
+    // Mono on both sides; panned hard left, off the right.
+    float output[2 * 32];
+    CMixer mono{1, 2, 32, 32, nRampFrames, 1.f};
+    MixLevels(&mono, levels, 1, 32, output);
+    CHECK(output[0] == .5f && output[1] == .5f && output[62] == .5f && output[63] == .5f);
+    mono.SetPan(0, -1.f);
+    for (int n{0}; n < 3; ++n) {
+        MixLevels(&mono, levels, 1, 32, output);
+    }
+    CHECK(output[62] == .5f && fabsf(output[63]) < fTolerance);
+
+    // A stereo stream on a mono device: the first channel, and no pan.
+    CMixer single{2, 1, 32, 32, nRampFrames, 1.f};
+    single.SetPan(0, 1.f);
+    for (int n{0}; n < 3; ++n) {
+        MixLevels(&single, levels, 2, 32, output);
+    }
+    CHECK(output[0] == .5f && output[31] == .5f);
+
+    // A stereo stream on four channels: left and right, then silence.
+    float quad[4 * 32];
+    CMixer four{2, 4, 32, 32, nRampFrames, 1.f};
+    MixLevels(&four, levels, 2, 32, quad);
+    CHECK(quad[0] == .5f && quad[1] == -.25f && quad[2] == 0.f && quad[3] == 0.f && quad[126] == 0.f
+          && quad[127] == 0.f);
+
+    // The monitor ramps up to a level of what was captured.
+    const float silence[2]{};
+    u32 captured[2 * 32];
+    for (u16 n{0}; n < 32; ++n) {
+        captured[2 * n] = 1 << 22;
+        captured[2 * n + 1] = static_cast<u32>(-(1 << 21));
+    }
+    stereo.Capture(captured);
+    stereo.SetMonitor(.5f);
+    float fMonitorError{0.f};
+    for (unsigned nFrame{0}; nFrame < 3 * 32; nFrame += 32) {
+        MixLevels(&stereo, silence, 2, 32, output);
+        stereo.AddMonitor(output);
+        for (u16 n{0}; n < 32; ++n) {
+            const unsigned k{nFrame + n + 1};
+            const float fGain{.5f * (k < nRampFrames ? static_cast<float>(k) / nRampFrames : 1.f)};
+            fMonitorError = fmaxf(fMonitorError, fabsf(output[2 * n] - fGain * .5f));
+            fMonitorError = fmaxf(fMonitorError, fabsf(output[2 * n + 1] + fGain * .25f));
+        }
+    }
+    CHECK(fMonitorError < fTolerance);
+}
+
+//// Stream decoder ///////////////////////////////////////////////////////////
+
+/**
+ * Encode a packet of nWireChannels, two of a stereo fifo's blocks long, in
+ * samples Bytes wide, decode it into T, and count the samples that aren't
+ * what rescaling the wire's would give. The first two frames are the wire's
+ * extremes; the rest, scattered over its range.
+ */
+template<unsigned Bytes, typename T>
+static unsigned CountDecodeErrors(u8 nWireChannels)
+{
+    constexpr u8 nChannels{2};
+    constexpr u16 nBlockFrames{32}, nPacketFrames{2 * nBlockFrames};
+    constexpr unsigned nWireBits{TWireSample<Bytes>::k_nBits}, nBits{TSampleTraits<T>::k_nBits};
+
+    CStreamDecoder<T> decoder{nChannels, nBlockFrames, 48000};
+    if (!decoder.Negotiate({nPacketFrames, 48000, Bytes, nWireChannels}) || decoder.GetBlocksPerPacket() != 2) {
+        return nChannels * nPacketFrames;
+    }
+
+    u8 payload[3 * nPacketFrames * BIT32];
+    int wire[3][nPacketFrames];
+    for (u8 ch{0}; ch < nWireChannels; ++ch) {
+        for (u16 n{0}; n < nPacketFrames; ++n) {
+            u32 nRandom{n == 0 ? 0x80000000u : n == 1 ? 0x7fffffffu : (n * 2654435761u) ^ (ch * 40503u)};
+            // Floats hold fewer bits than that: take what the wire holds.
+            u8 *pSample{payload + (ch * nPacketFrames + n) * Bytes};
+            TWireSample<Bytes>::Put(pSample, static_cast<int>(nRandom) >> (32 - nWireBits));
+            wire[ch][n] = TWireSample<Bytes>::Get(pSample);
+        }
+    }
+
+    unsigned nErrors{0};
+    for (unsigned nBlock{0}; nBlock < decoder.GetBlocksPerPacket(); ++nBlock) {
+        T left[nBlockFrames], right[nBlockFrames];
+        T *const block[nChannels]{left, right};
+        decoder.Decode(payload, nBlock, block);
+        for (u8 ch{0}; ch < nChannels; ++ch) {
+            // A mono stream goes to both channels; a third is dropped.
+            const int *pWire{wire[ch < nWireChannels ? ch : nWireChannels - 1] + nBlock * nBlockFrames};
+            for (u16 n{0}; n < nBlockFrames; ++n) {
+                int nExpected{nWireBits > nBits ? pWire[n] >> (nWireBits - nBits) : pWire[n] * (1 << (nBits - nWireBits))};
+                nErrors += TSampleTraits<T>::Centre(block[ch][n]) != nExpected;
+            }
+        }
+    }
+
+    return nErrors;
+}
+
+/**
+ * A sample as JackTrip's AudioInterface::fromSampleToBitConversion() puts it
+ * on the wire, and as fromBitToSampleConversion() reads it back.
+ */
+struct TWireVector
+{
+    unsigned nBytes;
+    u8 bytes[4];
+    float fJackTrip;
+};
+
+static const TWireVector s_WireVectors[]{
+        {BIT8, {0x40}, 64 / 127.f},
+        {BIT8, {0xd6}, -42 / 127.f},
+        {BIT8, {0x81}, -1.f},
+        {BIT16, {0x00, 0x40}, 16384 / 32767.f},
+        {BIT16, {0x56, 0xd5}, -10922 / 32767.f},
+        {BIT16, {0x01, 0x80}, -1.f},
+        {BIT24, {0x00, 0xe0, 0x00}, -.25f},
+        {BIT24, {0xaa, 0x2a, 0xaa}, (10922 + 170 / 256.f) / 32768},
+        {BIT24, {0x55, 0xd5, 0x55}, (-10923 + 85 / 256.f) / 32768},
+        {BIT24, {0x00, 0x80, 0x00}, -1.f},
+        {BIT32, {0x00, 0x00, 0x00, 0x3f}, .5f},
+        {BIT32, {0xab, 0xaa, 0xaa, 0xbe}, -1.f / 3},
+        {BIT32, {0x00, 0x00, 0x80, 0xbf}, -1.f},
+};
+
+/**
+ * @return How far a sample read from the wire is from what JackTrip reads,
+ * as a fraction of full scale; or 1, if it isn't put back as it was.
+ */
+template<unsigned Bytes>
+static double WireError(const TWireVector &vector)
+{
+    const int x{TWireSample<Bytes>::Get(vector.bytes)};
+    u8 bytes[4]{};
+    TWireSample<Bytes>::Put(bytes, x);
+    if (memcmp(bytes, vector.bytes, sizeof bytes) != 0) {
+        return 1;
+    }
+    return fabs(x / static_cast<double>(1ull << (TWireSample<Bytes>::k_nBits - 1)) - vector.fJackTrip);
+}
+
+/**
+ * Samples from JackTrip read as it reads them, give or take its scaling of 8
+ * and 16-bit samples by 127 and 32767, and are put back byte for byte.
+ */
+static void TestWireFormat()
+{
+    double fMaxError[BIT32 + 1]{};
+    for (const TWireVector &vector: s_WireVectors) {
+        double fError;
+        switch (vector.nBytes) {
+            case BIT8:
+                fError = WireError<BIT8>(vector);
+                CHECK(fError <= 1. / 127);
+                break;
+            case BIT16:
+                fError = WireError<BIT16>(vector);
+                CHECK(fError <= 1. / 32767);
+                break;
+            case BIT24:
+                fError = WireError<BIT24>(vector);
+                CHECK(fError <= 1. / (1 << 24));
+                break;
+            default:
+                fError = WireError<BIT32>(vector);
+                CHECK(fError <= 1. / (1 << 24));
+                break;
+        }
+        fMaxError[vector.nBytes] = fmax(fMaxError[vector.nBytes], fError);
+    }
+    printf("  within %.1e, %.1e, %.1e and %.1e of JackTrip at 8, 16, 24 and 32 bits\n", fMaxError[BIT8],
+           fMaxError[BIT16], fMaxError[BIT24], fMaxError[BIT32]);
+
+    // Floats beyond full scale clip; NaN is silence.
+    const float fOver{2.f}, fUnder{-2.f}, fNaN{NAN};
+    u8 bytes[4];
+    memcpy(bytes, &fOver, sizeof bytes);
+    CHECK(TWireSample<BIT32>::Get(bytes) == 0x7fffffff);
+    memcpy(bytes, &fUnder, sizeof bytes);
+    CHECK(TWireSample<BIT32>::Get(bytes) == -0x7fffffff - 1);
+    memcpy(bytes, &fNaN, sizeof bytes);
+    CHECK(TWireSample<BIT32>::Get(bytes) == 0);
+}
+
+template<typename T>
+static void CheckDecode()
+{
+    for (u8 nWireChannels{1}; nWireChannels <= 3; ++nWireChannels) {
+        CHECK((CountDecodeErrors<BIT8, T>(nWireChannels) == 0));
+        CHECK((CountDecodeErrors<BIT16, T>(nWireChannels) == 0));
+        CHECK((CountDecodeErrors<BIT24, T>(nWireChannels) == 0));
+        CHECK((CountDecodeErrors<BIT32, T>(nWireChannels) == 0));
+    }
+}
+
+/**
+ * Formats are read from headers, and negotiated or refused; and every sample
+ * format on the wire decodes into every sample format the fifo can hold, from
+ * mono, stereo and three-channel streams.
+ */
+static void TestStreamDecode()
+{
+    TJackTripPacketHeader header{};
+    header.nBufferSize = 64;
+    header.nSamplingRate = SR48;
+    header.nBitResolution = 24;
+    header.nNumIncomingChannelsFromNet = 1;
+    TStreamFormat format{};
+    CHECK(CStreamDecoder<s16>::Parse(header, &format));
+    CHECK(format.nBlockFrames == 64 && format.nSampleRate == 48000 && format.nSampleBytes == BIT24
+          && format.nChannels == 1);
+    header.nBitResolution = 12;
+    CHECK(!CStreamDecoder<s16>::Parse(header, &format));
+    header.nBitResolution = 16;
+    header.nSamplingRate = UNDEF;
+    CHECK(!CStreamDecoder<s16>::Parse(header, &format));
+    header.nSamplingRate = SR48;
+    header.nNumIncomingChannelsFromNet = 0;
+    CHECK(!CStreamDecoder<s16>::Parse(header, &format));
+
+    CStreamDecoder<s16> decoder{2, 32, 48000};
+    CHECK(!decoder.Negotiate({32, 44100, BIT16, 2}));
+    CHECK(!decoder.Negotiate({48, 48000, BIT16, 2}));
+    CHECK(!decoder.IsNegotiated());
+    CHECK(decoder.Negotiate({32, 48000, BIT16, 2}) && decoder.IsNative());
+    CHECK(decoder.GetPacketSize() == PACKET_HEADER_SIZE + 2 * 32 * 2);
+    header.nBufferSize = 32;
+    header.nNumIncomingChannelsFromNet = 2;
+    CHECK(decoder.Matches(header));
+    header.nBitResolution = 24;
+    CHECK(!decoder.Matches(header));
+    CHECK(decoder.Negotiate({64, 48000, BIT16, 2}) && !decoder.IsNative());
+    CHECK(decoder.Negotiate({32, 48000, BIT16, 1}) && !decoder.IsNative());
+    CHECK(decoder.Negotiate({32, 48000, BIT24, 2}) && !decoder.IsNative());
+    decoder.Reset();
+    CHECK(!decoder.IsNegotiated() && !decoder.Matches(header));
+
+    const unsigned nChecks{s_nChecks};
+    CheckDecode<u8>();
+    CheckDecode<s16>();
+    CheckDecode<s32>();
+    CheckDecode<u32>();
+    printf("  decoded 8, 16, 24 and 32-bit streams of 1-3 channels into u8, s16, s24 and u32: %u combinations\n",
+           s_nChecks - nChecks);
+}
+
+//// Latency monitor //////////////////////////////////////////////////////////
+
+static int CompareTimes(const void *pA, const void *pB)
+{
+    const u32 a{*static_cast<const u32 *>(pA)}, b{*static_cast<const u32 *>(pB)};
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * @return How far a percentile the histogram gives is from the exact one, as
+ * a fraction of it.
+ */
+static float PercentileError(u32 nGiven, const u32 *pSorted, unsigned nCount, unsigned nPermille)
+{
+    const u32 nExact{pSorted[(nCount * nPermille + 999) / 1000 - 1]};
+    return fabsf(static_cast<float>(nGiven) - static_cast<float>(nExact)) / static_cast<float>(nExact);
+}
+
+/**
+ * The histogram's percentiles against exact ones, of times spread over five
+ * decades, and of a long tail; and the monitor's sums of synthetic packets'
+ * round trips, queueing and packetisation, across the timer wrapping.
+ */
+static void TestLatency()
+{
+    CLatencyHistogram histogram;
+    TPercentiles p;
+    histogram.GetPercentiles(&p);
+    CHECK(p.nCount == 0 && p.n50 == 0 && p.nMax == 0);
+
+    // Exact, a microsecond a bucket, up to 32 us.
+    for (u32 n{0}; n < 32; ++n) {
+        histogram.Add(n);
+    }
+    histogram.GetPercentiles(&p);
+    CHECK(p.nCount == 32 && p.n50 == 15 && p.n95 == 30 && p.n99 == 31 && p.nMax == 31);
+
+    // Log-uniform from 10 us to 1 s.
+    constexpr unsigned nCount{10000};
+    static u32 times[nCount];
+    u32 nState{3};
+    histogram.Reset();
+    for (u32 &nTime: times) {
+        nTime = static_cast<u32>(10.f * powf(10.f, 5.f * static_cast<float>(Random(&nState) % 65536) / 65536.f));
+        histogram.Add(nTime);
+    }
+    qsort(times, nCount, sizeof times[0], CompareTimes);
+    histogram.GetPercentiles(&p);
+    float fError{PercentileError(p.n50, times, nCount, 500)};
+    fError = fmaxf(fError, PercentileError(p.n95, times, nCount, 950));
+    fError = fmaxf(fError, PercentileError(p.n99, times, nCount, 990));
+    printf("  percentiles of %u times from 10 us to 1 s within %.1f%% of exact\n", nCount,
+           static_cast<double>(fError) * 100);
+    CHECK(p.nCount == nCount && p.nMax == times[nCount - 1]);
+    CHECK(fError < 1.f / 32);
+
+    // A long tail: 1% at 10 s, and one beyond the top bucket.
+    histogram.Reset();
+    for (unsigned n{0}; n < 990; ++n) {
+        histogram.Add(1000);
+    }
+    for (unsigned n{0}; n < 9; ++n) {
+        histogram.Add(10000000);
+    }
+    histogram.Add(20000000);
+    histogram.GetPercentiles(&p);
+    CHECK(fabsf(static_cast<float>(p.n99) - 1000.f) < 1000.f / 32);
+    CHECK(p.nMax == 20000000);
+
+    // 10 ms in the fifo, a 4 ms round trip, 32 frames (666 us) a packet, and
+    // 1 ms from the fifo to the DAC.
+    CLatencyMonitor monitor{48000, 1000};
+    unsigned nTicks{0xfffff000u};
+    monitor.OnPacket(nTicks, 1234, 32, 480);
+    CHECK(monitor.GetFIFO().GetCount() == 1 && monitor.GetRoundTrip().GetCount() == 0);
+    CHECK(monitor.GetTotal().GetCount() == 0);
+    for (unsigned n{0}; n < 100; ++n) {
+        nTicks += 666;
+        // Every other packet stamped with one the server echoed.
+        const u64 nTimeStamp{n % 2 == 0 ? TIMESTAMP_ECHO | static_cast<u32>(nTicks - 4000) : 1234};
+        monitor.OnPacket(nTicks, nTimeStamp, 32, 480);
+    }
+    CHECK(nTicks < 0x10000u);
+    monitor.GetRoundTrip().GetPercentiles(&p);
+    CHECK(p.nCount == 50 && p.nMax == 4000);
+    monitor.GetTotal().GetPercentiles(&p);
+    CHECK(p.nCount == 100 && p.nMax == 666 + 2000 + 10000 + 1000);
+    monitor.GetFIFO().GetPercentiles(&p);
+    CHECK(p.nCount == 101 && p.nMax == 10000);
+
+    // Until the server echoes again, there's no round trip to add up.
+    monitor.Reset();
+    monitor.OnPacket(nTicks + 666, 1234, 32, 480);
+    CHECK(monitor.GetTotal().GetCount() == 100 && monitor.GetFIFO().GetCount() == 102);
+}
+
+//// Runner ///////////////////////////////////////////////////////////////////
+
+struct TTest
+{
+    const char *pName;
+    void (*pRun)();
+};
+
+static const TTest s_Tests[]{
+        {"sequence", TestSequence},
+        {"sequence-reset", TestSequenceReset},
+        {"sequence-jump", TestSequenceJump},
+        {"fifo-stress", TestFIFOStress},
+        {"fifo-shapes", TestFIFOShapes},
+        {"fifo-restart", TestFIFORestart},
+        {"capture-ring", TestCaptureRing},
+        {"jitter-steady", TestJitterSteady},
+        {"jitter-bursty", TestJitterBursty},
+        {"clock-recovery", TestClockRecovery},
+        {"resampler-thdn", TestResamplerTHDN},
+        {"resampler-tracking", TestResamplerTracking},
+        {"logring", TestLogRing},
+        {"audio-core", TestAudioCore},
+        {"arena", TestAudioArena},
+        {"fixed-output", TestFixedOutput},
+        {"mixer", TestMixer},
+        {"wire-format", TestWireFormat},
+        {"stream-decode", TestStreamDecode},
+        {"latency", TestLatency},
+};
+
+int main(int argc, char **argv)
+{
+    for (const TTest &test: s_Tests) {
+        bool bSelected{argc == 1};
+        for (int n{1}; n < argc; ++n) {
+            bSelected = bSelected || strcmp(argv[n], test.pName) == 0;
+        }
+        if (!bSelected) {
+            continue;
+        }
+
+        unsigned nFailures{s_nFailures};
+        printf("%s\n", test.pName);
+        test.pRun();
+        printf("%s: %s\n", test.pName, s_nFailures == nFailures ? "ok" : "FAILED");
+    }
+
+    printf("jttest: %u checks, %u failed\n", s_nChecks, s_nFailures);
+    return s_nFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,36 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AudioArena.h"
+#include <assert.h>
+
+alignas(CAudioArena::k_nCacheLine) u8 CAudioArena::s_Pool[AUDIO_ARENA_BYTES];
+unsigned CAudioArena::s_nUsed{0};
+
+void *CAudioArena::Allocate(unsigned nBytes)
+{
+    unsigned nSize{(nBytes + k_nCacheLine - 1) & ~(k_nCacheLine - 1)};
+    assert(s_nUsed + nSize <= AUDIO_ARENA_BYTES);
+    if (s_nUsed + nSize > AUDIO_ARENA_BYTES) {
+        return nullptr;
+    }
+
+    void *pBuffer{s_Pool + s_nUsed};
+    s_nUsed += nSize;
+    return pBuffer;
+}
@@ -0,0 +1,67 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_AUDIOARENA_H
+#define JACKTRIP_PI_AUDIOARENA_H
+
+#include <circle/types.h>
+#include "config.h"
+
+/**
+ * A static pool for the buffers the sound interrupt and the audio core work
+ * on: the fifo's, the capture ring's, the resampler's, the loss concealer's,
+ * the mixer's and the audio core's chunks. They are carved out of it while the client starts up, and never
+ * given back, so the audio path never touches the heap. Each starts on a
+ * cache line of its own, and takes up whole lines, so that no two buffers,
+ * nor a buffer and the heap, share one.
+ *
+ * Not thread-safe: allocate from the main task, before the audio path runs.
+ */
+class CAudioArena
+{
+public:
+    /**
+     * @param nBytes
+     * @return nBytes, aligned to a cache line; nullptr if the arena is
+     * exhausted (see AUDIO_ARENA_BYTES).
+     */
+    static void *Allocate(unsigned nBytes);
+
+    /**
+     * @param nCount
+     * @return Room for nCount Ts.
+     */
+    template<typename T>
+    static T *Allocate(unsigned nCount)
+    {
+        return static_cast<T *>(Allocate(nCount * static_cast<unsigned>(sizeof(T))));
+    }
+
+    /**
+     * @return Bytes allocated so far.
+     */
+    static unsigned GetUsed(void) { return s_nUsed; }
+
+    static constexpr unsigned k_nCacheLine{64};
+
+private:
+    alignas(k_nCacheLine) static u8 s_Pool[AUDIO_ARENA_BYTES];
+    static unsigned s_nUsed;
+};
+
+#endif //JACKTRIP_PI_AUDIOARENA_H
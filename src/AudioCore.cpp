@@ -0,0 +1,133 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AudioCore.h"
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+#include "AudioArena.h"
+#include "Profiler.h"
+
+CAudioCore::CAudioCore(CMemorySystem *pMemorySystem, TRenderChunkHandler *pRenderHandler, void *pParam,
+                       unsigned nChunkSize, u32 nSilence) :
+        CMultiCoreSupport(pMemorySystem),
+        m_pRenderHandler(pRenderHandler),
+        m_pParam(pParam),
+        k_nChunkSize(nChunkSize),
+        k_nSilence(nSilence)
+{
+    assert(m_pRenderHandler);
+    for (auto &slot: m_Slots) {
+        slot.pBuffer = CAudioArena::Allocate<u32>(k_nChunkSize);
+        assert(slot.pBuffer);
+        slot.nTimestamp = 0;
+    }
+    m_Stats.nMinLatency = static_cast<unsigned>(-1);
+}
+
+CAudioCore::~CAudioCore(void)
+{
+    // The slots' buffers are the audio arena's, and stay allocated.
+}
+
+void CAudioCore::Run(unsigned nCore)
+{
+    // Cores 2 and 3 have nothing to do; returning halts them.
+    if (nCore != k_nAudioCore) {
+        return;
+    }
+
+    if (PROFILING) {
+        CProfiler::EnableCounter();
+    }
+
+    while (true) {
+        u32 write{__atomic_load_n(&m_nWriteIndex, __ATOMIC_RELAXED)};
+
+        if (write - __atomic_load_n(&m_nReadIndex, __ATOMIC_ACQUIRE) == k_nSlots) {
+            // Ring full; Fetch() signals once it frees a slot.
+            WaitForEvent();
+            continue;
+        }
+
+        TSlot &slot{m_Slots[write % k_nSlots]};
+        (*m_pRenderHandler)(slot.pBuffer, k_nChunkSize, m_pParam);
+        slot.nTimestamp = CTimer::GetClockTicks();
+
+        __atomic_store_n(&m_nWriteIndex, write + 1, __ATOMIC_RELEASE);
+    }
+}
+
+unsigned CAudioCore::Fetch(u32 *pBuffer, unsigned nChunkSize)
+{
+    assert(nChunkSize == k_nChunkSize);
+
+    u32 read{__atomic_load_n(&m_nReadIndex, __ATOMIC_RELAXED)};
+
+    if (read == __atomic_load_n(&m_nWriteIndex, __ATOMIC_ACQUIRE)) {
+        // Core 1 fell behind (or hasn't started yet).
+        for (unsigned i = 0; i < nChunkSize; ++i) {
+            pBuffer[i] = k_nSilence;
+        }
+        ++m_Stats.nStarved;
+        return nChunkSize;
+    }
+
+    const TSlot &slot{m_Slots[read % k_nSlots]};
+    memcpy(pBuffer, slot.pBuffer, nChunkSize * sizeof(u32));
+
+    unsigned latency{CTimer::GetClockTicks() - slot.nTimestamp};
+
+    __atomic_store_n(&m_nReadIndex, read + 1, __ATOMIC_RELEASE);
+    // Wake core 1 to render into the slot just freed.
+    DataSyncBarrier();
+    SendEvent();
+
+    ++m_Stats.nBlocks;
+    m_nLatencySum += latency;
+    if (latency < m_Stats.nMinLatency) m_Stats.nMinLatency = latency;
+    if (latency > m_Stats.nMaxLatency) m_Stats.nMaxLatency = latency;
+
+    return nChunkSize;
+}
+
+void CAudioCore::GetStats(THandoffStats *pStats)
+{
+    assert(pStats);
+
+    // Fetch() runs in the sound interrupt on this core.
+    EnterCritical();
+
+    *pStats = m_Stats;
+    pStats->nMeanLatency = m_Stats.nBlocks > 0 ? static_cast<unsigned>(m_nLatencySum / m_Stats.nBlocks) : 0;
+    if (m_Stats.nBlocks == 0) {
+        pStats->nMinLatency = 0;
+    }
+
+    m_Stats = THandoffStats{};
+    m_Stats.nMinLatency = static_cast<unsigned>(-1);
+    m_nLatencySum = 0;
+
+    LeaveCritical();
+}
+
+#endif // ARM_ALLOW_MULTI_CORE
@@ -0,0 +1,125 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_AUDIOCORE_H
+#define JACKTRIP_PI_AUDIOCORE_H
+
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+#include "config.h"
+
+#if AUDIO_CORE && !defined(ARM_ALLOW_MULTI_CORE)
+#error "AUDIO_CORE needs Circle built with ARM_ALLOW_MULTI_CORE."
+#endif
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+#include <circle/multicore.h>
+#include <circle/memory.h>
+
+/**
+ * Fills a sound device chunk, on the audio core.
+ * @param pBuffer
+ * @param nChunkSize In words.
+ * @param pParam As given to CAudioCore.
+ */
+typedef void TRenderChunkHandler(u32 *pBuffer, unsigned nChunkSize, void *pParam);
+
+/**
+ * Core-to-core handoff statistics, accumulated since the previous call to
+ * CAudioCore::GetStats().
+ */
+struct THandoffStats
+{
+    unsigned nBlocks;
+    // Fetches that found no block ready, and played silence.
+    unsigned nStarved;
+    // Time from a block being rendered to the sound device fetching it, in
+    // microseconds; max - min is the handoff jitter.
+    unsigned nMinLatency, nMaxLatency, nMeanLatency;
+};
+
+/**
+ * Runs the audio path -- draining the fifo, resampling, converting samples --
+ * on core 1, leaving core 0 to the network stack, the scheduler and the sound
+ * device's interrupt. Core 1 renders device chunks ahead into a small
+ * single-producer/single-consumer ring; the interrupt handler only copies the
+ * next one out, so a burst of network traffic or logging on core 0 can't
+ * delay the DMA refill.
+ */
+class CAudioCore : public CMultiCoreSupport
+{
+public:
+    /**
+     * @param pMemorySystem
+     * @param pRenderHandler Renders the chunks, e.g. by way of
+     * CJackTripClient::RenderChunk().
+     * @param pParam For pRenderHandler.
+     * @param nChunkSize Size of a sound device chunk, in words.
+     * @param nSilence Word to play if no chunk is ready in time.
+     */
+    CAudioCore(CMemorySystem *pMemorySystem, TRenderChunkHandler *pRenderHandler, void *pParam, unsigned nChunkSize,
+               u32 nSilence);
+
+    ~CAudioCore(void);
+
+    void Run(unsigned nCore) override;
+
+    /**
+     * Copy the next rendered chunk out to the sound device. Call from the
+     * sound device's interrupt handler on core 0.
+     * @param pBuffer
+     * @param nChunkSize Must equal the size given to the constructor.
+     * @return nChunkSize
+     */
+    unsigned Fetch(u32 *pBuffer, unsigned nChunkSize);
+
+    /**
+     * Read, and reset, the handoff statistics. Call on core 0.
+     * @param pStats
+     */
+    void GetStats(THandoffStats *pStats);
+
+private:
+    static constexpr unsigned k_nAudioCore{1};
+    static constexpr u32 k_nSlots{AUDIO_CORE_CHUNKS};
+
+    struct TSlot
+    {
+        u32 *pBuffer;
+        unsigned nTimestamp;
+    };
+
+    TRenderChunkHandler *m_pRenderHandler;
+    void *m_pParam;
+    const unsigned k_nChunkSize;
+    const u32 k_nSilence;
+    TSlot m_Slots[k_nSlots];
+
+    // Written by core 1 and core 0 respectively; keep them apart.
+    alignas(64) u32 m_nWriteIndex{0};
+    alignas(64) u32 m_nReadIndex{0};
+
+    // Touched only by Fetch() and GetStats(), on core 0.
+    alignas(64) THandoffStats m_Stats{};
+    unsigned long long m_nLatencySum{0};
+};
+
+#endif // ARM_ALLOW_MULTI_CORE
+
+#endif //JACKTRIP_PI_AUDIOCORE_H
@@ -0,0 +1,208 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_BLOCKRING_H
+#define JACKTRIP_PI_BLOCKRING_H
+
+#include <circle/types.h>
+#include <assert.h>
+#include "AudioArena.h"
+#include "convert.h"
+
+/**
+ * Single-producer, single-consumer ring of whole datagrams, for the uplink.
+ *
+ * The producer (the sound device's capture interrupt) converts captured
+ * frames straight into the payload of the next free slot, channel-planar, as
+ * JackTrip sends it, and publishes the slot once it holds a block. The
+ * consumer (the send task) fills in the header of the oldest published slot
+ * and sends the slot as it is, so the payload is never copied again.
+ *
+ * As in CFIFO, each side owns one index and only reads the other's. The
+ * consumer opens the ring with Start() when it is ready to send; until then
+ * captured frames are discarded. If the consumer falls behind and the ring
+ * fills up, newly captured blocks are dropped.
+ */
+template<typename T>
+class CBlockRing
+{
+public:
+    /**
+     * @param nChannels
+     * @param nBlockFrames Frames per datagram.
+     * @param nSlots Datagrams the ring can hold, plus one.
+     * @param nHeaderSize Space to leave for the header at the start of each
+     * datagram, in bytes.
+     * @param nInputChannels Channels per captured frame; 0 for nChannels.
+     * Channels beyond them are sent silent; those beyond nChannels dropped.
+     */
+    CBlockRing(u8 nChannels, u16 nBlockFrames, unsigned nSlots, unsigned nHeaderSize, u8 nInputChannels = 0) :
+            k_nChannels{nChannels},
+            k_nInputChannels{nInputChannels ? nInputChannels : nChannels},
+            k_nBlockFrames{nBlockFrames},
+            k_nSlots{nSlots},
+            k_nHeaderSize{nHeaderSize},
+            k_nDatagramSize{nHeaderSize + nChannels * nBlockFrames * static_cast<unsigned>(sizeof(T))},
+            // Whole cache lines per slot, so that the capture side filling one
+            // and the sender reading the one before never share a line.
+            k_nSlotSize{(k_nDatagramSize + CAudioArena::k_nCacheLine - 1) & ~(CAudioArena::k_nCacheLine - 1)},
+            m_pBuffer{CAudioArena::Allocate<u8>(nSlots * k_nSlotSize)}
+    {
+        assert(m_pBuffer);
+        assert(nChannels <= k_nMaxChannels);
+        assert(nSlots > 1);
+        memset(m_pBuffer, 0, nSlots * k_nSlotSize);
+
+        // Channels that nothing is captured for are never written again.
+        const T silence{TSampleTraits<T>::FromCentred(0)};
+        for (unsigned slot{0}; slot < nSlots; ++slot) {
+            T *pPayload{reinterpret_cast<T *>(m_pBuffer + slot * k_nSlotSize + k_nHeaderSize)};
+            for (unsigned n{0}; n < nChannels * nBlockFrames; ++n) {
+                pPayload[n] = silence;
+            }
+        }
+    }
+
+    /**
+     * Convert captured frames into the ring. Producer side only.
+     * @param pFrames Sample-interleaved, as the sound device delivers them.
+     * @param nFrames
+     * @return Number of blocks completed and published.
+     */
+    unsigned Write(const u32 *pFrames, unsigned nFrames)
+    {
+        if (!__atomic_load_n(&m_bStarted, __ATOMIC_ACQUIRE)) {
+            m_nFrame = 0;
+            return 0;
+        }
+
+        unsigned nPublished{0};
+        u32 writeIndex{__atomic_load_n(&m_nWriteIndex, __ATOMIC_RELAXED)};
+
+        while (nFrames > 0) {
+            unsigned count{k_nBlockFrames - m_nFrame};
+            if (count > nFrames) {
+                count = nFrames;
+            }
+
+            T *channels[k_nMaxChannels];
+            T *pPayload{reinterpret_cast<T *>(m_pBuffer + writeIndex * k_nSlotSize + k_nHeaderSize)};
+            for (u8 ch{0}; ch < k_nChannels; ++ch) {
+                channels[ch] = pPayload + ch * k_nBlockFrames + m_nFrame;
+            }
+            CConvert::FromDevice(channels, pFrames, k_nChannels < k_nInputChannels ? k_nChannels : k_nInputChannels,
+                                 count, k_nInputChannels);
+
+            pFrames += count * k_nInputChannels;
+            nFrames -= count;
+            m_nFrame += count;
+
+            if (m_nFrame == k_nBlockFrames) {
+                m_nFrame = 0;
+
+                u32 nextIndex{writeIndex + 1 == k_nSlots ? 0 : writeIndex + 1};
+                if (nextIndex == __atomic_load_n(&m_nReadIndex, __ATOMIC_ACQUIRE)) {
+                    // Full; overwrite this block with the next.
+                    __atomic_fetch_add(&m_nOverruns, 1, __ATOMIC_RELAXED);
+                } else {
+                    writeIndex = nextIndex;
+                    __atomic_store_n(&m_nWriteIndex, writeIndex, __ATOMIC_RELEASE);
+                    ++nPublished;
+                }
+            }
+        }
+
+        return nPublished;
+    }
+
+    /**
+     * Consumer side only.
+     * @return The oldest published datagram, header first, or nullptr if
+     * there is none. It stays valid until Pop().
+     */
+    u8 *Front()
+    {
+        u32 readIndex{__atomic_load_n(&m_nReadIndex, __ATOMIC_RELAXED)};
+        if (readIndex == __atomic_load_n(&m_nWriteIndex, __ATOMIC_ACQUIRE)) {
+            return nullptr;
+        }
+        return m_pBuffer + readIndex * k_nSlotSize;
+    }
+
+    /**
+     * Hand the datagram returned by Front() back to the producer. Consumer
+     * side only.
+     */
+    void Pop()
+    {
+        u32 readIndex{__atomic_load_n(&m_nReadIndex, __ATOMIC_RELAXED)};
+        assert(readIndex != __atomic_load_n(&m_nWriteIndex, __ATOMIC_ACQUIRE));
+        __atomic_store_n(&m_nReadIndex, readIndex + 1 == k_nSlots ? 0 : readIndex + 1, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Discard anything stale and start accepting captured frames. Consumer
+     * side only.
+     */
+    void Start()
+    {
+        __atomic_store_n(&m_nReadIndex, __atomic_load_n(&m_nWriteIndex, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        __atomic_store_n(&m_bStarted, true, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Stop accepting captured frames. Consumer side only.
+     */
+    void Stop()
+    {
+        __atomic_store_n(&m_bStarted, false, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @return Size of a datagram, header included, in bytes.
+     */
+    unsigned GetDatagramSize() const { return k_nDatagramSize; }
+
+    /**
+     * @return Number of blocks dropped because the ring was full.
+     */
+    u32 GetOverruns() const { return __atomic_load_n(&m_nOverruns, __ATOMIC_RELAXED); }
+
+private:
+    static constexpr u8 k_nMaxChannels{8};
+
+    const u8 k_nChannels;
+    const u8 k_nInputChannels;
+    const u16 k_nBlockFrames;
+    const u32 k_nSlots;
+    const unsigned k_nHeaderSize;
+    const unsigned k_nDatagramSize;
+    const unsigned k_nSlotSize;
+
+    // From the audio arena; never freed.
+    u8 *const m_pBuffer;
+    alignas(64) u32 m_nWriteIndex{0};
+    alignas(64) u32 m_nReadIndex{0};
+    bool m_bStarted{false};
+
+    // Producer-side state.
+    unsigned m_nFrame{0};
+    u32 m_nOverruns{0};
+};
+
+#endif //JACKTRIP_PI_BLOCKRING_H
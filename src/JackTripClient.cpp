@@ -31,108 +31,327 @@ static const char FromJTC[] = "jtclient";
 CJackTripClient::CJackTripClient(CLogger *pLogger, CNetSubSystem *pNet, CDevice *pDevice) :
         m_Logger(*pLogger),
         m_pDevice(pDevice),
-        m_FIFO{WRITE_CHANNELS, AUDIO_BLOCK_FRAMES * 16},
-        m_pNet(pNet),
-        m_pUdpSocket(pNet, IPPROTO_UDP)
+        m_FIFO{AUDIO_BLOCK_FRAMES, JITTER_BUFFER_AUTO, PACKET_HEADER_SIZE, MAX_REDUNDANCY},
+        m_JitterTuner{AUDIO_BLOCK_FRAMES, SAMPLE_RATE, JITTER_MIN_DEPTH, JITTER_MAX_DEPTH, JITTER_UNDERRUNS_PER_MIN},
+        m_SequenceTracker{SEQUENCE_WINDOW},
+        m_LossConcealer{WRITE_CHANNELS, AUDIO_BLOCK_FRAMES, SAMPLE_RATE},
+        m_ReceiveMonitor{AUDIO_BLOCK_FRAMES, SAMPLE_RATE},
+        m_LatencyMonitor{SAMPLE_RATE, OUTPUT_LATENCY_US},
+        m_Resampler{DEVICE_CHANNELS, DMA_CHUNK_FRAMES, RESAMPLE_MAX_RATIO},
+        // As many frames as the resampler may ask for.
+        m_Mixer{WRITE_CHANNELS, DEVICE_CHANNELS, static_cast<u16>(DMA_CHUNK_FRAMES * RESAMPLE_MAX_RATIO + 2),
+                DMA_CHUNK_FRAMES, MIXER_RAMP_MS * SAMPLE_RATE / 1000, AUDIO_VOLUME},
+        m_pRenderBuffer{CAudioArena::Allocate<float>(DMA_CHUNK_FRAMES * DEVICE_CHANNELS)},
+        m_pNet(pNet)
 {
+    m_JitterTuner.SetPacketFrames(AUDIO_BLOCK_FRAMES, DMA_CHUNK_FRAMES);
+    m_FIFO.SetTargetDepth(m_JitterTuner.GetTargetDepth());
+    m_Resampler.SetRatio(static_cast<float>(SAMPLE_RATE) / DEVICE_SAMPLE_RATE);
+
     CString ipString;
     m_pNet->GetConfig()->GetIPAddress()->Format(&ipString);
     m_Logger.Write(FromJTC, LogNotice, "IP address is %s", (const char *) ipString);
 }
 
+CJackTripClient::~CJackTripClient()
+{
+    delete m_pTcpSocket;
+    delete m_pUdpSocket;
+    delete m_pCaptureRing;
+}
+
 bool CJackTripClient::Initialize(void)
 {
-//    m_pClockTask = new CClockTask();
     return true;
 }
 
+void CJackTripClient::StartClockRecovery(bool canSteerClock)
+{
+    if (!CLOCK_RECOVERY || m_pClockTask) {
+        return;
+    }
+
+    if (canSteerClock) {
+        m_pClockTask = new CClockTask(&m_FIFO, &m_Connected, nullptr);
+    } else if (RESAMPLER) {
+        // No clock to steer; let the resampler absorb the drift instead.
+        m_bResample = true;
+        m_pClockTask = new CClockTask(&m_FIFO, &m_Connected, &m_Resampler);
+    }
+}
+
+bool CJackTripClient::StartAudioCore(u32 nSilence)
+{
+#if AUDIO_CORE
+    if (m_pAudioCore) {
+        return true;
+    }
+
+    // NB the secondary cores can't be stopped again, so the audio core lives
+    // as long as the client does.
+    m_pAudioCore = new CAudioCore(CMemorySystem::Get(), RenderChunkHandler, this, DMA_CHUNK_FRAMES * DEVICE_CHANNELS,
+                                  nSilence);
+    if (!m_pAudioCore->Initialize()) {
+        m_Logger.Write(FromJTC, LogError, "Failed to start the audio core.");
+        delete m_pAudioCore;
+        m_pAudioCore = nullptr;
+        return false;
+    }
+
+    m_Logger.Write(FromJTC, LogNotice, "Audio path running on core 1.");
+#else
+    (void) nSilence;
+#endif
+
+    return true;
+}
+
+#if AUDIO_CORE
+void CJackTripClient::RenderChunkHandler(u32 *pBuffer, unsigned nChunkSize, void *pParam)
+{
+    static_cast<CJackTripClient *>(pParam)->RenderChunk(pBuffer, nChunkSize);
+}
+#endif
+
+void CJackTripClient::StartCapture()
+{
+    if (m_pCaptureRing) {
+        return;
+    }
+
+    m_pCaptureRing = new CBlockRing<TYPE>(WRITE_CHANNELS, AUDIO_BLOCK_FRAMES, CAPTURE_RING_BLOCKS + 1,
+                                          PACKET_HEADER_SIZE, DEVICE_CHANNELS);
+    m_Logger.Write(FromJTC, LogNotice, "Full duplex: sending captured audio.");
+}
+
+void CJackTripClient::Capture(const u32 *pBuffer, unsigned nChunkSize)
+{
+    if (MIXER) {
+        m_Mixer.Capture(pBuffer);
+    }
+
+    if (!m_pCaptureRing || !m_Connected) {
+        return;
+    }
+
+    if (m_pCaptureRing->Write(pBuffer, nChunkSize / DEVICE_CHANNELS) > 0) {
+        // A block is ready; have the send task send it now.
+        m_Event.Set();
+    }
+}
+
+unsigned CJackTripClient::FillChunk(u32 *pBuffer, unsigned nChunkSize)
+{
+    PROFILE_SCOPE(ProfileGetChunk);
+
+#if AUDIO_CORE
+    if (m_pAudioCore) {
+        return m_pAudioCore->Fetch(pBuffer, nChunkSize);
+    }
+#endif
+
+    RenderChunk(pBuffer, nChunkSize);
+
+    return nChunkSize;
+}
+
+template<TOutputStyle Style>
+void CJackTripClient::Render(u32 *pBuffer, u16 nFrames, float amp, float offset, const TFixedGain &fixedGain,
+                             TDither *pDither)
+{
+    if (MIXER) {
+        auto mix{[this](float *pOutput, u16 nOutputFrames) {
+            m_Mixer.Mix(pOutput, nOutputFrames, [this](float *const *ppStream, u16 nStreamFrames) {
+                m_FIFO.Read(ppStream, nStreamFrames);
+            });
+        }};
+        if (m_bResample) {
+            m_Resampler.Process(m_pRenderBuffer, nFrames, mix);
+        } else {
+            mix(m_pRenderBuffer, nFrames);
+        }
+        m_Mixer.AddMonitor(m_pRenderBuffer);
+
+        CConvert::FloatToDevice<Style>(pBuffer, m_pRenderBuffer, nFrames * DEVICE_CHANNELS, amp, offset, pDither);
+        return;
+    }
+
+    amp *= AUDIO_VOLUME;
+    if (!m_bResample) {
+        if (FIXED_POINT_OUTPUT) {
+            m_FIFO.Read<Style>(pBuffer, nFrames, fixedGain, pDither);
+        } else {
+            m_FIFO.Read<Style>(pBuffer, nFrames, amp, offset);
+        }
+        return;
+    }
+
+    m_Resampler.Process(m_pRenderBuffer, nFrames, [this](float *pInput, u16 nInputFrames) {
+        m_FIFO.Read(pInput, nInputFrames);
+    });
+
+    CConvert::FloatToDevice<Style>(pBuffer, m_pRenderBuffer, nFrames * DEVICE_CHANNELS, amp, offset, pDither);
+}
+
 bool CJackTripClient::Connect(void)
 {
     const u8 ip[] = {SERVER_IP};
     CIPAddress serverIP{ip};
     CString ipString;
     serverIP.Format(&ipString);
-    u16 tcpClientPort, udpPort;
 
-    tcpClientPort = GenerateDynamicPortNumber();
-    do {
-        udpPort = GenerateDynamicPortNumber(tcpClientPort);
-    } while (tcpClientPort == udpPort);
+    unsigned nNow{CTimer::GetClockTicks()};
 
-    auto tcpSocket = new CSocket(m_pNet, IPPROTO_TCP);
-    assert(tcpSocket);
+    switch (m_ConnectState) {
+        case BackingOff: {
+            unsigned nWaitedMs{(nNow - m_nStateStart) / 1000};
+            if (nWaitedMs < m_nBackoffMs) {
+                CScheduler::Get()->MsSleep(m_nBackoffMs - nWaitedMs);
+            }
+            m_nBackoffMs = m_nBackoffMs * 2 > RECONNECT_MAX_MS ? RECONNECT_MAX_MS : m_nBackoffMs * 2;
+            m_ConnectState = Connecting;
+            return false;
+        }
 
-    m_Logger.Write(FromJTC, LogNotice, "Looking for a JackTrip server at %s...", (const char *) ipString);
+        case Connecting: {
+            // The UDP socket stays bound from one connection to the next;
+            // only the first attempt, or one after a failure, binds it.
+            if (m_nUdpPort == 0) {
+                u16 udpPort{GenerateDynamicPortNumber()};
+                // Free up the socket for re-binding. Circle's sockets can't
+                // be moved, so it takes a new one.
+                delete m_pUdpSocket;
+                m_pUdpSocket = new CSocket(m_pNet, IPPROTO_UDP);
+                assert(m_pUdpSocket);
+                if (m_pUdpSocket->Bind(udpPort) < 0) {
+                    m_Logger.Write(FromJTC, LogError, "Failed to bind UDP socket to port %u.", udpPort);
+                    Retry();
+                    return false;
+                } else if (g_Verbose) {
+                    m_Logger.Write(FromJTC, LogNotice, "UDP Socket successfully bound to port %u", udpPort);
+                }
+                m_nUdpPort = udpPort;
+            }
 
-    // Bind the TCP port.
-    if (tcpSocket->Bind(tcpClientPort) < 0) {
-        m_Logger.Write(FromJTC, LogError, "Cannot bind TCP socket (port %u)", tcpClientPort);
-        Disconnect();
-        return false;
-    } else if (g_Verbose) {
-        m_Logger.Write(FromJTC, LogNotice, "Successfully bound TCP socket (port %u)", tcpClientPort);
-    }
+            u16 tcpClientPort;
+            do {
+                tcpClientPort = GenerateDynamicPortNumber(m_nUdpPort);
+            } while (tcpClientPort == m_nUdpPort);
 
-    if (tcpSocket->Connect(serverIP, JACKTRIP_TCP_PORT) < 0) {
-        m_Logger.Write(FromJTC, LogWarning, "Cannot establish TCP connection to JackTrip server.");
-        Disconnect();
-        return false;
-    } else {
-        m_Logger.Write(FromJTC, LogNotice, "TCP connection with server accepted.");
-    }
+            // Close the last attempt's socket, if any.
+            delete m_pTcpSocket;
+            m_pTcpSocket = new CSocket(m_pNet, IPPROTO_TCP);
+            assert(m_pTcpSocket);
 
-    // Send the UDP port to the JackTrip server; block until sent.
-    if (PORT_NUMBER_NUM_BYTES != tcpSocket->Send(
-            reinterpret_cast<const u8 *>(&udpPort),
-            PORT_NUMBER_NUM_BYTES,
-            MSG_DONTWAIT
-    )) {
-        m_Logger.Write(FromJTC, LogError, "Failed to send UDP port to server.");
-        Disconnect();
-        return false;
-    } else if (g_Verbose) {
-        m_Logger.Write(FromJTC, LogNotice, "Sent UDP port number %u to JackTrip server.", udpPort);
+            if (m_nBackoffMs == RECONNECT_MIN_MS) {
+                m_Logger.Write(FromJTC, LogNotice, "Looking for a JackTrip server at %s...",
+                               (const char *) ipString);
+            }
+
+            // Bind the TCP port.
+            if (m_pTcpSocket->Bind(tcpClientPort) < 0) {
+                m_Logger.Write(FromJTC, LogError, "Cannot bind TCP socket (port %u)", tcpClientPort);
+                Retry();
+                return false;
+            } else if (g_Verbose) {
+                m_Logger.Write(FromJTC, LogNotice, "Successfully bound TCP socket (port %u)", tcpClientPort);
+            }
+
+            // Refused at once if nothing's listening; Circle doesn't connect
+            // asynchronously, so an unreachable server takes longer.
+            if (m_pTcpSocket->Connect(serverIP, JACKTRIP_TCP_PORT) < 0) {
+                if (g_Verbose || m_nBackoffMs == RECONNECT_MIN_MS) {
+                    m_Logger.Write(FromJTC, LogWarning, "Cannot establish TCP connection to JackTrip server.");
+                }
+                Retry();
+                return false;
+            }
+            m_nConnectStart = CTimer::GetClockTicks();
+            m_Logger.Write(FromJTC, LogNotice, "TCP connection with server accepted.");
+
+            // Port numbers go over the wire as 32-bit integers.
+            u32 nPort{m_nUdpPort};
+
+            // Send the UDP port to the JackTrip server.
+            if (PORT_NUMBER_NUM_BYTES != m_pTcpSocket->Send(
+                    reinterpret_cast<const u8 *>(&nPort),
+                    PORT_NUMBER_NUM_BYTES,
+                    MSG_DONTWAIT
+            )) {
+                m_Logger.Write(FromJTC, LogError, "Failed to send UDP port to server.");
+                Retry();
+                return false;
+            } else if (g_Verbose) {
+                m_Logger.Write(FromJTC, LogNotice, "Sent UDP port number %u to JackTrip server.", m_nUdpPort);
+            }
+
+            m_ConnectState = ExchangingPorts;
+            m_nStateStart = m_nConnectStart;
+            return false;
+        }
+
+        case ExchangingPorts:
+            break;
     }
 
-    // Read the JackTrip server's UDP port; block until received.
-    if (PORT_NUMBER_NUM_BYTES != tcpSocket->Receive(
-            reinterpret_cast<u8 *>(&m_nServerUdpPort),
-            PORT_NUMBER_NUM_BYTES,
-            0
-    )) {
+    // Check for the JackTrip server's UDP port, and let the other tasks run
+    // a moment if it isn't here yet.
+    u32 nPort{0};
+    int nReceived{m_pTcpSocket->Receive(reinterpret_cast<u8 *>(&nPort), PORT_NUMBER_NUM_BYTES, MSG_DONTWAIT)};
+    if (nReceived == 0) {
+        if ((nNow - m_nStateStart) / 1000 >= PORT_EXCHANGE_MS) {
+            m_Logger.Write(FromJTC, LogError, "No UDP port from server after %u ms.", PORT_EXCHANGE_MS);
+            Retry();
+        } else {
+            CScheduler::Get()->MsSleep(1);
+        }
+        return false;
+    } else if (nReceived != PORT_NUMBER_NUM_BYTES) {
         m_Logger.Write(FromJTC, LogError, "Failed to read UDP port from server.");
-        Disconnect();
+        Retry();
         return false;
-    } else if (g_Verbose) {
+    }
+    m_nServerUdpPort = static_cast<u16>(nPort);
+    if (g_Verbose) {
         m_Logger.Write(FromJTC, LogNotice, "Received port %u from JackTrip server.", m_nServerUdpPort);
     }
 
-    // Free up the socket for re-binding.
-    m_pUdpSocket = CSocket(m_pNet, IPPROTO_UDP);
+    // That's all the TCP connection is for.
+    delete m_pTcpSocket;
+    m_pTcpSocket = nullptr;
 
-    // Set up the UDP socket.
-    if (m_pUdpSocket.Bind(udpPort) < 0) {
-        m_Logger.Write(FromJTC, LogError, "Failed to bind UDP socket to port %u.", udpPort);
-        Disconnect();
-        return false;
-    } else if (g_Verbose) {
-        m_Logger.Write(FromJTC, LogNotice, "UDP Socket successfully bound to port %u", udpPort);
-    }
-
-    if (m_pUdpSocket.Connect(serverIP, m_nServerUdpPort) < 0) {
+    if (m_pUdpSocket->Connect(serverIP, m_nServerUdpPort) < 0) {
         m_Logger.Write(FromJTC, LogError, "Failed to prepare UDP connection.");
-        Disconnect();
+        m_nUdpPort = 0;
+        Retry();
         return false;
     } else {
         m_Logger.Write(FromJTC, LogNotice, "Ready to send datagrams to %s:%u",
                        (const char *) ipString, (unsigned) m_nServerUdpPort);
     }
 
+    // Block in Receive() rather than poll, leaving the core to others, but
+    // not for so long that the receive timeout goes unnoticed.
+    if (m_pUdpSocket->SetOptionReceiveTimeout(RECEIVE_WAIT_MS * 1000) < 0) {
+        m_Logger.Write(FromJTC, LogError, "Failed to set UDP receive timeout.");
+        m_nUdpPort = 0;
+        Retry();
+        return false;
+    }
+
+    m_ConnectState = Connecting;
+    m_nBackoffMs = RECONNECT_MIN_MS;
     m_Connected = true;
 
     return true;
 }
 
+void CJackTripClient::Retry()
+{
+    m_ConnectState = BackingOff;
+    m_nStateStart = CTimer::GetClockTicks();
+}
+
 void CJackTripClient::Disconnect()
 {
     if (!m_Connected)
@@ -154,83 +373,353 @@ void CJackTripClient::Disconnect()
     // DON'T DELETE THE TASK; THE SCHEDULER DOES THIS.
 //        delete m_pSendTask;
     m_pSendTask = nullptr;
-    m_pClockTask = nullptr;
 
     if (g_Verbose) m_Logger.Write(FromJTC, LogDebug, "Resetting fifo and counters.");
     m_BufferCount = 0;
     m_nPacketsReceived = 0;
     m_PacketHeader.nSeqNumber = 0;
+    m_JitterTuner.Reset();
+    m_SequenceTracker.Reset();
+    m_LossConcealer.Reset();
+    m_ReceiveMonitor.Reset();
+    m_LatencyMonitor.Reset();
+    m_Decoder.Reset();
+    m_bFormatRefused = false;
+    m_FIFO.SetTargetDepth(m_JitterTuner.GetTargetDepth());
     m_FIFO.Clear();
 }
 
 void CJackTripClient::Run()
 {
     if (!m_Connected) {
-        // TODO: Move the connection loop into Connect()
         if (Connect()) {
             assert(!m_pSendTask);
             // Start the send task.
-            m_pSendTask = new CSendTask(&m_pUdpSocket, &m_Event, &m_Connected);
+            m_pSendTask = new CSendTask(m_pUdpSocket, &m_Event, &m_Connected, m_pCaptureRing);
             if (g_Verbose) m_Logger.Write(FromJTC, LogNotice, "Starting task %s.", m_pSendTask->GetName());
-            m_nLastReceive = CTimer::Get()->GetUptime();
-        } else {
-            CScheduler::Get()->Sleep(2);
+            m_nLastReceive = CTimer::GetClockTicks();
         }
     } else {
+        // The send task gets to work while Receive() waits.
         Receive();
+        LogStats();
     }
-
-    // Give the send task time to work.
-    CScheduler::Get()->Yield();
 }
 
 void CJackTripClient::Receive()
 {
     assert(m_Connected);
 
-    u8 buffer8[UDP_PACKET_SIZE];
+    // Receive straight into the fifo's next slot, which is laid out like a
+    // datagram, so that the usual packet needn't be copied again. That takes
+    // a stream in the fifo's own format; any other gets decoded.
+    const bool bNative{m_Decoder.IsNative()};
+    u8 *pDatagram{bNative ? m_FIFO.GetWriteSlot() : m_Datagram};
+    static_assert(UDP_PACKET_SIZE * MAX_REDUNDANCY <= MAX_DATAGRAM_SIZE, "datagram buffer too small");
 
-    // TODO: probably need a spinlock here and one around Send
-    // ...but there's one in CFIFO::Write, so be careful.
-    int nBytesReceived{m_pUdpSocket.Receive(buffer8, sizeof buffer8, MSG_DONTWAIT)};//m_ReceivedCount == 0 ? MSG_DONTWAIT : 0)};
+    // Wait for a datagram, or for up to RECEIVE_WAIT_MS.
+    unsigned nWaitStart{CTimer::GetClockTicks()};
+    int nBytesReceived{m_pUdpSocket->Receive(pDatagram, bNative ? UDP_PACKET_SIZE * MAX_REDUNDANCY : MAX_DATAGRAM_SIZE,
+                                             0)};
+    unsigned nWoken{CTimer::GetClockTicks()};
+    m_ReceiveMonitor.OnWait(nWoken - nWaitStart, nBytesReceived > 0);
+
+    PROFILE_SCOPE(ProfileReceive);
 
     if (nBytesReceived > 0) {
-        if (IsExitPacket(nBytesReceived, buffer8)) {
+        TJackTripPacketHeader header{};
+        if (nBytesReceived >= static_cast<int>(PACKET_HEADER_SIZE)) {
+            memcpy(&header, pDatagram, PACKET_HEADER_SIZE);
+        }
+
+        if (IsExitPacket(nBytesReceived, pDatagram)) {
             m_Logger.Write(FromJTC, LogNotice, "Exit packet received.");
             Disconnect();
-            CScheduler::Get()->Sleep(2);
             return;
-        } else if (nBytesReceived != UDP_PACKET_SIZE) {
-            m_Logger.Write(FromJTC,
-                           LogWarning,
-                           "Malformed packet received. Expected %u bytes; received %d bytes.",
-                           UDP_PACKET_SIZE,
-                           nBytesReceived);
+        } else if (nBytesReceived < static_cast<int>(PACKET_HEADER_SIZE)) {
+            CLogRing::Get()->Write(FromJTC, LogWarning, "Malformed packet received: %d bytes.", nBytesReceived);
+        } else if (!m_Decoder.Matches(header) && !NegotiateFormat(header)) {
+            // Not a stream that can be played; if nothing else comes, time
+            // out.
+        } else if (nBytesReceived % m_Decoder.GetPacketSize() != 0) {
+            CLogRing::Get()->Write(FromJTC,
+                                   LogWarning,
+                                   "Malformed packet received. Expected a multiple of %u bytes; received %d bytes.",
+                                   m_Decoder.GetPacketSize(),
+                                   nBytesReceived);
         } else {
-            const TYPE *buffer[WRITE_CHANNELS];
-            for (int ch = 0; ch < WRITE_CHANNELS; ++ch) {
-                buffer[ch] = reinterpret_cast<TYPE *>(buffer8 + PACKET_HEADER_SIZE + CHANNEL_QUEUE_SIZE * ch);
+            const unsigned nPacketSize{m_Decoder.GetPacketSize()};
+            const unsigned nBlocks{m_Decoder.GetBlocksPerPacket()};
+            int nPackets = nBytesReceived / nPacketSize;
+
+            // With redundancy, a datagram holds the newest packet followed by
+            // those before it. Any of those that are missing go in first, and
+            // a gap gets filled in first, so then the newest packet isn't
+            // where the fifo wants its next block, and has to be copied.
+            // Likewise if the format changed from the fifo's own just now.
+            bool bInPlace{m_Decoder.IsNative() && pDatagram != m_Datagram
+                          && m_SequenceTracker.IsNext(header.nSeqNumber)};
+            for (int n = 1; bInPlace && n < nPackets; ++n) {
+                TJackTripPacketHeader older;
+                memcpy(&older, pDatagram + n * nPacketSize, PACKET_HEADER_SIZE);
+                bInPlace = older.nBufferSize == 0 || !m_SequenceTracker.IsNew(older.nSeqNumber);
+            }
+
+            if (!bInPlace && pDatagram != m_Datagram) {
+                memcpy(m_Datagram, pDatagram, nBytesReceived);
+                pDatagram = m_Datagram;
             }
 
-            m_FIFO.Write(buffer, AUDIO_BLOCK_FRAMES);
+            // Take the older packets oldest first, so that they go in in
+            // order.
+            for (int n = nPackets - 1; n > 0; --n) {
+                u8 *pPacket{pDatagram + n * nPacketSize};
+                TJackTripPacketHeader older;
+                memcpy(&older, pPacket, PACKET_HEADER_SIZE);
+
+                // The sender's history starts out zeroed.
+                if (older.nBufferSize != 0 && m_SequenceTracker.IsNew(older.nSeqNumber)) {
+                    bool bPlaced;
+                    ReceivePacket(pPacket, older.nSeqNumber, false, bPlaced);
+                    if (bPlaced) {
+                        ++m_nRecovered;
+                    }
+                }
+            }
 
-            ++m_nPacketsReceived;
-            m_nLastReceive = CTimer::Get()->GetUptime();
+            bool bPlaced;
+            auto arrival{ReceivePacket(pDatagram, header.nSeqNumber, bInPlace, bPlaced)};
+
+            if (arrival == CSequenceTracker::InOrder || arrival == CSequenceTracker::AfterGap) {
+                // Tell the tuner and the monitor how many block periods on
+                // this one is from the last one they saw, so that loss doesn't
+                // pass for jitter.
+                u16 nPeriods = header.nSeqNumber - m_nLastTimedSeqNumber;
+                if (nPeriods == 0 || nPeriods > SEQUENCE_WINDOW) {
+                    // A restarted stream.
+                    nPeriods = 1;
+                }
+                m_nLastTimedSeqNumber = header.nSeqNumber;
+                nPeriods *= nBlocks;
+
+                m_ReceiveMonitor.OnPacket(nWoken, nPeriods);
+
+                // The packet's frames wait to play behind those already in
+                // the fifo, including any standing in for a gap before it.
+                unsigned nFrames{nBlocks * AUDIO_BLOCK_FRAMES};
+                unsigned nFill{m_FIFO.GetFillLevel()};
+                m_LatencyMonitor.OnPacket(nWoken, header.nTimeStamp, nFrames, nFill > nFrames ? nFill - nFrames : 0);
+
+                if (JITTER_BUFFER_AUTO) {
+                    m_JitterTuner.OnPacket(nWoken, m_FIFO.GetUnderruns(), nPeriods);
+                    m_FIFO.SetTargetDepth(m_JitterTuner.GetTargetDepth());
+                }
+            }
+
+            if (++m_nPacketsReceived == 1) {
+                CLogRing::Get()->Write(FromJTC, LogNotice, "Stream started %u ms after connecting.",
+                                       (nWoken - m_nConnectStart) / 1000);
+            }
+            m_nLastReceive = nWoken;
 
-            // Notify the send task to send a packet.
-            m_Event.Set();
+            // Notify the send task to send a packet. In full duplex, the
+            // capture interrupt does that instead.
+            if (!m_pCaptureRing) {
+                m_Event.Set();
+            }
 
             if (ShouldLog()) {
-                m_Logger.Write(FromJTC, LogDebug, "Received %d bytes via UDP", nBytesReceived);
-                HexDump(buffer8, nBytesReceived, true);
+                CLogRing::Get()->Write(FromJTC, LogDebug, "Jitter %u us, fifo target depth %u frames, "
+                                                          "underruns %u, overruns %u",
+                                       m_JitterTuner.GetJitter(), m_FIFO.GetTargetDepth(),
+                                       m_FIFO.GetUnderruns(), m_FIFO.GetOverruns());
+                CLogRing::Get()->Write(FromJTC, LogDebug, "Received %d bytes via UDP", nBytesReceived);
+                HexDump(pDatagram, nBytesReceived, true);
+            }
+        }
+    } else {
+        // A stream that stopped has likely gone for good, e.g. with the
+        // server restarting, so don't wait as long for it as for a new one.
+        unsigned nTimeoutMs{m_nPacketsReceived > 0 ? STREAM_TIMEOUT_MS : RECEIVE_TIMEOUT_SEC * 1000};
+        if ((nWoken - m_nLastReceive) / 1000 > nTimeoutMs) {
+            m_Logger.Write(FromJTC, LogNotice, "Nothing received for %u ms.", nTimeoutMs);
+            Disconnect();
+            return;
+        }
+    }
+}
+
+CSequenceTracker::TArrival CJackTripClient::ReceivePacket(u8 *pPacket, u16 nSeqNumber, bool bInPlace, bool &bPlaced)
+{
+    const u8 *pPayload{pPacket + PACKET_HEADER_SIZE};
+    const unsigned nBlocks{m_Decoder.GetBlocksPerPacket()};
+
+    // A packet in the fifo's format is a block, as is; any other is decoded
+    // a block at a time.
+    TYPE decoded[WRITE_CHANNELS][AUDIO_BLOCK_FRAMES];
+    TYPE *buffer[WRITE_CHANNELS];
+    for (int ch = 0; ch < WRITE_CHANNELS; ++ch) {
+        buffer[ch] = m_Decoder.IsNative()
+                     ? reinterpret_cast<TYPE *>(pPacket + PACKET_HEADER_SIZE + CHANNEL_QUEUE_SIZE * ch)
+                     : decoded[ch];
+    }
+
+    unsigned nDistance;
+    auto arrival{m_SequenceTracker.Track(nSeqNumber, nDistance)};
+    bPlaced = false;
+    switch (arrival) {
+        case CSequenceTracker::AfterGap:
+            // Hold the missing packets' places, so this one plays on time,
+            // and so they can still play if they turn up late.
+            ConcealLoss(nDistance * nBlocks);
+            // Fall through.
+        case CSequenceTracker::InOrder:
+            for (unsigned n = 0; n < nBlocks; ++n) {
+                if (!m_Decoder.IsNative()) {
+                    m_Decoder.Decode(pPayload, n, buffer);
+                }
+                if (LOSS_CONCEALMENT) {
+                    m_LossConcealer.Receive(buffer);
+                }
+                if (bInPlace) {
+                    m_FIFO.CommitSlot();
+                } else {
+                    m_FIFO.Write(buffer, AUDIO_BLOCK_FRAMES);
+                }
+            }
+            bPlaced = true;
+            break;
+        case CSequenceTracker::OutOfOrder: {
+            // Into its place, unless that has already played; the packet's
+            // last block lies nDistance packets behind the newest's.
+            for (unsigned n = 0; n < nBlocks; ++n) {
+                if (!m_Decoder.IsNative()) {
+                    m_Decoder.Decode(pPayload, n, buffer);
+                }
+                unsigned nBehind{nDistance * nBlocks + nBlocks - 1 - n};
+                bPlaced = m_FIFO.Patch(buffer, AUDIO_BLOCK_FRAMES, nBehind * AUDIO_BLOCK_FRAMES) || bPlaced;
+            }
+            m_SequenceTracker.OnOutOfOrder(bPlaced);
+            break;
+        }
+        default:
+            // Duplicate, or too late; appending it would put playback a block
+            // behind.
+            break;
+    }
+
+    return arrival;
+}
+
+bool CJackTripClient::NegotiateFormat(const TJackTripPacketHeader &header)
+{
+    TStreamFormat format;
+    bool bValid{CStreamDecoder<TYPE>::Parse(header, &format)};
+
+    // Packets have to fit the buffer, and, to be tracked, the sequence
+    // window.
+    if (!bValid || !m_Decoder.Negotiate(format) || m_Decoder.GetPacketSize() > MAX_DATAGRAM_SIZE
+        || m_Decoder.GetBlocksPerPacket() > SEQUENCE_WINDOW) {
+        m_Decoder.Reset();
+        if (!m_bFormatRefused) {
+            m_bFormatRefused = true;
+            if (bValid) {
+                m_Logger.Write(FromJTC, LogWarning, "Can't play a stream of %u frames per packet at %u Hz, "
+                                                    "%u-bit, %u channels; expected %u Hz, and multiples of %u "
+                                                    "frames per packet, up to %u bytes.",
+                               format.nBlockFrames, format.nSampleRate, format.nSampleBytes * 8, format.nChannels,
+                               SAMPLE_RATE, AUDIO_BLOCK_FRAMES, MAX_DATAGRAM_SIZE);
+            } else {
+                m_Logger.Write(FromJTC, LogWarning, "Received a packet header that describes no stream.");
             }
         }
-    } else if (CTimer::Get()->GetUptime() - m_nLastReceive > RECEIVE_TIMEOUT_SEC) {
-        m_Logger.Write(FromJTC, LogNotice, "Nothing received for %u seconds.", RECEIVE_TIMEOUT_SEC);
-        Disconnect();
-        CScheduler::Get()->Sleep(2);
+        return false;
+    }
+
+    m_bFormatRefused = false;
+    m_Logger.Write(FromJTC, LogNotice, "Stream of %u frames per packet at %u Hz, %u-bit, %u channels (%s).",
+                   format.nBlockFrames, format.nSampleRate, format.nSampleBytes * 8, format.nChannels,
+                   m_Decoder.IsNative() ? "native" : "converting");
+
+    // A new stream, maybe; its sequence numbers may count different packets.
+    m_SequenceTracker.Reset();
+    m_LossConcealer.Reset();
+    m_JitterTuner.SetPacketFrames(format.nBlockFrames, DMA_CHUNK_FRAMES);
+    m_FIFO.SetTargetDepth(m_JitterTuner.GetTargetDepth());
+
+    return true;
+}
+
+void CJackTripClient::ConcealLoss(unsigned nBlocks)
+{
+    // Any more would only overrun the fifo.
+    if (nBlocks > SEQUENCE_WINDOW) {
+        nBlocks = SEQUENCE_WINDOW;
+    }
+
+    if (!LOSS_CONCEALMENT) {
+        m_FIFO.WriteGap(nBlocks * AUDIO_BLOCK_FRAMES);
         return;
     }
+
+    TYPE block[WRITE_CHANNELS][AUDIO_BLOCK_FRAMES];
+    TYPE *channels[WRITE_CHANNELS];
+    for (int ch = 0; ch < WRITE_CHANNELS; ++ch) {
+        channels[ch] = block[ch];
+    }
+
+    while (nBlocks-- > 0) {
+        m_LossConcealer.Conceal(channels);
+        m_FIFO.Write(channels, AUDIO_BLOCK_FRAMES);
+    }
+}
+
+void CJackTripClient::LogStats()
+{
+    unsigned now{CTimer::Get()->GetUptime()};
+    if (STATS_INTERVAL_SEC == 0 || now - m_nLastStats < STATS_INTERVAL_SEC) {
+        return;
+    }
+    m_nLastStats = now;
+
+    m_Logger.Write(FromJTC, LogNotice, "fifo: fill %u frames (target %u), underruns %u, overruns %u, "
+                                       "slip %d frames; jitter %u us",
+                   m_FIFO.GetFillLevel(), m_FIFO.GetTargetDepth(), m_FIFO.GetUnderruns(), m_FIFO.GetOverruns(),
+                   m_FIFO.GetSlip(), m_JitterTuner.GetJitter());
+
+    m_Logger.Write(FromJTC, LogNotice, "packets: lost %u, late %u, duplicate %u, reordered %u; "
+                                       "%u recovered from redundancy, %u blocks concealed",
+                   m_SequenceTracker.GetLost(), m_SequenceTracker.GetLate(), m_SequenceTracker.GetDuplicates(),
+                   m_SequenceTracker.GetReordered(), m_nRecovered, m_LossConcealer.GetConcealed());
+
+    TReceiveStats receive;
+    m_ReceiveMonitor.GetStats(CTimer::GetClockTicks(), &receive);
+    m_Logger.Write(FromJTC, LogNotice, "receive: idle %u.%u%%, %u wake-ups (%u timed out); "
+                                       "wake-up latency %u/%u us (mean/max)",
+                   receive.nIdlePermille / 10, receive.nIdlePermille % 10, receive.nWakeUps, receive.nTimeouts,
+                   receive.nMeanLatency, receive.nMaxLatency);
+
+    if (m_pCaptureRing) {
+        m_Logger.Write(FromJTC, LogNotice, "uplink: %u captured blocks dropped", m_pCaptureRing->GetOverruns());
+    }
+
+    m_LatencyMonitor.Dump(&m_Logger);
+
+#if AUDIO_CORE
+    if (m_pAudioCore) {
+        THandoffStats stats;
+        m_pAudioCore->GetStats(&stats);
+        m_Logger.Write(FromJTC, LogNotice, "audio core: %u chunks, %u starved; "
+                                           "handoff latency %u/%u/%u us (min/mean/max), jitter %u us",
+                       stats.nBlocks, stats.nStarved,
+                       stats.nMinLatency, stats.nMeanLatency, stats.nMaxLatency,
+                       stats.nMaxLatency - stats.nMinLatency);
+    }
+#endif
+
+    if (PROFILING) {
+        CProfiler::Dump(&m_Logger, true);
+    }
 }
 
 bool CJackTripClient::IsExitPacket(int size, const u8 *packet)
@@ -250,39 +739,40 @@ bool CJackTripClient::ShouldLog() const { return g_Verbose && m_BufferCount > 0
 
 void CJackTripClient::HexDump(const u8 *buffer, unsigned int length, bool doHeader)
 {
-    CString log{"\n"}, chunk;
-    size_t word{doHeader ? PACKET_HEADER_SIZE : 0}, row{0};
-    if (doHeader)log.Append("HEAD:");
-    for (const u8 *p = buffer; word < length + (doHeader ? PACKET_HEADER_SIZE : 0); ++p, ++word) {
-        if (word % 16 == 0 && !(doHeader && word == PACKET_HEADER_SIZE)) {
-            if (row > 0 || doHeader) {
-//                m_Logger.Write(FromJTC, LogDebug, log);
-//                log = "";
-                log.Append("\n");
-            }
-            chunk.Format("%04x: ", row);
-            log.Append(chunk);
-            ++row;
-        } else if (word % 2 == 0) {
-            log.Append(" ");
+    // Deferred via the log ring, a row of 16 bytes per entry. Each group of
+    // four bytes is packed big-endian, so that it prints in memory order.
+    auto group = [buffer, length](unsigned offset) {
+        u32 word{0};
+        for (unsigned i = offset; i < offset + 4; ++i) {
+            word = (word << 8) | (i < length ? buffer[i] : 0);
         }
-        chunk.Format("%02x ", *p);
-        log.Append(chunk);
+        return word;
+    };
+
+    unsigned offset{0};
+    if (doHeader) {
+        CLogRing::Get()->Write(FromJTC, LogDebug, "HEAD: %08x %08x %08x %08x",
+                               group(0), group(4), group(8), group(12));
+        offset = PACKET_HEADER_SIZE;
     }
 
-    log.Append("\n");
-    m_Logger.Write(FromJTC, LogDebug, log);
+    for (unsigned row = 0; offset < length; offset += 16, ++row) {
+        CLogRing::Get()->Write(FromJTC, LogDebug, "%04x: %08x %08x %08x %08x", row,
+                               group(offset), group(offset + 4), group(offset + 8), group(offset + 12));
+    }
 }
 
 //// SEND TASK ////////////////////////////////////////////////////////////////
 
 static const char FromJTCSend[] = "jtcsend";
 
-CJackTripClient::CSendTask::CSendTask(CSocket *pUdpSocket, CSynchronizationEvent *pEvent, bool *pConnected) :
+CJackTripClient::CSendTask::CSendTask(CSocket *pUdpSocket, CSynchronizationEvent *pEvent, bool *pConnected,
+                                      CBlockRing<TYPE> *pCaptureRing) :
 //        CTask(TASK_STACK_SIZE, true),
         m_pUdpSocket(pUdpSocket),
         m_pEvent(pEvent),
-        m_pConnected(*pConnected)
+        m_pConnected(*pConnected),
+        m_pCaptureRing(pCaptureRing)
 {
     SetName(FromJTCSend);
     if (g_Verbose)
@@ -302,6 +792,11 @@ void CJackTripClient::CSendTask::Run(void)
 
     u8 packet[UDP_PACKET_SIZE];
     memcpy(packet, &m_PacketHeader, PACKET_HEADER_SIZE);
+    // Silence, unless full duplex.
+    for (unsigned i = PACKET_HEADER_SIZE; i < UDP_PACKET_SIZE; i += TYPE_SIZE) {
+        TYPE silence{NULL_LEVEL};
+        memcpy(packet + i, &silence, TYPE_SIZE);
+    }
     // The JackTrip server checks whether a datagram is available, and, if not,
     // sleeps for 100 ms and tries again. This process repeats until a global
     // timeout is exceeded, at which point it gives up. Just delaying before the
@@ -312,27 +807,178 @@ void CJackTripClient::CSendTask::Run(void)
     // unreachable (Port unreachable)" warnings.
     CScheduler::Get()->MsSleep(100);
     // Send the zeroth packet.
-    m_pUdpSocket->Send(packet, UDP_PACKET_SIZE, MSG_DONTWAIT);
+    m_PacketHeader.nTimeStamp = GetTimeStamp();
+    memcpy(packet, &m_PacketHeader, PACKET_HEADER_SIZE);
+    Send(packet);
     CScheduler::Get()->MsSleep(25);
 
     CLogger::Get()->Write(FromJTCSend, LogNotice, "Sending datagrams.");
 
-    while (m_pConnected) {
-        assert(m_pUdpSocket);
+    if (m_pCaptureRing) {
+        // Start with what's captured from now on.
+        m_pCaptureRing->Start();
 
-        ++m_PacketHeader.nSeqNumber;
-        memcpy(packet, &m_PacketHeader, PACKET_HEADER_SIZE);
+        while (m_pConnected) {
+            // Clear first, so that a block captured meanwhile isn't missed.
+            m_pEvent->Clear();
+            SendCaptured();
+            m_pEvent->Wait();
+        }
+
+        m_pCaptureRing->Stop();
+    } else {
+        while (m_pConnected) {
+            assert(m_pUdpSocket);
 
-        m_pUdpSocket->Send(packet, UDP_PACKET_SIZE, MSG_DONTWAIT);
+            {
+                PROFILE_SCOPE(ProfileSend);
 
-        m_pEvent->Clear();
-        // Wait for a signal from the main (receive) task.
-        m_pEvent->Wait();
+                ++m_PacketHeader.nSeqNumber;
+                m_PacketHeader.nTimeStamp = GetTimeStamp();
+                memcpy(packet, &m_PacketHeader, PACKET_HEADER_SIZE);
+
+                Send(packet);
+            }
+
+            m_pEvent->Clear();
+            // Wait for a signal from the main (receive) task.
+            m_pEvent->Wait();
+        }
     }
 
     CLogger::Get()->Write(FromJTCSend, LogDebug, "Disconnected; leaving task %s.", GetName());
 }
 
+void CJackTripClient::CSendTask::SendCaptured(void)
+{
+    u8 *pDatagram;
+    while ((pDatagram = m_pCaptureRing->Front()) != nullptr) {
+        PROFILE_SCOPE(ProfileSend);
+
+        // The payload is already in place; only the header is missing.
+        ++m_PacketHeader.nSeqNumber;
+        m_PacketHeader.nTimeStamp = GetTimeStamp();
+        memcpy(pDatagram, &m_PacketHeader, PACKET_HEADER_SIZE);
+
+        assert(m_pCaptureRing->GetDatagramSize() == UDP_PACKET_SIZE);
+        Send(pDatagram);
+        m_pCaptureRing->Pop();
+    }
+}
+
+void CJackTripClient::CSendTask::Send(const u8 *pPacket)
+{
+    if (REDUNDANCY == 1) {
+        m_pUdpSocket->Send(pPacket, UDP_PACKET_SIZE, MSG_DONTWAIT);
+        return;
+    }
+
+    // As JackTrip does it: the packets already in the datagram move up a
+    // place, the oldest dropping off the end, and this one goes first.
+    memmove(m_Datagram + UDP_PACKET_SIZE, m_Datagram, (REDUNDANCY - 1) * UDP_PACKET_SIZE);
+    memcpy(m_Datagram, pPacket, UDP_PACKET_SIZE);
+    m_pUdpSocket->Send(m_Datagram, REDUNDANCY * UDP_PACKET_SIZE, MSG_DONTWAIT);
+}
+
+u64 CJackTripClient::CSendTask::GetTimeStamp()
+{
+    unsigned nTicks{CTimer::GetClockTicks()};
+    if (nTicks < static_cast<u32>(m_nTimeStamp)) {
+        m_nTimeStamp += 1ull << 32;
+    }
+    m_nTimeStamp = (m_nTimeStamp & ~0xFFFFFFFFull) | nTicks;
+    return m_nTimeStamp;
+}
+
+
+//// CLOCK TASK ///////////////////////////////////////////////////////////////
+
+static const char FromJTCClock[] = "jtcclock";
+
+CJackTripClient::CClockTask::CClockTask(TFIFO *pFIFO, bool *pConnected, CResampler *pResampler) :
+        m_Clock(GPIOClockPCM, GPIOClockSourcePLLD),
+        m_pFIFO(pFIFO),
+        m_pConnected(*pConnected),
+        m_pResampler(pResampler),
+        m_Controller(CLOCK_RECOVERY_KP,
+                     CLOCK_RECOVERY_KI,
+                     CLOCK_RECOVERY_MAX_PPM,
+                     CLOCK_RECOVERY_PERIOD_MS / 1000.f),
+        m_nClockFreq(CMachineInfo::Get()->GetGPIOClockSourceRate(GPIOClockSourcePLLD))
+{
+    SetName(FromJTCClock);
+}
+
+void CJackTripClient::CClockTask::Run(void)
+{
+    const unsigned samplesPerPeriod{CLOCK_RECOVERY_PERIOD_MS / CLOCK_RECOVERY_SAMPLE_MS};
+    unsigned nSamples{0};
+
+    while (true) {
+        CScheduler::Get()->MsSleep(CLOCK_RECOVERY_SAMPLE_MS);
+
+        if (!m_pConnected) {
+            if (m_Controller.IsLocked()) {
+                // Lost the server; return to the nominal rate and start over
+                // with the next connection.
+                m_Controller.Reset();
+                SetCorrection(0.f);
+                nSamples = 0;
+            }
+            continue;
+        }
+
+        m_Controller.AddMeasurement(static_cast<int>(m_pFIFO->GetFillLevel()) + m_pFIFO->GetSlip());
+
+        if (++nSamples < samplesPerPeriod) {
+            continue;
+        }
+        nSamples = 0;
+
+        if (m_Controller.Update()) {
+            SetCorrection(m_Controller.GetPPM());
+
+            if (g_Verbose) {
+                CLogger::Get()->Write(FromJTCClock, LogDebug, "Fill error %d/100 frames, correction %d/100 ppm",
+                                      static_cast<int>(m_Controller.GetError() * 100.f),
+                                      static_cast<int>(m_Controller.GetPPM() * 100.f));
+            }
+        }
+    }
+}
+
+void CJackTripClient::CClockTask::SetCorrection(float fPPM)
+{
+    if (m_pResampler) {
+        // Speeding up the output means consuming more input per output frame.
+        m_pResampler->SetRatio(static_cast<float>(SAMPLE_RATE) / DEVICE_SAMPLE_RATE * (1.f + fPPM * 1e-6f));
+    } else {
+        SetSampleRate(DEVICE_SAMPLE_RATE * (1.f + fPPM * 1e-6f));
+    }
+}
+
+void CJackTripClient::CClockTask::SetSampleRate(float fSampleRate)
+{
+    // 32 bits per sample, two channels per frame. Fixed point, 12 fractional
+    // bits. E.g. 500'000'000 * 4096 / 64 / 48000 = 666666.66... => 666667
+    // = 162 * 4096 + 3115
+    auto nDivider{static_cast<unsigned>(static_cast<float>(m_nClockFreq) * 4096.f / (32 * 2) / fSampleRate + .5f)};
+    unsigned nDivI{nDivider >> 12};
+    unsigned nDivF{nDivider & 0xFFF};
+
+    if (nDivI == m_nDivI && nDivF == m_nDivF) {
+        // Below the resolution of the divider; nothing to do.
+        return;
+    }
+    m_nDivI = nDivI;
+    m_nDivF = nDivF;
+
+    if (g_Verbose) {
+        CLogger::Get()->Write(FromJTCClock, LogDebug, "Setting DivI: %u, DivF: %u", nDivI, nDivF);
+    }
+
+    m_Clock.Start(nDivI, nDivF, nDivF > 0 ? 1 : 0);
+}
 
 //// PWM //////////////////////////////////////////////////////////////////////
 
@@ -341,14 +987,39 @@ JackTripClientPWM::JackTripClientPWM(CLogger *pLogger,
                                      CInterruptSystem *pInterrupt,
                                      CDevice *pDevice) :
         CJackTripClient(pLogger, pNet, pDevice),
-        CPWMSoundBaseDevice(pInterrupt, SAMPLE_RATE, AUDIO_BLOCK_FRAMES * WRITE_CHANNELS),
+        CPWMSoundBaseDevice(pInterrupt, DEVICE_SAMPLE_RATE, DMA_CHUNK_FRAMES * DEVICE_CHANNELS),
         m_nMaxLevel(GetRangeMax() - 1),
-        m_nZeroLevel(m_nMaxLevel / 2)
+        m_nZeroLevel(m_nMaxLevel / 2),
+        k_FixedGain(CConvert::MakeFixedGain<TYPE>(AUDIO_VOLUME * m_nMaxLevel / 2.f, m_nMaxLevel / 2.f, 0,
+                                                  static_cast<s32>(m_nMaxLevel)))
 {
 }
 
+bool JackTripClientPWM::Initialize(void)
+{
+    if (!CJackTripClient::Initialize()) {
+        return false;
+    }
+
+    // The PWM clock isn't steered; the resampler takes care of drift.
+    StartClockRecovery(false);
+
+    if (FULL_DUPLEX) {
+        m_Logger.Write(FromJTC, LogWarning, "The PWM device can't capture; sending silence.");
+    }
+
+    return StartAudioCore(m_nZeroLevel);
+}
+
 unsigned int JackTripClientPWM::GetChunk(u32 *pBuffer, unsigned int nChunkSize)
 {
+    return FillChunk(pBuffer, nChunkSize);
+}
+
+void JackTripClientPWM::RenderChunk(u32 *pBuffer, unsigned nChunkSize)
+{
+    PROFILE_SCOPE(ProfileRenderChunk);
+
     auto *b = pBuffer;
     // "Size of the buffer in words" -- numChannels * numFrames
     unsigned nResult = nChunkSize;
@@ -360,7 +1031,7 @@ unsigned int JackTripClientPWM::GetChunk(u32 *pBuffer, unsigned int nChunkSize)
         float amp = gain * sampleMaxValue / 2.f;
         // Get current sine wave sample.
         int sample{static_cast<int>((sin(m_fPhasor) + 1) * (1 << 15))};
-        m_fPhasor += MATH_2_PI * m_fF0 / SAMPLE_RATE;
+        m_fPhasor += MATH_2_PI * m_fF0 / DEVICE_SAMPLE_RATE;
         if (m_fPhasor > MATH_PI) {
             m_fPhasor -= MATH_2_PI;
         }
@@ -369,27 +1040,27 @@ unsigned int JackTripClientPWM::GetChunk(u32 *pBuffer, unsigned int nChunkSize)
         // Scale to u32 range
         int nSample{static_cast<int>(fSample * amp + sampleZeroValue)};
         if (ShouldLog()) {
-            CLogger::Get()->Write(FromJTC, LogDebug, "sample = %d (%04x)", sample, sample);
-            CLogger::Get()->Write(FromJTC, LogDebug, "fSample = %d / (1 << 15) = %f", sample, fSample);
-            CLogger::Get()->Write(FromJTC, LogDebug, "amp = %f * %u / 2 = %f", gain, sampleMaxValue, amp);
-            CLogger::Get()->Write(FromJTC, LogDebug, "nSample = %f * %f + %u = %d (%08x)", fSample, amp, sampleZeroValue, nSample, nSample);
+            CLogRing::Get()->Write(FromJTC, LogDebug, "sample = %d (%04x)", sample, sample);
+            CLogRing::Get()->Write(FromJTC, LogDebug, "fSample = %d / (1 << 15) = %f", sample, fSample);
+            CLogRing::Get()->Write(FromJTC, LogDebug, "amp = %f * %u / 2 = %f", gain, sampleMaxValue, amp);
+            CLogRing::Get()->Write(FromJTC, LogDebug, "nSample = %f * %f + %u = %d (%08x)", fSample, amp, sampleZeroValue, nSample, nSample);
         }
-        for (; nChunkSize > 0; nChunkSize -= 2) {
-            *pBuffer++ = (u32) nSample;
-            *pBuffer++ = (u32) nSample;
+        for (; nChunkSize > 0; nChunkSize -= DEVICE_CHANNELS) {
+            for (unsigned ch = 0; ch < DEVICE_CHANNELS; ++ch) {
+                *pBuffer++ = (u32) nSample;
+            }
         }
     } else {
-        m_FIFO.Read(pBuffer, nChunkSize / WRITE_CHANNELS, sampleMaxValue, false, ShouldLog());
+        Render<OutputOffsetBinary>(pBuffer, nChunkSize / DEVICE_CHANNELS, sampleMaxValue / 2.f, sampleMaxValue / 2.f,
+                                   k_FixedGain, PWM_DITHER ? &m_Dither : nullptr);
     }
 
     if (ShouldLog()) {
-        m_Logger.Write(FromJTC, LogDebug, "Output buffer");
+        CLogRing::Get()->Write(FromJTC, LogDebug, "Output buffer");
         HexDump(reinterpret_cast<u8 *>(b), nResult * sizeof(u32), false);
     }
 
     ++m_BufferCount;
-
-    return nResult;
 }
 
 boolean JackTripClientPWM::Start(void)
@@ -411,14 +1082,39 @@ JackTripClientI2S::JackTripClientI2S(CLogger *pLogger,
                                      CI2CMaster *pI2CMaster,
                                      CDevice *pDevice) :
         CJackTripClient(pLogger, pNet, pDevice),
-        CI2SSoundBaseDevice(pInterrupt, SAMPLE_RATE, AUDIO_BLOCK_FRAMES * WRITE_CHANNELS, FALSE, pI2CMaster, DAC_I2C_ADDRESS),
+        CI2SSoundBaseDevice(pInterrupt, DEVICE_SAMPLE_RATE, DMA_CHUNK_FRAMES * DEVICE_CHANNELS, FALSE, pI2CMaster,
+                            DAC_I2C_ADDRESS,
+                            FULL_DUPLEX ? CSoundBaseDevice::DeviceModeTXRX : CSoundBaseDevice::DeviceModeTXOnly),
         k_nMinLevel(GetRangeMin() + 1),
-        k_nMaxLevel(GetRangeMax() - 1)
+        k_nMaxLevel(GetRangeMax() - 1),
+        k_FixedGain(CConvert::MakeFixedGain<TYPE>(AUDIO_VOLUME * k_nMaxLevel, 0.f, k_nMinLevel, k_nMaxLevel))
+{
+}
+
+bool JackTripClientI2S::Initialize(void)
 {
+    if (!CJackTripClient::Initialize()) {
+        return false;
+    }
+
+    StartClockRecovery(true);
+
+    if (FULL_DUPLEX) {
+        StartCapture();
+    }
+
+    return StartAudioCore(0);
 }
 
 unsigned int JackTripClientI2S::GetChunk(u32 *pBuffer, unsigned int nChunkSize)
 {
+    return FillChunk(pBuffer, nChunkSize);
+}
+
+void JackTripClientI2S::RenderChunk(u32 *pBuffer, unsigned nChunkSize)
+{
+    PROFILE_SCOPE(ProfileRenderChunk);
+
     auto *b = pBuffer;
     // "Size of the buffer in words" -- numChannels * numFrames
     unsigned nResult = nChunkSize;
@@ -428,10 +1124,10 @@ unsigned int JackTripClientI2S::GetChunk(u32 *pBuffer, unsigned int nChunkSize)
         float gain{.1f};
         float amp = gain * sampleMaxValue;
 
-        for (; nChunkSize > 0; nChunkSize -= 2) {
+        for (; nChunkSize > 0; nChunkSize -= DEVICE_CHANNELS) {
             // Get current sine wave sample.
             int sample{static_cast<int>((sin(m_fPhasor) + 1) * (1 << 15))};
-            m_fPhasor += MATH_2_PI * m_fF0 / SAMPLE_RATE;
+            m_fPhasor += MATH_2_PI * m_fF0 / DEVICE_SAMPLE_RATE;
             if (m_fPhasor > MATH_PI) {
                 m_fPhasor -= MATH_2_PI;
             }
@@ -441,8 +1137,9 @@ unsigned int JackTripClientI2S::GetChunk(u32 *pBuffer, unsigned int nChunkSize)
             // Scale to u32 range
             int nSample{static_cast<int>(fSample * amp)};
 
-            *pBuffer++ = (u32) nSample;
-            *pBuffer++ = (u32) nSample;
+            for (unsigned ch = 0; ch < DEVICE_CHANNELS; ++ch) {
+                *pBuffer++ = (u32) nSample;
+            }
         }
 //        if (ShouldLog()) {
 //            CLogger::Get()->Write(FromJTC, LogDebug, "sample = %d (%04x)", sample, sample);
@@ -451,17 +1148,20 @@ unsigned int JackTripClientI2S::GetChunk(u32 *pBuffer, unsigned int nChunkSize)
 //            CLogger::Get()->Write(FromJTC, LogDebug, "nSample = %f * %f = %d (%08x)", fSample, amp, nSample, nSample);
 //        }
     } else {
-        m_FIFO.Read(pBuffer, nChunkSize / WRITE_CHANNELS, sampleMaxValue, true, ShouldLog());
+        Render<OutputSigned>(pBuffer, nChunkSize / DEVICE_CHANNELS, sampleMaxValue, 0.f, k_FixedGain);
     }
 
     if (ShouldLog()) {
-        m_Logger.Write(FromJTC, LogDebug, "Output buffer");
+        CLogRing::Get()->Write(FromJTC, LogDebug, "Output buffer");
         HexDump(reinterpret_cast<u8 *>(b), nResult * sizeof(u32), false);
     }
 
     ++m_BufferCount;
+}
 
-    return nResult;
+void JackTripClientI2S::PutChunk(const u32 *pBuffer, unsigned nChunkSize)
+{
+    Capture(pBuffer, nChunkSize);
 }
 
 boolean JackTripClientI2S::Start(void)
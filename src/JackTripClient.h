@@ -28,41 +28,192 @@
 #include <circle/util.h>
 #include <circle/sched/scheduler.h>
 #include <circle/bcmrandom.h>
+#include <circle/gpioclock.h>
+#include <circle/machineinfo.h>
 #include "config.h"
+#include "AudioArena.h"
 #include "fifo.h"
+#include "BlockRing.h"
+#include "JitterTuner.h"
+#include "SequenceTracker.h"
+#include "LossConcealer.h"
+#include "ReceiveMonitor.h"
+#include "LatencyMonitor.h"
+#include "StreamFormat.h"
+#include "RateController.h"
+#include "Resampler.h"
+#include "Mixer.h"
+#include "AudioCore.h"
+#include "LogRing.h"
+#include "Profiler.h"
 #include "PacketHeader.h"
 
 #define PORT_NUMBER_NUM_BYTES 4
 #define UDP_PACKET_SIZE       (PACKET_HEADER_SIZE + WRITE_CHANNELS * AUDIO_BLOCK_FRAMES * TYPE_SIZE)
-#define RECEIVE_TIMEOUT_SEC   5
+// How long to wait for a new stream to start, and for a stopped one to carry
+// on, before reconnecting.
+#define RECEIVE_TIMEOUT_SEC   5u
+#define STREAM_TIMEOUT_MS     500u
+// Back-off between attempts to connect: doubling from the first to the last.
+#define RECONNECT_MIN_MS      8
+#define RECONNECT_MAX_MS      64
+// How long the server has to send its UDP port.
+#define PORT_EXCHANGE_MS      1000
+// How long to wait for a datagram before giving up, for now, to check for the
+// receive timeout and log statistics.
+#define RECEIVE_WAIT_MS       100
+// The largest datagram to accept, in whatever format the server sends.
+#define MAX_DATAGRAM_SIZE     8192
+// Packets to keep track of for reordering: as many as fit in the half of the
+// fifo that the read index normally trails the write index by.
+#define SEQUENCE_WINDOW       (FIFO_LENGTH_FRAMES / 2 / AUDIO_BLOCK_FRAMES)
+// The fastest the resampler may consume the stream, allowing for clock
+// recovery's corrections.
+#define RESAMPLE_MAX_RATIO    (1.01f * SAMPLE_RATE / DEVICE_SAMPLE_RATE)
+// From reading the fifo to the DAC, in microseconds: a chunk plays after the
+// one playing as it's rendered, and after any the audio core renders ahead.
+#define OUTPUT_LATENCY_US     (1000000u * DMA_CHUNK_FRAMES * (AUDIO_CORE ? AUDIO_CORE_CHUNKS : 1) \
+                               / DEVICE_SAMPLE_RATE)
 
 class CJackTripClient
 {
 public:
+    typedef CFIFO<TYPE, WRITE_CHANNELS, FIFO_LENGTH_FRAMES, DEVICE_CHANNELS> TFIFO;
+
     CJackTripClient(CLogger *pLogger, CNetSubSystem *pNet, CDevice *pDevice);
 
-    virtual ~CJackTripClient() = default;
+    virtual ~CJackTripClient();
 
-    bool Initialize(void);
+    virtual bool Initialize(void);
 
     virtual boolean Start(void) = 0;
 
     virtual boolean IsActive(void) = 0;
 
+    /**
+     * Take the next step in connecting to the server, without waiting any
+     * longer than that step takes: back off after a failed attempt, connect
+     * over TCP and send the UDP port, or check for the server's.
+     * @return Whether connected.
+     */
     bool Connect();
 
     void Run();
 
+    /**
+     * Fill a chunk of the sound device's buffer. Called from the sound
+     * device's interrupt handler, or on the audio core if AUDIO_CORE.
+     * @param pBuffer Sample-interleaved sound device buffer.
+     * @param nChunkSize Size of the buffer, in words.
+     */
+    virtual void RenderChunk(u32 *pBuffer, unsigned nChunkSize) = 0;
+
+    /**
+     * @return The receive fifo, for its statistics.
+     */
+    const TFIFO &GetFIFO() const { return m_FIFO; }
+
+    /**
+     * @return The output mixer, to change its settings from the main task
+     * (see CMixer); only in use if MIXER.
+     */
+    CMixer &GetMixer() { return m_Mixer; }
+
+    /**
+     * @return The receive sequence tracker, for its statistics.
+     */
+    const CSequenceTracker &GetSequenceTracker() const { return m_SequenceTracker; }
+
+    const CLossConcealer &GetLossConcealer() const { return m_LossConcealer; }
+
+    const CLatencyMonitor &GetLatencyMonitor() const { return m_LatencyMonitor; }
+
+    /**
+     * @return Packets that were missing until a redundant datagram brought
+     * them.
+     */
+    u32 GetRecovered() const { return m_nRecovered; }
+
 protected:
     void Receive();
 
     bool ShouldLog() const;
 
+    /**
+     * Start tracking the server's sample rate, by steering either the PCM
+     * clock or the resampler.
+     * @param canSteerClock Whether the sound device runs from the PCM clock.
+     */
+    void StartClockRecovery(bool canSteerClock);
+
+    /**
+     * Hand the audio path over to core 1, if AUDIO_CORE.
+     * @param nSilence Sound device word for silence.
+     * @return Whether the secondary cores started.
+     */
+    bool StartAudioCore(u32 nSilence);
+
+    /**
+     * Supply the sound device with a chunk: from the audio core if it's
+     * running, else by rendering it here and now.
+     * @param pBuffer
+     * @param nChunkSize
+     * @return nChunkSize
+     */
+    unsigned FillChunk(u32 *pBuffer, unsigned nChunkSize);
+
+    /**
+     * Set up the uplink for full duplex: captured blocks go into a ring, and
+     * the send task sends each one as soon as it is complete.
+     */
+    void StartCapture();
+
+    /**
+     * Queue captured frames for sending, if connected. Called from the sound
+     * device's interrupt handler.
+     * @param pBuffer Sample-interleaved sound device buffer.
+     * @param nChunkSize Size of the buffer, in words.
+     */
+    void Capture(const u32 *pBuffer, unsigned nChunkSize);
+
+    /**
+     * Fill a chunk of the sound device's buffer from the fifo, via the
+     * resampler if it is in use.
+     * @tparam Style The sound device's.
+     * @param pBuffer Sample-interleaved sound device buffer.
+     * @param nFrames
+     * @param amp Full scale, for samples in [-1, 1); see CConvert. The
+     * mixer sets the level, or, without the MIXER, AUDIO_VOLUME.
+     * @param offset The sound device's zero level (OutputOffsetBinary only).
+     * @param fixedGain The same, at AUDIO_VOLUME, for FIXED_POINT_OUTPUT.
+     * @param pDither TPDF dither to add, or nullptr.
+     */
+    template<TOutputStyle Style>
+    void Render(u32 *pBuffer, u16 nFrames, float amp, float offset, const TFixedGain &fixedGain,
+                TDither *pDither = nullptr);
+
+    /**
+     * Log a buffer in hex, deferred.
+     * @param buffer
+     * @param length
+     * @param doHeader Whether the buffer starts with a packet header.
+     */
     void HexDump(const u8 *buffer, unsigned int length, bool doHeader);
 
     CLogger m_Logger;
     CDevice *m_pDevice;
-    CFIFO<TYPE> m_FIFO;
+    TFIFO m_FIFO;
+    CBlockRing<TYPE> *m_pCaptureRing{nullptr};
+    CJitterTuner m_JitterTuner;
+    CSequenceTracker m_SequenceTracker;
+    CLossConcealer m_LossConcealer;
+    CReceiveMonitor m_ReceiveMonitor;
+    CLatencyMonitor m_LatencyMonitor;
+    CResampler m_Resampler;
+    CMixer m_Mixer;
+    // Device channels, sample-interleaved, on their way to the sound device.
+    float *m_pRenderBuffer;
+    bool m_bResample{RESAMPLER && DEVICE_SAMPLE_RATE != SAMPLE_RATE};
     bool m_Connected{false};
     int m_BufferCount{0};
 
@@ -71,10 +222,76 @@ protected:
 private:
     static bool IsExitPacket(int size, const u8 *packet) ;
 
+#if AUDIO_CORE
+    static void RenderChunkHandler(u32 *pBuffer, unsigned nChunkSize, void *pParam);
+#endif
+
     void Disconnect();
 
+    /**
+     * Put a packet's audio in the fifo, or in its place there, according to
+     * its sequence number.
+     * @param pPacket Header and payload, in the negotiated format; the
+     * payload may be modified.
+     * @param nSeqNumber
+     * @param bInPlace Whether pPacket is the fifo's write slot, so that the
+     * packet need only be committed, if it's next. Native format only.
+     * @param bPlaced Set to whether the packet's audio went into the fifo:
+     * not if it was a duplicate, or too late, even for its place.
+     * @return Where the packet belonged.
+     */
+    CSequenceTracker::TArrival ReceivePacket(u8 *pPacket, u16 nSeqNumber, bool bInPlace, bool &bPlaced);
+
+    /**
+     * Take on the format of the stream a packet belongs to, if it can be
+     * decoded, starting the stream over if it's a change of format.
+     * @param header
+     * @return Whether it can.
+     */
+    bool NegotiateFormat(const TJackTripPacketHeader &header);
+
+    /**
+     * Fill in for lost blocks in the fifo.
+     * @param nBlocks
+     */
+    void ConcealLoss(unsigned nBlocks);
+
+    void LogStats();
+
+    /**
+     * Where Connect() is.
+     */
+    enum TConnectState
+    {
+        BackingOff,
+        Connecting,
+        ExchangingPorts
+    };
+
+    /**
+     * Give up on this attempt to connect, and back off before the next:
+     * twice as long as last time, up to RECONNECT_MAX_MS.
+     */
+    void Retry();
+
     CNetSubSystem *m_pNet;
-    CSocket m_pUdpSocket;
+    // Bound once, and pointed at each server port in turn; replaced only to
+    // bind another port.
+    CSocket *m_pUdpSocket{nullptr};
+    u16 m_nUdpPort{0};
+    // For the port exchange; deleted, and so closed, when that's done, or on
+    // the next attempt.
+    CSocket *m_pTcpSocket{nullptr};
+    TConnectState m_ConnectState{Connecting};
+    unsigned m_nBackoffMs{RECONNECT_MIN_MS};
+    // In clock ticks: when the state was entered, and when the server last
+    // accepted a connection.
+    unsigned m_nStateStart{0};
+    unsigned m_nConnectStart{0};
+    CStreamDecoder<TYPE> m_Decoder{WRITE_CHANNELS, AUDIO_BLOCK_FRAMES, SAMPLE_RATE};
+    // Datagrams not in the fifo's format go here, to be decoded.
+    u8 m_Datagram[MAX_DATAGRAM_SIZE]{};
+    bool m_bFormatRefused{false};
     CSynchronizationEvent m_Event;
     CSpinLock m_SpinLock;
 
@@ -90,69 +307,98 @@ private:
     };
 
     int m_nPacketsReceived{0};
+    u32 m_nRecovered{0};
+    u16 m_nLastTimedSeqNumber{0};
+    // In clock ticks.
     unsigned int m_nLastReceive{0};
+    unsigned int m_nLastStats{0};
+
+#if AUDIO_CORE
+    CAudioCore *m_pAudioCore{nullptr};
+#endif
 
     class CSendTask : public CTask
     {
     public:
-        CSendTask(CSocket *pUdpSocket, CSynchronizationEvent *pEvent, bool *pConnected);
+        /**
+         * @param pUdpSocket
+         * @param pEvent Set for each datagram received, or, in full duplex,
+         * for each block captured.
+         * @param pConnected
+         * @param pCaptureRing Captured blocks to send, or nullptr to send
+         * silence, a datagram per datagram received.
+         */
+        CSendTask(CSocket *pUdpSocket, CSynchronizationEvent *pEvent, bool *pConnected,
+                  CBlockRing<TYPE> *pCaptureRing);
 
         ~CSendTask(void) override;
 
         void Run(void) override;
 
     private:
+        /**
+         * Send every block captured so far.
+         */
+        void SendCaptured();
+
+        /**
+         * Send a packet, with the REDUNDANCY - 1 sent before it, if any.
+         * @param pPacket UDP_PACKET_SIZE bytes.
+         */
+        void Send(const u8 *pPacket);
+
+        /**
+         * @return Microseconds, for a packet header: the system timer, with
+         * its wraps carried into the upper 32 bits.
+         */
+        u64 GetTimeStamp();
+
         CSocket *m_pUdpSocket;
         CSynchronizationEvent *m_pEvent;
         bool &m_pConnected;
+        CBlockRing<TYPE> *m_pCaptureRing;
         TJackTripPacketHeader m_PacketHeader{0, 0, AUDIO_BLOCK_FRAMES, JACKTRIP_SAMPLE_RATE, JACKTRIP_BIT_RES * 8, WRITE_CHANNELS, WRITE_CHANNELS};
+        // With redundancy, the last REDUNDANCY packets sent, newest first, as
+        // they go in a datagram.
+        u8 m_Datagram[REDUNDANCY * UDP_PACKET_SIZE]{};
+        u64 m_nTimeStamp{0};
     };
 
+    /**
+     * Clock recovery: steers the PCM clock (I2S), or the resampler, so that
+     * the output runs at the server's rate, judging by the fifo fill level.
+     */
     class CClockTask : public CTask
     {
     public:
-        CClockTask() : m_Clock(GPIOClockPCM, GPIOClockSourcePLLD) {}
+        /**
+         * @param pFIFO
+         * @param pConnected
+         * @param pResampler The resampler to steer, or nullptr to steer the
+         * PCM clock.
+         */
+        CClockTask(TFIFO *pFIFO, bool *pConnected, CResampler *pResampler);
 
         ~CClockTask(void) override = default;
 
-        void Run(void) override {
-            unsigned nSampleRate{SAMPLE_RATE};
-            unsigned nClockFreq =
-                    CMachineInfo::Get ()->GetGPIOClockSourceRate (GPIOClockSourcePLLD);
-            CBcmRandomNumberGenerator rand;
-
-            while (true)
-            {
-                CScheduler::Get()->MsSleep(5000);
-
-                nSampleRate += (rand.GetNumber() % 1000 - 500);
-
-                if (8000 <= nSampleRate && nSampleRate <= 192000) {
-                    return;
-                }
-
-                // E.g. 500'000'000 / 64 / 48000 = 162.76... => 162
-                unsigned nDivI = nClockFreq / (32*2) / nSampleRate;
-                // E.g. 500'000'000 / 64 % 48000 = 36500
-                unsigned nTemp = nClockFreq / (32*2) % nSampleRate;
-                // E.g. (36500 * 4096 + 24000) / 48000 = 3115.166... => 3115
-                unsigned nDivF = (nTemp * 4096 + nSampleRate/2) / nSampleRate;
-                assert (nDivF <= 4096);
-                if (nDivF > 4095)
-                {
-                    nDivI++;
-                    nDivF = 0;
-                }
-
-                CLogger::Get()->Write("clocktask", LogDebug, "Setting Fs: %u, DivI: %u, DivF: %u",
-                                      nSampleRate, nDivI, nDivF);
-
-                m_Clock.Start (nDivI, nDivF, nDivF > 0 ? 1 : 0);
-            }
-        }
+        void Run(void) override;
 
     private:
+        /**
+         * Apply a correction to the output rate.
+         * @param fPPM Parts per million; positive to speed up.
+         */
+        void SetCorrection(float fPPM);
+
+        void SetSampleRate(float fSampleRate);
+
         CGPIOClock m_Clock;
+        TFIFO *m_pFIFO;
+        bool &m_pConnected;
+        CResampler *m_pResampler;
+        CRateController m_Controller;
+        unsigned m_nClockFreq;
+        unsigned m_nDivI{0}, m_nDivF{0};
     };
 
     CSendTask *m_pSendTask{nullptr};
@@ -166,14 +412,20 @@ class JackTripClientPWM : public CJackTripClient, public CPWMSoundBaseDevice
 public:
     JackTripClientPWM(CLogger *pLogger, CNetSubSystem *pNet, CInterruptSystem *pInterrupt, CDevice *pDevice);
 
+    bool Initialize(void) override;
+
     boolean Start(void) override;
 
     boolean IsActive(void) override;
 
+    void RenderChunk(u32 *pBuffer, unsigned nChunkSize) override;
+
 private:
     unsigned int GetChunk(u32 *pBuffer, unsigned int nChunkSize) override;
 
     unsigned m_nMaxLevel, m_nZeroLevel;
+    const TFixedGain k_FixedGain;
+    TDither m_Dither;
 };
 
 //// I2S //////////////////////////////////////////////////////////////////////
@@ -184,14 +436,21 @@ public:
     JackTripClientI2S(CLogger *pLogger, CNetSubSystem *pNet, CInterruptSystem *pInterrupt, CI2CMaster *pI2CMaster,
                       CDevice *pDevice);
 
+    bool Initialize(void) override;
+
     boolean Start(void) override;
 
     boolean IsActive(void) override;
 
+    void RenderChunk(u32 *pBuffer, unsigned nChunkSize) override;
+
 private:
     unsigned int GetChunk(u32 *pBuffer, unsigned int nChunkSize) override;
 
+    void PutChunk(const u32 *pBuffer, unsigned nChunkSize) override;
+
     const int k_nMinLevel, k_nMaxLevel;
+    const TFixedGain k_FixedGain;
 };
 
 
@@ -0,0 +1,126 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "JitterTuner.h"
+
+CJitterTuner::CJitterTuner(u16 nBlockFrames,
+                           unsigned nSampleRate,
+                           u32 nMinDepth,
+                           u32 nMaxDepth,
+                           unsigned nUnderrunsPerMinute) :
+        k_nBlockFrames{nBlockFrames},
+        k_nSampleRate{nSampleRate},
+        k_nPeriod{static_cast<unsigned>(static_cast<u64>(nBlockFrames) * 1000000 / nSampleRate)},
+        k_nPacketsPerWindow{nSampleRate / nBlockFrames},
+        k_nMinDepth{nMinDepth},
+        k_nMaxDepth{nMaxDepth},
+        k_nUnderrunsPerMinute{nUnderrunsPerMinute},
+        m_nTargetDepth{nMinDepth}
+{
+}
+
+void CJitterTuner::OnPacket(unsigned nTicks, u32 nUnderruns, unsigned nPeriods)
+{
+    if (m_bFirstPacket) {
+        m_bFirstPacket = false;
+        m_nLastTicks = nTicks;
+        m_nLastUnderruns = nUnderruns;
+        return;
+    }
+
+    // Deviation of the inter-arrival time from the nominal packet period.
+    int delta{static_cast<int>(nTicks - m_nLastTicks) - static_cast<int>(nPeriods * k_nPeriod)};
+    unsigned deviation = delta < 0 ? -delta : delta;
+    m_nLastTicks = nTicks;
+
+    // J += (|D| - J) / 16, kept scaled by 16.
+    m_nJitter += deviation - ((m_nJitter + (1 << (k_nJitterShift - 1))) >> k_nJitterShift);
+
+    if (deviation > m_nWindowPeak) {
+        m_nWindowPeak = deviation;
+    }
+
+    if (++m_nPacketCount >= k_nPacketsPerWindow) {
+        Evaluate(nUnderruns);
+    }
+}
+
+void CJitterTuner::Evaluate(u32 nUnderruns)
+{
+    u32 newUnderruns{nUnderruns - m_nLastUnderruns};
+    m_nLastUnderruns = nUnderruns;
+
+    // Keep a running count of underruns over the last minute.
+    m_nUnderrunsThisMinute -= m_UnderrunHistory[m_nHistoryIndex];
+    m_UnderrunHistory[m_nHistoryIndex] = newUnderruns;
+    m_nUnderrunsThisMinute += newUnderruns;
+    m_nHistoryIndex = (m_nHistoryIndex + 1) % k_nWindowsPerMinute;
+
+    // Largest lateness seen this window, in frames (rounded up). Let the peak
+    // decay by a frame per window so a single spike doesn't pin the depth.
+    auto windowFrames{static_cast<u32>((static_cast<u64>(m_nWindowPeak) * k_nSampleRate + 999999) / 1000000)};
+    if (windowFrames >= m_nPeakFrames) {
+        m_nPeakFrames = windowFrames;
+    } else {
+        --m_nPeakFrames;
+    }
+
+    if (newUnderruns > 0) {
+        m_nQuietCount = 0;
+        if (m_nUnderrunsThisMinute > k_nUnderrunsPerMinute) {
+            // Too many underruns; back off quickly.
+            m_nMargin += k_nBlockFrames / 4;
+        }
+    } else if (++m_nQuietCount >= k_nQuietWindows
+               && m_nUnderrunsThisMinute < k_nUnderrunsPerMinute
+               && m_nMargin > 0) {
+        // Comfortably within budget; creep towards lower latency.
+        --m_nMargin;
+    }
+
+    u32 target{m_nPeakFrames + m_nMargin};
+    if (target < k_nMinDepth) {
+        target = k_nMinDepth;
+    } else if (target > k_nMaxDepth) {
+        target = k_nMaxDepth;
+        // No point in growing the margin any further.
+        m_nMargin = target > m_nPeakFrames ? target - m_nPeakFrames : 0;
+    }
+    m_nTargetDepth = target;
+
+    m_nWindowPeak = 0;
+    m_nPacketCount = 0;
+}
+
+void CJitterTuner::Reset()
+{
+    m_bFirstPacket = true;
+    m_nJitter = 0;
+    m_nWindowPeak = 0;
+    m_nPacketCount = 0;
+    m_nPeakFrames = 0;
+    m_nMargin = 0;
+    m_nTargetDepth = k_nMinDepth;
+    m_nLastUnderruns = 0;
+    for (auto &n: m_UnderrunHistory) {
+        n = 0;
+    }
+    m_nHistoryIndex = 0;
+    m_nUnderrunsThisMinute = 0;
+    m_nQuietCount = 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_JITTERTUNER_H
+#define JACKTRIP_PI_JITTERTUNER_H
+
+#include <circle/types.h>
+
+/**
+ * Chooses the jitter buffer depth, i.e. the number of spare frames the fifo
+ * should hold when the sound device asks for more, from the measured packet
+ * inter-arrival jitter and the fifo's underrun count. Something like
+ * JackTrip's `-q auto`.
+ *
+ * Call OnPacket() from the receive path for every audio packet; pass
+ * GetTargetDepth() on to the fifo.
+ */
+class CJitterTuner
+{
+public:
+    /**
+     * @param nBlockFrames Frames per packet.
+     * @param nSampleRate Sampling rate of the stream.
+     * @param nMinDepth Smallest depth the tuner may choose, in frames.
+     * @param nMaxDepth Largest depth the tuner may choose, in frames.
+     * @param nUnderrunsPerMinute Tolerated underrun rate.
+     */
+    CJitterTuner(u16 nBlockFrames, unsigned nSampleRate, u32 nMinDepth, u32 nMaxDepth,
+                 unsigned nUnderrunsPerMinute);
+
+    /**
+     * Register the arrival of a packet.
+     * @param nTicks Arrival time, in microseconds.
+     * @param nUnderruns The fifo's (cumulative) underrun count.
+     * @param nPeriods Packet periods since the last packet registered, e.g. 2
+     * if the one in between was lost, so that loss doesn't pass for jitter.
+     */
+    void OnPacket(unsigned nTicks, u32 nUnderruns, unsigned nPeriods = 1);
+
+    /**
+     * Forget all measurements, e.g. on disconnection.
+     */
+    void Reset();
+
+    /**
+     * Allow for packets longer than the sound device's chunks: between
+     * packets, the fifo drains by a packet's worth, less a chunk, below the
+     * depth it's at right after one arrives.
+     * @param nPacketFrames
+     * @param nChunkFrames
+     */
+    void SetPacketFrames(u16 nPacketFrames, u16 nChunkFrames)
+    {
+        m_nPacketDepth = nPacketFrames > nChunkFrames ? nPacketFrames - nChunkFrames : 0;
+    }
+
+    u32 GetTargetDepth() const { return m_nTargetDepth + m_nPacketDepth; }
+
+    /**
+     * @return Smoothed inter-arrival jitter (RFC 3550), in microseconds.
+     */
+    unsigned GetJitter() const { return m_nJitter >> k_nJitterShift; }
+
+private:
+    void Evaluate(u32 nUnderruns);
+
+    // RFC 3550 smooths jitter with a gain of 1/16.
+    static constexpr unsigned k_nJitterShift{4};
+    // Length of the evaluation window and of the underrun history.
+    static constexpr unsigned k_nWindowsPerMinute{60};
+    // Quiet windows required before the safety margin is allowed to shrink.
+    static constexpr unsigned k_nQuietWindows{10};
+
+    const u16 k_nBlockFrames;
+    const unsigned k_nSampleRate;
+    const unsigned k_nPeriod;
+    const unsigned k_nPacketsPerWindow;
+    const u32 k_nMinDepth, k_nMaxDepth;
+    const unsigned k_nUnderrunsPerMinute;
+
+    bool m_bFirstPacket{true};
+    unsigned m_nLastTicks{0};
+    unsigned m_nJitter{0};
+    unsigned m_nWindowPeak{0};
+    unsigned m_nPacketCount{0};
+
+    u32 m_nPeakFrames{0};
+    u32 m_nMargin{0};
+    u32 m_nTargetDepth;
+    u32 m_nPacketDepth{0};
+
+    u32 m_nLastUnderruns{0};
+    u32 m_UnderrunHistory[k_nWindowsPerMinute]{};
+    unsigned m_nHistoryIndex{0};
+    u32 m_nUnderrunsThisMinute{0};
+    unsigned m_nQuietCount{0};
+};
+
+#endif //JACKTRIP_PI_JITTERTUNER_H
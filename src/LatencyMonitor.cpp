@@ -0,0 +1,151 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LatencyMonitor.h"
+#include "PacketHeader.h"
+
+static const char FromLatency[] = "latency";
+
+void CLatencyHistogram::Add(u32 nMicroseconds)
+{
+    ++m_nCounts[GetBucket(nMicroseconds)];
+    ++m_nCount;
+    if (nMicroseconds > m_nMax) {
+        m_nMax = nMicroseconds;
+    }
+}
+
+void CLatencyHistogram::GetPercentiles(TPercentiles *pPercentiles) const
+{
+    pPercentiles->nCount = m_nCount;
+    pPercentiles->n50 = GetPercentile(500);
+    pPercentiles->n95 = GetPercentile(950);
+    pPercentiles->n99 = GetPercentile(990);
+    pPercentiles->nMax = m_nMax;
+}
+
+void CLatencyHistogram::Reset()
+{
+    for (auto &nCount: m_nCounts) {
+        nCount = 0;
+    }
+    m_nCount = 0;
+    m_nMax = 0;
+}
+
+unsigned CLatencyHistogram::GetBucket(u32 nMicroseconds)
+{
+    if (nMicroseconds >= 1u << k_nMaxBits) {
+        return k_nBuckets - 1;
+    }
+    if (nMicroseconds < 2u << k_nSubBits) {
+        return nMicroseconds;
+    }
+
+    // The top k_nSubBits bits below the leading one pick the bucket within
+    // the doubling.
+    unsigned nShift{31u - __builtin_clz(nMicroseconds) - k_nSubBits};
+    return ((nShift + 1) << k_nSubBits) + ((nMicroseconds >> nShift) & ((1u << k_nSubBits) - 1));
+}
+
+u32 CLatencyHistogram::GetValue(unsigned nBucket)
+{
+    if (nBucket < 2u << k_nSubBits) {
+        return nBucket;
+    }
+
+    unsigned nShift{(nBucket >> k_nSubBits) - 1};
+    u32 nLow{((1u << k_nSubBits) + (nBucket & ((1u << k_nSubBits) - 1))) << nShift};
+    return nLow + (1u << nShift) / 2;
+}
+
+u32 CLatencyHistogram::GetPercentile(unsigned nPermille) const
+{
+    if (m_nCount == 0) {
+        return 0;
+    }
+
+    // The first bucket that brings the count to the rank, rounding up.
+    u64 nRank{(static_cast<u64>(m_nCount) * nPermille + 999) / 1000};
+    u64 nSeen{0};
+    for (unsigned n{0}; n < k_nBuckets; ++n) {
+        nSeen += m_nCounts[n];
+        if (nSeen >= nRank && nSeen > 0) {
+            // Not beyond the longest time seen, which shares its bucket.
+            u32 nValue{GetValue(n)};
+            return nValue < m_nMax ? nValue : m_nMax;
+        }
+    }
+
+    return m_nMax;
+}
+
+CLatencyMonitor::CLatencyMonitor(unsigned nSampleRate, unsigned nOutputLatency) :
+        k_nSampleRate{nSampleRate},
+        k_nOutputLatency{nOutputLatency}
+{
+}
+
+void CLatencyMonitor::OnPacket(unsigned nTicks, u64 nTimeStamp, unsigned nPacketFrames, unsigned nQueued)
+{
+    const u32 nQueueTime{static_cast<u32>(1000000ull * nQueued / k_nSampleRate)};
+    m_FIFO.Add(nQueueTime);
+
+    // The server adds the time it held the stamp to it, so the round trip
+    // is the network's and the two ends' send and receive paths'. The
+    // client's stamps are of its 32-bit timer, so compare those bits.
+    if ((nTimeStamp & TIMESTAMP_ECHO) != 0) {
+        m_bEchoed = true;
+        m_nRoundTrip = nTicks - static_cast<u32>(nTimeStamp);
+        m_RoundTrip.Add(m_nRoundTrip);
+    }
+
+    if (m_bEchoed) {
+        const u32 nPacketTime{static_cast<u32>(1000000ull * nPacketFrames / k_nSampleRate)};
+        m_Total.Add(nPacketTime + m_nRoundTrip / 2 + nQueueTime + k_nOutputLatency);
+    }
+}
+
+void CLatencyMonitor::Reset()
+{
+    m_bEchoed = false;
+    m_nRoundTrip = 0;
+}
+
+void CLatencyMonitor::Dump(CLogger *pLogger) const
+{
+    TPercentiles p;
+
+    m_FIFO.GetPercentiles(&p);
+    pLogger->Write(FromLatency, LogNotice, "fifo %u/%u/%u/%u us (p50/p95/p99/max) over %u packets",
+                   p.n50, p.n95, p.n99, p.nMax, p.nCount);
+
+    if (m_RoundTrip.GetCount() == 0) {
+        pLogger->Write(FromLatency, LogNotice, "no timestamps echoed, so no round trip; "
+                                               "the server has to echo them (jthub -e)");
+        return;
+    }
+
+    m_RoundTrip.GetPercentiles(&p);
+    pLogger->Write(FromLatency, LogNotice, "round trip %u/%u/%u/%u us (p50/p95/p99/max) over %u echoes; "
+                                           "one way %u us (p50)",
+                   p.n50, p.n95, p.n99, p.nMax, p.nCount, p.n50 / 2);
+    m_Total.GetPercentiles(&p);
+    pLogger->Write(FromLatency, LogNotice, "mouth to ear %u/%u/%u/%u us (p50/p95/p99/max)",
+                   p.n50, p.n95, p.n99, p.nMax);
+}
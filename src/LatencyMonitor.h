@@ -0,0 +1,144 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_LATENCYMONITOR_H
+#define JACKTRIP_PI_LATENCYMONITOR_H
+
+#include <circle/logger.h>
+#include <circle/types.h>
+
+/**
+ * Percentiles of a set of times, in microseconds.
+ */
+struct TPercentiles
+{
+    unsigned nCount;
+    u32 n50, n95, n99, nMax;
+};
+
+/**
+ * Counts times in a fixed set of buckets, so that percentiles over any
+ * number of them take constant space and time to add to. The buckets are
+ * log-linear: 1 us wide up to 32 us, then 16 to each doubling, so a
+ * percentile is within about 3% of the time it stands for, up to 16 s;
+ * longer times count as 16 s.
+ */
+class CLatencyHistogram
+{
+public:
+    void Add(u32 nMicroseconds);
+
+    /**
+     * @param pPercentiles Of everything added since Reset().
+     */
+    void GetPercentiles(TPercentiles *pPercentiles) const;
+
+    unsigned GetCount() const { return m_nCount; }
+
+    void Reset();
+
+private:
+    static constexpr unsigned k_nSubBits{4};
+    static constexpr unsigned k_nMaxBits{24};
+    static constexpr unsigned k_nBuckets{(k_nMaxBits - k_nSubBits + 1) << k_nSubBits};
+
+    static unsigned GetBucket(u32 nMicroseconds);
+
+    /**
+     * @return The middle of a bucket.
+     */
+    static u32 GetValue(unsigned nBucket);
+
+    /**
+     * @param nPermille
+     * @return The time nPermille of those counted are at or below.
+     */
+    u32 GetPercentile(unsigned nPermille) const;
+
+    u32 m_nCounts[k_nBuckets]{};
+    unsigned m_nCount{0};
+    u32 m_nMax{0};
+};
+
+/**
+ * Measures latency from end to end, given a server that echoes the client's
+ * packet timestamps back (see TIMESTAMP_ECHO): the network round trip, how
+ * long packets wait in the fifo to play, and the total, mouth to ear. That
+ * is the far end's packetisation, a packet's length; the network one way,
+ * taken as half the round trip, since the two ends' clocks aren't
+ * synchronised; the fifo; and the sound device's output buffering. Each
+ * frame of a packet waits the same in total: the earlier it was captured,
+ * the sooner after the packet arrives it plays.
+ *
+ * Call OnPacket() for each packet that is next in sequence (after any gap).
+ * The histograms run from start-up.
+ */
+class CLatencyMonitor
+{
+public:
+    /**
+     * @param nSampleRate Sampling rate of the stream.
+     * @param nOutputLatency From reading the fifo to the DAC, in
+     * microseconds.
+     */
+    CLatencyMonitor(unsigned nSampleRate, unsigned nOutputLatency);
+
+    /**
+     * Register the arrival of a packet.
+     * @param nTicks Arrival time, in microseconds.
+     * @param nTimeStamp The packet header's.
+     * @param nPacketFrames
+     * @param nQueued Frames in the fifo ahead of the packet's.
+     */
+    void OnPacket(unsigned nTicks, u64 nTimeStamp, unsigned nPacketFrames, unsigned nQueued);
+
+    /**
+     * Forget the last round trip, e.g. on disconnection. The histograms keep
+     * counting.
+     */
+    void Reset();
+
+    /**
+     * Log the percentiles so far.
+     * @param pLogger
+     */
+    void Dump(CLogger *pLogger) const;
+
+    const CLatencyHistogram &GetRoundTrip() const { return m_RoundTrip; }
+
+    const CLatencyHistogram &GetFIFO() const { return m_FIFO; }
+
+    /**
+     * @return Mouth to ear, for packets that arrived once the server had
+     * echoed a timestamp.
+     */
+    const CLatencyHistogram &GetTotal() const { return m_Total; }
+
+private:
+    const unsigned k_nSampleRate;
+    const unsigned k_nOutputLatency;
+
+    CLatencyHistogram m_RoundTrip;
+    CLatencyHistogram m_FIFO;
+    CLatencyHistogram m_Total;
+
+    bool m_bEchoed{false};
+    u32 m_nRoundTrip{0};
+};
+
+#endif //JACKTRIP_PI_LATENCYMONITOR_H
@@ -0,0 +1,221 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LogRing.h"
+#include <circle/sched/scheduler.h>
+#include <circle/string.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+
+static const char FromLogRing[] = "logring";
+
+static CLogRing s_LogRing;
+
+CLogRing::CLogRing(void)
+{
+    for (u32 i = 0; i < k_nEntries; ++i) {
+        m_Entries[i].nSequence = Free(i);
+    }
+}
+
+CLogRing *CLogRing::Get(void)
+{
+    return &s_LogRing;
+}
+
+CLogRing::TEntry *CLogRing::Claim(u32 *pPos)
+{
+    u32 pos{__atomic_fetch_add(&m_nWriteIndex, 1, __ATOMIC_RELAXED)};
+    TEntry &entry{m_Entries[pos & (k_nEntries - 1)]};
+
+    // Fails if the entry still holds a message from the previous lap, i.e.
+    // the ring is full; or if the consumer, finding the position claimed but
+    // the entry untouched, has skipped it meanwhile.
+    u32 expected{Free(pos)};
+    if (!__atomic_compare_exchange_n(&entry.nSequence, &expected, Writing(pos), false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&m_nDropped, 1, __ATOMIC_RELAXED);
+        return nullptr;
+    }
+
+    *pPos = pos;
+    return &entry;
+}
+
+unsigned CLogRing::Flush(CLogger *pLogger, unsigned nMaxEntries)
+{
+    unsigned n{0};
+    CString message;
+
+    while (n < nMaxEntries) {
+        TEntry &slot{m_Entries[m_nReadIndex & (k_nEntries - 1)]};
+        u32 sequence{__atomic_load_n(&slot.nSequence, __ATOMIC_ACQUIRE)};
+
+        if (sequence == Free(m_nReadIndex)) {
+            // Either nobody has claimed the position yet, or its producer
+            // dropped its entry, the ring being full at the time, and never
+            // will write it; or it's about to. Skip it if claimed: should
+            // the producer lose the race, it drops its entry instead.
+            u32 writeIndex{__atomic_load_n(&m_nWriteIndex, __ATOMIC_RELAXED)};
+            if (writeIndex == m_nReadIndex
+                || !__atomic_compare_exchange_n(&slot.nSequence, &sequence, Free(m_nReadIndex + k_nEntries), false,
+                                                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                break;
+            }
+            ++m_nReadIndex;
+            continue;
+        }
+        if (sequence != Published(m_nReadIndex)) {
+            // Still being written.
+            break;
+        }
+
+        // Copy the entry out and free the slot before the slow part.
+        TEntry entry{slot};
+        __atomic_store_n(&slot.nSequence, Free(m_nReadIndex + k_nEntries), __ATOMIC_RELEASE);
+        ++m_nReadIndex;
+        ++n;
+
+        if (pLogger) {
+            Format(entry, &message);
+            pLogger->Write(entry.pSource, entry.Severity, "%s", (const char *) message);
+        }
+    }
+
+    u32 dropped{GetDropped()};
+    if (pLogger && dropped != m_nDroppedReported) {
+        pLogger->Write(FromLogRing, LogWarning, "%u log entries dropped", dropped - m_nDroppedReported);
+        m_nDroppedReported = dropped;
+    }
+
+    return n;
+}
+
+void CLogRing::Format(const TEntry &entry, CString *pMessage)
+{
+    // Format one conversion at a time, so that each argument can be passed as
+    // the type its conversion expects.
+    *pMessage = "";
+    CString piece;
+    char spec[16];
+    unsigned nArg{0};
+
+    for (const char *p = entry.pFormat; *p != '\0'; ++p) {
+        if (*p != '%') {
+            const char c[2]{*p, '\0'};
+            pMessage->Append(c);
+            continue;
+        }
+        if (p[1] == '%') {
+            pMessage->Append("%");
+            ++p;
+            continue;
+        }
+
+        // Copy the specification up to and including its conversion.
+        unsigned len{0};
+        unsigned nLongs{0};
+        spec[len++] = *p++;
+        while (*p != '\0' && len < sizeof spec - 2 && !strchr("diouxXcsfFeEgGp", *p)) {
+            nLongs += *p == 'l';
+            spec[len++] = *p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        spec[len++] = *p;
+        spec[len] = '\0';
+
+        if (nArg >= k_nMaxArgs) {
+            pMessage->Append("?");
+            continue;
+        }
+        const TArg &arg{entry.Args[nArg++]};
+
+        switch (*p) {
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                piece.Format(spec, arg.f);
+                break;
+            case 's':
+                piece.Format(spec, static_cast<const char *>(arg.p));
+                break;
+            case 'p':
+                piece.Format(spec, arg.p);
+                break;
+            default:
+                if (nLongs >= 2) {
+                    piece.Format(spec, arg.i);
+                } else if (nLongs == 1) {
+                    piece.Format(spec, static_cast<long>(arg.i));
+                } else {
+                    piece.Format(spec, static_cast<int>(arg.i));
+                }
+                break;
+        }
+        pMessage->Append(piece);
+    }
+}
+
+//// FLUSH TASK ///////////////////////////////////////////////////////////////
+
+CLogFlushTask::CLogFlushTask(CLogger *pLogger) :
+        m_pLogger(pLogger)
+{
+    SetName(FromLogRing);
+}
+
+void CLogFlushTask::Run(void)
+{
+    if (LOG_RING_BENCHMARK) {
+        Benchmark();
+    }
+
+    auto *pRing = CLogRing::Get();
+
+    while (true) {
+        if (pRing->Flush(m_pLogger, k_nBatch) < k_nBatch) {
+            CScheduler::Get()->MsSleep(LOG_FLUSH_MS);
+        } else {
+            // Still more to do, but let everybody else go first.
+            CScheduler::Get()->Yield();
+        }
+    }
+}
+
+void CLogFlushTask::Benchmark(void)
+{
+    static constexpr unsigned k_nRounds{64};
+    static constexpr unsigned k_nCalls{LOG_RING_ENTRIES / 2};
+
+    auto *pRing = CLogRing::Get();
+    pRing->Flush(m_pLogger, LOG_RING_ENTRIES);
+
+    unsigned elapsed{0};
+    for (unsigned round = 0; round < k_nRounds; ++round) {
+        unsigned start{CTimer::GetClockTicks()};
+        for (unsigned i = 0; i < k_nCalls; ++i) {
+            pRing->Write(FromLogRing, LogDebug, "benchmark %u: %d, %f", i, -1, .5f);
+        }
+        elapsed += CTimer::GetClockTicks() - start;
+
+        pRing->Flush(nullptr, LOG_RING_ENTRIES);
+    }
+
+    m_pLogger->Write(FromLogRing, LogNotice, "CLogRing::Write() takes %u ns per call (%u calls)",
+                     static_cast<unsigned>(elapsed * 1000ull / (k_nRounds * k_nCalls)), k_nRounds * k_nCalls);
+}
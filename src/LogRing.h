@@ -0,0 +1,164 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_LOGRING_H
+#define JACKTRIP_PI_LOGRING_H
+
+#include <circle/types.h>
+#include <circle/logger.h>
+#include <circle/sched/task.h>
+#include "config.h"
+
+/**
+ * Deferred logging. Hot paths -- the sound device callback, the audio core,
+ * the receive path -- push a format string and its arguments into a bounded
+ * ring; CLogFlushTask formats the entries and writes them to the logger later,
+ * from task context. Pushing is wait-free: there is no lock and no retry; a
+ * position is claimed with one atomic increment, and if the ring is full at
+ * that position the entry is dropped and counted.
+ *
+ * Any number of producers (tasks, interrupt handlers, other cores) may call
+ * Write(); there is a single consumer, the flush task.
+ *
+ * Since formatting is deferred, a %s argument must still be valid when the
+ * entry is flushed; string literals only. Up to k_nMaxArgs arguments, of
+ * integer, floating point or pointer type.
+ */
+class CLogRing
+{
+public:
+    static constexpr unsigned k_nMaxArgs{6};
+
+    CLogRing(void);
+
+    static CLogRing *Get(void);
+
+    template<typename... TArgs>
+    void Write(const char *pSource, TLogSeverity Severity, const char *pFormat, TArgs... args)
+    {
+        static_assert(sizeof...(TArgs) <= k_nMaxArgs, "Too many arguments for a deferred log entry.");
+
+        u32 pos;
+        TEntry *pEntry{Claim(&pos)};
+        if (!pEntry) {
+            return;
+        }
+
+        pEntry->pSource = pSource;
+        pEntry->pFormat = pFormat;
+        pEntry->Severity = Severity;
+        const TArg packed[sizeof...(TArgs) + 1]{Pack(args)..., TArg{}};
+        for (unsigned i = 0; i < sizeof...(TArgs); ++i) {
+            pEntry->Args[i] = packed[i];
+        }
+
+        // Hand the entry to the consumer.
+        __atomic_store_n(&pEntry->nSequence, Published(pos), __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Format and write out pending entries. Consumer only.
+     * @param pLogger Where to write the entries; nullptr to discard them.
+     * @param nMaxEntries
+     * @return The number of entries taken from the ring.
+     */
+    unsigned Flush(CLogger *pLogger, unsigned nMaxEntries);
+
+    u32 GetDropped(void) const { return __atomic_load_n(&m_nDropped, __ATOMIC_RELAXED); }
+
+private:
+    static constexpr u32 k_nEntries{LOG_RING_ENTRIES};
+    static_assert((k_nEntries & (k_nEntries - 1)) == 0, "LOG_RING_ENTRIES must be a power of two.");
+
+    union TArg
+    {
+        long long i;
+        double f;
+        const void *p;
+    };
+
+    struct TEntry
+    {
+        // The position the entry is for, and its state there: Free(pos) until
+        // a producer takes it, Writing(pos) while the message goes in, and
+        // Published(pos) once it's there to read. Only ever moves forward, so
+        // a producer or the consumer holding a stale position can't take it.
+        u32 nSequence;
+        TLogSeverity Severity;
+        const char *pSource;
+        const char *pFormat;
+        TArg Args[k_nMaxArgs];
+    };
+
+    static TArg Pack(int v) { TArg a; a.i = v; return a; }
+    static TArg Pack(unsigned v) { TArg a; a.i = v; return a; }
+    static TArg Pack(long v) { TArg a; a.i = v; return a; }
+    static TArg Pack(unsigned long v) { TArg a; a.i = static_cast<long long>(v); return a; }
+    static TArg Pack(long long v) { TArg a; a.i = v; return a; }
+    static TArg Pack(unsigned long long v) { TArg a; a.i = static_cast<long long>(v); return a; }
+    static TArg Pack(double v) { TArg a; a.f = v; return a; }
+    static TArg Pack(const void *v) { TArg a; a.p = v; return a; }
+
+    static constexpr u32 Free(u32 pos) { return pos << 2; }
+    static constexpr u32 Writing(u32 pos) { return (pos << 2) | 1; }
+    static constexpr u32 Published(u32 pos) { return (pos << 2) | 2; }
+
+    /**
+     * Reserve an entry for writing: take the next position, and its entry,
+     * if free. Wait-free: an increment and a compare-exchange, each tried
+     * once.
+     * @param pPos Receives the entry's position.
+     * @return The entry, or nullptr if the ring is full, i.e. the entry still
+     * holds the message from a lap before, or the consumer has already
+     * skipped the position.
+     */
+    TEntry *Claim(u32 *pPos);
+
+    static void Format(const TEntry &entry, CString *pMessage);
+
+    TEntry m_Entries[k_nEntries];
+
+    alignas(64) u32 m_nWriteIndex{0};
+    alignas(64) u32 m_nReadIndex{0};
+    u32 m_nDropped{0};
+    u32 m_nDroppedReported{0};
+};
+
+/**
+ * Drains the log ring into the logger, a batch at a time, sleeping whenever
+ * the ring is empty so as to stay out of the way of the other tasks.
+ */
+class CLogFlushTask : public CTask
+{
+public:
+    explicit CLogFlushTask(CLogger *pLogger);
+
+    void Run(void) override;
+
+private:
+    /**
+     * Measure the cost of CLogRing::Write() on the calling core, and log it.
+     */
+    void Benchmark(void);
+
+    static constexpr unsigned k_nBatch{16};
+
+    CLogger *m_pLogger;
+};
+
+#endif //JACKTRIP_PI_LOGRING_H
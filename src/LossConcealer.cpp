@@ -0,0 +1,214 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LossConcealer.h"
+#include <circle/util.h>
+#include "AudioArena.h"
+#include "Profiler.h"
+
+CLossConcealer::CLossConcealer(u8 nChannels, u16 nBlockFrames, unsigned nSampleRate) :
+        k_nChannels{nChannels},
+        k_nBlockFrames{nBlockFrames},
+        // Pitch from 60 Hz to 1.5 kHz, judged over 10 ms.
+        k_nMinPeriod{nSampleRate / 1500},
+        k_nMaxPeriod{nSampleRate / 60},
+        k_nWindow{nSampleRate / 100},
+        k_nHistoryFrames{k_nMaxPeriod + k_nWindow},
+        k_nDecimation{nSampleRate >= 12000 ? nSampleRate / 6000 : 1},
+        // Hold for 10 ms, then fade out over 50 ms.
+        k_nHoldFrames{nSampleRate / 100},
+        k_nFadeFrames{nSampleRate / 20},
+        m_pHistory{CAudioArena::Allocate<float *>(nChannels)},
+        m_pPeriod{CAudioArena::Allocate<float *>(nChannels)},
+        m_pBlock{CAudioArena::Allocate<float *>(nChannels)},
+        m_pMono{CAudioArena::Allocate<float>(k_nHistoryFrames)}
+{
+    for (u8 ch{0}; ch < k_nChannels; ++ch) {
+        m_pHistory[ch] = CAudioArena::Allocate<float>(2 * k_nHistoryFrames);
+        m_pPeriod[ch] = CAudioArena::Allocate<float>(k_nMaxPeriod);
+        m_pBlock[ch] = CAudioArena::Allocate<float>(k_nBlockFrames);
+    }
+    Reset();
+}
+
+void CLossConcealer::Reset()
+{
+    for (u8 ch{0}; ch < k_nChannels; ++ch) {
+        memset(m_pHistory[ch], 0, 2 * k_nHistoryFrames * sizeof(float));
+    }
+    m_nHistoryIndex = 0;
+    m_nConcealed = 0;
+}
+
+void CLossConcealer::Extrapolate()
+{
+    PROFILE_SCOPE(ProfileConceal);
+
+    if (m_nConcealed == 0) {
+        // The first block lost: take the last pitch period to repeat.
+        m_nPeriod = FindPeriod();
+        m_nPhase = 0;
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            for (unsigned n{0}; n < m_nPeriod; ++n) {
+                m_pPeriod[ch][n] = GetHistory(ch, m_nPeriod - n);
+            }
+        }
+    }
+
+    for (u16 n{0}; n < k_nBlockFrames; ++n) {
+        float gain{GetGain()};
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            m_pBlock[ch][n] = gain * m_pPeriod[ch][m_nPhase];
+        }
+        if (++m_nPhase == m_nPeriod) {
+            m_nPhase = 0;
+        }
+        ++m_nConcealed;
+    }
+
+    ++m_nBlocksConcealed;
+}
+
+u16 CLossConcealer::CrossFade()
+{
+    // Over a quarter of a period, as G.711 does, or as much of that as fits
+    // in a block.
+    unsigned nFade{m_nPeriod / 4 > 0 ? m_nPeriod / 4 : 1};
+    if (nFade > k_nBlockFrames) {
+        nFade = k_nBlockFrames;
+    }
+
+    for (unsigned n{0}; n < nFade; ++n) {
+        float weight{static_cast<float>(n + 1) / (nFade + 1)};
+        float gain{(1.f - weight) * GetGain()};
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            m_pBlock[ch][n] = weight * m_pBlock[ch][n] + gain * m_pPeriod[ch][m_nPhase];
+        }
+        if (++m_nPhase == m_nPeriod) {
+            m_nPhase = 0;
+        }
+        ++m_nConcealed;
+    }
+
+    m_nConcealed = 0;
+
+    return static_cast<u16>(nFade);
+}
+
+void CLossConcealer::Remember()
+{
+    for (u16 n{0}; n < k_nBlockFrames; ++n) {
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            m_pHistory[ch][m_nHistoryIndex] = m_pHistory[ch][m_nHistoryIndex + k_nHistoryFrames] = m_pBlock[ch][n];
+        }
+        if (++m_nHistoryIndex == k_nHistoryFrames) {
+            m_nHistoryIndex = 0;
+        }
+    }
+}
+
+unsigned CLossConcealer::FindPeriod()
+{
+    // Coarse search: correlate the last window of a decimated mono mix with
+    // the window a lag earlier, for each lag in range, normalising by the
+    // energy of the earlier window.
+    const unsigned nPoints{k_nHistoryFrames / k_nDecimation};
+    const unsigned nOffset{k_nHistoryFrames - nPoints * k_nDecimation};
+    for (unsigned i{0}; i < nPoints; ++i) {
+        float sum{0.f};
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            const float *pFrames{m_pHistory[ch] + m_nHistoryIndex + nOffset + i * k_nDecimation};
+            for (unsigned k{0}; k < k_nDecimation; ++k) {
+                sum += pFrames[k];
+            }
+        }
+        m_pMono[i] = sum;
+    }
+
+    const unsigned nWindow{k_nWindow / k_nDecimation};
+    const float *pTarget{m_pMono + nPoints - nWindow};
+
+    unsigned nBest{0};
+    float fBestScore{0.f};
+    for (unsigned lag{(k_nMinPeriod + k_nDecimation - 1) / k_nDecimation}; lag <= k_nMaxPeriod / k_nDecimation; ++lag) {
+        const float *pCandidate{pTarget - lag};
+        float correlation{0.f}, energy{0.f};
+        for (unsigned i{0}; i < nWindow; ++i) {
+            correlation += pTarget[i] * pCandidate[i];
+            energy += pCandidate[i] * pCandidate[i];
+        }
+        // Compare correlation^2 / energy, and so avoid the square root.
+        if (correlation > 0.f && correlation * correlation > fBestScore * energy) {
+            fBestScore = correlation * correlation / energy;
+            nBest = lag;
+        }
+    }
+
+    if (nBest == 0) {
+        // Nothing periodic about it; the longest period is the least buzzy.
+        return k_nMaxPeriod;
+    }
+
+    // Fine search at the full rate, either side of the coarse result.
+    unsigned nFirst{nBest * k_nDecimation > k_nMinPeriod + k_nDecimation
+                    ? nBest * k_nDecimation - k_nDecimation + 1 : k_nMinPeriod};
+    unsigned nLast{nBest * k_nDecimation + k_nDecimation - 1 < k_nMaxPeriod
+                   ? nBest * k_nDecimation + k_nDecimation - 1 : k_nMaxPeriod};
+    if (nFirst == nLast) {
+        return nFirst;
+    }
+
+    // Full-rate mono mix of the span the fine search covers: the window and
+    // the nLast frames before it.
+    const unsigned nSpan{k_nWindow + nLast};
+    float *pSpan{m_pMono};
+    for (unsigned n{0}; n < nSpan; ++n) {
+        float sum{0.f};
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            sum += m_pHistory[ch][m_nHistoryIndex + k_nHistoryFrames - nSpan + n];
+        }
+        pSpan[n] = sum;
+    }
+    pTarget = pSpan + nLast;
+
+    unsigned nBestPeriod{nBest * k_nDecimation};
+    fBestScore = 0.f;
+    for (unsigned lag{nFirst}; lag <= nLast; ++lag) {
+        const float *pCandidate{pTarget - lag};
+        float correlation{0.f}, energy{0.f};
+        for (unsigned n{0}; n < k_nWindow; ++n) {
+            correlation += pTarget[n] * pCandidate[n];
+            energy += pCandidate[n] * pCandidate[n];
+        }
+        if (correlation > 0.f && correlation * correlation > fBestScore * energy) {
+            fBestScore = correlation * correlation / energy;
+            nBestPeriod = lag;
+        }
+    }
+
+    return nBestPeriod;
+}
+
+float CLossConcealer::GetGain() const
+{
+    if (m_nConcealed < k_nHoldFrames) {
+        return 1.f;
+    }
+    unsigned nFading{m_nConcealed - k_nHoldFrames};
+    return nFading < k_nFadeFrames ? 1.f - static_cast<float>(nFading) / k_nFadeFrames : 0.f;
+}
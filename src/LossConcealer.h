@@ -0,0 +1,175 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_LOSSCONCEALER_H
+#define JACKTRIP_PI_LOSSCONCEALER_H
+
+#include <circle/types.h>
+#include "convert.h"
+
+/**
+ * Packet loss concealment, after G.711 Appendix I: stands in for a lost
+ * block by repeating the last pitch period of the signal, found by
+ * correlation, fading to silence as the loss goes on; when audio resumes,
+ * crossfades from the extrapolation into it.
+ *
+ * Feed every block that goes into the fifo in order through Receive(), and
+ * call Conceal() for each one that doesn't arrive. Blocks are
+ * channel-planar, as on the wire.
+ *
+ * Its buffers come from CAudioArena, and live as long as the client does.
+ */
+class CLossConcealer
+{
+public:
+    /**
+     * @param nChannels
+     * @param nBlockFrames Frames per block.
+     * @param nSampleRate
+     */
+    CLossConcealer(u8 nChannels, u16 nBlockFrames, unsigned nSampleRate);
+
+    /**
+     * Take a block that arrived, crossfading into it if it follows a
+     * concealed one, and remember it.
+     * @param ppBlock A block's worth of samples per channel; modified in
+     * place.
+     */
+    template<typename T>
+    void Receive(T *const *ppBlock)
+    {
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            for (u16 n{0}; n < k_nBlockFrames; ++n) {
+                m_pBlock[ch][n] = static_cast<float>(TSampleTraits<T>::Centre(ppBlock[ch][n]));
+            }
+        }
+
+        if (m_nConcealed > 0) {
+            u16 nFade{CrossFade()};
+            Store(ppBlock, nFade);
+        }
+
+        Remember();
+    }
+
+    /**
+     * Make up a block in place of one that was lost, and remember it.
+     * @param ppBlock Filled with a block's worth of samples per channel.
+     */
+    template<typename T>
+    void Conceal(T *const *ppBlock)
+    {
+        Extrapolate();
+        Store(ppBlock, k_nBlockFrames);
+        Remember();
+    }
+
+    /**
+     * Forget the signal history, e.g. on disconnection.
+     */
+    void Reset();
+
+    /**
+     * @return Blocks concealed so far.
+     */
+    u32 GetConcealed() const { return m_nBlocksConcealed; }
+
+private:
+    /**
+     * Fill m_pBlock with the next block of the extrapolation, starting one
+     * if this is the first block lost.
+     */
+    void Extrapolate();
+
+    /**
+     * Crossfade from the extrapolation into the block in m_pBlock.
+     * @return The number of frames at the start of the block affected.
+     */
+    u16 CrossFade();
+
+    /**
+     * Append m_pBlock to the history.
+     */
+    void Remember();
+
+    /**
+     * @return The pitch period of the end of the history, in frames, within
+     * [k_nMinPeriod, k_nMaxPeriod].
+     */
+    unsigned FindPeriod();
+
+    /**
+     * @param ch
+     * @param nAge Position, counting back from the newest frame (1).
+     * @return A sample from the history.
+     */
+    float GetHistory(u8 ch, unsigned nAge) const
+    {
+        return m_pHistory[ch][m_nHistoryIndex + k_nHistoryFrames - nAge];
+    }
+
+    /**
+     * @return The gain of the extrapolation after m_nConcealed frames.
+     */
+    float GetGain() const;
+
+    template<typename T>
+    void Store(T *const *ppBlock, u16 nFrames) const
+    {
+        // Clip to the sample type's range; the extrapolation can overshoot.
+        constexpr int nMax{static_cast<int>((1ull << (TSampleTraits<T>::k_nBits - 1)) - 1)};
+        constexpr float fMax{static_cast<float>(nMax)};
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            for (u16 n{0}; n < nFrames; ++n) {
+                float x{m_pBlock[ch][n]};
+                x = x > fMax ? fMax : x < -fMax ? -fMax : x;
+                ppBlock[ch][n] = TSampleTraits<T>::FromCentred(static_cast<int>(x < 0 ? x - .5f : x + .5f));
+            }
+        }
+    }
+
+    const u8 k_nChannels;
+    const u16 k_nBlockFrames;
+    // Pitch search range, correlation window and history length, in frames.
+    const unsigned k_nMinPeriod, k_nMaxPeriod;
+    const unsigned k_nWindow;
+    const unsigned k_nHistoryFrames;
+    // The coarse pitch search runs on a decimated mono mix.
+    const unsigned k_nDecimation;
+    // Frames of full-level extrapolation, and of the fade to silence after.
+    const unsigned k_nHoldFrames, k_nFadeFrames;
+
+    // Each channel's history is written twice, k_nHistoryFrames apart, so
+    // that the last k_nHistoryFrames frames are always contiguous.
+    float **m_pHistory;
+    unsigned m_nHistoryIndex{0};
+    // The pitch period being repeated, per channel.
+    float **m_pPeriod;
+    unsigned m_nPeriod{0};
+    unsigned m_nPhase{0};
+    // The block on its way in or out.
+    float **m_pBlock;
+    // Mono mix for the pitch search.
+    float *m_pMono;
+
+    // Frames concealed since the last block received.
+    unsigned m_nConcealed{0};
+    u32 m_nBlocksConcealed{0};
+};
+
+#endif //JACKTRIP_PI_LOSSCONCEALER_H
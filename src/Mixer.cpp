@@ -0,0 +1,347 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Mixer.h"
+#include <circle/util.h>
+#include <assert.h>
+#include "AudioArena.h"
+
+#if defined(CONVERT_NEON)
+#define MIXER_VECTOR
+using TVector = float32x4_t;
+
+static TVector Splat(float f) { return vdupq_n_f32(f); }
+
+static TVector Add(TVector a, TVector b) { return vaddq_f32(a, b); }
+
+static TVector Mul(TVector a, TVector b) { return vmulq_f32(a, b); }
+
+static TVector Min(TVector a, TVector b) { return vminq_f32(a, b); }
+
+static TVector Load(const float *p) { return vld1q_f32(p); }
+
+static TVector LoadCaptured(const u32 *p) { return vcvtq_f32_s32(vreinterpretq_s32_u32(vld1q_u32(p))); }
+
+static TVector MakeVector(float a, float b, float c, float d)
+{
+    const float f[4]{a, b, c, d};
+    return vld1q_f32(f);
+}
+
+static void Store(float *p, TVector v) { vst1q_f32(p, v); }
+
+static void StoreInterleaved(float *p, TVector left, TVector right)
+{
+    float32x4x2_t pair{{left, right}};
+    vst2q_f32(p, pair);
+}
+#elif defined(CONVERT_SSE2)
+#define MIXER_VECTOR
+using TVector = __m128;
+
+static TVector Splat(float f) { return _mm_set1_ps(f); }
+
+static TVector Add(TVector a, TVector b) { return _mm_add_ps(a, b); }
+
+static TVector Mul(TVector a, TVector b) { return _mm_mul_ps(a, b); }
+
+static TVector Min(TVector a, TVector b) { return _mm_min_ps(a, b); }
+
+static TVector Load(const float *p) { return _mm_loadu_ps(p); }
+
+static TVector LoadCaptured(const u32 *p)
+{
+    return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+static TVector MakeVector(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+
+static void Store(float *p, TVector v) { _mm_storeu_ps(p, v); }
+
+static void StoreInterleaved(float *p, TVector left, TVector right)
+{
+    _mm_storeu_ps(p, _mm_unpacklo_ps(left, right));
+    _mm_storeu_ps(p + 4, _mm_unpackhi_ps(left, right));
+}
+#endif
+
+CMixer::CMixer(u8 nStreamChannels, u8 nDeviceChannels, u16 nMaxFrames, u16 nChunkFrames, u16 nRampFrames,
+               float fMaster) :
+        k_nStreamChannels{nStreamChannels},
+        k_nDeviceChannels{nDeviceChannels},
+        k_nChunkFrames{nChunkFrames},
+        k_nRampFrames{nRampFrames}
+{
+    assert(nStreamChannels >= 1 && nStreamChannels <= k_nMaxChannels);
+    assert(nDeviceChannels >= 1 && nDeviceChannels <= k_nMaxChannels);
+    assert(nRampFrames > 0);
+
+    for (u8 ch{0}; ch < nStreamChannels; ++ch) {
+        m_ppStream[ch] = CAudioArena::Allocate<float>(nMaxFrames);
+        assert(m_ppStream[ch]);
+    }
+    for (auto &pCaptured: m_pCaptured) {
+        pCaptured = CAudioArena::Allocate<u32>(nChunkFrames * nDeviceChannels);
+        assert(pCaptured);
+        memset(pCaptured, 0, nChunkFrames * nDeviceChannels * sizeof(u32));
+    }
+
+    // As without the mixer: a mono stream on every device channel, or the
+    // stream's channels on the device's, in order.
+    m_Settings.fMaster = fMaster;
+    for (u8 ch{0}; ch < k_nMaxChannels; ++ch) {
+        m_Settings.fGain[ch] = 1.f;
+        m_Settings.bMute[ch] = ch >= nDeviceChannels;
+        m_Settings.fPan[ch] = nStreamChannels == 1 || ch > 1 ? 0.f : ch == 0 ? -1.f : 1.f;
+    }
+    m_Settings.fMonitor = 0.f;
+
+    // Start at the settings, rather than ramping to them.
+    Publish();
+    TakeSnapshot();
+    memcpy(m_fCurrent, m_Snapshots[m_nFront].fGain, sizeof m_fCurrent);
+    m_nRampLeft = 0;
+    m_fMonitor = m_Snapshots[m_nFront].fMonitor;
+    m_nMonitorRampLeft = 0;
+}
+
+void CMixer::SetMaster(float fGain)
+{
+    m_Settings.fMaster = fGain;
+    Publish();
+}
+
+void CMixer::SetGain(u8 nChannel, float fGain)
+{
+    if (nChannel < k_nStreamChannels) {
+        m_Settings.fGain[nChannel] = fGain;
+        Publish();
+    }
+}
+
+void CMixer::SetMute(u8 nChannel, bool bMute)
+{
+    if (nChannel < k_nStreamChannels) {
+        m_Settings.bMute[nChannel] = bMute;
+        Publish();
+    }
+}
+
+void CMixer::SetPan(u8 nChannel, float fPan)
+{
+    if (nChannel < k_nStreamChannels) {
+        m_Settings.fPan[nChannel] = fPan < -1.f ? -1.f : fPan > 1.f ? 1.f : fPan;
+        Publish();
+    }
+}
+
+void CMixer::SetMonitor(float fGain)
+{
+    m_Settings.fMonitor = fGain;
+    Publish();
+}
+
+void CMixer::Capture(const u32 *pChunk)
+{
+    u32 nNext{m_nCaptured ^ 1};
+    memcpy(m_pCaptured[nNext], pChunk, k_nChunkFrames * k_nDeviceChannels * sizeof(u32));
+    __atomic_store_n(&m_nCaptured, nNext, __ATOMIC_RELEASE);
+}
+
+void CMixer::AddMonitor(float *pOutput)
+{
+    if (m_fMonitor == 0.f && m_nMonitorRampLeft == 0) {
+        return;
+    }
+
+    const u32 *pCaptured{m_pCaptured[__atomic_load_n(&m_nCaptured, __ATOMIC_ACQUIRE)]};
+    // Captured samples are 24 bits; the ramp's steps are per frame, and
+    // stop where it ends.
+    const float fScale{1.f / (1 << 23)};
+    const float fGain{m_fMonitor * fScale}, fStep{m_fMonitorStep * fScale};
+    const unsigned nRamp{m_nMonitorRampLeft < k_nChunkFrames ? m_nMonitorRampLeft : k_nChunkFrames};
+    const unsigned nSamples{static_cast<unsigned>(k_nChunkFrames) * k_nDeviceChannels};
+    unsigned n{0};
+
+#if defined(MIXER_VECTOR)
+    if (4 % k_nDeviceChannels == 0) {
+        // Four samples are 4 / k_nDeviceChannels whole frames.
+        TVector frames{MakeVector(1.f, 1.f + static_cast<float>(1 / k_nDeviceChannels),
+                                  1.f + static_cast<float>(2 / k_nDeviceChannels),
+                                  1.f + static_cast<float>(3 / k_nDeviceChannels))};
+        const TVector advance{Splat(static_cast<float>(4 / k_nDeviceChannels))};
+        const TVector gain{Splat(fGain)}, step{Splat(fStep)}, ramp{Splat(static_cast<float>(nRamp))};
+        for (; n + 4 <= nSamples; n += 4) {
+            const TVector g{Add(gain, Mul(step, Min(frames, ramp)))};
+            Store(pOutput + n, Add(Load(pOutput + n), Mul(g, LoadCaptured(pCaptured + n))));
+            frames = Add(frames, advance);
+        }
+    }
+#endif
+
+    for (; n < nSamples; ++n) {
+        unsigned nFrame{n / k_nDeviceChannels + 1};
+        float g{fGain + fStep * static_cast<float>(nFrame < nRamp ? nFrame : nRamp)};
+        pOutput[n] += g * static_cast<float>(static_cast<s32>(pCaptured[n]));
+    }
+
+    m_nMonitorRampLeft -= nRamp;
+    if (m_nMonitorRampLeft == 0) {
+        m_fMonitor = m_Snapshots[m_nFront].fMonitor;
+    } else {
+        m_fMonitor += m_fMonitorStep * static_cast<float>(nRamp);
+    }
+}
+
+void CMixer::Publish()
+{
+    TSnapshot &snapshot{m_Snapshots[m_nBack]};
+    memset(&snapshot, 0, sizeof snapshot);
+
+    for (u8 in{0}; in < k_nStreamChannels; ++in) {
+        float fGain{m_Settings.bMute[in] ? 0.f : m_Settings.fMaster * m_Settings.fGain[in]};
+        if (k_nDeviceChannels == 2) {
+            float fPan{m_Settings.fPan[in]};
+            snapshot.fGain[0][in] = fGain * (fPan > 0.f ? 1.f - fPan : 1.f);
+            snapshot.fGain[1][in] = fGain * (fPan < 0.f ? 1.f + fPan : 1.f);
+        } else {
+            for (u8 out{0}; out < k_nDeviceChannels; ++out) {
+                if (in == out || k_nStreamChannels == 1) {
+                    snapshot.fGain[out][in] = fGain;
+                }
+            }
+        }
+    }
+    snapshot.fMonitor = m_Settings.fMonitor;
+
+    // Swap the snapshot in for the audio side, and take back whichever one
+    // is spare: the one the audio side left, or an older one it never saw.
+    m_nBack = __atomic_exchange_n(&m_nMiddle, m_nBack | k_nFresh, __ATOMIC_ACQ_REL) & ~k_nFresh;
+}
+
+void CMixer::TakeSnapshot()
+{
+    if ((__atomic_load_n(&m_nMiddle, __ATOMIC_RELAXED) & k_nFresh) == 0) {
+        return;
+    }
+
+    m_nFront = __atomic_exchange_n(&m_nMiddle, m_nFront, __ATOMIC_ACQ_REL) & ~k_nFresh;
+    const TSnapshot &target{m_Snapshots[m_nFront]};
+
+    // Ramp from wherever the last ramp got to.
+    const float fRamp{static_cast<float>(k_nRampFrames)};
+    for (u8 out{0}; out < k_nDeviceChannels; ++out) {
+        for (u8 in{0}; in < k_nStreamChannels; ++in) {
+            m_fStep[out][in] = (target.fGain[out][in] - m_fCurrent[out][in]) / fRamp;
+        }
+    }
+    m_nRampLeft = k_nRampFrames;
+    m_fMonitorStep = (target.fMonitor - m_fMonitor) / fRamp;
+    m_nMonitorRampLeft = k_nRampFrames;
+}
+
+void CMixer::MixStream(float *pOutput, u16 nFrames)
+{
+    unsigned n{0};
+
+    if (m_nRampLeft > 0) {
+        n = nFrames < m_nRampLeft ? nFrames : m_nRampLeft;
+        MixFrames<true>(pOutput, 0, n);
+        m_nRampLeft -= n;
+        if (m_nRampLeft == 0) {
+            memcpy(m_fCurrent, m_Snapshots[m_nFront].fGain, sizeof m_fCurrent);
+        }
+    }
+
+    if (n < nFrames) {
+        MixFrames<false>(pOutput + n * k_nDeviceChannels, n, nFrames - n);
+    }
+}
+
+/**
+ * Mix frames [nFrom, nFrom + nCount) of the stream buffers, at the current
+ * gains or, if Ramp, stepping them on a frame at a time.
+ */
+template<bool Ramp>
+void CMixer::MixFrames(float *pOutput, unsigned nFrom, unsigned nCount)
+{
+    const u8 nStream{k_nStreamChannels}, nDevice{k_nDeviceChannels};
+    unsigned n{0};
+
+#if defined(MIXER_VECTOR)
+    if (nDevice <= 2) {
+        // Local copies, which the output can't alias.
+        const float *ppIn[k_nMaxChannels];
+        TVector gain[2][k_nMaxChannels], step[2][k_nMaxChannels];
+        for (u8 in{0}; in < nStream; ++in) {
+            ppIn[in] = m_ppStream[in] + nFrom;
+            for (u8 out{0}; out < nDevice; ++out) {
+                gain[out][in] = Splat(m_fCurrent[out][in]);
+                step[out][in] = Splat(m_fStep[out][in]);
+            }
+        }
+        // Each lane's frame, counted from one, for the ramp.
+        TVector frames{MakeVector(1.f, 2.f, 3.f, 4.f)};
+
+        for (; n + 4 <= nCount; n += 4) {
+            TVector sum[2]{Splat(0.f), Splat(0.f)};
+            for (u8 in{0}; in < nStream; ++in) {
+                const TVector x{Load(ppIn[in] + n)};
+                for (u8 out{0}; out < nDevice; ++out) {
+                    TVector g{gain[out][in]};
+                    if (Ramp) {
+                        g = Add(g, Mul(step[out][in], frames));
+                    }
+                    sum[out] = Add(sum[out], Mul(g, x));
+                }
+            }
+
+            if (nDevice == 1) {
+                Store(pOutput + n, sum[0]);
+            } else {
+                StoreInterleaved(pOutput + 2 * n, sum[0], sum[1]);
+            }
+            if (Ramp) {
+                frames = Add(frames, Splat(4.f));
+            }
+        }
+    }
+#endif
+
+    for (; n < nCount; ++n) {
+        for (u8 out{0}; out < nDevice; ++out) {
+            float sum{0.f};
+            for (u8 in{0}; in < nStream; ++in) {
+                float g{m_fCurrent[out][in]};
+                if (Ramp) {
+                    g += m_fStep[out][in] * static_cast<float>(n + 1);
+                }
+                sum += g * m_ppStream[in][nFrom + n];
+            }
+            pOutput[n * nDevice + out] = sum;
+        }
+    }
+
+    if (Ramp) {
+        for (u8 out{0}; out < nDevice; ++out) {
+            for (u8 in{0}; in < nStream; ++in) {
+                m_fCurrent[out][in] += m_fStep[out][in] * static_cast<float>(nCount);
+            }
+        }
+    }
+}
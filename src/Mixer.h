@@ -0,0 +1,173 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_MIXER_H
+#define JACKTRIP_PI_MIXER_H
+
+#include <circle/types.h>
+#include "convert.h"
+
+/**
+ * The mixer's settings, as the control side last set them.
+ */
+struct TMixerSettings
+{
+    static constexpr u8 k_nMaxChannels{8};
+
+    float fMaster;
+    // Per stream channel.
+    float fGain[k_nMaxChannels];
+    bool bMute[k_nMaxChannels];
+    // -1 (left) to 1 (right); for a stereo device only.
+    float fPan[k_nMaxChannels];
+    // Level of the captured input in the output.
+    float fMonitor;
+};
+
+/**
+ * Mixes the stream's channels down to the sound device's, with a gain, mute
+ * and pan per stream channel and a master gain, and adds a monitor mix of
+ * what the device captures. Works in floats in [-1, 1), between the fifo
+ * and the conversion for the sound device.
+ *
+ * Pan is a balance: centred, a channel plays at full level on both sides,
+ * and panning attenuates the other side only. So the defaults -- a mono
+ * stream centred, a stereo one hard left and right, any further channels
+ * muted -- play as without the mixer. On a device other than stereo, stream
+ * channels are routed as described at DEVICE_CHANNELS, and pan is ignored.
+ *
+ * The control side, a single task other than the audio path, changes the
+ * settings with the Set...() methods, each of which publishes a snapshot of
+ * the resulting gains through a lock-free triple buffer. The audio side
+ * picks up the latest at the start of each Mix(), and ramps every gain to
+ * it linearly over nRampFrames, so that changes don't zipper. The mixing
+ * itself is vectorised for one- and two-channel devices.
+ */
+class CMixer
+{
+public:
+    /**
+     * @param nStreamChannels
+     * @param nDeviceChannels
+     * @param nMaxFrames The most frames Mix() will be asked for.
+     * @param nChunkFrames Frames per sound device chunk, captured or played.
+     * @param nRampFrames Frames over which to ramp to new settings.
+     * @param fMaster Master gain to start with.
+     */
+    CMixer(u8 nStreamChannels, u8 nDeviceChannels, u16 nMaxFrames, u16 nChunkFrames, u16 nRampFrames,
+           float fMaster);
+
+    /**
+     * Control side. Each publishes new settings to the audio side.
+     * @param fGain Linear.
+     */
+    void SetMaster(float fGain);
+
+    void SetGain(u8 nChannel, float fGain);
+
+    void SetMute(u8 nChannel, bool bMute);
+
+    void SetPan(u8 nChannel, float fPan);
+
+    void SetMonitor(float fGain);
+
+    const TMixerSettings &GetSettings() const { return m_Settings; }
+
+    /**
+     * Keep a chunk the sound device captured, for the monitor mix. Call from
+     * the sound device's interrupt handler.
+     * @param pChunk Sample-interleaved, signed, 24 bits in 32, as the I2S
+     * device captures; nChunkFrames frames.
+     */
+    void Capture(const u32 *pChunk);
+
+    /**
+     * Mix a block of the stream down to the device's channels. Audio side.
+     * @param pOutput Sample-interleaved buffer to receive nFrames frames.
+     * @param nFrames At most nMaxFrames.
+     * @param read Input source, called as read(ppChannels, nFrames) to fetch
+     * exactly nFrames frames into one buffer per stream channel.
+     */
+    template<typename Source>
+    void Mix(float *pOutput, u16 nFrames, Source read)
+    {
+        read(m_ppStream, nFrames);
+        TakeSnapshot();
+        MixStream(pOutput, nFrames);
+    }
+
+    /**
+     * Add the monitor mix of the chunk captured last to a chunk of output.
+     * Audio side; after Mix().
+     * @param pOutput Sample-interleaved; nChunkFrames frames.
+     */
+    void AddMonitor(float *pOutput);
+
+private:
+    static constexpr u8 k_nMaxChannels{TMixerSettings::k_nMaxChannels};
+    // In a triple buffer index, marks a snapshot the audio side hasn't seen.
+    static constexpr u32 k_nFresh{4};
+
+    /**
+     * The gains the settings come to: one per device channel per stream
+     * channel, and the monitor's.
+     */
+    struct TSnapshot
+    {
+        float fGain[k_nMaxChannels][k_nMaxChannels];
+        float fMonitor;
+    };
+
+    void Publish();
+
+    void TakeSnapshot();
+
+    void MixStream(float *pOutput, u16 nFrames);
+
+    template<bool Ramp>
+    void MixFrames(float *pOutput, unsigned nFrom, unsigned nCount);
+
+    const u8 k_nStreamChannels;
+    const u8 k_nDeviceChannels;
+    const u16 k_nChunkFrames;
+    const u16 k_nRampFrames;
+
+    // Control side.
+    TMixerSettings m_Settings;
+    u32 m_nBack{0};
+
+    TSnapshot m_Snapshots[3];
+    u32 m_nMiddle{1};
+
+    // Audio side.
+    u32 m_nFront{2};
+    float *m_ppStream[k_nMaxChannels];
+    float m_fCurrent[k_nMaxChannels][k_nMaxChannels]{};
+    float m_fStep[k_nMaxChannels][k_nMaxChannels]{};
+    unsigned m_nRampLeft{0};
+    float m_fMonitor{0.f};
+    float m_fMonitorStep{0.f};
+    unsigned m_nMonitorRampLeft{0};
+
+    // The capture side fills one while the audio side reads the other, the
+    // one last filled. They start out silent.
+    u32 *m_pCaptured[2];
+    u32 m_nCaptured{0};
+};
+
+#endif //JACKTRIP_PI_MIXER_H
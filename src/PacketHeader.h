@@ -53,4 +53,9 @@ public:
 
 #define PACKET_HEADER_SIZE sizeof(TJackTripPacketHeader)
 
+// Set in a timestamp that a server echoes back to the client it came from
+// (jthub -e), rather than one of its own clock, which as microseconds would
+// take nearly 300,000 years to reach it.
+#define TIMESTAMP_ECHO (1ull << 63)
+
 #endif //JACKTRIP_PI_PACKETHEADER_H
@@ -0,0 +1,99 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Profiler.h"
+#include <circle/string.h>
+#include <circle/util.h>
+
+static const char FromProfiler[] = "profiler";
+
+CProfiler::TStats CProfiler::s_Stats[ProfilePointCount];
+
+void CProfiler::EnableCounter(void)
+{
+#if defined(__linux__)
+    // Nothing to do.
+#elif AARCH == 64
+    u64 nControl;
+    asm volatile ("mrs %0, pmcr_el0" : "=r" (nControl));
+    // E: enable the counters; clear D, so as to count every cycle.
+    nControl = (nControl | 1) & ~(1ul << 3);
+    asm volatile ("msr pmcr_el0, %0" : : "r" (nControl));
+    // Count at all exception levels.
+    asm volatile ("msr pmccfiltr_el0, %0" : : "r" (0ul));
+    asm volatile ("msr pmcntenset_el0, %0" : : "r" (1ul << 31));
+    asm volatile ("isb");
+#else
+    u32 nControl;
+    asm volatile ("mrc p15, 0, %0, c9, c12, 0" : "=r" (nControl));
+    nControl = (nControl | 1) & ~(1u << 3);
+    asm volatile ("mcr p15, 0, %0, c9, c12, 0" : : "r" (nControl));
+    asm volatile ("mcr p15, 0, %0, c9, c12, 1" : : "r" (1u << 31));
+    asm volatile ("isb");
+#endif
+}
+
+void CProfiler::Dump(CLogger *pLogger, bool bReset)
+{
+    CString histogram, bucket;
+
+    for (unsigned i = 0; i < ProfilePointCount; ++i) {
+        const TStats &stats{s_Stats[i]};
+        if (stats.nCount == 0) {
+            continue;
+        }
+
+        pLogger->Write(FromProfiler, LogNotice, "%s: %u calls, cycles min %u, mean %u, max %u",
+                       GetName(static_cast<TProfilePoint>(i)), stats.nCount,
+                       stats.nMin, static_cast<unsigned>(stats.nSum / stats.nCount), stats.nMax);
+
+        histogram = "";
+        for (unsigned b = 0; b < k_nBuckets; ++b) {
+            if (stats.Histogram[b] > 0) {
+                bucket.Format(" 2^%u:%u", b, stats.Histogram[b]);
+                histogram.Append(bucket);
+            }
+        }
+        pLogger->Write(FromProfiler, LogNotice, "%s:%s", GetName(static_cast<TProfilePoint>(i)),
+                       (const char *) histogram);
+    }
+
+    if (bReset) {
+        Reset();
+    }
+}
+
+void CProfiler::Reset(void)
+{
+    memset(s_Stats, 0, sizeof s_Stats);
+}
+
+const char *CProfiler::GetName(TProfilePoint point)
+{
+    static const char *const names[ProfilePointCount]{
+            "Receive",
+            "CFIFO::Write",
+            "CFIFO::Read",
+            "GetChunk",
+            "RenderChunk",
+            "CSendTask::Run",
+            "CLossConcealer::Extrapolate"
+    };
+
+    return point < ProfilePointCount ? names[point] : "?";
+}
@@ -0,0 +1,164 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_PROFILER_H
+#define JACKTRIP_PI_PROFILER_H
+
+#include <circle/types.h>
+#include <circle/logger.h>
+#include "config.h"
+
+#if defined(__linux__)
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+/**
+ * The code paths that can be profiled.
+ */
+enum TProfilePoint
+{
+    ProfileReceive,
+    ProfileFIFOWrite,
+    ProfileFIFORead,
+    ProfileGetChunk,
+    ProfileRenderChunk,
+    ProfileSend,
+    ProfileConceal,
+    ProfilePointCount
+};
+
+/**
+ * Cycle-counter profiling. Each probe (see PROFILE_SCOPE) reads the CPU's
+ * cycle counter on entry to and exit from a scope and accumulates the
+ * difference into per-point statistics: count, min, max, mean and a log2
+ * histogram. Everything lives in static storage, so recording never allocates
+ * and is cheap enough for the sound callback.
+ *
+ * On the Pi the counter is the PMU cycle counter, which counts CPU clock
+ * cycles and has to be enabled on each core (EnableCounter()); on a Linux host
+ * it's the TSC, or failing that CLOCK_MONOTONIC in nanoseconds.
+ *
+ * Each point should only be recorded from one context at a time, e.g. the
+ * receive task, or the sound callback. Dump() may observe a partially updated
+ * point; these are statistics, not accounts.
+ *
+ * With PROFILING 0 the probes compile to nothing.
+ */
+class CProfiler
+{
+public:
+    static constexpr unsigned k_nBuckets{32};
+
+    struct TStats
+    {
+        u32 nCount;
+        u32 nMin, nMax;
+        u64 nSum;
+        // Bucket b counts durations in [2^b, 2^(b+1)) cycles; bucket 0 also
+        // counts zero.
+        u32 Histogram[k_nBuckets];
+    };
+
+    /**
+     * Enable the cycle counter on the calling core.
+     */
+    static void EnableCounter(void);
+
+    static inline u64 GetCycles(void)
+    {
+#if defined(__linux__)
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<u64>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+#endif
+#elif AARCH == 64
+        u64 nCycles;
+        asm volatile ("mrs %0, pmccntr_el0" : "=r" (nCycles));
+        return nCycles;
+#else
+        u32 nCycles;
+        asm volatile ("mrc p15, 0, %0, c9, c13, 0" : "=r" (nCycles));
+        return nCycles;
+#endif
+    }
+
+    static inline void Record(TProfilePoint point, u32 nCycles)
+    {
+        TStats &stats{s_Stats[point]};
+        if (stats.nCount == 0 || nCycles < stats.nMin) stats.nMin = nCycles;
+        if (nCycles > stats.nMax) stats.nMax = nCycles;
+        stats.nSum += nCycles;
+        ++stats.nCount;
+        ++stats.Histogram[nCycles == 0 ? 0 : 31 - __builtin_clz(nCycles)];
+    }
+
+    /**
+     * Log the statistics of every point that has been recorded.
+     * @param pLogger
+     * @param bReset Whether to start afresh afterwards.
+     */
+    static void Dump(CLogger *pLogger, bool bReset);
+
+    static void Reset(void);
+
+    static const TStats &GetStats(TProfilePoint point) { return s_Stats[point]; }
+
+    static const char *GetName(TProfilePoint point);
+
+private:
+    static TStats s_Stats[ProfilePointCount];
+};
+
+/**
+ * Records the cycles spent between its construction and destruction.
+ */
+class CProfileScope
+{
+public:
+    explicit CProfileScope(TProfilePoint point) :
+            m_Point(point),
+            m_nStart(CProfiler::GetCycles())
+    {
+    }
+
+    ~CProfileScope(void)
+    {
+        CProfiler::Record(m_Point, static_cast<u32>(CProfiler::GetCycles() - m_nStart));
+    }
+
+private:
+    const TProfilePoint m_Point;
+    const u64 m_nStart;
+};
+
+#if PROFILING
+#define PROFILE_CONCAT_(a, b)  a##b
+#define PROFILE_CONCAT(a, b)   PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(point)   CProfileScope PROFILE_CONCAT(profileScope, __LINE__)(point)
+#else
+#define PROFILE_SCOPE(point)
+#endif
+
+#endif //JACKTRIP_PI_PROFILER_H
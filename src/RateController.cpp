@@ -0,0 +1,81 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RateController.h"
+
+CRateController::CRateController(float fKp, float fKi, float fMaxPPM, float fPeriod) :
+        k_fKp{fKp},
+        k_fKi{fKi},
+        k_fMaxPPM{fMaxPPM},
+        k_fPeriod{fPeriod}
+{
+}
+
+void CRateController::Reset()
+{
+    m_nSum = 0;
+    m_nCount = 0;
+    m_bHaveReference = false;
+    m_fReference = 0.f;
+    m_fError = 0.f;
+    m_fIntegral = 0.f;
+    m_fPPM = 0.f;
+}
+
+void CRateController::AddMeasurement(int nFillLevel)
+{
+    m_nSum += nFillLevel;
+    ++m_nCount;
+}
+
+bool CRateController::Update()
+{
+    if (m_nCount == 0) {
+        return false;
+    }
+
+    float average{static_cast<float>(m_nSum) / static_cast<float>(m_nCount)};
+    m_nSum = 0;
+    m_nCount = 0;
+
+    if (!m_bHaveReference) {
+        m_fReference = average;
+        m_bHaveReference = true;
+        return false;
+    }
+
+    // A fifo that fills up means the server is running faster than the
+    // output, so the output should speed up, and vice versa.
+    m_fError = average - m_fReference;
+
+    float integral{m_fIntegral + k_fKi * m_fError * k_fPeriod};
+    float ppm{k_fKp * m_fError + integral};
+
+    // Clamp, and stop integrating while saturated, to avoid wind-up.
+    if (ppm > k_fMaxPPM) {
+        ppm = k_fMaxPPM;
+    } else if (ppm < -k_fMaxPPM) {
+        ppm = -k_fMaxPPM;
+    } else {
+        m_fIntegral = integral;
+    }
+
+    m_fPPM = ppm;
+
+    return true;
+}
@@ -0,0 +1,82 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_RATECONTROLLER_H
+#define JACKTRIP_PI_RATECONTROLLER_H
+
+#include <circle/types.h>
+
+/**
+ * PI controller that estimates the rate mismatch between the JackTrip server
+ * and the local output device from the fifo fill level.
+ *
+ * Feed it fill level measurements (fill level plus slip; see CFIFO::GetSlip())
+ * at a steady rate, and call Update() once per control period. GetPPM() is
+ * the correction, in parts per million, to apply to the output sample rate:
+ * positive if the output should run faster.
+ */
+class CRateController
+{
+public:
+    /**
+     * @param fKp Proportional gain, ppm per frame of error.
+     * @param fKi Integral gain, ppm per frame-second of error.
+     * @param fMaxPPM Bound on the correction.
+     * @param fPeriod Control period, in seconds.
+     */
+    CRateController(float fKp, float fKi, float fMaxPPM, float fPeriod);
+
+    /**
+     * Forget all measurements and the reference level; the next control
+     * period's average fill level becomes the new reference.
+     */
+    void Reset();
+
+    void AddMeasurement(int nFillLevel);
+
+    /**
+     * Close the current control period and recompute the correction.
+     * @return false if there was nothing to go on, i.e. no measurements, or
+     * the reference level has only just been taken.
+     */
+    bool Update();
+
+    float GetPPM() const { return m_fPPM; }
+
+    /**
+     * @return Deviation from the reference fill level, in frames, over the
+     * last control period.
+     */
+    float GetError() const { return m_fError; }
+
+    bool IsLocked() const { return m_bHaveReference; }
+
+private:
+    const float k_fKp, k_fKi, k_fMaxPPM, k_fPeriod;
+
+    s64 m_nSum{0};
+    unsigned m_nCount{0};
+
+    bool m_bHaveReference{false};
+    float m_fReference{0.f};
+    float m_fError{0.f};
+    float m_fIntegral{0.f};
+    float m_fPPM{0.f};
+};
+
+#endif //JACKTRIP_PI_RATECONTROLLER_H
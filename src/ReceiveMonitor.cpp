@@ -0,0 +1,88 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ReceiveMonitor.h"
+
+CReceiveMonitor::CReceiveMonitor(u16 nBlockFrames, unsigned nSampleRate) :
+        k_nBlockFrames{nBlockFrames},
+        k_nSampleRate{nSampleRate},
+        k_nPacketsPerWindow{nSampleRate / nBlockFrames}
+{
+}
+
+void CReceiveMonitor::OnWait(unsigned nTicks, bool bReceived)
+{
+    m_nWaitTicks += nTicks;
+    ++m_Stats.nWakeUps;
+    if (!bReceived) {
+        ++m_Stats.nTimeouts;
+    }
+}
+
+void CReceiveMonitor::OnPacket(unsigned nTicks, unsigned nPeriods)
+{
+    m_nScheduleFrames += nPeriods * k_nBlockFrames;
+    auto nScheduled{m_nScheduleTicks + static_cast<unsigned>(1000000u * m_nScheduleFrames / k_nSampleRate)};
+
+    // A packet ahead of the schedule sets a new one, e.g. if the sender's
+    // clock runs fast, or if the first packets were held up.
+    auto nLatency{static_cast<int>(nTicks - nScheduled)};
+    if (!m_bScheduled || nLatency < 0) {
+        m_bScheduled = true;
+        m_nScheduleTicks = nTicks;
+        m_nScheduleFrames = 0;
+        nLatency = 0;
+    }
+
+    m_nLatencySum += nLatency;
+    ++m_nPackets;
+    if (static_cast<unsigned>(nLatency) > m_Stats.nMaxLatency) {
+        m_Stats.nMaxLatency = nLatency;
+    }
+
+    // A sender that runs slow drifts later and later against the schedule;
+    // move it on by the least latency seen over each window.
+    if (m_nWindowPackets == 0 || static_cast<unsigned>(nLatency) < m_nWindowMin) {
+        m_nWindowMin = nLatency;
+    }
+    if (++m_nWindowPackets == k_nPacketsPerWindow) {
+        m_nScheduleTicks += m_nWindowMin;
+        m_nWindowPackets = 0;
+    }
+}
+
+void CReceiveMonitor::GetStats(unsigned nTicks, TReceiveStats *pStats)
+{
+    unsigned nElapsed{nTicks - m_nStartTicks};
+
+    *pStats = m_Stats;
+    pStats->nIdlePermille = nElapsed > 0 ? static_cast<unsigned>(1000 * m_nWaitTicks / nElapsed) : 0;
+    pStats->nMeanLatency = m_nPackets > 0 ? static_cast<unsigned>(m_nLatencySum / m_nPackets) : 0;
+
+    m_Stats = TReceiveStats{};
+    m_nStartTicks = nTicks;
+    m_nWaitTicks = 0;
+    m_nLatencySum = 0;
+    m_nPackets = 0;
+}
+
+void CReceiveMonitor::Reset()
+{
+    m_bScheduled = false;
+    m_nWindowPackets = 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_RECEIVEMONITOR_H
+#define JACKTRIP_PI_RECEIVEMONITOR_H
+
+#include <circle/types.h>
+
+/**
+ * Receive task statistics, accumulated since the previous call to
+ * CReceiveMonitor::GetStats().
+ */
+struct TReceiveStats
+{
+    // Share of the time spent blocked waiting for a datagram, in tenths of a
+    // percent: an upper bound on the core's idle time, as the send task and
+    // the sound interrupt get to run meanwhile too.
+    unsigned nIdlePermille;
+    // Returns from waiting, and those that timed out with nothing received.
+    unsigned nWakeUps, nTimeouts;
+    // How much later each packet was received than the packet schedule set
+    // by the earliest, in microseconds. Network jitter on top of the receive
+    // task's wake-up latency, which dominates on a quiet LAN.
+    unsigned nMeanLatency, nMaxLatency;
+};
+
+/**
+ * Measures the receive task's headroom: how long it spends waiting for
+ * datagrams, and how promptly it is woken for them.
+ *
+ * Call OnWait() after each wait for a datagram, and OnPacket() for each
+ * packet that is next in sequence (after any gap).
+ */
+class CReceiveMonitor
+{
+public:
+    /**
+     * @param nBlockFrames Frames per packet.
+     * @param nSampleRate Sampling rate of the stream.
+     */
+    CReceiveMonitor(u16 nBlockFrames, unsigned nSampleRate);
+
+    /**
+     * Register a wait for a datagram.
+     * @param nTicks Time spent waiting, in microseconds.
+     * @param bReceived Whether a datagram arrived, rather than the wait
+     * timing out.
+     */
+    void OnWait(unsigned nTicks, bool bReceived);
+
+    /**
+     * Register the arrival of a packet.
+     * @param nTicks Arrival time, in microseconds.
+     * @param nPeriods Packet periods since the last packet registered.
+     */
+    void OnPacket(unsigned nTicks, unsigned nPeriods);
+
+    /**
+     * Read, and reset, the statistics.
+     * @param nTicks The time now, in microseconds.
+     * @param pStats
+     */
+    void GetStats(unsigned nTicks, TReceiveStats *pStats);
+
+    /**
+     * Forget the packet schedule, e.g. on disconnection.
+     */
+    void Reset();
+
+private:
+    const u16 k_nBlockFrames;
+    const unsigned k_nSampleRate;
+    // About a second's worth.
+    const unsigned k_nPacketsPerWindow;
+
+    TReceiveStats m_Stats{};
+    unsigned m_nStartTicks{0};
+    u64 m_nWaitTicks{0};
+
+    // The schedule: when a packet arrived, and the frames sent since; a
+    // packet ahead of it starts a new one. Counting frames rather than
+    // microseconds keeps a period that isn't a whole number of them from
+    // drifting.
+    bool m_bScheduled{false};
+    unsigned m_nScheduleTicks{0};
+    u64 m_nScheduleFrames{0};
+    unsigned m_nWindowMin{0};
+    unsigned m_nWindowPackets{0};
+    u64 m_nLatencySum{0};
+    unsigned m_nPackets{0};
+};
+
+#endif //JACKTRIP_PI_RECEIVEMONITOR_H
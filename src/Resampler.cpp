@@ -0,0 +1,47 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Resampler.h"
+#include "AudioArena.h"
+
+CResampler::CResampler(u8 nChannels, u16 nMaxOutputFrames, float fMaxRatio) :
+        k_nChannels{nChannels},
+        // Worst case: the phase is just short of a whole frame, plus a whole
+        // frame per output frame at the maximum ratio.
+        m_pInput{CAudioArena::Allocate<float>(
+                (k_nHistory + 1 + static_cast<unsigned>(nMaxOutputFrames * fMaxRatio + 1)) * nChannels)}
+{
+    Reset();
+}
+
+void CResampler::SetRatio(float fRatio)
+{
+    auto step{static_cast<u64>(static_cast<double>(fRatio) * static_cast<double>(1ull << k_nPhaseBits) + .5)};
+    __atomic_store_n(&m_nStep, step, __ATOMIC_RELAXED);
+}
+
+float CResampler::GetRatio() const
+{
+    return static_cast<float>(__atomic_load_n(&m_nStep, __ATOMIC_RELAXED)) * k_fPhaseScale;
+}
+
+void CResampler::Reset()
+{
+    memset(m_pInput, 0, k_nHistory * k_nChannels * sizeof(float));
+    m_nPhase = 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_RESAMPLER_H
+#define JACKTRIP_PI_RESAMPLER_H
+
+#include <circle/types.h>
+#include <circle/util.h>
+
+/**
+ * Asynchronous sample-rate converter: six-point, fifth-order Lagrange
+ * interpolation, with a ratio that may change from one block to the next.
+ *
+ * Keeps the last six input frames between blocks, adding four frames of
+ * latency. The phase is kept in 32.32 fixed point, so the number of input
+ * frames consumed per block is exact and drift-free. Its input buffer comes
+ * from CAudioArena, and lives as long as the client does.
+ */
+class CResampler
+{
+public:
+    /**
+     * @param nChannels
+     * @param nMaxOutputFrames The largest block Process() will be asked for.
+     * @param fMaxRatio The largest ratio SetRatio() will be given.
+     */
+    CResampler(u8 nChannels, u16 nMaxOutputFrames, float fMaxRatio);
+
+    /**
+     * Set the conversion ratio, i.e. input frames per output frame. May be
+     * called from a different context to Process(); takes effect at the start
+     * of the next block.
+     * @param fRatio E.g. 48000 / 44100 to play a 48 kHz stream on a 44.1 kHz
+     * device; slightly greater than 1 to consume a same-rate stream faster.
+     */
+    void SetRatio(float fRatio);
+
+    float GetRatio() const;
+
+    /**
+     * Forget the signal history.
+     */
+    void Reset();
+
+    /**
+     * Produce a block of output.
+     * @param pOutput Sample-interleaved buffer to receive nOutputFrames frames.
+     * @param nOutputFrames
+     * @param read Input source, called once per block as read(pBuffer, n) to
+     * fetch exactly n sample-interleaved frames.
+     */
+    template<typename Source>
+    void Process(float *pOutput, u16 nOutputFrames, Source read)
+    {
+        const u64 step{__atomic_load_n(&m_nStep, __ATOMIC_RELAXED)};
+        const u64 end{m_nPhase + step * nOutputFrames};
+        const auto nInputFrames{static_cast<u16>(end >> k_nPhaseBits)};
+
+        // Input buffer: a few frames of history, then this block's frames.
+        read(m_pInput + k_nHistory * k_nChannels, nInputFrames);
+
+        u64 phase{m_nPhase};
+        for (u16 frame{0}; frame < nOutputFrames; ++frame, phase += step) {
+            const float *x{m_pInput + (phase >> k_nPhaseBits) * k_nChannels};
+            const float t{static_cast<float>(phase & k_nPhaseMask) * k_fPhaseScale};
+
+            // Lagrange weights for nodes -2..3, interpolating at t in [0, 1);
+            // computed once per frame and shared by all channels.
+            const float a{t + 2.f}, b{t + 1.f}, d{t - 1.f}, e{t - 2.f}, f{t - 3.f};
+            const float ab{a * b}, abt{ab * t}, abtd{abt * d},
+                    ef{e * f}, def{d * ef}, tdef{t * def};
+            const float w[k_nTaps]{
+                    b * tdef * (-1.f / 120.f),
+                    a * tdef * (1.f / 24.f),
+                    ab * def * (-1.f / 12.f),
+                    abt * ef * (1.f / 12.f),
+                    abtd * f * (-1.f / 24.f),
+                    abtd * e * (1.f / 120.f)
+            };
+
+            for (u8 ch{0}; ch < k_nChannels; ++ch) {
+                float y{0.f};
+                for (unsigned k{0}; k < k_nTaps; ++k) {
+                    y += w[k] * x[ch + k * k_nChannels];
+                }
+                *pOutput++ = y;
+            }
+        }
+
+        // Keep the frames the next block will need.
+        memmove(m_pInput,
+                m_pInput + nInputFrames * k_nChannels,
+                k_nHistory * k_nChannels * sizeof(float));
+        m_nPhase = end & k_nPhaseMask;
+    }
+
+private:
+    static constexpr unsigned k_nPhaseBits{32};
+    static constexpr u64 k_nPhaseMask{(1ull << k_nPhaseBits) - 1};
+    static constexpr float k_fPhaseScale{1.f / static_cast<float>(1ull << k_nPhaseBits)};
+    static constexpr unsigned k_nTaps{6};
+    static constexpr unsigned k_nHistory{k_nTaps};
+
+    const u8 k_nChannels;
+
+    float *m_pInput;
+    u64 m_nPhase{0};
+    u64 m_nStep{1ull << k_nPhaseBits};
+};
+
+#endif //JACKTRIP_PI_RESAMPLER_H
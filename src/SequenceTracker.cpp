@@ -0,0 +1,111 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SequenceTracker.h"
+#include <assert.h>
+
+CSequenceTracker::CSequenceTracker(unsigned nWindow) :
+        k_nWindow{nWindow}
+{
+    assert(nWindow > 0 && nWindow <= 64);
+}
+
+CSequenceTracker::TArrival CSequenceTracker::Track(u16 nSeqNumber, unsigned &nDistance)
+{
+    nDistance = 0;
+
+    // Sequence numbers wrap; take the shorter way round.
+    auto delta{static_cast<s16>(nSeqNumber - m_nNewest)};
+
+    if (m_bFirstPacket || delta > static_cast<int>(k_nWindow)) {
+        m_bFirstPacket = false;
+        m_nNewest = nSeqNumber;
+        m_nArrived = 1;
+        m_nMissing = 0;
+        return InOrder;
+    }
+
+    if (delta > 0) {
+        nDistance = delta - 1;
+        m_nNewest = nSeqNumber;
+        m_nArrived = (delta < 64 ? m_nArrived << delta : 0) | 1;
+        // The skipped ones are now 1 to delta - 1 older than the newest.
+        u64 nSkipped{delta < 64 ? (static_cast<u64>(1) << delta) - 2 : ~static_cast<u64>(1)};
+        m_nMissing = (delta < 64 ? m_nMissing << delta : 0) | nSkipped;
+        m_nLost += nDistance;
+        return nDistance == 0 ? InOrder : AfterGap;
+    }
+
+    unsigned age = -delta;
+    if (age >= k_nWindow) {
+        ++m_nLate;
+        return TooLate;
+    }
+
+    u64 bit{static_cast<u64>(1) << age};
+    if (m_nArrived & bit) {
+        ++m_nDuplicates;
+        return Duplicate;
+    }
+
+    if (!(m_nMissing & bit)) {
+        // No place was held for it: it's from before a restart.
+        ++m_nLate;
+        return TooLate;
+    }
+
+    m_nArrived |= bit;
+    m_nMissing &= ~bit;
+    --m_nLost;
+    nDistance = age;
+    return OutOfOrder;
+}
+
+bool CSequenceTracker::IsNew(u16 nSeqNumber) const
+{
+    auto delta{static_cast<s16>(nSeqNumber - m_nNewest)};
+    if (m_bFirstPacket || delta > 0) {
+        return true;
+    }
+
+    unsigned age = -delta;
+    return age < k_nWindow && (m_nMissing & static_cast<u64>(1) << age);
+}
+
+bool CSequenceTracker::IsNext(u16 nSeqNumber) const
+{
+    auto delta{static_cast<s16>(nSeqNumber - m_nNewest)};
+    return m_bFirstPacket || delta == 1 || delta > static_cast<int>(k_nWindow);
+}
+
+void CSequenceTracker::OnOutOfOrder(bool bPlaced)
+{
+    if (bPlaced) {
+        ++m_nReordered;
+    } else {
+        ++m_nLate;
+    }
+}
+
+void CSequenceTracker::Reset()
+{
+    m_bFirstPacket = true;
+    m_nNewest = 0;
+    m_nArrived = 0;
+    m_nMissing = 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_SEQUENCETRACKER_H
+#define JACKTRIP_PI_SEQUENCETRACKER_H
+
+#include <circle/types.h>
+
+/**
+ * Follows the sequence numbers of incoming packets and says where each one
+ * belongs relative to the newest packet so far: next in line, after a gap,
+ * out of order, or a duplicate. Keeps a record of which of the last few
+ * packets have arrived, so that a late packet can go into the place held
+ * for it, and a duplicate can be told apart from a late packet.
+ *
+ * Call Track() from the receive path for every audio packet; for a packet
+ * that comes back OutOfOrder, tell the tracker whether it was used, with
+ * OnOutOfOrder().
+ */
+class CSequenceTracker
+{
+public:
+    enum TArrival
+    {
+        InOrder,    // The next packet, or the first after Reset().
+        AfterGap,   // Newer than the next packet; nDistance were skipped.
+        OutOfOrder, // Missing until now; nDistance packets older than the newest.
+        Duplicate,  // Already seen.
+        TooLate     // Too old to tell, or to place, or from before a restart.
+    };
+
+    /**
+     * @param nWindow Number of packets, up to 64, to keep track of. A gap
+     * longer than this is taken for a restarted stream, rather than for
+     * loss, and a packet older than this is too late.
+     */
+    explicit CSequenceTracker(unsigned nWindow);
+
+    /**
+     * Register the arrival of a packet.
+     * @param nSeqNumber
+     * @param nDistance For AfterGap, the number of packets skipped; for
+     * OutOfOrder, how many packets older than the newest this one is.
+     * @return Where the packet belongs.
+     */
+    TArrival Track(u16 nSeqNumber, unsigned &nDistance);
+
+    /**
+     * @param nSeqNumber
+     * @return Whether a packet would be of use, i.e. next or missing, rather
+     * than a duplicate, too late, or from before a restart; e.g. to pick the
+     * missing ones out of a redundant datagram.
+     */
+    bool IsNew(u16 nSeqNumber) const;
+
+    /**
+     * @param nSeqNumber
+     * @return Whether Track() would find a packet InOrder.
+     */
+    bool IsNext(u16 nSeqNumber) const;
+
+    /**
+     * Report what became of an OutOfOrder packet.
+     * @param bPlaced Whether it went into its place, i.e. was reordered,
+     * rather than being dropped as late.
+     */
+    void OnOutOfOrder(bool bPlaced);
+
+    /**
+     * Start again, e.g. on disconnection. The counters keep counting.
+     */
+    void Reset();
+
+    /**
+     * @return Packets skipped over that haven't turned up since.
+     */
+    u32 GetLost() const { return m_nLost; }
+
+    /**
+     * @return Packets that turned up after their place had been played, or
+     * too long after to tell.
+     */
+    u32 GetLate() const { return m_nLate; }
+
+    u32 GetDuplicates() const { return m_nDuplicates; }
+
+    /**
+     * @return Packets that turned up out of order, but in time to be played.
+     */
+    u32 GetReordered() const { return m_nReordered; }
+
+private:
+    const unsigned k_nWindow;
+
+    bool m_bFirstPacket{true};
+    u16 m_nNewest{0};
+    // Bit n is set if the packet n older than the newest has arrived, or
+    // was skipped over, and so counted lost, and still has a place held.
+    // Neither is set for those from before the first packet, or a restart.
+    u64 m_nArrived{0};
+    u64 m_nMissing{0};
+
+    u32 m_nLost{0}, m_nLate{0}, m_nDuplicates{0}, m_nReordered{0};
+};
+
+#endif //JACKTRIP_PI_SEQUENCETRACKER_H
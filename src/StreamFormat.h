@@ -0,0 +1,306 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_STREAMFORMAT_H
+#define JACKTRIP_PI_STREAMFORMAT_H
+
+#include <circle/types.h>
+#include <circle/util.h>
+#include <assert.h>
+#include "convert.h"
+#include "PacketHeader.h"
+
+/**
+ * The shape of an audio stream, as the headers of its packets describe it.
+ */
+struct TStreamFormat
+{
+    u16 nBlockFrames;
+    unsigned nSampleRate;
+    // One of TAudioBitResolution.
+    u8 nSampleBytes;
+    u8 nChannels;
+};
+
+/**
+ * Samples as they go over the wire, Bytes wide, as JackTrip's AudioInterface
+ * lays them out: signed at 8 and 16 bits; at 24, a signed 16-bit sample and
+ * an unsigned byte of the remainder below it; and at 32, a float. All are in
+ * the sender's byte order, i.e. little-endian. Get() and Put() deal in
+ * samples centred on zero, k_nBits wide.
+ *
+ * JackTrip scales 8 and 16-bit samples by 127 and 32767 rather than 128 and
+ * 32768; the difference, under 0.07 dB, is ignored here.
+ */
+template<unsigned Bytes>
+struct TWireSample;
+
+template<>
+struct TWireSample<BIT8>
+{
+    static constexpr unsigned k_nBits{8};
+
+    static int Get(const u8 *p) { return static_cast<s8>(p[0]); }
+
+    static void Put(u8 *p, int x) { p[0] = static_cast<u8>(x); }
+};
+
+template<>
+struct TWireSample<BIT16>
+{
+    static constexpr unsigned k_nBits{16};
+
+    static int Get(const u8 *p) { return static_cast<s16>(p[0] | p[1] << 8); }
+
+    static void Put(u8 *p, int x)
+    {
+        p[0] = static_cast<u8>(x);
+        p[1] = static_cast<u8>(x >> 8);
+    }
+};
+
+template<>
+struct TWireSample<BIT24>
+{
+    static constexpr unsigned k_nBits{24};
+
+    // The 16-bit sample, then the remainder: together, a 24-bit one.
+    static int Get(const u8 *p) { return static_cast<s16>(p[0] | p[1] << 8) * (1 << 8) + p[2]; }
+
+    static void Put(u8 *p, int x)
+    {
+        p[0] = static_cast<u8>(x >> 8);
+        p[1] = static_cast<u8>(x >> 16);
+        p[2] = static_cast<u8>(x);
+    }
+};
+
+template<>
+struct TWireSample<BIT32>
+{
+    static constexpr unsigned k_nBits{32};
+
+    /**
+     * @return The float at p, clipped to [-1, 1), in 32 bits, rounded down
+     * as Rescale() does; NaN as silence.
+     */
+    static int Get(const u8 *p)
+    {
+        float f;
+        memcpy(&f, p, sizeof f);
+        const double y{static_cast<double>(f) * k_fFullScale};
+        if (y >= k_fFullScale) {
+            return 0x7fffffff;
+        } else if (y > -k_fFullScale) {
+            const int x{static_cast<int>(y)};
+            return x > y ? x - 1 : x;
+        } else {
+            return y == y ? -0x7fffffff - 1 : 0;
+        }
+    }
+
+    static void Put(u8 *p, int x)
+    {
+        const float f{static_cast<float>(x / k_fFullScale)};
+        memcpy(p, &f, sizeof f);
+    }
+
+private:
+    static constexpr double k_fFullScale{2147483648.0};
+};
+
+/**
+ * Takes on the format of the stream a server sends, from the header of its
+ * first packet, and decodes its packets into blocks for a fifo of T: the
+ * fifo's channel count and block size, and T's sample format.
+ *
+ * A packet may hold any whole number of the fifo's blocks, in any of
+ * JackTrip's sample formats, and any number of channels: a mono stream goes
+ * to every channel, and channels beyond the fifo's are dropped. The sample
+ * rate has to match. Each sample format has a decoder of its own, chosen
+ * once, when the format is negotiated. A stream in the fifo's own format
+ * (IsNative()) needn't be decoded at all.
+ */
+template<typename T>
+class CStreamDecoder
+{
+public:
+    /**
+     * @param nChannels The fifo's.
+     * @param nBlockFrames The fifo's.
+     * @param nSampleRate The client's.
+     */
+    CStreamDecoder(u8 nChannels, u16 nBlockFrames, unsigned nSampleRate) :
+            k_nChannels{nChannels},
+            k_nBlockFrames{nBlockFrames},
+            k_nSampleRate{nSampleRate}
+    {
+    }
+
+    /**
+     * Read a stream's format from a packet header.
+     * @param header
+     * @param pFormat
+     * @return Whether the header describes a stream at all.
+     */
+    static bool Parse(const TJackTripPacketHeader &header, TStreamFormat *pFormat)
+    {
+        static const unsigned rates[]{22050, 32000, 44100, 48000, 88200, 96000, 192000};
+
+        if (header.nSamplingRate >= sizeof rates / sizeof rates[0] || header.nBitResolution % 8 != 0
+            || header.nBitResolution / 8 < BIT8 || header.nBitResolution / 8 > BIT32
+            || header.nBufferSize == 0 || header.nNumIncomingChannelsFromNet == 0) {
+            return false;
+        }
+
+        pFormat->nBlockFrames = header.nBufferSize;
+        pFormat->nSampleRate = rates[header.nSamplingRate];
+        pFormat->nSampleBytes = header.nBitResolution / 8;
+        // As JackTrip does, take the sender's input channels for those in
+        // the packet.
+        pFormat->nChannels = header.nNumIncomingChannelsFromNet;
+        return true;
+    }
+
+    /**
+     * Take on a stream's format, if its packets can be decoded.
+     * @param format
+     * @return Whether they can.
+     */
+    bool Negotiate(const TStreamFormat &format)
+    {
+        if (format.nSampleRate != k_nSampleRate || format.nBlockFrames % k_nBlockFrames != 0) {
+            return false;
+        }
+
+        switch (format.nSampleBytes) {
+            case BIT8:
+                m_pDecode = &DecodeBlock<BIT8>;
+                break;
+            case BIT16:
+                m_pDecode = &DecodeBlock<BIT16>;
+                break;
+            case BIT24:
+                m_pDecode = &DecodeBlock<BIT24>;
+                break;
+            case BIT32:
+                m_pDecode = &DecodeBlock<BIT32>;
+                break;
+            default:
+                return false;
+        }
+
+        m_Format = format;
+        // Only 16-bit samples are stored on the wire as in the fifo.
+        m_bNative = format.nSampleBytes == BIT16 && sizeof(T) == BIT16 && TSampleTraits<T>::k_nBits == 16
+                    && format.nChannels == k_nChannels && format.nBlockFrames == k_nBlockFrames;
+        return true;
+    }
+
+    /**
+     * Forget the format, e.g. on disconnection.
+     */
+    void Reset() { m_pDecode = nullptr; }
+
+    bool IsNegotiated() const { return m_pDecode != nullptr; }
+
+    /**
+     * @param header
+     * @return Whether a packet is in the format negotiated.
+     */
+    bool Matches(const TJackTripPacketHeader &header) const
+    {
+        return m_pDecode && header.nBufferSize == m_Format.nBlockFrames
+               && header.nBitResolution == m_Format.nSampleBytes * 8
+               && header.nNumIncomingChannelsFromNet == m_Format.nChannels;
+    }
+
+    const TStreamFormat &GetFormat() const { return m_Format; }
+
+    /**
+     * @return Whether packets are in the fifo's format, i.e. each is a block,
+     * channel-planar, as the fifo stores it.
+     */
+    bool IsNative() const { return m_pDecode && m_bNative; }
+
+    /**
+     * @return Bytes per packet, header included.
+     */
+    unsigned GetPacketSize() const
+    {
+        return PACKET_HEADER_SIZE + m_Format.nChannels * m_Format.nBlockFrames * m_Format.nSampleBytes;
+    }
+
+    unsigned GetBlocksPerPacket() const { return m_Format.nBlockFrames / k_nBlockFrames; }
+
+    /**
+     * Decode one of a packet's blocks.
+     * @param pPayload The packet, after its header.
+     * @param nBlock Which of the packet's blocks.
+     * @param ppBlock One pointer per channel, to a block's worth each.
+     */
+    void Decode(const u8 *pPayload, unsigned nBlock, T *const *ppBlock) const
+    {
+        assert(m_pDecode && nBlock < GetBlocksPerPacket());
+        m_pDecode(*this, pPayload, nBlock, ppBlock);
+    }
+
+private:
+    template<unsigned Bytes>
+    static void DecodeBlock(const CStreamDecoder &decoder, const u8 *pPayload, unsigned nBlock, T *const *ppBlock)
+    {
+        const TStreamFormat &format{decoder.m_Format};
+        const unsigned nFirstFrame{nBlock * decoder.k_nBlockFrames};
+
+        for (u8 ch{0}; ch < decoder.k_nChannels; ++ch) {
+            u8 nSource = ch < format.nChannels ? ch : format.nChannels - 1;
+            const u8 *pIn{pPayload + (nSource * format.nBlockFrames + nFirstFrame) * Bytes};
+            T *pOut{ppBlock[ch]};
+            for (u16 n{0}; n < decoder.k_nBlockFrames; ++n, pIn += Bytes) {
+                pOut[n] = TSampleTraits<T>::FromCentred(
+                        Rescale<TWireSample<Bytes>::k_nBits, TSampleTraits<T>::k_nBits>(TWireSample<Bytes>::Get(pIn)));
+            }
+        }
+    }
+
+    /**
+     * Change a centred sample's width, truncating if it narrows.
+     */
+    template<unsigned From, unsigned To>
+    static int Rescale(int x)
+    {
+        if constexpr (From > To) {
+            return x >> (From - To);
+        } else {
+            return x * (1 << (To - From));
+        }
+    }
+
+    typedef void (*TDecodeFunc)(const CStreamDecoder &decoder, const u8 *pPayload, unsigned nBlock,
+                                T *const *ppBlock);
+
+    const u8 k_nChannels;
+    const u16 k_nBlockFrames;
+    const unsigned k_nSampleRate;
+
+    TStreamFormat m_Format{};
+    TDecodeFunc m_pDecode{nullptr};
+    bool m_bNative{false};
+};
+
+#endif //JACKTRIP_PI_STREAMFORMAT_H
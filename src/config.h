@@ -21,16 +21,27 @@
 
 constexpr bool g_Verbose{false};
 
-// 0: 22050, 1: 32000, 2: 44100, 3: 48000
+// 0: 22050, 1: 32000, 2: 44100, 3: 48000, 4: 88200, 5: 96000, 6: 192000
 #define SR_FORMAT            3
 
 // Format in which to exchange samples with JackTrip
 // 0: u8, 1: s16, 2: s24, 3: u32 (See TSoundFormat)
 #define SAMPLE_FORMAT        1
 
-// 1: Mono, 2: Stereo
+// Channels to exchange with JackTrip: 1 (mono) to 8.
 #define WRITE_CHANNELS       2
 
+// Channels per frame the sound device plays and captures. Circle's PWM and
+// I2S devices are stereo. A mono stream plays on every device channel; any
+// other leaves device channels beyond its own silent, and stream channels
+// beyond the device's are dropped. Captured channels go out on the first
+// stream channels, and any others are sent silent.
+#define DEVICE_CHANNELS      2
+
+#if WRITE_CHANNELS < 1 || WRITE_CHANNELS > 8 || DEVICE_CHANNELS < 1 || DEVICE_CHANNELS > 8
+#error "WRITE_CHANNELS and DEVICE_CHANNELS must be 1 to 8."
+#endif
+
 #if SR_FORMAT == 0
 #define SAMPLE_RATE          22050
 #define JACKTRIP_SAMPLE_RATE SR22
@@ -43,6 +54,29 @@ constexpr bool g_Verbose{false};
 #elif SR_FORMAT == 3
 #define SAMPLE_RATE          48000
 #define JACKTRIP_SAMPLE_RATE SR48
+#elif SR_FORMAT == 4
+#define SAMPLE_RATE          88200
+#define JACKTRIP_SAMPLE_RATE SR88
+#elif SR_FORMAT == 5
+#define SAMPLE_RATE          96000
+#define JACKTRIP_SAMPLE_RATE SR96
+#elif SR_FORMAT == 6
+#define SAMPLE_RATE          192000
+#define JACKTRIP_SAMPLE_RATE SR192
+#endif
+
+// Sample rate of the sound device. May only differ from SAMPLE_RATE if the
+// resampler is enabled.
+#define DEVICE_SAMPLE_RATE   SAMPLE_RATE
+
+// 1: Put an asynchronous sample-rate converter between the fifo and the sound
+//    device. It converts SAMPLE_RATE to DEVICE_SAMPLE_RATE and, where the
+//    device clock can't be steered (PWM), clock recovery steers it instead to
+//    absorb clock drift.
+#define RESAMPLER            1
+
+#if !RESAMPLER && DEVICE_SAMPLE_RATE != SAMPLE_RATE
+#error "DEVICE_SAMPLE_RATE differs from SAMPLE_RATE; enable the RESAMPLER."
 #endif
 
 #if SAMPLE_FORMAT == 0
@@ -71,16 +105,146 @@ constexpr bool g_Verbose{false};
 #define NULL_LEVEL           (1 << 31)
 #endif
 
+// The MIXER's master gain to start with; without it, the output level.
 #define AUDIO_VOLUME         0.8f
 
+// 1: Put a mixer between the fifo and the sound device (see Mixer.h): gain,
+//    mute and pan per stream channel, a master gain and a monitor mix of what
+//    the device captures, all set at run time and ramped to over
+//    MIXER_RAMP_MS. Mixes in float, so FIXED_POINT_OUTPUT doesn't apply.
+// 0: Play the stream at AUDIO_VOLUME, routed as described at DEVICE_CHANNELS,
+//    and scaled for the device as FIXED_POINT_OUTPUT says.
+#define MIXER                0
+#define MIXER_RAMP_MS        10
+
+// 1: Scale samples for the sound device in fixed point (Q15 or Q31; see
+//    CConvert::ToDeviceFixed()) rather than via float, unless they go through
+//    the resampler or the MIXER. Rounds to nearest, so is within one step of
+//    the float path, which truncates.
+// Off by default: on x86, Q31 costs 3 to 5 times as much as float, Q15 about
+// the same, and on Arm it runs one sample at a time, the NEON kernels being
+// left out until checked there (see convert.h). jtbench compares the two for
+// each sample format; turn it on where it wins.
+#define FIXED_POINT_OUTPUT   0
+
+// 1: Add TPDF dither when quantising for the PWM device, whose range is only
+//    about 11 bits at 48 kHz and 9 at 192 kHz; in fixed point, or after the
+//    resampler.
+#define PWM_DITHER           1
+
 #define AUDIO_BLOCK_FRAMES   32
 #define QUEUE_SIZE_US        (AUDIO_BLOCK_FRAMES * 1000000 / SAMPLE_RATE)
 
+// Frames per sound device chunk, i.e. per DMA buffer, independent of the
+// packet size; the fifo bridges the two. Output latency grows with the chunk,
+// the packet rate shrinks with the block. Even, and no more than a quarter of
+// the fifo.
+#ifndef DMA_CHUNK_FRAMES
+#define DMA_CHUNK_FRAMES     AUDIO_BLOCK_FRAMES
+#endif
+
+// Length of the receive fifo, in frames; a power of two, so that its indices
+// wrap with a mask. So AUDIO_BLOCK_FRAMES has to be one too, as JackTrip's
+// buffer sizes are.
+#define FIFO_LENGTH_FRAMES   (AUDIO_BLOCK_FRAMES * 16)
+
+#if (FIFO_LENGTH_FRAMES & (FIFO_LENGTH_FRAMES - 1)) != 0
+#error "FIFO_LENGTH_FRAMES must be a power of two."
+#endif
+
+// Bytes set aside at build time for the audio path's buffers: the fifo's, the
+// capture ring's, the resampler's, the loss concealer's, the mixer's and the
+// audio core's (see AudioArena.h). Plenty for 8 channels of 32-bit samples in
+// 128-frame blocks at 192 kHz, of which the loss concealer's history takes
+// the most, about 450 kB.
+#ifndef AUDIO_ARENA_BYTES
+#define AUDIO_ARENA_BYTES    (1 << 20)
+#endif
+
+// 0: Fixed jitter buffer; the fifo jumps by half its length on under/overrun.
+// 1: Auto-tune the jitter buffer depth from the measured packet jitter and
+//    underrun rate, like JackTrip's `-q auto`.
+#define JITTER_BUFFER_AUTO   1
+// Bounds on the auto-tuned depth (spare frames), and the tolerated underrun
+// rate the tuner aims for.
+#define JITTER_MIN_DEPTH     (AUDIO_BLOCK_FRAMES / 8)
+#define JITTER_MAX_DEPTH     (FIFO_LENGTH_FRAMES / 2)
+#define JITTER_UNDERRUNS_PER_MIN 1
+
+#if DMA_CHUNK_FRAMES % 2 != 0 || DMA_CHUNK_FRAMES > FIFO_LENGTH_FRAMES / 4
+#error "DMA_CHUNK_FRAMES must be even, and no more than a quarter of FIFO_LENGTH_FRAMES."
+#endif
+
+// 1: Conceal lost packets by extrapolating the signal (see CLossConcealer).
+// 0: Play silence in their place.
+#define LOSS_CONCEALMENT     1
+
+// Packets per datagram sent, as JackTrip's --redundancy: each datagram
+// carries the newest packet followed by the REDUNDANCY - 1 before it, so
+// that the server can ride out that many datagrams lost in a row. Should
+// match the server's setting. Datagrams received may carry up to
+// MAX_REDUNDANCY packets, whatever the server's setting.
+#define REDUNDANCY           1
+#define MAX_REDUNDANCY       4
+
+// Clock recovery: steer the PCM clock (I2S), or else the resampler, so that
+// the output follows the server's sample rate and the fifo neither fills nor
+// drains. The fill level
+// is sampled every CLOCK_RECOVERY_SAMPLE_MS and averaged over each control
+// period of CLOCK_RECOVERY_PERIOD_MS.
+#define CLOCK_RECOVERY            1
+#define CLOCK_RECOVERY_SAMPLE_MS  10
+#define CLOCK_RECOVERY_PERIOD_MS  1000
+// PI gains (ppm per frame, ppm per frame-second) and correction bound (ppm).
+// Against a simulated clock (jttest clock-recovery, under host/) these settle
+// within about a minute for offsets up to 400 ppm, with the fill level off by
+// 66 frames at most, and leave about 9 ppm of wander in the output rate.
+#define CLOCK_RECOVERY_KP         5.f
+#define CLOCK_RECOVERY_KI         .3f
+#define CLOCK_RECOVERY_MAX_PPM    500.f
+
+// 1: Full duplex: capture the I2S device's input and send it to the server,
+//    a datagram per block, as soon as each block has been captured.
+//    0: Receive only; send silence, a datagram per datagram received. The PWM
+//    device can't capture, so it always sends silence.
+#define FULL_DUPLEX          0
+// Captured blocks the uplink can hold while the send task catches up.
+#define CAPTURE_RING_BLOCKS  8
+
+// 1: Drain the fifo and render the sound device's chunks on a core of their
+//    own (core 1), so that nothing on core 0 -- network, logging, the
+//    scheduler -- can hold up the DMA refill. Needs Circle built with
+//    ARM_ALLOW_MULTI_CORE (add `DEFINE += -DARM_ALLOW_MULTI_CORE` to
+//    circle/Config.mk).
+#ifndef AUDIO_CORE
+#define AUDIO_CORE           0
+#endif
+// Chunks core 1 renders ahead of the sound device; each beyond the first adds
+// a chunk of latency but more slack.
+#define AUDIO_CORE_CHUNKS    2
+
+// Period at which to log runtime statistics, in seconds; 0 to disable.
+#define STATS_INTERVAL_SEC   10
+
+// Deferred logging from the hot paths (see CLogRing): capacity of the ring,
+// a power of two, and how often the flush task checks it when idle.
+#define LOG_RING_ENTRIES     256
+#define LOG_FLUSH_MS         20
+// 1: On startup, measure and log the cost of a deferred log call.
+#define LOG_RING_BENCHMARK   0
+
+// 1: Profile the receive, fifo, sound callback, send and concealment paths
+//    with the CPU cycle counter (see CProfiler); statistics are logged, and
+//    reset, every STATS_INTERVAL_SEC. 0: The probes compile to nothing.
+#define PROFILING            0
+
 // I2C slave address of the DAC (0 for auto probing)
 #define DAC_I2C_ADDRESS      0
 
 // IP of the JackTrip server (i.e. the IPv4 address of your ethernet interface)
+#ifndef SERVER_IP
 #define SERVER_IP            192,168,10,10
+#endif
 // Other ethernet interface settings; should match settings on your machine.
 #define NETMASK              255,255,255,0
 #define GATEWAY              192,168,10,1
@@ -0,0 +1,691 @@
+/**
+ * JackTrip client for bare-metal Raspberry Pi
+ * Copyright (C) 2023 Thomas Rushton
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKTRIP_PI_CONVERT_H
+#define JACKTRIP_PI_CONVERT_H
+
+#include <circle/types.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CONVERT_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CONVERT_SSE2
+#endif
+
+// ToDeviceFixed()'s NEON kernels have yet to be built for Arm and checked
+// against its scalar path, so are left out unless CONVERT_NEON_FIXED is
+// defined; without it, Arm scales in fixed point one sample at a time.
+#if defined(CONVERT_SSE2) || (defined(CONVERT_NEON) && defined(CONVERT_NEON_FIXED))
+#define CONVERT_FIXED_VECTOR
+#endif
+
+/**
+ * How the sound device wants its samples.
+ */
+enum TOutputStyle
+{
+    // PWM: unsigned, zero level at half range.
+    OutputOffsetBinary,
+    // I2S: signed, zero level at zero.
+    OutputSigned
+};
+
+/**
+ * Per-format properties of the samples JackTrip exchanges: how to centre a
+ * sample on zero and back, its width, and the (power-of-two) scale that takes
+ * it to [-1, 1).
+ */
+template<typename T>
+struct TSampleTraits;
+
+template<>
+struct TSampleTraits<u8>
+{
+    static constexpr float k_fScale{1.f / (1 << 7)};
+    static constexpr unsigned k_nBits{8};
+
+    static int Centre(u8 x) { return static_cast<int>(x) - (1 << 7); }
+
+    static u8 FromCentred(int x) { return static_cast<u8>(x + (1 << 7)); }
+};
+
+template<>
+struct TSampleTraits<s16>
+{
+    static constexpr float k_fScale{1.f / (1 << 15)};
+    static constexpr unsigned k_nBits{16};
+
+    static int Centre(s16 x) { return x; }
+
+    static s16 FromCentred(int x) { return static_cast<s16>(x); }
+};
+
+// 24-bit samples, sign-extended into 32 bits.
+template<>
+struct TSampleTraits<s32>
+{
+    static constexpr float k_fScale{1.f / (1 << 23)};
+    static constexpr unsigned k_nBits{24};
+
+    static int Centre(s32 x) { return x; }
+
+    static s32 FromCentred(int x) { return x; }
+};
+
+template<>
+struct TSampleTraits<u32>
+{
+    static constexpr float k_fScale{1.f / (1u << 31)};
+    static constexpr unsigned k_nBits{32};
+
+    static int Centre(u32 x) { return static_cast<int>(x ^ 0x80000000u); }
+
+    static u32 FromCentred(int x) { return static_cast<u32>(x) ^ 0x80000000u; }
+};
+
+/**
+ * The sound device's scale and zero level in fixed point, for
+ * CConvert::ToDeviceFixed(); see CConvert::MakeFixedGain(). A centred sample,
+ * normalised to 16 bits (Q15) or 32 bits (Q31), is multiplied by a gain in
+ * [0.25, 0.5) of the same precision, shifted down with rounding, offset by
+ * the zero level, and clamped to the device's range if it could leave it.
+ */
+struct TFixedGain
+{
+    // Q15: 32-bit products. For samples of 16 bits or fewer and a small
+    // gain, as for the PWM device. Q31 otherwise: the top half of a 64-bit
+    // product, rounded.
+    bool bQ15;
+    s32 nGain;
+    // Left shift that normalises a centred sample.
+    unsigned nInShift;
+    // Right shift of the (Q31: rounded) product.
+    unsigned nShift;
+    // Half an output step, plus the zero level's fraction, before the shift.
+    s32 nBias;
+    s32 nOffset;
+    // Of dither, from TPDF units of 2^-16 steps to before the shift; left if
+    // positive.
+    int nDitherShift;
+    s32 nMin, nMax;
+    bool bSaturate;
+};
+
+/**
+ * TPDF dither state: an xorshift32 generator per vector lane. The scalar
+ * paths use the first.
+ */
+struct TDither
+{
+    u32 nState[4]{0x9e3779b9u, 0x7f4a7c15u, 0x85ebca6bu, 0xc2b2ae35u};
+};
+
+/**
+ * Block sample-format conversion kernels.
+ *
+ * Inputs are channel-planar, as stored in the fifo and sent by JackTrip;
+ * device outputs are sample-interleaved, as Circle expects. A sample x of
+ * type T becomes
+ *
+ *     (int) ((Centre(x) * k_fScale) * amp + offset)
+ *
+ * with a separate multiply and add, and truncation towards zero. The vector
+ * paths (NEON on Arm, SSE2 on x86) perform exactly the same operations, in
+ * the same order, so they are bit-exact with the scalar path, which handles
+ * the remaining frames and any channel count other than one or two. (That
+ * holds as long as the compiler doesn't contract multiply-add into FMA, i.e.
+ * -ffp-contract=off, the default in ISO C++ modes.)
+ *
+ * ToDeviceFixed() does the same in fixed point, without going via float,
+ * and rounds to nearest, so it is within one step of ToDevice(). Its vector
+ * paths are bit-exact with its scalar path too, without dither; with dither,
+ * each vector lane has a generator of its own. Q15 multiplies in 16-bit
+ * lanes, eight frames at a time. SSE2 has no 32-bit multiply, so leaves Q31
+ * to the scalar path. Arm has the vector paths only with CONVERT_NEON_FIXED
+ * (see above).
+ */
+class CConvert
+{
+public:
+    /**
+     * Convert fifo samples for the sound device.
+     * @tparam Channels
+     * @param pOut Sample-interleaved output; nFrames * Channels words.
+     * @param ppIn One pointer per channel, to nFrames samples each.
+     * @param nFrames
+     * @param fAmp Scale applied to samples in [-1, 1).
+     * @param fOffset Zero level of the device (OutputOffsetBinary only).
+     */
+    template<TOutputStyle Style, u8 Channels, typename T>
+    static void ToDevice(u32 *pOut, const T *const *ppIn, unsigned nFrames, float fAmp, float fOffset)
+    {
+        unsigned n{0};
+
+#if defined(CONVERT_NEON) || defined(CONVERT_SSE2)
+        if (Channels == 1) {
+            for (; n + 4 <= nFrames; n += 4) {
+                Store(pOut + n, ScaleToDevice<Style>(Load(ppIn[0] + n), fAmp, fOffset, TSampleTraits<T>::k_fScale));
+            }
+        } else if (Channels == 2) {
+            for (; n + 4 <= nFrames; n += 4) {
+                StoreInterleaved(pOut + 2 * n,
+                                 ScaleToDevice<Style>(Load(ppIn[0] + n), fAmp, fOffset, TSampleTraits<T>::k_fScale),
+                                 ScaleToDevice<Style>(Load(ppIn[1] + n), fAmp, fOffset, TSampleTraits<T>::k_fScale));
+            }
+        }
+#endif
+
+        for (; n < nFrames; ++n) {
+            for (u8 ch{0}; ch < Channels; ++ch) {
+                pOut[n * Channels + ch] = SampleToDevice<Style>(ppIn[ch][n], fAmp, fOffset);
+            }
+        }
+    }
+
+    /**
+     * Work out a device scale in fixed point, for samples of type T.
+     * @param fAmp As for ToDevice(); less than 2^30.
+     * @param fOffset As for ToDevice(); not negative.
+     * @param nMin Lowest level the device takes.
+     * @param nMax Highest level the device takes.
+     */
+    template<typename T>
+    static TFixedGain MakeFixedGain(float fAmp, float fOffset, s32 nMin, s32 nMax)
+    {
+        assert(fAmp >= 0.f && fAmp < static_cast<float>(1 << 30));
+        assert(fOffset >= 0.f);
+
+        // fAmp = gain * 2^nExp, with the gain in [0.25, 0.5): a bit of
+        // headroom, so that nothing overflows before the shift.
+        unsigned nExp{3};
+        while (fAmp >= static_cast<float>(1u << (nExp - 1))) {
+            ++nExp;
+        }
+
+        TFixedGain gain{};
+        gain.bQ15 = TSampleTraits<T>::k_nBits <= 16 && nExp >= 4 && nExp <= 14;
+        const unsigned nQ{gain.bQ15 ? 15u : 31u};
+        gain.nGain = static_cast<s32>(static_cast<double>(fAmp) / (1u << nExp) * (1ull << nQ) + .5);
+        gain.nInShift = nQ + 1 - TSampleTraits<T>::k_nBits;
+        gain.nShift = (gain.bQ15 ? 2 * nQ : nQ) - nExp;
+        gain.nOffset = static_cast<s32>(fOffset);
+        gain.nBias = static_cast<s32>((.5 + fOffset - gain.nOffset) * (1u << gain.nShift));
+        gain.nDitherShift = static_cast<int>(gain.nShift) - 16;
+        gain.nMin = nMin;
+        gain.nMax = nMax;
+        // Rounding and dither add up to two steps.
+        gain.bSaturate = fOffset - fAmp - 2.f < static_cast<float>(nMin)
+                         || fOffset + fAmp + 2.f > static_cast<float>(nMax);
+
+        return gain;
+    }
+
+    /**
+     * Convert fifo samples for the sound device, in fixed point.
+     * @tparam Channels
+     * @param pOut Sample-interleaved output; nFrames * Channels words.
+     * @param ppIn One pointer per channel, to nFrames samples each.
+     * @param nFrames
+     * @param gain From MakeFixedGain<T>().
+     * @param pDither TPDF dither, of one step either side, to add before
+     * rounding; nullptr for none.
+     */
+    template<TOutputStyle Style, u8 Channels, typename T>
+    static void ToDeviceFixed(u32 *pOut, const T *const *ppIn, unsigned nFrames, const TFixedGain &gainIn,
+                              TDither *pDither = nullptr)
+    {
+        // A copy the output can't alias, so that it stays in registers.
+        const TFixedGain gain{gainIn};
+        unsigned n{0};
+
+#if defined(CONVERT_FIXED_VECTOR)
+        if constexpr (TSampleTraits<T>::k_nBits <= 16 && Channels <= 2) {
+            // Eight frames at a time, multiplied in 16-bit lanes.
+            if (gain.bQ15) {
+                for (; n + 8 <= nFrames; n += 8) {
+                    TVector products[Channels][2];
+                    for (u8 ch{0}; ch < Channels; ++ch) {
+                        MultiplyQ15(Load16(ppIn[ch] + n), gain, products[ch]);
+                    }
+                    for (unsigned half{0}; half < 2; ++half) {
+                        if (Channels == 1) {
+                            Store(pOut + n + 4 * half, FinishFixed<Style>(products[0][half], gain, pDither));
+                        } else {
+                            StoreInterleaved(pOut + 2 * n + 8 * half,
+                                             FinishFixed<Style>(products[0][half], gain, pDither),
+                                             FinishFixed<Style>(products[Channels - 1][half], gain, pDither));
+                        }
+                    }
+                }
+            }
+        }
+#if defined(CONVERT_NEON)
+        if (!gain.bQ15 && Channels <= 2) {
+            for (; n + 4 <= nFrames; n += 4) {
+                if (Channels == 1) {
+                    Store(pOut + n, FinishFixed<Style>(MultiplyQ31(Load(ppIn[0] + n), gain), gain, pDither));
+                } else {
+                    StoreInterleaved(pOut + 2 * n,
+                                     FinishFixed<Style>(MultiplyQ31(Load(ppIn[0] + n), gain), gain, pDither),
+                                     FinishFixed<Style>(MultiplyQ31(Load(ppIn[Channels - 1] + n), gain), gain,
+                                                        pDither));
+                }
+            }
+        }
+#endif
+#endif
+
+        for (; n < nFrames; ++n) {
+            for (u8 ch{0}; ch < Channels; ++ch) {
+                s32 nDither{pDither ? ScaleDither(Dither(pDither->nState[0]), gain.nDitherShift) : 0};
+                pOut[n * Channels + ch] = SampleToDeviceFixed<Style>(ppIn[ch][n], gain, nDither);
+            }
+        }
+    }
+
+    /**
+     * Convert fifo samples to sample-interleaved floats in [-1, 1).
+     */
+    template<u8 Channels, typename T>
+    static void ToFloat(float *pOut, const T *const *ppIn, unsigned nFrames)
+    {
+        for (unsigned n{0}; n < nFrames; ++n) {
+            for (u8 ch{0}; ch < Channels; ++ch) {
+                pOut[n * Channels + ch] = static_cast<float>(TSampleTraits<T>::Centre(ppIn[ch][n]))
+                                          * TSampleTraits<T>::k_fScale;
+            }
+        }
+    }
+
+    /**
+     * Convert a channel's fifo samples to floats in [-1, 1).
+     */
+    template<typename T>
+    static void ToFloat(float *pOut, const T *pIn, unsigned nSamples)
+    {
+        unsigned n{0};
+
+#if defined(CONVERT_NEON)
+        for (; n + 4 <= nSamples; n += 4) {
+            vst1q_f32(pOut + n, vmulq_n_f32(vcvtq_f32_s32(Load(pIn + n)), TSampleTraits<T>::k_fScale));
+        }
+#elif defined(CONVERT_SSE2)
+        for (; n + 4 <= nSamples; n += 4) {
+            _mm_storeu_ps(pOut + n, _mm_mul_ps(_mm_cvtepi32_ps(Load(pIn + n)), _mm_set1_ps(TSampleTraits<T>::k_fScale)));
+        }
+#endif
+
+        for (; n < nSamples; ++n) {
+            pOut[n] = static_cast<float>(TSampleTraits<T>::Centre(pIn[n])) * TSampleTraits<T>::k_fScale;
+        }
+    }
+
+    /**
+     * Convert floats in [-1, 1) for the sound device. Interleaving is
+     * unchanged.
+     * @param pDither TPDF dither, of one step either side, to add and then
+     * round rather than truncate; nullptr for none. OutputOffsetBinary only.
+     */
+    template<TOutputStyle Style>
+    static void FloatToDevice(u32 *pOut, const float *pIn, unsigned nSamples, float fAmp, float fOffset,
+                              TDither *pDither = nullptr)
+    {
+        unsigned n{0};
+
+        if (pDither) {
+            assert(Style == OutputOffsetBinary);
+            // Levels are positive, so truncating half a step up rounds.
+            fOffset += .5f;
+#if defined(CONVERT_NEON)
+            for (; n + 4 <= nSamples; n += 4) {
+                TFloatVector dither{vmulq_n_f32(vcvtq_f32_s32(Dither(pDither)), 1.f / (1 << 16))};
+                Store(pOut + n, vcvtq_s32_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(vld1q_f32(pIn + n), fAmp),
+                                                                  vdupq_n_f32(fOffset)), dither)));
+            }
+#elif defined(CONVERT_SSE2)
+            for (; n + 4 <= nSamples; n += 4) {
+                TFloatVector dither{_mm_mul_ps(_mm_cvtepi32_ps(Dither(pDither)), _mm_set1_ps(1.f / (1 << 16)))};
+                Store(pOut + n, _mm_cvttps_epi32(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pIn + n),
+                                                                                  _mm_set1_ps(fAmp)),
+                                                                       _mm_set1_ps(fOffset)), dither)));
+            }
+#endif
+            for (; n < nSamples; ++n) {
+                float dither{static_cast<float>(Dither(pDither->nState[0])) * (1.f / (1 << 16))};
+                pOut[n] = static_cast<u32>(static_cast<int>(pIn[n] * fAmp + fOffset + dither));
+            }
+            return;
+        }
+
+#if defined(CONVERT_NEON)
+        for (; n + 4 <= nSamples; n += 4) {
+            Store(pOut + n, Quantise<Style>(vld1q_f32(pIn + n), fAmp, fOffset));
+        }
+#elif defined(CONVERT_SSE2)
+        for (; n + 4 <= nSamples; n += 4) {
+            Store(pOut + n, Quantise<Style>(_mm_loadu_ps(pIn + n), fAmp, fOffset));
+        }
+#endif
+
+        for (; n < nSamples; ++n) {
+            pOut[n] = Quantise<Style>(pIn[n], fAmp, fOffset);
+        }
+    }
+
+    /**
+     * Convert samples captured by an I2S device (signed, 24 bits in 32) for
+     * JackTrip. Integer only: each sample is shifted to T's width, truncating
+     * if T is narrower.
+     * @param ppOut One pointer per channel, to nFrames samples each.
+     * @param pIn Sample-interleaved input; nFrames * nStride words.
+     * @param nChannels
+     * @param nFrames
+     * @param nStride Words per input frame, of which the first nChannels are
+     * converted; 0 for nChannels.
+     */
+    template<typename T>
+    static void FromDevice(T *const *ppOut, const u32 *pIn, u8 nChannels, unsigned nFrames, u8 nStride = 0)
+    {
+        constexpr unsigned k_nBits{TSampleTraits<T>::k_nBits};
+        const unsigned nStep{nStride ? nStride : nChannels};
+
+        for (unsigned n{0}; n < nFrames; ++n) {
+            for (u8 ch{0}; ch < nChannels; ++ch) {
+                int x{static_cast<s32>(pIn[n * nStep + ch])};
+                if (k_nBits < 24) {
+                    x >>= k_nBits < 24 ? 24 - k_nBits : 0;
+                } else if (k_nBits > 24) {
+                    x = static_cast<int>(static_cast<u32>(x) << (k_nBits > 24 ? k_nBits - 24 : 0));
+                }
+                ppOut[ch][n] = TSampleTraits<T>::FromCentred(x);
+            }
+        }
+    }
+
+    /**
+     * Scalar reference for a single sample.
+     */
+    template<TOutputStyle Style, typename T>
+    static u32 SampleToDevice(T x, float fAmp, float fOffset)
+    {
+        return Quantise<Style>(static_cast<float>(TSampleTraits<T>::Centre(x)) * TSampleTraits<T>::k_fScale,
+                               fAmp, fOffset);
+    }
+
+    /**
+     * Scalar reference for a single sample, in fixed point.
+     * @param nDither Already scaled by ScaleDither().
+     */
+    template<TOutputStyle Style, typename T>
+    static u32 SampleToDeviceFixed(T x, const TFixedGain &gain, s32 nDither = 0)
+    {
+        s32 nSample{static_cast<s32>(static_cast<u32>(TSampleTraits<T>::Centre(x)) << gain.nInShift)};
+        s32 nProduct;
+        if (gain.bQ15) {
+            nProduct = nSample * gain.nGain;
+        } else {
+            // As NEON's vqrdmulh, which can't saturate with a gain below 0.5.
+            nProduct = static_cast<s32>((static_cast<s64>(nSample) * gain.nGain + (1 << 30)) >> 31);
+        }
+
+        s32 y{(nProduct + gain.nBias + nDither) >> gain.nShift};
+        if (Style == OutputOffsetBinary) {
+            y += gain.nOffset;
+        }
+        if (gain.bSaturate) {
+            y = y < gain.nMin ? gain.nMin : y > gain.nMax ? gain.nMax : y;
+        }
+        return static_cast<u32>(y);
+    }
+
+    /**
+     * @param nState
+     * @return TPDF dither of up to a step either side, in 2^-16 steps.
+     */
+    static s32 Dither(u32 &nState)
+    {
+        nState ^= nState << 13;
+        nState ^= nState >> 17;
+        nState ^= nState << 5;
+        return static_cast<s32>(nState >> 16) + static_cast<s32>(nState & 0xffff) - (1 << 16);
+    }
+
+    static s32 ScaleDither(s32 nDither, int nShift)
+    {
+        return nShift >= 0 ? nDither * (1 << nShift) : nDither >> -nShift;
+    }
+
+private:
+    template<TOutputStyle Style>
+    static u32 Quantise(float f, float fAmp, float fOffset)
+    {
+        float scaled{f * fAmp};
+        if (Style == OutputOffsetBinary) {
+            scaled = scaled + fOffset;
+        }
+        return static_cast<u32>(static_cast<int>(scaled));
+    }
+
+#if defined(CONVERT_NEON)
+    using TVector = int32x4_t;
+    using TFloatVector = float32x4_t;
+
+    static TVector Load(const u8 *p)
+    {
+        u32 word;
+        memcpy(&word, p, sizeof word);
+        uint16x8_t wide{vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(word)))};
+        return vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(wide))), vdupq_n_s32(1 << 7));
+    }
+
+    static TVector Load(const s16 *p) { return vmovl_s16(vld1_s16(p)); }
+
+    static TVector Load(const s32 *p) { return vld1q_s32(p); }
+
+    static TVector Load(const u32 *p)
+    {
+        return vreinterpretq_s32_u32(veorq_u32(vld1q_u32(p), vdupq_n_u32(0x80000000u)));
+    }
+
+    template<TOutputStyle Style>
+    static TVector Quantise(TFloatVector f, float fAmp, float fOffset)
+    {
+        TFloatVector scaled{vmulq_n_f32(f, fAmp)};
+        if (Style == OutputOffsetBinary) {
+            scaled = vaddq_f32(scaled, vdupq_n_f32(fOffset));
+        }
+        return vcvtq_s32_f32(scaled);
+    }
+
+    template<TOutputStyle Style>
+    static TVector ScaleToDevice(TVector x, float fAmp, float fOffset, float fScale)
+    {
+        return Quantise<Style>(vmulq_n_f32(vcvtq_f32_s32(x), fScale), fAmp, fOffset);
+    }
+
+#if defined(CONVERT_FIXED_VECTOR)
+    // Centred and normalised to Q15.
+    static int16x8_t Load16(const u8 *p)
+    {
+        return vreinterpretq_s16_u16(veorq_u16(vshll_n_u8(vld1_u8(p), 8), vdupq_n_u16(0x8000)));
+    }
+
+    static int16x8_t Load16(const s16 *p) { return vld1q_s16(p); }
+
+    static void MultiplyQ15(int16x8_t x, const TFixedGain &gain, TVector *pProducts)
+    {
+        const int16x4_t gain16{vdup_n_s16(static_cast<s16>(gain.nGain))};
+        pProducts[0] = vmull_s16(vget_low_s16(x), gain16);
+        pProducts[1] = vmull_s16(vget_high_s16(x), gain16);
+    }
+
+    static TVector MultiplyQ31(TVector x, const TFixedGain &gain)
+    {
+        return vqrdmulhq_n_s32(vshlq_s32(x, vdupq_n_s32(static_cast<int>(gain.nInShift))), gain.nGain);
+    }
+
+    template<TOutputStyle Style>
+    static TVector FinishFixed(TVector y, const TFixedGain &gain, TDither *pDither)
+    {
+        y = vaddq_s32(y, vdupq_n_s32(gain.nBias));
+        if (pDither) {
+            y = vaddq_s32(y, vshlq_s32(Dither(pDither), vdupq_n_s32(gain.nDitherShift)));
+        }
+        y = vshlq_s32(y, vdupq_n_s32(-static_cast<int>(gain.nShift)));
+        if (Style == OutputOffsetBinary) {
+            y = vaddq_s32(y, vdupq_n_s32(gain.nOffset));
+        }
+        if (gain.bSaturate) {
+            y = vminq_s32(vmaxq_s32(y, vdupq_n_s32(gain.nMin)), vdupq_n_s32(gain.nMax));
+        }
+        return y;
+    }
+#endif
+
+    static TVector Dither(TDither *pDither)
+    {
+        uint32x4_t state{vld1q_u32(pDither->nState)};
+        state = veorq_u32(state, vshlq_n_u32(state, 13));
+        state = veorq_u32(state, vshrq_n_u32(state, 17));
+        state = veorq_u32(state, vshlq_n_u32(state, 5));
+        vst1q_u32(pDither->nState, state);
+        TVector sum{vreinterpretq_s32_u32(vaddq_u32(vshrq_n_u32(state, 16), vandq_u32(state, vdupq_n_u32(0xffff))))};
+        return vsubq_s32(sum, vdupq_n_s32(1 << 16));
+    }
+
+    static void Store(u32 *p, TVector v) { vst1q_u32(p, vreinterpretq_u32_s32(v)); }
+
+    static void StoreInterleaved(u32 *p, TVector left, TVector right)
+    {
+        uint32x4x2_t pair{{vreinterpretq_u32_s32(left), vreinterpretq_u32_s32(right)}};
+        vst2q_u32(p, pair);
+    }
+#elif defined(CONVERT_SSE2)
+    using TVector = __m128i;
+    using TFloatVector = __m128;
+
+    static TVector Load(const u8 *p)
+    {
+        int word;
+        memcpy(&word, p, sizeof word);
+        const __m128i zero{_mm_setzero_si128()};
+        __m128i wide{_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero), zero)};
+        return _mm_sub_epi32(wide, _mm_set1_epi32(1 << 7));
+    }
+
+    static TVector Load(const s16 *p)
+    {
+        __m128i x{_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))};
+        // Sign-extend by placing each sample in the top half and shifting down.
+        return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    }
+
+    static TVector Load(const s32 *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+
+    static TVector Load(const u32 *p)
+    {
+        return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)),
+                             _mm_set1_epi32(static_cast<int>(0x80000000u)));
+    }
+
+    template<TOutputStyle Style>
+    static TVector Quantise(TFloatVector f, float fAmp, float fOffset)
+    {
+        TFloatVector scaled{_mm_mul_ps(f, _mm_set1_ps(fAmp))};
+        if (Style == OutputOffsetBinary) {
+            scaled = _mm_add_ps(scaled, _mm_set1_ps(fOffset));
+        }
+        return _mm_cvttps_epi32(scaled);
+    }
+
+    template<TOutputStyle Style>
+    static TVector ScaleToDevice(TVector x, float fAmp, float fOffset, float fScale)
+    {
+        return Quantise<Style>(_mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(fScale)), fAmp, fOffset);
+    }
+
+    // Centred and normalised to Q15.
+    static __m128i Load16(const u8 *p)
+    {
+        __m128i x{_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))};
+        return _mm_xor_si128(_mm_unpacklo_epi8(_mm_setzero_si128(), x), _mm_set1_epi16(static_cast<short>(0x8000)));
+    }
+
+    static __m128i Load16(const s16 *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+
+    static void MultiplyQ15(__m128i x, const TFixedGain &gain, TVector *pProducts)
+    {
+        // No 32-bit multiply before SSE4.1; put the products together from
+        // their halves.
+        const __m128i gain16{_mm_set1_epi16(static_cast<short>(gain.nGain))};
+        const __m128i lo{_mm_mullo_epi16(x, gain16)}, hi{_mm_mulhi_epi16(x, gain16)};
+        pProducts[0] = _mm_unpacklo_epi16(lo, hi);
+        pProducts[1] = _mm_unpackhi_epi16(lo, hi);
+    }
+
+    template<TOutputStyle Style>
+    static TVector FinishFixed(TVector y, const TFixedGain &gain, TDither *pDither)
+    {
+        y = _mm_add_epi32(y, _mm_set1_epi32(gain.nBias));
+        if (pDither) {
+            TVector dither{Dither(pDither)};
+            dither = gain.nDitherShift >= 0 ? _mm_sll_epi32(dither, _mm_cvtsi32_si128(gain.nDitherShift))
+                                            : _mm_sra_epi32(dither, _mm_cvtsi32_si128(-gain.nDitherShift));
+            y = _mm_add_epi32(y, dither);
+        }
+        y = _mm_sra_epi32(y, _mm_cvtsi32_si128(static_cast<int>(gain.nShift)));
+        if (Style == OutputOffsetBinary) {
+            y = _mm_add_epi32(y, _mm_set1_epi32(gain.nOffset));
+        }
+        if (gain.bSaturate) {
+            // Nor 32-bit min and max.
+            const __m128i lo{_mm_set1_epi32(gain.nMin)}, hi{_mm_set1_epi32(gain.nMax)};
+            __m128i mask{_mm_cmplt_epi32(y, lo)};
+            y = _mm_or_si128(_mm_and_si128(mask, lo), _mm_andnot_si128(mask, y));
+            mask = _mm_cmpgt_epi32(y, hi);
+            y = _mm_or_si128(_mm_and_si128(mask, hi), _mm_andnot_si128(mask, y));
+        }
+        return y;
+    }
+
+    static TVector Dither(TDither *pDither)
+    {
+        __m128i state{_mm_loadu_si128(reinterpret_cast<const __m128i *>(pDither->nState))};
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pDither->nState), state);
+        TVector sum{_mm_add_epi32(_mm_srli_epi32(state, 16), _mm_and_si128(state, _mm_set1_epi32(0xffff)))};
+        return _mm_sub_epi32(sum, _mm_set1_epi32(1 << 16));
+    }
+
+    static void Store(u32 *p, TVector v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+
+    static void StoreInterleaved(u32 *p, TVector left, TVector right)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_unpacklo_epi32(left, right));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p + 4), _mm_unpackhi_epi32(left, right));
+    }
+#endif
+};
+
+#endif //JACKTRIP_PI_CONVERT_H
@@ -20,168 +20,370 @@
 #define JACKTRIP_PI_FIFO_H
 
 #include <circle/types.h>
+#include <assert.h>
+#include "AudioArena.h"
+#include "convert.h"
+#include "LogRing.h"
+#include "Profiler.h"
 
 static const char FromFIFO[] = "fifo";
 
-template<typename T>
+/**
+ * Single-producer, single-consumer ring buffer. The producer (network receive)
+ * calls Write() and Clear(); the consumer (sound device callback) calls
+ * Read(). Each side owns one index and only ever reads the other's, so neither
+ * side ever waits for the other: indices are published with release semantics
+ * and observed with acquire semantics. The read index is only ever moved by
+ * the consumer, even on a Clear(); until it has, the producer takes it to be
+ * as far back as that could move it.
+ *
+ * In adaptive mode the fifo doesn't jump by half its length on under/overrun.
+ * Instead the consumer steers the number of spare frames it finds on each
+ * Read() towards a target depth (see SetTargetDepth()), dropping or repeating
+ * at most one frame per Read().
+ *
+ * The producer can hold the place of frames that haven't arrived with
+ * WriteGap(), and fill it in with Patch() if they turn up before they're due.
+ *
+ * Frames are stored a block at a time, in slots laid out like datagrams: a
+ * header's worth of space, then the block, channel-planar, as on the wire.
+ * So the producer can have the next block received straight into its slot
+ * (GetWriteSlot(), CommitSlot()), rather than copying it in with Write().
+ * The producer works in whole blocks; the consumer reads any number of frames.
+ * The slots are a single array from the audio arena (see AudioArena.h). A
+ * frame-interleaved one would spare the consumer a stream per channel, but
+ * cost the producer a copy per block, and the streams are sequential.
+ *
+ * The channel counts and the length are template parameters, so that the
+ * per-frame loops over channels unroll, and the indices wrap with a mask.
+ * @tparam T Sample type.
+ * @tparam Channels Channels per block.
+ * @tparam Length In frames; a power of two, and a multiple of the block size.
+ * @tparam OutputChannels Channels per frame Read() produces, e.g. the sound
+ * device's. A mono fifo plays on all of them; any other leaves those beyond
+ * its own silent. Channels beyond them are dropped.
+ */
+template<typename T, u8 Channels, u32 Length, u8 OutputChannels = Channels>
 class CFIFO
 {
 public:
-    CFIFO(u8 numChannels, u16 length, int sampleMaxValue = FACTOR) :
-            k_nChannels{numChannels},
-            k_nLength{length},
-            m_pBuffer{new T *[numChannels]}
+    /**
+     * @param blockFrames Frames per block, i.e. per packet.
+     * @param adaptive
+     * @param headerSize Bytes to leave before each block.
+     * @param packetsPerSlot Packets each slot has room for, e.g. for a
+     * redundant datagram, of which the first is the block.
+     */
+    explicit CFIFO(u16 blockFrames, bool adaptive = false, unsigned headerSize = 0, unsigned packetsPerSlot = 1) :
+            k_nBlockFrames{blockFrames},
+            k_bAdaptive{adaptive},
+            k_nHeaderSize{headerSize},
+            // Keep slots 8-byte aligned, for the samples' sake.
+            k_nSlotSize{static_cast<unsigned>((packetsPerSlot * (headerSize + Channels * blockFrames * sizeof(T)) + 7) & ~7u)},
+            k_nSlots{static_cast<u32>(Length / blockFrames)},
+            // One more slot than the ring has, to lend when the ring is full,
+            // and a silent one for output channels beyond the fifo's.
+            m_pSlots{CAudioArena::Allocate<u8>((k_nSlots + 1 + k_nSilentSlots) * k_nSlotSize)}
     {
-        for (int ch{0}; ch < k_nChannels; ++ch) {
-            m_pBuffer[ch] = new T[k_nLength];
-        }
+        assert(m_pSlots);
+        assert(Length % blockFrames == 0);
+        assert(adaptive || (Length / 2) % blockFrames == 0);
+        WriteSilence(0, k_nSlots + 1 + k_nSilentSlots);
         Clear();
     }
 
-    ~CFIFO()
+    /**
+     * Write a block of samples to the fifo. Channel-planar, like JackTrip.
+     * Producer side only.
+     * @param dataToWrite
+     * @param numFrames A block's worth.
+     */
+    void Write(const T *const *dataToWrite, u16 numFrames)
     {
-        for (int i{0}; i < k_nChannels; ++i) {
-            delete m_pBuffer[i];
+        PROFILE_SCOPE(ProfileFIFOWrite);
+
+        assert(numFrames == k_nBlockFrames);
+        GetWriteSlot();
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            memcpy(GetChannel(m_nLentSlot, ch), dataToWrite[ch], k_nBlockFrames * sizeof(T));
         }
-        delete[] m_pBuffer;
+        CommitSlot();
     }
 
     /**
-     * Write samples to the fifo. Channel-interleaved, like JackTrip.
-     * @param dataToWrite
-     * @param numFrames
+     * Hold the place of frames that haven't arrived, e.g. a lost packet's,
+     * with silence, so that what follows plays on time. A late packet may
+     * yet take its place; see Patch(). Producer side only.
+     * @param numFrames Whole blocks' worth.
      */
-    void Write(const T **dataToWrite, u16 numFrames)
+    void WriteGap(u32 numFrames)
     {
-        auto reset{false};
-        m_SpinLock.Acquire();
-
-        for (int n{0}; n < numFrames; ++n) {
-            for (int ch{0}; ch < k_nChannels; ++ch) {
-                m_pBuffer[ch][m_nWriteIndex] = dataToWrite[ch][n];
+        const T silence{TSampleTraits<T>::FromCentred(0)};
+        for (u32 n{0}; n < numFrames; n += k_nBlockFrames) {
+            GetWriteSlot();
+            for (u8 ch{0}; ch < k_nChannels; ++ch) {
+                T *pSamples{GetChannel(m_nLentSlot, ch)};
+                for (u16 i{0}; i < k_nBlockFrames; ++i) {
+                    pSamples[i] = silence;
+                }
             }
+            CommitSlot();
+        }
+    }
 
-            ++m_nWriteIndex;
+    /**
+     * Lend the slot the next block goes into, e.g. to receive a datagram
+     * into. Producer side only; follow with CommitSlot().
+     * @return GetSlotSize() bytes: a header's worth, then the block,
+     * channel-planar.
+     */
+    u8 *GetWriteSlot()
+    {
+        u32 writeIndex{Load(&m_nWriteIndex, __ATOMIC_RELAXED)};
+        u32 readIndex{GetProducerReadIndex()};
 
-            if (m_nWriteIndex == m_nReadIndex) {
-//                if (m_LogThrottle == 0) {
-//                    CLogger::Get()->Write(FromFIFO, LogNotice, "Buffer full (Write); resetting.");
-//                    m_LogThrottle = 10000;
-//                }
-                reset = true;
-                Reset(Full);
-            }
+        // If the consumer might still be reading from the next slot, lend
+        // the spare, so as not to write over frames it hasn't read.
+        m_nLentSlot = HasRoom(writeIndex, readIndex) ? writeIndex / k_nBlockFrames : k_nSlots;
 
-            if (m_nWriteIndex == k_nLength) {
-                m_nWriteIndex = 0;
-            }
+        return m_pSlots + m_nLentSlot * k_nSlotSize;
+    }
 
-            if (m_LogThrottle > 0) {
-                --m_LogThrottle;
+    /**
+     * Publish the block in the slot lent by GetWriteSlot(), unless there's
+     * no room for it. Producer side only.
+     */
+    void CommitSlot()
+    {
+        u32 writeIndex{Load(&m_nWriteIndex, __ATOMIC_RELAXED)};
+
+        if (m_nLentSlot == k_nSlots) {
+            u32 readIndex{GetProducerReadIndex()};
+            if (!HasRoom(writeIndex, readIndex)) {
+                Increment(&m_nOverruns);
+                if (k_bAdaptive || IsResetPending()) {
+                    // Drop the block rather than overwrite unread frames, or
+                    // those the consumer may yet go back to. It will catch up.
+                    AddSlip(k_nBlockFrames);
+                    if (g_Verbose) {
+                        CLogRing::Get()->Write(FromFIFO, LogNotice, "Buffer full (Write); dropping a block.");
+                    }
+                    return;
+                }
+
+                // Move the write index back by half the fifo.
+                AddSlip(k_nLength / 2);
+                writeIndex = Reset(Full, writeIndex);
+                if (g_Verbose) {
+                    CLogRing::Get()->Write(FromFIFO, LogNotice, "Buffer full (Write); resetting.");
+                }
             }
+
+            // There's room now; move the block into place.
+            memcpy(m_pSlots + (writeIndex / k_nBlockFrames) * k_nSlotSize, m_pSlots + k_nSlots * k_nSlotSize,
+                   k_nSlotSize);
         }
 
-        m_SpinLock.Release();
+        writeIndex = (writeIndex + k_nBlockFrames) & k_nMask;
 
-        if (g_Verbose && reset) {
-            CLogger::Get()->Write(FromFIFO, LogNotice, "Buffer full (Write); resetting.");
+        // Publish the new frames to the consumer.
+        Store(&m_nWriteIndex, writeIndex, __ATOMIC_RELEASE);
+
+        if (!__atomic_load_n(&m_bPrimed, __ATOMIC_RELAXED)) {
+            // The first block since Clear(). Have the consumer start out a
+            // target depth behind it, on the silence written for the
+            // Clear(), rather than play it the moment it lands and underrun
+            // on the next.
+            __atomic_store_n(&m_bPrimed, true, __ATOMIC_RELAXED);
+            RequestReset(writeIndex);
         }
     }
 
+    /**
+     * @return Size of a slot, in bytes.
+     */
+    unsigned GetSlotSize() const { return k_nSlotSize; }
+
+    /**
+     * Overwrite a block written earlier, e.g. a gap, with a late packet, as
+     * long as the consumer hasn't got to it yet. Channel-planar, like
+     * Write(). Producer side only.
+     * @param dataToWrite
+     * @param numFrames A block's worth.
+     * @param framesBehind How far the end of the block to overwrite lies
+     * behind the write index; whole blocks' worth.
+     * @return Whether the block was written; if not, it'd have played.
+     */
+    bool Patch(const T *const *dataToWrite, u16 numFrames, u32 framesBehind)
+    {
+        assert(numFrames == k_nBlockFrames && framesBehind % k_nBlockFrames == 0);
+
+        u32 writeIndex{Load(&m_nWriteIndex, __ATOMIC_RELAXED)};
+        u32 readIndex{GetProducerReadIndex()};
+        u32 fill{Distance(readIndex, writeIndex)};
+
+        // The consumer may be part way through reading a block from the read
+        // index on; keep a block clear of it.
+        if (framesBehind + 2u * numFrames > fill) {
+            return false;
+        }
+
+        u32 index{(writeIndex - framesBehind - numFrames) & k_nMask};
+
+        for (u8 ch{0}; ch < k_nChannels; ++ch) {
+            memcpy(GetChannel(index / k_nBlockFrames, ch), dataToWrite[ch], numFrames * sizeof(T));
+        }
+
+        // Publish the patched frames, as Write() publishes new ones.
+        Store(&m_nWriteIndex, writeIndex, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
     /**
      * Read samples into a buffer. Sample-interleaved, like Circle.
-     *
-     * TODO: extract the sample-conversion logic into a dedicated class, or the sound device.
+     * Consumer side only; never blocks.
      *
      * @param bufferToFill The sample-interleaved buffer into which to write samples.
      * @param numFrames The number of frames to write, i.e. for each frame, a number of samples
-     * equal to the number of channels in the fifo will be written to the buffer.
-     * @param sampleMaxValue Different sound devices and sample rates may have differing bit
-     * resolutions; the maximum permitted sample value is required here.
-     * @param isI2S
-     * @param debug
+     * equal to the number of output channels will be written to the buffer.
+     * @tparam Style The sound device's, e.g. OutputSigned for I2S.
+     * @param amp Scale for samples in [-1, 1); see CConvert.
+     * @param offset The sound device's zero level (OutputOffsetBinary only).
      */
-    void Read(u32 *bufferToFill, u16 numFrames, int sampleMaxValue, bool isI2S, bool debug)
+    template<TOutputStyle Style>
+    void Read(u32 *bufferToFill, u16 numFrames, float amp, float offset)
     {
-        auto reset{false};
-        float amp = AUDIO_VOLUME * sampleMaxValue / (isI2S ? 1.f : 2.f);
-        float offset = isI2S ? 0.f : sampleMaxValue / 2.f;
-
-        m_SpinLock.Acquire();
-
-        for (u16 frame{0}; frame < numFrames; ++frame) {
-            auto frameStart{frame * k_nChannels};
-
-            for (u8 channel{0}; channel < k_nChannels; ++channel) {
-                // Get sample in range [-32768, 32767]
-                int sample{m_pBuffer[channel][m_nReadIndex]};
-                // Convert to float [-1, 1)
-                float fSample{static_cast<float>(sample) / static_cast<float>(1 << 15)};
-                // Scale to u32 range
-                int nSample{static_cast<int>(fSample * amp + offset)};
-
-                if (debug && frame == 0 && channel == 0) {
-                    CLogger::Get()->Write(FromFIFO, LogDebug, "sample = %d (%04x)", sample, sample);
-                    CLogger::Get()->Write(FromFIFO, LogDebug, "fSample = %d / (1 << 15) = %f", sample, fSample);
-                    CLogger::Get()->Write(FromFIFO, LogDebug, "amp = %f * %u / 2 = %f", AUDIO_VOLUME, sampleMaxValue, amp);
-                    if (isI2S) {
-                        CLogger::Get()->Write(FromFIFO, LogDebug, "nSample = %f * %f = %d (%08x)", fSample, amp, nSample, nSample);
-                    } else {
-                        CLogger::Get()->Write(FromFIFO, LogDebug, "nSample = %f * %f + %u = %d (%08x)", fSample, amp, sampleMaxValue / 2, nSample, nSample);
-                    }
-                }
+        ReadFrames(numFrames, [&](u16 frame, u32 index, u16 count) {
+            const T *channels[OutputChannels];
+            GetOutputSamples(index, channels);
 
-                bufferToFill[frameStart + channel] = (u32) nSample;
-            }
+            CConvert::ToDevice<Style, OutputChannels>(bufferToFill + frame * OutputChannels, channels, count,
+                                                      amp, offset);
+        });
+    }
 
-            ++m_nReadIndex;
+    /**
+     * Read samples into a buffer for the sound device, as above, but scaled
+     * in fixed point. Consumer side only; never blocks.
+     * @param bufferToFill
+     * @param numFrames
+     * @param gain The sound device's scale; see CConvert::MakeFixedGain().
+     * @param pDither TPDF dither to add, or nullptr.
+     */
+    template<TOutputStyle Style>
+    void Read(u32 *bufferToFill, u16 numFrames, const TFixedGain &gain, TDither *pDither = nullptr)
+    {
+        ReadFrames(numFrames, [&](u16 frame, u32 index, u16 count) {
+            const T *channels[OutputChannels];
+            GetOutputSamples(index, channels);
 
-            if (m_nReadIndex == m_nWriteIndex) {
-//                if (m_LogThrottle == 0) {
-//                    CLogger::Get()->Write(FromFIFO, LogNotice, "Buffer full (Read); resetting.");
-//                    m_LogThrottle = 10000;
-//                }
-                reset = true;
-                Reset(Empty);
-            }
+            CConvert::ToDeviceFixed<Style, OutputChannels>(bufferToFill + frame * OutputChannels, channels, count,
+                                                           gain, pDither);
+        });
+    }
 
-            if (m_nReadIndex == k_nLength) {
-                m_nReadIndex = 0;
-            }
+    /**
+     * Read samples, normalised to [-1, 1), into a sample-interleaved buffer,
+     * e.g. for further processing before conversion for the sound device.
+     * Consumer side only; never blocks.
+     * @param bufferToFill
+     * @param numFrames
+     */
+    void Read(float *bufferToFill, u16 numFrames)
+    {
+        ReadFrames(numFrames, [&](u16 frame, u32 index, u16 count) {
+            const T *channels[OutputChannels];
+            GetOutputSamples(index, channels);
+
+            CConvert::ToFloat<OutputChannels>(bufferToFill + frame * OutputChannels, channels, count);
+        });
+    }
 
-            if (m_LogThrottle > 0) {
-                --m_LogThrottle;
+    /**
+     * Read every channel of the stream, normalised to [-1, 1), one buffer
+     * per channel, e.g. for the mixer. Consumer side only; never blocks.
+     * @param channels Channels buffers, of numFrames samples each.
+     * @param numFrames
+     */
+    void Read(float *const *channels, u16 numFrames)
+    {
+        ReadFrames(numFrames, [&](u16 frame, u32 index, u16 count) {
+            for (u8 ch{0}; ch < Channels; ++ch) {
+                CConvert::ToFloat(channels[ch] + frame, GetSamples(ch, index), count);
             }
-        }
+        });
+    }
 
-        m_SpinLock.Release();
+    /**
+     * Start the fifo over, e.g. for a new stream: reset the write index, and
+     * have the consumer reset the read index at the start of the next Read(),
+     * and again once the next block is written, so that the stream starts out
+     * primed to the target depth. The consumer also writes silence over the
+     * half of the fifo the read index can go back into, since it may be
+     * reading the old stream's frames until then. Producer side only.
+     */
+    void Clear()
+    {
+        Store(&m_nWriteIndex, 0u, __ATOMIC_RELEASE);
+        __atomic_store_n(&m_bPrimed, false, __ATOMIC_RELAXED);
+        Store(&m_nClears, m_nClears + 1, __ATOMIC_RELAXED);
+        RequestReset(0);
 
-        if (g_Verbose && reset) {
-            CLogger::Get()->Write(FromFIFO, LogNotice, "Buffer full (Read); resetting.");
+        if (g_Verbose) {
+            CLogRing::Get()->Write(FromFIFO, LogDebug, "Cleared buffer. Num channels %u, "
+                                                       "num frames %u",
+                                   k_nChannels, k_nLength);
         }
     }
 
     /**
-     * Write zeros to the fifo and reset the write and read indices.
+     * Set the number of spare frames the consumer should aim to find on each
+     * Read() while packets arrive on time; a late packet eats into them.
+     * Adaptive mode only; may be called from the producer side.
+     * @param numFrames
      */
-    void Clear()
+    void SetTargetDepth(u32 numFrames)
     {
-        m_SpinLock.Acquire();
-//        memset(*m_pBuffer, 0, k_nChannels * k_nLength * sizeof(T));
-        for (int ch = 0; ch < k_nChannels; ++ch) {
-            memset(m_pBuffer[ch], 0, k_nLength * sizeof(T));
+        if (numFrames > k_nLength / 2) {
+            numFrames = k_nLength / 2;
         }
-        Reset();
-        m_SpinLock.Release();
+        Store(&m_nTargetDepth, numFrames, __ATOMIC_RELAXED);
+    }
 
-        if (g_Verbose) {
-            CLogger::Get()->Write(FromFIFO, LogDebug, "Cleared buffer. Num channels %u, "
-                                                      "num frames %u, write index %u, "
-                                                      "read index %u",
-                                  k_nChannels, k_nLength, m_nWriteIndex, m_nReadIndex);
-        }
+    u32 GetTargetDepth() const { return Load(&m_nTargetDepth, __ATOMIC_RELAXED); }
+
+    /**
+     * @return Number of Read() calls that ran out of frames, not counting
+     * those between a Clear() and the next Write(), e.g. while waiting for a
+     * stream to start.
+     */
+    u32 GetUnderruns() const { return Load(&m_nUnderruns, __ATOMIC_RELAXED); }
+
+    /**
+     * @return Number of blocks that ran out of space.
+     */
+    u32 GetOverruns() const { return Load(&m_nOverruns, __ATOMIC_RELAXED); }
+
+    /**
+     * @return Number of frames written but not yet read. May be called from
+     * either side, or from a third party; the result is a snapshot.
+     */
+    u32 GetFillLevel() const
+    {
+        u32 readIndex{Load(&m_nReadIndex, __ATOMIC_ACQUIRE)};
+        u32 writeIndex{Load(&m_nWriteIndex, __ATOMIC_ACQUIRE)};
+        return Distance(readIndex, writeIndex);
     }
 
+    /**
+     * @return Net number of frames the fifo has discarded (positive) or
+     * invented (negative) to recover from under/overruns or to steer its
+     * depth. The fill level plus the slip follows the accumulated rate
+     * mismatch between producer and consumer, free of those corrections.
+     */
+    int GetSlip() const { return __atomic_load_n(&m_nSlip, __ATOMIC_RELAXED); }
+
 private:
     enum TFIFOState
     {
@@ -190,42 +392,365 @@ private:
         Full
     };
 
-    void Reset(TFIFOState state = OK)
+    /**
+     * @param writeIndex
+     * @param readIndex
+     * @return Whether a block fits between the write index and the read
+     * index, with a frame to spare, so that a full fifo isn't taken for an
+     * empty one.
+     */
+    bool HasRoom(u32 writeIndex, u32 readIndex) const
     {
-        int temp;
+        return Distance(readIndex, writeIndex) + k_nBlockFrames < k_nLength;
+    }
 
-        switch (state) {
-            case Empty:
-                // No new samples left to read, so move the read-index back.
-                temp = static_cast<int>(m_nReadIndex) - (k_nLength / 2);
-                if (temp < 0) {
-                    temp += k_nLength;
-                }
-                m_nReadIndex = temp;
-                break;
-            case Full:
-                // No space to write new samples, so move the write-index back.
-                temp = static_cast<int>(m_nWriteIndex) - (k_nLength / 2);
-                if (temp < 0) {
-                    temp += k_nLength;
+    /**
+     * Ask the consumer to reset the read index, a target depth behind the
+     * write index, at the start of its next Read(). Producer side only.
+     * @param writeIndex Where the write index is now.
+     */
+    void RequestReset(u32 writeIndex)
+    {
+        m_nResetIndex = writeIndex;
+        Store(&m_nResets, m_nResets + 1, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @return The read index, as far as the producer is concerned: until the
+     * consumer has made the last reset asked of it, as far back as that could
+     * move it, i.e. half the fifo behind the write index at the time. Producer
+     * side only.
+     */
+    u32 GetProducerReadIndex() const
+    {
+        if (IsResetPending()) {
+            return (m_nResetIndex - k_nLength / 2) & k_nMask;
+        }
+        return Load(&m_nReadIndex, __ATOMIC_ACQUIRE);
+    }
+
+    /**
+     * @return Whether the consumer has yet to make the last reset asked of
+     * it. Producer side only.
+     */
+    bool IsResetPending() const { return Load(&m_nResetsDone, __ATOMIC_ACQUIRE) != m_nResets; }
+
+    /**
+     * Make a reset the producer has asked for, if any. Consumer side only.
+     * @param readIndex Set to the new read index, if reset.
+     * @param writeIndex Set to the write index, if reset.
+     */
+    void MakeReset(u32 &readIndex, u32 &writeIndex)
+    {
+        const u32 resets{Load(&m_nResets, __ATOMIC_ACQUIRE)};
+        if (resets == m_nResetsDone) {
+            return;
+        }
+
+        const u32 clears{Load(&m_nClears, __ATOMIC_RELAXED)};
+        if (clears != m_nClearsDone) {
+            // Until the producer knows the read index has moved, it writes
+            // no further than half way round from the start.
+            WriteSilence(k_nSlots / 2, k_nSlots - k_nSlots / 2);
+            m_nClearsDone = clears;
+        }
+
+        // The producer may have written since the index was loaded.
+        writeIndex = Load(&m_nWriteIndex, __ATOMIC_ACQUIRE);
+        readIndex = Reset(OK, writeIndex);
+
+        // Publish the read index before owning up to the reset, for the
+        // producer to go by it from then on.
+        Store(&m_nReadIndex, readIndex, __ATOMIC_RELEASE);
+        Store(&m_nResetsDone, resets, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Fill slots with silence, headers included; they're received over.
+     * @param firstSlot
+     * @param numSlots
+     */
+    void WriteSilence(u32 firstSlot, u32 numSlots)
+    {
+        const T silence{TSampleTraits<T>::FromCentred(0)};
+        u8 *pStart{m_pSlots + firstSlot * k_nSlotSize};
+        if (silence == 0) {
+            memset(pStart, 0, numSlots * k_nSlotSize);
+        } else {
+            T *pSamples{reinterpret_cast<T *>(pStart)};
+            for (u32 i{0}; i < numSlots * k_nSlotSize / sizeof(T); ++i) {
+                pSamples[i] = silence;
+            }
+        }
+    }
+
+    /**
+     * @param slot
+     * @param channel
+     * @return The start of a channel's samples in a slot.
+     */
+    T *GetChannel(u32 slot, u8 channel) const
+    {
+        return reinterpret_cast<T *>(m_pSlots + slot * k_nSlotSize + k_nHeaderSize) + channel * k_nBlockFrames;
+    }
+
+    /**
+     * @param channel
+     * @param index
+     * @return A channel's sample at a position in the ring; those after it
+     * are contiguous up to the end of the block.
+     */
+    T *GetSamples(u8 channel, u32 index) const
+    {
+        return GetChannel(index / k_nBlockFrames, channel) + index % k_nBlockFrames;
+    }
+
+    /**
+     * @param index
+     * @param channels Set to each output channel's samples at a position in
+     * the ring: a mono fifo's channel on them all, or silence on those
+     * beyond the fifo's.
+     */
+    void GetOutputSamples(u32 index, const T **channels) const
+    {
+        for (u8 ch{0}; ch < OutputChannels; ++ch) {
+            if (ch < Channels || Channels == 1) {
+                channels[ch] = GetSamples(ch < Channels ? ch : 0, index);
+            } else {
+                channels[ch] = GetChannel(k_nSlots + 1, 0) + index % k_nBlockFrames;
+            }
+        }
+    }
+
+    /**
+     * Walk the read index over numFrames frames, handling under/overrun and
+     * (in adaptive mode) depth steering, and hand the frames to the caller in
+     * contiguous runs.
+     * @param numFrames
+     * @param emit Called as emit(frame, index, count): output frames
+     * [frame, frame + count) come from positions [index, index + count) of
+     * the ring, all in one block (see GetSamples()).
+     */
+    template<typename Emit>
+    void ReadFrames(u16 numFrames, Emit emit)
+    {
+        PROFILE_SCOPE(ProfileFIFORead);
+
+        auto reset{false};
+
+        u32 readIndex{Load(&m_nReadIndex, __ATOMIC_RELAXED)};
+        u32 writeIndex{Load(&m_nWriteIndex, __ATOMIC_ACQUIRE)};
+        MakeReset(readIndex, writeIndex);
+
+        u16 frame{0};
+        int slip{0};
+
+        if (k_bAdaptive) {
+            // Whether to play the first frame twice.
+            auto hold{false};
+            u32 steered{Steer(readIndex, writeIndex, numFrames, hold)};
+            if (steered != readIndex) {
+                ++slip;
+                readIndex = steered;
+            } else if (hold && readIndex != writeIndex) {
+                --slip;
+                emit(frame++, readIndex, 1);
+            }
+        }
+
+        while (frame < numFrames) {
+            u32 available{Distance(readIndex, writeIndex)};
+
+            if (available == 0) {
+                // As in Write(), check for fresh frames before giving up.
+                writeIndex = Load(&m_nWriteIndex, __ATOMIC_ACQUIRE);
+                if (readIndex == writeIndex) {
+                    bool primed{__atomic_load_n(&m_bPrimed, __ATOMIC_RELAXED)};
+                    if (!reset && primed) {
+                        Increment(&m_nUnderruns);
+                    }
+                    reset = true;
+
+                    if (k_bAdaptive) {
+                        // Keep playing the last frame until the producer
+                        // catches up.
+                        if (primed) {
+                            --slip;
+                        }
+                        emit(frame++, (readIndex - 1) & k_nMask, 1);
+                    } else {
+                        slip -= k_nLength / 2;
+                        readIndex = Reset(Empty, readIndex);
+                    }
                 }
-                m_nWriteIndex = temp;
+                continue;
+            }
+
+            u32 count{static_cast<u32>(numFrames - frame)};
+            if (count > available) {
+                count = available;
+            }
+            // Runs are contiguous only within a block.
+            if (count > k_nBlockFrames - readIndex % k_nBlockFrames) {
+                count = k_nBlockFrames - readIndex % k_nBlockFrames;
+            }
+
+            emit(frame, readIndex, static_cast<u16>(count));
+
+            frame += count;
+            readIndex = (readIndex + count) & k_nMask;
+        }
+
+        // Hand the consumed frames back to the producer.
+        Store(&m_nReadIndex, readIndex, __ATOMIC_RELEASE);
+
+        if (slip != 0) {
+            AddSlip(slip);
+        }
+
+        if (g_Verbose && reset) {
+            CLogRing::Get()->Write(FromFIFO, LogNotice, "Buffer full (Read); resetting.");
+        }
+    }
+
+    /**
+     * Compute the new position of an index after an under/overrun, or after
+     * the fifo has been cleared.
+     * @param state Empty: index is the read index; Full: index is the write
+     * index; OK: index is the write index, and the result is a read index
+     * placed half a buffer (fixed) or a target depth (adaptive) behind it.
+     * @param index The index to reposition.
+     * @return The repositioned index.
+     */
+    u32 Reset(TFIFOState state, u32 index) const
+    {
+        u32 distance;
+
+        switch (state) {
+            case Empty: // No new samples left to read, so move the read-index back.
+            case Full:  // No space to write new samples, so move the write-index back.
+                distance = k_nLength / 2;
                 break;
             default:
-                m_nWriteIndex = 0;
-                m_nReadIndex = static_cast<u32>(k_nLength / 2);
+                distance = k_bAdaptive ? GetTargetDepth() : k_nLength / 2;
                 break;
         }
+
+        return (index - distance) & k_nMask;
     }
 
-    const u8 k_nChannels;
-    const u32 k_nLength;
+    /**
+     * Adaptive mode: track the largest number of spare frames seen over a
+     * window of reads, i.e. the depth while packets arrive on time, and nudge
+     * the read index, a frame at a time, so that number converges on the
+     * target depth. Late packets dip below it, which is what the target
+     * depth is there to absorb; steering on the dips would chase the jitter.
+     * @param readIndex
+     * @param writeIndex
+     * @param numFrames Frames about to be read.
+     * @param hold Set if the first frame of this read should be repeated.
+     * @return The (possibly advanced) read index.
+     */
+    u32 Steer(u32 readIndex, u32 writeIndex, u16 numFrames, bool &hold)
+    {
+        u32 fill{Distance(readIndex, writeIndex)};
+        u32 spare{fill > numFrames ? fill - numFrames : 0};
+
+        if (m_nReadCount == 0 || spare > m_nMaxSpare) {
+            m_nMaxSpare = spare;
+        }
+
+        if (++m_nReadCount == k_nReadsPerWindow) {
+            m_nAdjust = static_cast<int>(m_nMaxSpare) - static_cast<int>(GetTargetDepth());
+            // A frame either way isn't worth a discontinuity.
+            if (m_nAdjust == 1 || m_nAdjust == -1) {
+                m_nAdjust = 0;
+            }
+            m_nReadCount = 0;
+        }
+
+        if (m_nAdjust > 0 && spare > 0) {
+            // Too deep; skip a frame.
+            --m_nAdjust;
+            return (readIndex + 1) & k_nMask;
+        } else if (m_nAdjust < 0) {
+            // Too shallow; repeat a frame.
+            ++m_nAdjust;
+            hold = true;
+        }
 
-    T **m_pBuffer;
-    u32 m_nWriteIndex{0}, m_nReadIndex{0};
+        return readIndex;
+    }
+
+    /**
+     * @param from
+     * @param to
+     * @return Frames from one index on to another, around the ring.
+     */
+    static u32 Distance(u32 from, u32 to) { return (to - from) & k_nMask; }
+
+    static u32 Load(const u32 *pIndex, int memoryOrder)
+    {
+        return __atomic_load_n(pIndex, memoryOrder);
+    }
+
+    static void Store(u32 *pIndex, u32 value, int memoryOrder)
+    {
+        __atomic_store_n(pIndex, value, memoryOrder);
+    }
+
+    static void Increment(u32 *pCount)
+    {
+        __atomic_fetch_add(pCount, 1, __ATOMIC_RELAXED);
+    }
+
+    void AddSlip(int numFrames)
+    {
+        __atomic_fetch_add(&m_nSlip, numFrames, __ATOMIC_RELAXED);
+    }
 
-    CSpinLock m_SpinLock;
-    int m_LogThrottle{0};
+    static constexpr u32 k_nReadsPerWindow{64};
+    static constexpr u8 k_nChannels{Channels};
+    static constexpr u32 k_nLength{Length};
+    static constexpr u32 k_nMask{Length - 1};
+    static constexpr u32 k_nSilentSlots{Channels > 1 && OutputChannels > Channels ? 1u : 0u};
+    static_assert(Channels >= 1 && Channels <= 8 && OutputChannels >= 1 && OutputChannels <= 8,
+                  "1 to 8 channels");
+    static_assert((Length & k_nMask) == 0, "Length must be a power of two");
+
+    const u16 k_nBlockFrames;
+    const bool k_bAdaptive;
+    const unsigned k_nHeaderSize;
+    const unsigned k_nSlotSize;
+    const u32 k_nSlots;
+
+    // From the audio arena; never freed.
+    u8 *const m_pSlots;
+    // Producer side: the slot last lent; k_nSlots for the spare. The silent
+    // slot, if any, comes after that, and is never written.
+    u32 m_nLentSlot{0};
+    // Keep the indices on separate cache lines so the producer and consumer
+    // don't contend for the same line.
+    alignas(64) u32 m_nWriteIndex{0};
+    alignas(64) u32 m_nReadIndex{0};
+    bool m_bPrimed{false};
+    // Resets of the read index the producer has asked for (RequestReset())
+    // and the consumer has made, and Clear()s, whose silence it writes.
+    u32 m_nResets{0}, m_nResetsDone{0};
+    u32 m_nClears{0};
+    // Producer side: the write index as of the last reset asked for.
+    u32 m_nResetIndex{0};
+    // Consumer side: the Clear()s whose silence has been written.
+    u32 m_nClearsDone{0};
+
+    u32 m_nTargetDepth{0};
+    u32 m_nUnderruns{0}, m_nOverruns{0};
+    int m_nSlip{0};
+
+    // Consumer-side state for adaptive mode.
+    u32 m_nMaxSpare{0};
+    u32 m_nReadCount{0};
+    int m_nAdjust{0};
 };
 
 #endif //JACKTRIP_PI_FIFO_H
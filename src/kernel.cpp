@@ -61,6 +61,15 @@ boolean CKernel::Initialize(void) {
         bOK = m_Logger.Initialize(pTarget);
     }
 
+    if (bOK) {
+        // Writes out what the hot paths log via CLogRing.
+        new CLogFlushTask(&m_Logger);
+    }
+
+    if (PROFILING) {
+        CProfiler::EnableCounter();
+    }
+
     if (bOK) {
         bOK = m_Interrupt.Initialize();
     }
@@ -116,8 +125,11 @@ TShutdownMode CKernel::Run(void) {
         return ShutdownHalt;
     } else {
         m_Logger.Write(FromKernel, LogNotice,
-                       "Started JackTrip client. Sample rate %u, block size %u, num channels %u.",
-                       SAMPLE_RATE, AUDIO_BLOCK_FRAMES, WRITE_CHANNELS);
+                       "Started JackTrip client. Sample rate %u, block size %u, DMA chunk %u, "
+                       "num channels %u.",
+                       SAMPLE_RATE, AUDIO_BLOCK_FRAMES, DMA_CHUNK_FRAMES, WRITE_CHANNELS);
+        m_Logger.Write(FromKernel, LogNotice, "Audio arena: %u of %u bytes used.",
+                       CAudioArena::GetUsed(), AUDIO_ARENA_BYTES);
     }
 
     while (m_pJTC->IsActive()) {